@@ -0,0 +1,1390 @@
+#define _GNU_SOURCE  // O_PATH
+#include "archive.h"
+#include "bufpool.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Rodapé: posição do índice (8) + tamanho do índice (8) + magic e versão (8)
+#define ARCHIVE_MAGIC        "STGA"
+#define ARCHIVE_VERSION      1
+#define ARCHIVE_TRAILERBYTES 24
+
+// Início do texto do índice
+#define ARCHIVE_INDEX_MAGIC  "STGI"
+
+// Tipos de entrada gravados no índice
+#define ENTRY_FILE    'f'
+#define ENTRY_DIR     'd'
+#define ENTRY_SYMLINK 'l'
+
+// Bytes lidos de cada arquivo por vez
+#define ARCHIVE_IO_SIZE 65536
+
+// Parte do cabeçalho STGC igual em todos os blocos (prefixo + salt)
+#define SHARED_HEADERBYTES (CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES)
+
+// Segmento criptografado completo
+#define SEGMENT_BYTES (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES)
+
+/**
+ * @brief Um bloco sólido: contêiner STGC com um fluxo deflate do conteúdo concatenado.
+ */
+typedef struct {
+    uint64_t offset;   // posição do cabeçalho STGC no arquivo
+    uint64_t stored;   // bytes no arquivo (cabeçalho + segmentos)
+    uint64_t raw;      // conteúdo descomprimido
+    unsigned char header[CRYPT_STREAM_HEADERBYTES];   // header do fluxo, conferido na leitura
+} ArchiveBlock;
+
+/**
+ * @brief Entrada do índice. O conteúdo de arquivos e o alvo de links ficam em
+ *        [offset, offset + size) do bloco `block`.
+ */
+typedef struct {
+    char *path;
+    unsigned char type;
+    uint32_t mode;
+    int64_t mtime;
+    uint32_t mtime_nsec;
+    uint64_t size;
+    uint32_t block;
+    uint64_t offset;
+} ArchiveEntry;
+
+/**
+ * @brief Estado da criação: bloco aberto, buffers de segmento e índice em memória.
+ */
+typedef struct {
+    FILE *out;
+    uint64_t pos;                 // bytes já gravados
+    CryptSuite suite;
+    unsigned char key[CRYPT_KEYBYTES];
+    unsigned char header[CRYPT_FILE_HEADERBYTES];
+    CryptStream cs;
+    z_stream zs;
+    int block_open;
+    ArchiveBlock cur;
+    size_t block_size;
+
+    unsigned char *seg;           // saída do deflate (um segmento de texto claro)
+    size_t seg_len;
+    unsigned char *enc;           // segmento criptografado
+    unsigned char *io;            // leitura dos arquivos
+
+    ArchiveBlock *blocks;
+    size_t n_blocks, cap_blocks;
+    ArchiveEntry *entries;
+    size_t n_entries, cap_entries;
+
+    char path[PATH_MAX];          // caminho atual; o relativo começa em path + root_len + 1
+    size_t root_len;
+    int skip_self;                // a saída é um arquivo dentro da árvore?
+    dev_t self_dev;
+    ino_t self_ino;
+    uint64_t content_bytes;
+} ArchiveWriter;
+
+/**
+ * @brief Estado da leitura: índice carregado e o bloco aberto no momento.
+ */
+typedef struct {
+    FILE *in;
+    uint64_t size;
+    CryptSuite suite;
+    unsigned char key[CRYPT_KEYBYTES];
+    unsigned char header[CRYPT_FILE_HEADERBYTES];   // cabeçalho do índice (referência)
+    CryptStream cs;
+    z_stream zs;
+    int block_open;
+    int block_index;              // bloco aberto (-1 = índice)
+    uint64_t block_pos;           // conteúdo já entregue do bloco aberto
+    uint64_t left;                // bytes do bloco ainda não lidos do arquivo
+    int final;                    // último segmento do bloco já lido
+    int stream_end;               // fim do fluxo deflate
+
+    unsigned char *enc;
+    unsigned char *plain;
+    unsigned char *io;
+
+    ArchiveBlock *blocks;
+    size_t n_blocks;
+    ArchiveEntry *entries;
+    size_t n_entries;
+} ArchiveReader;
+
+/**
+ * @brief Buffer crescente usado para montar o índice.
+ */
+typedef struct {
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} ByteBuf;
+
+/**
+ * @brief Leitura com verificação de limites do texto do índice.
+ */
+typedef struct {
+    const unsigned char *p;
+    size_t left;
+    int bad;
+} Cursor;
+
+static void put_u16(unsigned char *p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_u32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+static uint64_t get_le(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void bytebuf_append(ByteBuf *b, const void *data, size_t len) {
+    if (b->failed) {
+        return;
+    }
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap ? b->cap : 4096;
+        while (cap < b->len + len) {
+            cap *= 2;
+        }
+        unsigned char *p = realloc(b->data, cap);
+        if (!p) {
+            b->failed = 1;
+            return;
+        }
+        b->data = p;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static const unsigned char *cursor_take(Cursor *c, size_t n) {
+    if (c->bad || c->left < n) {
+        c->bad = 1;
+        return NULL;
+    }
+    const unsigned char *p = c->p;
+    c->p += n;
+    c->left -= n;
+    return p;
+}
+
+static uint64_t cursor_le(Cursor *c, int n) {
+    const unsigned char *p = cursor_take(c, (size_t)n);
+    return p ? get_le(p, n) : 0;
+}
+
+/**
+ * @brief Recusa caminhos vazios, absolutos ou com componentes "." e "..".
+ */
+static int path_is_safe(const char *path) {
+    const char *p = path;
+    if (*p == '\0' || *p == '/') {
+        return 0;
+    }
+    while (*p) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == 0 || (len == 1 && p[0] == '.') || (len == 2 && p[0] == '.' && p[1] == '.')) {
+            return 0;
+        }
+        p += len;
+        if (*p == '/') {
+            p++;
+            if (*p == '\0') {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void free_entries(ArchiveEntry *entries, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(entries[i].path);
+    }
+    free(entries);
+}
+
+/* ---------------------------------------------------------------------------
+ * Criação
+ * ------------------------------------------------------------------------- */
+
+static int writer_out(ArchiveWriter *w, const void *data, size_t len) {
+    if (metrics_fwrite(data, len, w->out) != len) {
+        fprintf(stderr, "Erro ao escrever o arquivo sólido\n");
+        return -1;
+    }
+    w->pos += len;
+    return 0;
+}
+
+static int writer_push_segment(ArchiveWriter *w, int final) {
+    size_t len;
+    if (crypt_stream_push(&w->cs, w->enc, &len, w->seg, w->seg_len, final) != 0) {
+        fprintf(stderr, "Erro: Falha ao criptografar o bloco\n");
+        return -1;
+    }
+    w->seg_len = 0;
+    return writer_out(w, w->enc, len);
+}
+
+/**
+ * @brief Abre um bloco: novo header de fluxo com a mesma chave e um deflate novo.
+ */
+static int writer_block_begin(ArchiveWriter *w) {
+    unsigned char *stream_header = w->header + SHARED_HEADERBYTES;
+
+    if (crypt_stream_init_push(&w->cs, w->suite, w->key, stream_header) != 0) {
+        fprintf(stderr, "Erro: Falha ao inicializar o fluxo de criptografia.\n");
+        return -1;
+    }
+    memset(&w->zs, 0, sizeof w->zs);
+    w->zs.zalloc = buf_zalloc;
+    w->zs.zfree = buf_zfree;
+    if (deflateInit(&w->zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a compressão\n");
+        return -1;
+    }
+    w->block_open = 1;
+    w->seg_len = 0;
+    w->cur.offset = w->pos;
+    w->cur.raw = 0;
+    memcpy(w->cur.header, stream_header, CRYPT_STREAM_HEADERBYTES);
+    return writer_out(w, w->header, CRYPT_FILE_HEADERBYTES);
+}
+
+/**
+ * @brief Comprime dados no bloco aberto; cada segmento cheio é criptografado e gravado.
+ */
+static int writer_block_deflate(ArchiveWriter *w, const unsigned char *data, size_t len,
+                                int flush) {
+    w->zs.next_in = (Bytef *)data;
+    w->zs.avail_in = (uInt)len;
+    w->cur.raw += len;
+    for (;;) {
+        w->zs.next_out = w->seg + w->seg_len;
+        w->zs.avail_out = (uInt)(CRYPT_SEGMENT_SIZE - w->seg_len);
+        uint64_t t = metrics_start();
+        uInt avail_in = w->zs.avail_in, avail_out = w->zs.avail_out;
+        int ret = deflate(&w->zs, flush);
+        metrics_stop(METRICS_DEFLATE, t, avail_in - w->zs.avail_in, avail_out - w->zs.avail_out);
+        if (ret == Z_STREAM_ERROR) {
+            fprintf(stderr, "Erro na compressão\n");
+            return -1;
+        }
+        w->seg_len = CRYPT_SEGMENT_SIZE - w->zs.avail_out;
+        if (w->seg_len < CRYPT_SEGMENT_SIZE) {
+            return 0;
+        }
+        if (writer_push_segment(w, 0) != 0) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Fecha o bloco aberto: fim do deflate e segmento final.
+ */
+static int writer_block_end(ArchiveWriter *w) {
+    int ret = writer_block_deflate(w, NULL, 0, Z_FINISH);
+    if (ret == 0) {
+        ret = writer_push_segment(w, 1);
+    }
+    deflateEnd(&w->zs);
+    w->block_open = 0;
+    w->cur.stored = w->pos - w->cur.offset;
+    return ret;
+}
+
+/**
+ * @brief Fecha o bloco de dados aberto e o registra no índice.
+ */
+static int writer_finish_block(ArchiveWriter *w) {
+    if (writer_block_end(w) != 0) {
+        return -1;
+    }
+    if (w->n_blocks == w->cap_blocks) {
+        size_t cap = w->cap_blocks ? w->cap_blocks * 2 : 16;
+        ArchiveBlock *p = realloc(w->blocks, cap * sizeof *p);
+        if (!p) {
+            fprintf(stderr, "Erro: Memória insuficiente\n");
+            return -1;
+        }
+        w->blocks = p;
+        w->cap_blocks = cap;
+    }
+    w->blocks[w->n_blocks++] = w->cur;
+    return 0;
+}
+
+static ArchiveEntry *writer_add_entry(ArchiveWriter *w, unsigned char type,
+                                      const struct stat *st) {
+    if (w->n_entries == w->cap_entries) {
+        size_t cap = w->cap_entries ? w->cap_entries * 2 : 256;
+        ArchiveEntry *p = realloc(w->entries, cap * sizeof *p);
+        if (!p) {
+            fprintf(stderr, "Erro: Memória insuficiente\n");
+            return NULL;
+        }
+        w->entries = p;
+        w->cap_entries = cap;
+    }
+    const char *rel = w->path + w->root_len + 1;
+    if (strlen(rel) > UINT16_MAX) {
+        fprintf(stderr, "Erro: caminho longo demais: %s\n", rel);
+        return NULL;
+    }
+    ArchiveEntry *e = &w->entries[w->n_entries];
+    e->path = strdup(rel);
+    if (!e->path) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return NULL;
+    }
+    e->type = type;
+    e->mode = (uint32_t)(st->st_mode & 07777);
+    e->mtime = (int64_t)st->st_mtim.tv_sec;
+    e->mtime_nsec = (uint32_t)st->st_mtim.tv_nsec;
+    e->size = 0;
+    e->block = 0;
+    e->offset = 0;
+    w->n_entries++;
+    return e;
+}
+
+/**
+ * @brief Posiciona uma entrada com conteúdo no bloco atual, abrindo um novo
+ *        quando o anterior já passou do tamanho de bloco.
+ */
+static int writer_place(ArchiveWriter *w, ArchiveEntry *e) {
+    if (w->block_open && w->cur.raw >= w->block_size && writer_finish_block(w) != 0) {
+        return -1;
+    }
+    if (!w->block_open && writer_block_begin(w) != 0) {
+        return -1;
+    }
+    e->block = (uint32_t)w->n_blocks;
+    e->offset = w->cur.raw;
+    return 0;
+}
+
+static int writer_add_file(ArchiveWriter *w, const struct stat *st) {
+    FILE *fp = fopen(w->path, "rb");
+    if (!fp) {
+        perror(w->path);
+        return -1;
+    }
+    ArchiveEntry *e = writer_add_entry(w, ENTRY_FILE, st);
+    if (!e) {
+        fclose(fp);
+        return -1;
+    }
+    int ret = 0;
+    size_t n;
+    while ((n = metrics_fread(w->io, ARCHIVE_IO_SIZE, fp)) > 0) {
+        if ((e->size == 0 && writer_place(w, e) != 0) ||
+            writer_block_deflate(w, w->io, n, Z_NO_FLUSH) != 0) {
+            ret = -1;
+            break;
+        }
+        e->size += n;
+    }
+    if (ret == 0 && ferror(fp)) {
+        perror(w->path);
+        ret = -1;
+    }
+    fclose(fp);
+    w->content_bytes += e->size;
+    return ret;
+}
+
+static int writer_add_symlink(ArchiveWriter *w, const struct stat *st) {
+    char target[PATH_MAX];
+    ssize_t n = readlink(w->path, target, sizeof target);
+    if (n < 0 || (size_t)n >= sizeof target) {
+        perror(w->path);
+        return -1;
+    }
+    ArchiveEntry *e = writer_add_entry(w, ENTRY_SYMLINK, st);
+    if (!e || writer_place(w, e) != 0 ||
+        writer_block_deflate(w, (unsigned char *)target, (size_t)n, Z_NO_FLUSH) != 0) {
+        return -1;
+    }
+    e->size = (uint64_t)n;
+    w->content_bytes += e->size;
+    return 0;
+}
+
+static int skip_dots(const struct dirent *d) {
+    return strcmp(d->d_name, ".") != 0 && strcmp(d->d_name, "..") != 0;
+}
+
+/**
+ * @brief Percorre w->path recursivamente, em ordem alfabética dentro de cada diretório.
+ */
+static int writer_walk(ArchiveWriter *w) {
+    struct dirent **names;
+    int n = scandir(w->path, &names, skip_dots, alphasort);
+    if (n < 0) {
+        perror(w->path);
+        return -1;
+    }
+
+    size_t base_len = strlen(w->path);
+    int ret = 0;
+    for (int i = 0; i < n; i++) {
+        if (ret == 0) {
+            struct stat st;
+            size_t name_len = strlen(names[i]->d_name);
+            if (base_len + 1 + name_len >= sizeof w->path) {
+                fprintf(stderr, "Erro: caminho longo demais em %s\n", w->path);
+                ret = -1;
+            } else {
+                w->path[base_len] = '/';
+                memcpy(w->path + base_len + 1, names[i]->d_name, name_len + 1);
+                if (lstat(w->path, &st) != 0) {
+                    perror(w->path);
+                    ret = -1;
+                } else if (w->skip_self && st.st_dev == w->self_dev && st.st_ino == w->self_ino) {
+                    // o próprio arquivo de saída, quando ele fica dentro da árvore
+                } else if (S_ISREG(st.st_mode)) {
+                    ret = writer_add_file(w, &st);
+                } else if (S_ISLNK(st.st_mode)) {
+                    ret = writer_add_symlink(w, &st);
+                } else if (S_ISDIR(st.st_mode)) {
+                    ret = writer_add_entry(w, ENTRY_DIR, &st) ? writer_walk(w) : -1;
+                } else {
+                    fprintf(stderr, "Aviso: ignorando %s (tipo não suportado)\n", w->path);
+                }
+                w->path[base_len] = '\0';
+            }
+        }
+        free(names[i]);
+    }
+    free(names);
+    return ret;
+}
+
+/**
+ * @brief Grava o índice como um último bloco e o rodapé que aponta para ele.
+ */
+static int writer_finish(ArchiveWriter *w) {
+    ByteBuf idx = { NULL, 0, 0, 0 };
+    unsigned char tmp[8 + 8 + 8 + CRYPT_STREAM_HEADERBYTES];
+
+    bytebuf_append(&idx, ARCHIVE_INDEX_MAGIC, 4);
+    put_u32(tmp, (uint32_t)w->n_blocks);
+    bytebuf_append(&idx, tmp, 4);
+    for (size_t i = 0; i < w->n_blocks; i++) {
+        put_u64(tmp, w->blocks[i].offset);
+        put_u64(tmp + 8, w->blocks[i].stored);
+        put_u64(tmp + 16, w->blocks[i].raw);
+        memcpy(tmp + 24, w->blocks[i].header, CRYPT_STREAM_HEADERBYTES);
+        bytebuf_append(&idx, tmp, sizeof tmp);
+    }
+    put_u32(tmp, (uint32_t)w->n_entries);
+    bytebuf_append(&idx, tmp, 4);
+    for (size_t i = 0; i < w->n_entries; i++) {
+        const ArchiveEntry *e = &w->entries[i];
+        size_t path_len = strlen(e->path);
+        unsigned char rec[1 + 4 + 8 + 4 + 8 + 4 + 8 + 2];
+        rec[0] = e->type;
+        put_u32(rec + 1, e->mode);
+        put_u64(rec + 5, (uint64_t)e->mtime);
+        put_u32(rec + 13, e->mtime_nsec);
+        put_u64(rec + 17, e->size);
+        put_u32(rec + 25, e->block);
+        put_u64(rec + 29, e->offset);
+        put_u16(rec + 37, (uint16_t)path_len);
+        bytebuf_append(&idx, rec, sizeof rec);
+        bytebuf_append(&idx, e->path, path_len);
+    }
+    if (idx.failed) {
+        fprintf(stderr, "Erro: Memória insuficiente para o índice\n");
+        free(idx.data);
+        return -1;
+    }
+
+    int ret = writer_block_begin(w);
+    for (size_t done = 0; ret == 0 && done < idx.len; done += ARCHIVE_IO_SIZE) {
+        size_t n = idx.len - done < ARCHIVE_IO_SIZE ? idx.len - done : ARCHIVE_IO_SIZE;
+        ret = writer_block_deflate(w, idx.data + done, n, Z_NO_FLUSH);
+    }
+    if (ret == 0) {
+        ret = writer_block_end(w);
+    } else if (w->block_open) {
+        deflateEnd(&w->zs);
+        w->block_open = 0;
+    }
+    free(idx.data);
+    if (ret != 0) {
+        return -1;
+    }
+
+    put_u64(tmp, w->cur.offset);
+    put_u64(tmp + 8, w->cur.stored);
+    memcpy(tmp + 16, ARCHIVE_MAGIC, 4);
+    put_u32(tmp + 20, ARCHIVE_VERSION);
+    return writer_out(w, tmp, ARCHIVE_TRAILERBYTES);
+}
+
+int archive_create(const char *dir_path, const char *output_path,
+                   const unsigned char *password, size_t password_len,
+                   CryptSuite suite, size_t block_size, ArchiveStats *stats) {
+    struct stat st;
+    if (stat(dir_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Erro: %s não é um diretório\n", dir_path);
+        return -1;
+    }
+
+    ArchiveWriter *w = buf_calloc(sizeof *w);
+    if (!w) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return -1;
+    }
+    w->block_size = block_size ? block_size : ARCHIVE_DEFAULT_BLOCK_SIZE;
+    w->suite = suite;
+    w->root_len = strlen(dir_path);
+    while (w->root_len > 1 && dir_path[w->root_len - 1] == '/') {
+        w->root_len--;
+    }
+    if (w->root_len >= sizeof w->path) {
+        fprintf(stderr, "Erro: caminho longo demais: %s\n", dir_path);
+        buf_free(w);
+        return -1;
+    }
+    memcpy(w->path, dir_path, w->root_len);
+    w->path[w->root_len] = '\0';
+
+    w->seg = buf_alloc(CRYPT_SEGMENT_SIZE);
+    w->enc = buf_alloc(SEGMENT_BYTES);
+    w->io = buf_alloc(ARCHIVE_IO_SIZE);
+    w->out = stdstream_open_write(output_path, 0);
+    int ret = -1;
+    if (!w->seg || !w->enc || !w->io) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+    } else if (!w->out) {
+        perror("Erro ao criar arquivo de saída");
+    } else if (crypt_password_key_push(&w->suite, password, password_len,
+                                       w->header, w->key) == 0) {
+        struct stat out_st;
+        if (fstat(fileno(w->out), &out_st) == 0 && S_ISREG(out_st.st_mode)) {
+            w->skip_self = 1;
+            w->self_dev = out_st.st_dev;
+            w->self_ino = out_st.st_ino;
+        }
+        ret = writer_walk(w);
+        if (ret == 0 && w->block_open) {
+            ret = writer_finish_block(w);
+        }
+        if (ret == 0) {
+            ret = writer_finish(w);
+        }
+    }
+    if (w->block_open) {
+        deflateEnd(&w->zs);
+    }
+    if (w->out && stdstream_close_write(w->out, output_path, ret != 0) != 0) {
+        ret = -1;
+    }
+
+    if (ret == 0 && stats) {
+        stats->entries = w->n_entries;
+        stats->blocks = w->n_blocks;
+        stats->content_bytes = w->content_bytes;
+        stats->archive_bytes = w->pos;
+    }
+    sodium_memzero(w->key, sizeof w->key);
+    free_entries(w->entries, w->n_entries);
+    free(w->blocks);
+    buf_free(w->seg);
+    buf_free(w->enc);
+    buf_free(w->io);
+    buf_free(w);
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------
+ * Leitura
+ * ------------------------------------------------------------------------- */
+
+static void reader_block_close(ArchiveReader *r) {
+    if (r->block_open) {
+        inflateEnd(&r->zs);
+        r->block_open = 0;
+    }
+}
+
+/**
+ * @brief Abre um bloco: confere o cabeçalho STGC contra o índice e inicia o fluxo.
+ */
+static int reader_block_open(ArchiveReader *r, int index, uint64_t offset, uint64_t stored,
+                             const unsigned char expected[CRYPT_STREAM_HEADERBYTES]) {
+    unsigned char header[CRYPT_FILE_HEADERBYTES];
+
+    reader_block_close(r);
+    if (stored < CRYPT_FILE_HEADERBYTES || offset > r->size || stored > r->size - offset) {
+        fprintf(stderr, "Erro: arquivo sólido corrompido (bloco fora do arquivo)\n");
+        return -1;
+    }
+    if (fseeko(r->in, (off_t)offset, SEEK_SET) != 0 ||
+        fread(header, 1, sizeof header, r->in) != sizeof header) {
+        fprintf(stderr, "Erro ao ler o arquivo sólido\n");
+        return -1;
+    }
+    // Todos os blocos usam o salt do índice e o header de fluxo registrado nele,
+    // então um bloco trocado ou movido não é aceito.
+    if (memcmp(header, r->header, SHARED_HEADERBYTES) != 0 ||
+        memcmp(header + SHARED_HEADERBYTES, expected, CRYPT_STREAM_HEADERBYTES) != 0) {
+        fprintf(stderr, "Erro: bloco não corresponde ao índice (arquivo corrompido?)\n");
+        return -1;
+    }
+    if (crypt_stream_init_pull(&r->cs, r->suite, r->key, header + SHARED_HEADERBYTES) != 0) {
+        fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
+        return -1;
+    }
+    memset(&r->zs, 0, sizeof r->zs);
+    r->zs.zalloc = buf_zalloc;
+    r->zs.zfree = buf_zfree;
+    if (inflateInit(&r->zs) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a descompressão\n");
+        return -1;
+    }
+    r->block_open = 1;
+    r->block_index = index;
+    r->block_pos = 0;
+    r->left = stored - CRYPT_FILE_HEADERBYTES;
+    r->final = 0;
+    r->stream_end = 0;
+    return 0;
+}
+
+/**
+ * @brief Lê e autentica o próximo segmento do bloco aberto.
+ */
+static int reader_pull_segment(ArchiveReader *r, size_t *plain_len) {
+    size_t n = r->left < SEGMENT_BYTES ? (size_t)r->left : SEGMENT_BYTES;
+    int final;
+
+    if (r->final || n == 0) {
+        fprintf(stderr, "Erro: Arquivo truncado (tag final ausente).\n");
+        return -1;
+    }
+    if (metrics_fread(r->enc, n, r->in) != n) {
+        fprintf(stderr, "Erro ao ler o arquivo sólido\n");
+        return -1;
+    }
+    r->left -= n;
+    if (crypt_stream_pull(&r->cs, r->plain, plain_len, &final, r->enc, n) != 0) {
+        fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+        return -1;
+    }
+    if (final != (r->left == 0)) {
+        fprintf(stderr, "Erro: tag final fora do fim do bloco (arquivo corrompido?)\n");
+        return -1;
+    }
+    r->final = final;
+    return 0;
+}
+
+/**
+ * @brief Lê até len bytes de conteúdo do bloco aberto.
+ * @return Bytes lidos (menos que len só no fim do bloco), ou -1 em erro.
+ */
+static long reader_block_read(ArchiveReader *r, unsigned char *dst, size_t len) {
+    r->zs.next_out = dst;
+    r->zs.avail_out = (uInt)len;
+    while (r->zs.avail_out > 0 && !r->stream_end) {
+        if (r->zs.avail_in == 0) {
+            size_t plain_len;
+            if (reader_pull_segment(r, &plain_len) != 0) {
+                return -1;
+            }
+            r->zs.next_in = r->plain;
+            r->zs.avail_in = (uInt)plain_len;
+        }
+        uint64_t t = metrics_start();
+        uInt avail_in = r->zs.avail_in, avail_out = r->zs.avail_out;
+        int ret = inflate(&r->zs, Z_NO_FLUSH);
+        metrics_stop(METRICS_INFLATE, t, avail_in - r->zs.avail_in, avail_out - r->zs.avail_out);
+        if (ret == Z_STREAM_END) {
+            r->stream_end = 1;
+            if (r->zs.avail_in != 0) {
+                fprintf(stderr, "Erro: dados após o fim do bloco\n");
+                return -1;
+            }
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            fprintf(stderr, "Erro na descompressão: %d\n", ret);
+            return -1;
+        }
+    }
+    size_t got = len - r->zs.avail_out;
+    r->block_pos += got;
+    return (long)got;
+}
+
+/**
+ * @brief Confere que o bloco aberto termina logo após o fim do fluxo deflate.
+ */
+static int reader_block_check_end(ArchiveReader *r) {
+    while (!r->final) {
+        size_t plain_len;
+        if (reader_pull_segment(r, &plain_len) != 0) {
+            return -1;
+        }
+        if (plain_len != 0) {
+            fprintf(stderr, "Erro: dados após o fim do bloco\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Interpreta o texto do índice, validando limites e caminhos.
+ */
+static int compare_entry_paths(const void *a, const void *b) {
+    const ArchiveEntry *const *x = a;
+    const ArchiveEntry *const *y = b;
+    return strcmp((*x)->path, (*y)->path);
+}
+
+/**
+ * @brief Recusa caminhos repetidos e entradas abaixo de algo que o índice não
+ *        registra como diretório (um link, por exemplo): extraídas, elas seriam
+ *        escritas através do link, fora do destino.
+ */
+static int reader_check_paths(const ArchiveReader *r) {
+    const ArchiveEntry **sorted = malloc((r->n_entries ? r->n_entries : 1) * sizeof *sorted);
+    char *prefix = malloc((size_t)UINT16_MAX + 1);
+    int ret = -1;
+    if (!sorted || !prefix) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        goto out;
+    }
+    for (size_t i = 0; i < r->n_entries; i++) {
+        sorted[i] = &r->entries[i];
+    }
+    qsort(sorted, r->n_entries, sizeof *sorted, compare_entry_paths);
+    for (size_t i = 1; i < r->n_entries; i++) {
+        if (strcmp(sorted[i - 1]->path, sorted[i]->path) == 0) {
+            fprintf(stderr, "Erro: caminho repetido no índice: %s\n", sorted[i]->path);
+            goto out;
+        }
+    }
+
+    ArchiveEntry key;
+    const ArchiveEntry *key_ptr = &key;
+    key.path = prefix;
+    for (size_t i = 0; i < r->n_entries; i++) {
+        const char *path = r->entries[i].path;
+        for (const char *slash = strchr(path, '/'); slash; slash = strchr(slash + 1, '/')) {
+            memcpy(prefix, path, (size_t)(slash - path));
+            prefix[slash - path] = '\0';
+            const ArchiveEntry **found = bsearch(&key_ptr, sorted, r->n_entries, sizeof *sorted,
+                                                 compare_entry_paths);
+            if (found && (*found)->type != ENTRY_DIR) {
+                fprintf(stderr, "Erro: %s está abaixo de %s, que não é um diretório\n",
+                        path, prefix);
+                goto out;
+            }
+        }
+    }
+    ret = 0;
+
+out:
+    free(prefix);
+    free(sorted);
+    return ret;
+}
+
+static int reader_parse_index(ArchiveReader *r, const unsigned char *data, size_t len) {
+    Cursor c = { data, len, 0 };
+    const unsigned char *magic = cursor_take(&c, 4);
+
+    if (!magic || memcmp(magic, ARCHIVE_INDEX_MAGIC, 4) != 0) {
+        goto corrupt;
+    }
+    uint64_t n_blocks = cursor_le(&c, 4);
+    if (n_blocks > c.left / (24 + CRYPT_STREAM_HEADERBYTES)) {
+        goto corrupt;
+    }
+    r->blocks = calloc(n_blocks ? n_blocks : 1, sizeof *r->blocks);
+    if (!r->blocks) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return -1;
+    }
+    r->n_blocks = (size_t)n_blocks;
+    for (size_t i = 0; i < r->n_blocks; i++) {
+        ArchiveBlock *b = &r->blocks[i];
+        b->offset = cursor_le(&c, 8);
+        b->stored = cursor_le(&c, 8);
+        b->raw = cursor_le(&c, 8);
+        const unsigned char *h = cursor_take(&c, CRYPT_STREAM_HEADERBYTES);
+        if (h) {
+            memcpy(b->header, h, CRYPT_STREAM_HEADERBYTES);
+        }
+    }
+
+    uint64_t n_entries = cursor_le(&c, 4);
+    if (c.bad || n_entries > c.left / 39) {
+        goto corrupt;
+    }
+    r->entries = calloc(n_entries ? n_entries : 1, sizeof *r->entries);
+    if (!r->entries) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return -1;
+    }
+    for (size_t i = 0; i < n_entries; i++) {
+        ArchiveEntry *e = &r->entries[i];
+        const unsigned char *type = cursor_take(&c, 1);
+        e->type = type ? *type : 0;
+        e->mode = (uint32_t)cursor_le(&c, 4);
+        e->mtime = (int64_t)cursor_le(&c, 8);
+        e->mtime_nsec = (uint32_t)cursor_le(&c, 4);
+        e->size = cursor_le(&c, 8);
+        e->block = (uint32_t)cursor_le(&c, 4);
+        e->offset = cursor_le(&c, 8);
+        size_t path_len = (size_t)cursor_le(&c, 2);
+        const unsigned char *path = cursor_take(&c, path_len);
+        if (c.bad) {
+            goto corrupt;
+        }
+        e->path = strndup((const char *)path, path_len);
+        if (!e->path) {
+            fprintf(stderr, "Erro: Memória insuficiente\n");
+            return -1;
+        }
+        r->n_entries = i + 1;
+
+        if (strlen(e->path) != path_len || !path_is_safe(e->path)) {
+            fprintf(stderr, "Erro: caminho inseguro no índice: %s\n", e->path);
+            return -1;
+        }
+        if (e->type != ENTRY_FILE && e->type != ENTRY_DIR && e->type != ENTRY_SYMLINK) {
+            goto corrupt;
+        }
+        if (e->size > 0 && (e->type == ENTRY_DIR || e->block >= r->n_blocks ||
+                            e->offset > r->blocks[e->block].raw ||
+                            e->size > r->blocks[e->block].raw - e->offset)) {
+            goto corrupt;
+        }
+    }
+    if (c.left != 0) {
+        goto corrupt;
+    }
+    return reader_check_paths(r);
+
+corrupt:
+    fprintf(stderr, "Erro: índice do arquivo sólido corrompido\n");
+    return -1;
+}
+
+/**
+ * @brief Abre o arquivo sólido: rodapé, Argon2 com o salt do índice e leitura do índice.
+ */
+static int reader_open(ArchiveReader *r, const char *path,
+                       const unsigned char *password, size_t password_len) {
+    unsigned char trailer[ARCHIVE_TRAILERBYTES];
+    struct stat st;
+
+    r->block_index = -1;
+    r->in = fopen(path, "rb");
+    if (!r->in) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+    if (fstat(fileno(r->in), &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Erro: o arquivo sólido precisa ser um arquivo comum\n");
+        return -1;
+    }
+    r->size = (uint64_t)st.st_size;
+    if (r->size < ARCHIVE_TRAILERBYTES + CRYPT_FILE_HEADERBYTES ||
+        fseeko(r->in, -(off_t)ARCHIVE_TRAILERBYTES, SEEK_END) != 0 ||
+        fread(trailer, 1, sizeof trailer, r->in) != sizeof trailer ||
+        memcmp(trailer + 16, ARCHIVE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Erro: %s não é um arquivo sólido\n", path);
+        return -1;
+    }
+    if (get_le(trailer + 20, 4) != ARCHIVE_VERSION) {
+        fprintf(stderr, "Erro: versão de arquivo sólido não suportada\n");
+        return -1;
+    }
+    uint64_t index_offset = get_le(trailer, 8);
+    uint64_t index_stored = get_le(trailer + 8, 8);
+    if (index_offset > r->size - ARCHIVE_TRAILERBYTES ||
+        index_stored > r->size - ARCHIVE_TRAILERBYTES - index_offset ||
+        index_stored < CRYPT_FILE_HEADERBYTES) {
+        fprintf(stderr, "Erro: arquivo sólido corrompido (rodapé)\n");
+        return -1;
+    }
+
+    if (fseeko(r->in, (off_t)index_offset, SEEK_SET) != 0 ||
+        fread(r->header, 1, sizeof r->header, r->in) != sizeof r->header) {
+        fprintf(stderr, "Erro ao ler o arquivo sólido\n");
+        return -1;
+    }
+    if (crypt_password_key_pull(r->header, password, password_len, r->key, &r->suite) != 0) {
+        return -1;
+    }
+
+    r->enc = buf_alloc(SEGMENT_BYTES);
+    r->plain = buf_alloc(CRYPT_SEGMENT_SIZE);
+    r->io = buf_alloc(ARCHIVE_IO_SIZE);
+    if (!r->enc || !r->plain || !r->io) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return -1;
+    }
+    if (reader_block_open(r, -1, index_offset, index_stored,
+                          r->header + SHARED_HEADERBYTES) != 0) {
+        return -1;
+    }
+
+    ByteBuf idx = { NULL, 0, 0, 0 };
+    long n;
+    while ((n = reader_block_read(r, r->io, ARCHIVE_IO_SIZE)) > 0) {
+        bytebuf_append(&idx, r->io, (size_t)n);
+    }
+    int ret = -1;
+    if (idx.failed) {
+        fprintf(stderr, "Erro: Memória insuficiente para o índice\n");
+    } else if (n == 0 && reader_block_check_end(r) == 0) {
+        ret = reader_parse_index(r, idx.data, idx.len);
+    }
+    free(idx.data);
+    reader_block_close(r);
+    return ret;
+}
+
+static void reader_close(ArchiveReader *r) {
+    reader_block_close(r);
+    if (r->in) {
+        fclose(r->in);
+    }
+    sodium_memzero(r->key, sizeof r->key);
+    free_entries(r->entries, r->n_entries);
+    free(r->blocks);
+    buf_free(r->enc);
+    buf_free(r->plain);
+    buf_free(r->io);
+}
+
+/**
+ * @brief Posiciona a leitura no conteúdo de uma entrada, reaproveitando o bloco
+ *        aberto quando a entrada vem depois da posição atual.
+ */
+static int reader_seek_entry(ArchiveReader *r, const ArchiveEntry *e) {
+    if (!r->block_open || r->block_index != (int)e->block || r->block_pos > e->offset) {
+        const ArchiveBlock *b = &r->blocks[e->block];
+        if (reader_block_open(r, (int)e->block, b->offset, b->stored, b->header) != 0) {
+            return -1;
+        }
+    }
+    // O deflate não tem acesso aleatório: o conteúdo anterior do bloco é descartado.
+    while (r->block_pos < e->offset) {
+        uint64_t skip = e->offset - r->block_pos;
+        size_t n = skip < ARCHIVE_IO_SIZE ? (size_t)skip : ARCHIVE_IO_SIZE;
+        if (reader_block_read(r, r->io, n) != (long)n) {
+            fprintf(stderr, "Erro: bloco menor que o indicado no índice\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Cria path e os diretórios que faltam acima dele (como mkdir -p).
+ */
+static int make_dirs(char *path) {
+    for (char *p = path + 1; *p; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            int ret = mkdir(path, 0777);
+            *p = '/';
+            if (ret != 0 && errno != EEXIST) {
+                perror(path);
+                return -1;
+            }
+        }
+    }
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Abre o diretório que contém rel, a partir do destino root, sem seguir
+ *        links: cada componente intermediário é aberto com O_NOFOLLOW (e criado
+ *        antes, se create), então um link no caminho é erro e nada é escrito fora
+ *        do destino.
+ * @param rel: caminho relativo já aceito por path_is_safe
+ * @param leaf: recebe o último componente de rel
+ * @return: descritor do diretório, ou -1 em erro (com errno)
+ */
+static int open_parent(int root, const char *rel, int create, const char **leaf) {
+    char name[NAME_MAX + 1];
+    int fd = openat(root, ".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    const char *slash;
+    while (fd >= 0 && (slash = strchr(rel, '/'))) {
+        size_t len = (size_t)(slash - rel);
+        if (len > NAME_MAX) {
+            close(fd);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(name, rel, len);
+        name[len] = '\0';
+        if (create && mkdirat(fd, name, 0777) != 0 && errno != EEXIST) {
+            close(fd);
+            return -1;
+        }
+        int next = openat(fd, name, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        close(fd);
+        fd = next;
+        rel = slash + 1;
+    }
+    *leaf = rel;
+    return fd;
+}
+
+/**
+ * @brief Tira do lugar o que já existe em name antes de criar um arquivo ou link.
+ *        O lstat vem antes do unlink, que assim só apaga a entrada em si (nunca o
+ *        alvo de um link); um diretório no lugar é erro.
+ */
+static int clear_leaf(int dir_fd, const char *name) {
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        errno = EISDIR;
+        return -1;
+    }
+    return unlinkat(dir_fd, name, 0);
+}
+
+/**
+ * @brief Cria o diretório rel dentro do destino; o que houver no lugar que não
+ *        seja um diretório (um link, por exemplo) é substituído.
+ */
+static int extract_dir(int root, const ArchiveEntry *e, const char *path) {
+    const char *leaf;
+    struct stat st;
+    int dir_fd = open_parent(root, e->path, 1, &leaf);
+    int ret = dir_fd < 0 ? -1 : 0;
+    if (ret == 0 && fstatat(dir_fd, leaf, &st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(st.st_mode)) {
+        ret = unlinkat(dir_fd, leaf, 0);
+    }
+    if (ret == 0 && mkdirat(dir_fd, leaf, 0777) != 0 && errno != EEXIST) {
+        ret = -1;
+    }
+    if (ret != 0) {
+        perror(path);
+    }
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    return ret;
+}
+
+static int extract_file(ArchiveReader *r, const ArchiveEntry *e, int root, const char *path) {
+    const char *leaf;
+    int dir_fd = open_parent(root, e->path, 1, &leaf);
+    int fd = -1;
+    if (dir_fd >= 0 && clear_leaf(dir_fd, leaf) == 0) {
+        fd = openat(dir_fd, leaf, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    }
+    if (fd < 0) {
+        perror(path);
+        if (dir_fd >= 0) {
+            close(dir_fd);
+        }
+        return -1;
+    }
+    int ret = e->size > 0 ? reader_seek_entry(r, e) : 0;
+    for (uint64_t left = e->size; ret == 0 && left > 0;) {
+        size_t n = left < ARCHIVE_IO_SIZE ? (size_t)left : ARCHIVE_IO_SIZE;
+        if (reader_block_read(r, r->io, n) != (long)n) {
+            fprintf(stderr, "Erro: bloco menor que o indicado no índice\n");
+            ret = -1;
+            break;
+        }
+        for (size_t done = 0; done < n;) {
+            uint64_t t = metrics_start();
+            ssize_t w = write(fd, r->io + done, n - done);
+            metrics_stop(METRICS_WRITE, t, w > 0 ? (size_t)w : 0, w > 0 ? (size_t)w : 0);
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                perror(path);
+                ret = -1;
+                break;
+            }
+            done += (size_t)w;
+        }
+        left -= n;
+    }
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { e->mtime, e->mtime_nsec } };
+    if (ret == 0 && (fchmod(fd, e->mode) != 0 || futimens(fd, times) != 0)) {
+        perror(path);
+        ret = -1;
+    }
+    if (close(fd) != 0 && ret == 0) {
+        perror(path);
+        ret = -1;
+    }
+    if (ret != 0) {
+        unlinkat(dir_fd, leaf, 0);
+    }
+    close(dir_fd);
+    return ret;
+}
+
+/**
+ * @brief Cria o link rel -> target dentro do destino.
+ */
+static int extract_symlink(int root, const ArchiveEntry *e, const char *target,
+                           const char *path) {
+    const char *leaf;
+    int dir_fd = open_parent(root, e->path, 1, &leaf);
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { e->mtime, e->mtime_nsec } };
+    if (dir_fd < 0 || clear_leaf(dir_fd, leaf) != 0 || symlinkat(target, dir_fd, leaf) != 0) {
+        perror(path);
+        if (dir_fd >= 0) {
+            close(dir_fd);
+        }
+        return -1;
+    }
+    utimensat(dir_fd, leaf, times, AT_SYMLINK_NOFOLLOW);
+    close(dir_fd);
+    return 0;
+}
+
+/**
+ * @brief Aplica modo e data de um diretório já extraído, sem seguir links.
+ */
+static int finish_dir(int root, const ArchiveEntry *e, const char *path) {
+    const char *leaf;
+    struct timespec times[2] = { { 0, UTIME_OMIT }, { e->mtime, e->mtime_nsec } };
+    int dir_fd = open_parent(root, e->path, 0, &leaf);
+    int fd = dir_fd < 0 ? -1 : openat(dir_fd, leaf, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    int ret = fd < 0 || fchmod(fd, e->mode) != 0 || futimens(fd, times) != 0 ? -1 : 0;
+    if (ret != 0) {
+        perror(path);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+    return ret;
+}
+
+/**
+ * @brief Lê o alvo de um link simbólico do bloco dele.
+ */
+static char *read_symlink_target(ArchiveReader *r, const ArchiveEntry *e) {
+    if (e->size == 0 || e->size >= PATH_MAX) {
+        fprintf(stderr, "Erro: alvo de link inválido: %s\n", e->path);
+        return NULL;
+    }
+    char *target = malloc((size_t)e->size + 1);
+    if (!target) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return NULL;
+    }
+    if (reader_seek_entry(r, e) != 0 ||
+        reader_block_read(r, (unsigned char *)target, (size_t)e->size) != (long)e->size) {
+        free(target);
+        return NULL;
+    }
+    target[e->size] = '\0';
+    return target;
+}
+
+/**
+ * @brief Marca as entradas pedidas (um diretório inclui tudo abaixo dele).
+ */
+static int select_members(const ArchiveReader *r, char *const *members, size_t n_members,
+                          unsigned char *wanted) {
+    if (!members || n_members == 0) {
+        memset(wanted, 1, r->n_entries);
+        return 0;
+    }
+    int ret = 0;
+    for (size_t m = 0; m < n_members; m++) {
+        size_t len = strlen(members[m]);
+        while (len > 1 && members[m][len - 1] == '/') {
+            len--;
+        }
+        int found = 0;
+        for (size_t i = 0; i < r->n_entries; i++) {
+            const char *p = r->entries[i].path;
+            if (strncmp(p, members[m], len) == 0 && (p[len] == '\0' || p[len] == '/')) {
+                wanted[i] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Erro: %s não está no arquivo sólido\n", members[m]);
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+int archive_extract(const char *archive_path, const char *dest_dir,
+                    const unsigned char *password, size_t password_len,
+                    char *const *members, size_t n_members, ArchiveStats *stats) {
+    ArchiveReader r;
+    memset(&r, 0, sizeof r);
+    if (reader_open(&r, archive_path, password, password_len) != 0) {
+        reader_close(&r);
+        return -1;
+    }
+
+    unsigned char *wanted = calloc(r.n_entries ? r.n_entries : 1, 1);
+    char **links = calloc(r.n_entries ? r.n_entries : 1, sizeof *links);
+    char path[PATH_MAX];
+    size_t dest_len = strlen(dest_dir);
+    int root = -1;
+    int ret = -1;
+    if (!wanted || !links) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        goto out;
+    }
+    if (select_members(&r, members, n_members, wanted) != 0) {
+        goto out;
+    }
+    if (dest_len >= sizeof path) {
+        fprintf(stderr, "Erro: caminho longo demais: %s\n", dest_dir);
+        goto out;
+    }
+    memcpy(path, dest_dir, dest_len + 1);
+    if (make_dirs(path) != 0) {
+        goto out;
+    }
+    // Tudo é criado a partir deste descritor: os caminhos do índice nunca passam
+    // por um link, nem um que já estava no destino.
+    root = open(dest_dir, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (root < 0) {
+        perror(dest_dir);
+        goto out;
+    }
+
+    ArchiveStats st = { 0, r.n_blocks, 0, r.size };
+    ret = 0;
+    // Arquivos e diretórios na ordem do índice, que é a ordem dentro dos blocos.
+    // Links ficam para depois, para que nenhum arquivo seja escrito através deles.
+    for (size_t i = 0; ret == 0 && i < r.n_entries; i++) {
+        const ArchiveEntry *e = &r.entries[i];
+        if (!wanted[i]) {
+            continue;
+        }
+        if ((size_t)snprintf(path, sizeof path, "%s/%s", dest_dir, e->path) >= sizeof path) {
+            fprintf(stderr, "Erro: caminho longo demais: %s\n", e->path);
+            ret = -1;
+        } else if (e->type == ENTRY_DIR) {
+            ret = extract_dir(root, e, path);
+        } else if (e->type == ENTRY_FILE) {
+            ret = extract_file(&r, e, root, path);
+        } else {
+            links[i] = read_symlink_target(&r, e);
+            ret = links[i] ? 0 : -1;
+        }
+        st.entries++;
+        st.content_bytes += e->size;
+    }
+    for (size_t i = 0; ret == 0 && i < r.n_entries; i++) {
+        const ArchiveEntry *e = &r.entries[i];
+        if (!links[i]) {
+            continue;
+        }
+        snprintf(path, sizeof path, "%s/%s", dest_dir, e->path);
+        ret = extract_symlink(root, e, links[i], path);
+    }
+    // Modos e datas dos diretórios por último, de baixo para cima, para que um
+    // diretório sem permissão de escrita não impeça a criação do conteúdo dele.
+    for (size_t i = r.n_entries; ret == 0 && i-- > 0;) {
+        const ArchiveEntry *e = &r.entries[i];
+        if (!wanted[i] || e->type != ENTRY_DIR) {
+            continue;
+        }
+        snprintf(path, sizeof path, "%s/%s", dest_dir, e->path);
+        ret = finish_dir(root, e, path);
+    }
+    if (ret == 0 && stats) {
+        *stats = st;
+    }
+
+out:
+    if (root >= 0) {
+        close(root);
+    }
+    if (links) {
+        for (size_t i = 0; i < r.n_entries; i++) {
+            free(links[i]);
+        }
+    }
+    free(links);
+    free(wanted);
+    reader_close(&r);
+    return ret;
+}
+
+int archive_list(const char *archive_path,
+                 const unsigned char *password, size_t password_len,
+                 FILE *out, ArchiveStats *stats) {
+    ArchiveReader r;
+    memset(&r, 0, sizeof r);
+    if (reader_open(&r, archive_path, password, password_len) != 0) {
+        reader_close(&r);
+        return -1;
+    }
+
+    ArchiveStats st = { r.n_entries, r.n_blocks, 0, r.size };
+    for (size_t i = 0; i < r.n_entries; i++) {
+        const ArchiveEntry *e = &r.entries[i];
+        fprintf(out, "%c %04o %12llu %s%s\n", e->type, (unsigned)e->mode,
+                (unsigned long long)e->size, e->path, e->type == ENTRY_DIR ? "/" : "");
+        st.content_bytes += e->size;
+    }
+    if (stats) {
+        *stats = st;
+    }
+    reader_close(&r);
+    return 0;
+}
@@ -0,0 +1,94 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "crypt_utils.h"
+
+/**
+ * Arquivo sólido: uma árvore de diretórios em um único contêiner
+ *
+ * O conteúdo de todos os arquivos é concatenado e comprimido em blocos sólidos
+ * (um fluxo deflate por bloco, então arquivos pequenos e parecidos se
+ * comprimem juntos). Cada bloco é um contêiner criptografado completo (cabeçalho
+ * STGC + segmentos), todos com o mesmo salt e a mesma chave: o Argon2 roda uma
+ * vez por arquivo, e não por entrada. O índice (caminhos, modos, datas e a
+ * posição de cada entrada no seu bloco) vai no fim, também comprimido e
+ * criptografado, seguido de um rodapé fixo que aponta para ele. Assim, listar
+ * lê só o índice, e extrair uma entrada lê o índice e o bloco dela.
+ */
+
+/**
+ * Tamanho padrão dos blocos sólidos (conteúdo antes da compressão)
+ */
+#define ARCHIVE_DEFAULT_BLOCK_SIZE ((size_t)16 * 1024 * 1024)
+
+/**
+ * Totais de uma operação com arquivo sólido
+ */
+typedef struct {
+    size_t entries;          // arquivos, diretórios e links processados
+    size_t blocks;           // blocos sólidos no arquivo
+    uint64_t content_bytes;  // soma do conteúdo das entradas
+    uint64_t archive_bytes;  // tamanho do arquivo sólido
+} ArchiveStats;
+
+/**
+ * Empacota um diretório em um arquivo sólido comprimido e criptografado
+ *
+ * Guarda arquivos comuns, diretórios e links simbólicos (outros tipos são
+ * ignorados com um aviso). As entradas de cada diretório seguem a ordem
+ * alfabética. A saída é escrita em sequência, então pode ser um pipe ("-").
+ *
+ * @param dir_path: diretório de origem
+ * @param output_path: arquivo de saída ("-" = saída padrão)
+ * @param password: senha usada na derivação da chave
+ * @param password_len: tamanho da senha
+ * @param suite: suite de cifra (ou CRYPT_SUITE_AUTO)
+ * @param block_size: conteúdo máximo por bloco antes de abrir o próximo
+ *                    (um arquivo nunca é dividido entre blocos)
+ * @param stats: recebe os totais (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro (a saída parcial é removida)
+ */
+int archive_create(const char *dir_path, const char *output_path,
+                   const unsigned char *password, size_t password_len,
+                   CryptSuite suite, size_t block_size, ArchiveStats *stats);
+
+/**
+ * Extrai um arquivo sólido para um diretório
+ *
+ * Com membros, extrai só as entradas com esses caminhos (um diretório inclui
+ * tudo abaixo dele) e lê do arquivo apenas os blocos que as contêm. Caminhos
+ * absolutos ou com ".." no índice são recusados.
+ *
+ * @param archive_path: arquivo sólido (precisa permitir seek)
+ * @param dest_dir: diretório de destino (criado se não existir)
+ * @param password: senha usada na criação
+ * @param password_len: tamanho da senha
+ * @param members: caminhos a extrair, ou NULL para todos
+ * @param n_members: quantidade de caminhos em members
+ * @param stats: recebe os totais das entradas extraídas (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int archive_extract(const char *archive_path, const char *dest_dir,
+                    const unsigned char *password, size_t password_len,
+                    char *const *members, size_t n_members, ArchiveStats *stats);
+
+/**
+ * Lista as entradas de um arquivo sólido (lê apenas o índice)
+ *
+ * Cada linha traz o tipo (f, d ou l), o modo em octal, o tamanho e o caminho.
+ *
+ * @param archive_path: arquivo sólido (precisa permitir seek)
+ * @param password: senha usada na criação
+ * @param password_len: tamanho da senha
+ * @param out: onde escrever a listagem
+ * @param stats: recebe os totais do arquivo (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int archive_list(const char *archive_path,
+                 const unsigned char *password, size_t password_len,
+                 FILE *out, ArchiveStats *stats);
+
+#endif /* ARCHIVE_H */
@@ -0,0 +1,173 @@
+/**
+ * Gera arquivos sólidos (.sta) com um índice arbitrário, para os testes de
+ * extração com entradas maliciosas (links no meio de caminhos, caminhos
+ * repetidos). O formato é o mesmo de archive.c: um bloco de dados com o
+ * conteúdo de todas as entradas, o bloco do índice e o rodapé.
+ *
+ * Uso: archive_craft <saida.sta> <senha> <entrada> [entrada ...]
+ *   d:caminho            diretório
+ *   f:caminho=conteúdo   arquivo
+ *   l:caminho=alvo       link simbólico
+ */
+#include "crypt_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define SHARED_HEADERBYTES (CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES)
+
+typedef struct {
+    uint64_t offset;
+    uint64_t stored;
+    uint64_t raw;
+    unsigned char header[CRYPT_STREAM_HEADERBYTES];
+} CraftBlock;
+
+static void put_le(unsigned char *p, uint64_t v, int n) {
+    for (int i = 0; i < n; i++) {
+        p[i] = (unsigned char)(v >> (8 * i));
+    }
+}
+
+/**
+ * @brief Grava data como um bloco: cabeçalho STGC, fluxo zlib em segmentos criptografados.
+ */
+static int write_block(FILE *out, uint64_t *pos, unsigned char *file_header, CryptSuite suite,
+                       const unsigned char *key, const unsigned char *data, size_t len,
+                       CraftBlock *b) {
+    uLongf zlen = compressBound((uLong)len);
+    unsigned char *z = malloc(zlen);
+    unsigned char *enc = malloc(CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES);
+    CryptStream cs;
+    int ret = -1;
+
+    if (!z || !enc || compress2(z, &zlen, data, (uLong)len, Z_DEFAULT_COMPRESSION) != Z_OK ||
+        crypt_stream_init_push(&cs, suite, key, file_header + SHARED_HEADERBYTES) != 0 ||
+        fwrite(file_header, 1, CRYPT_FILE_HEADERBYTES, out) != CRYPT_FILE_HEADERBYTES) {
+        goto out;
+    }
+    b->offset = *pos;
+    b->raw = len;
+    memcpy(b->header, file_header + SHARED_HEADERBYTES, CRYPT_STREAM_HEADERBYTES);
+    *pos += CRYPT_FILE_HEADERBYTES;
+    size_t done = 0;
+    do {
+        size_t n = zlen - done < CRYPT_SEGMENT_SIZE ? zlen - done : CRYPT_SEGMENT_SIZE;
+        size_t enc_len;
+        int final = done + n == zlen;
+        if (crypt_stream_push(&cs, enc, &enc_len, z + done, n, final) != 0 ||
+            fwrite(enc, 1, enc_len, out) != enc_len) {
+            goto out;
+        }
+        *pos += enc_len;
+        done += n;
+    } while (done < zlen);
+    b->stored = *pos - b->offset;
+    ret = 0;
+
+out:
+    sodium_memzero(&cs, sizeof cs);
+    free(enc);
+    free(z);
+    return ret;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        fprintf(stderr, "Uso: %s <saida.sta> <senha> <d:caminho|f:caminho=conteúdo|l:caminho=alvo> ...\n",
+                argv[0]);
+        return 1;
+    }
+    if (sodium_init() < 0) {
+        fprintf(stderr, "Erro: Não foi possível inicializar a libsodium\n");
+        return 1;
+    }
+
+    int n_entries = argc - 3;
+    size_t content_len = 0, index_len = 4 + 4 + 2 * (24 + CRYPT_STREAM_HEADERBYTES) + 4;
+    for (int i = 0; i < n_entries; i++) {
+        const char *spec = argv[3 + i];
+        const char *eq = strchr(spec, '=');
+        if (strlen(spec) < 3 || spec[1] != ':' || !strchr("dfl", spec[0]) ||
+            (spec[0] != 'd') != (eq != NULL)) {
+            fprintf(stderr, "Erro: entrada inválida: %s\n", spec);
+            return 1;
+        }
+        content_len += eq ? strlen(eq + 1) : 0;
+        index_len += 39 + strlen(spec);
+    }
+
+    unsigned char *content = malloc(content_len ? content_len : 1);
+    unsigned char *index = malloc(index_len);
+    if (!content || !index) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        return 1;
+    }
+    unsigned char *p = index + 4 + 4 + 24 + CRYPT_STREAM_HEADERBYTES;   // bloco 0 vem depois
+    size_t used = 0;
+    put_le(p, (uint64_t)n_entries, 4);
+    p += 4;
+    for (int i = 0; i < n_entries; i++) {
+        const char *spec = argv[3 + i];
+        const char *eq = strchr(spec, '=');
+        size_t path_len = eq ? (size_t)(eq - spec - 2) : strlen(spec + 2);
+        size_t size = eq ? strlen(eq + 1) : 0;
+        p[0] = (unsigned char)spec[0];
+        put_le(p + 1, spec[0] == 'd' ? 0755 : spec[0] == 'f' ? 0644 : 0777, 4);
+        put_le(p + 5, 0, 8);
+        put_le(p + 13, 0, 4);
+        put_le(p + 17, size, 8);
+        put_le(p + 25, 0, 4);
+        put_le(p + 29, used, 8);
+        put_le(p + 37, path_len, 2);
+        memcpy(p + 39, spec + 2, path_len);
+        p += 39 + path_len;
+        if (eq) {
+            memcpy(content + used, eq + 1, size);
+            used += size;
+        }
+    }
+    index_len = (size_t)(p - index);
+
+    FILE *out = fopen(argv[1], "wb");
+    if (!out) {
+        perror("Erro ao criar arquivo de saída");
+        return 1;
+    }
+    CryptSuite suite = CRYPT_SUITE_XCHACHA20;
+    unsigned char header[CRYPT_FILE_HEADERBYTES];
+    unsigned char key[CRYPT_KEYBYTES];
+    CraftBlock data_block, index_block;
+    uint64_t pos = 0;
+    int ret = crypt_password_key_push(&suite, (const unsigned char *)argv[2], strlen(argv[2]),
+                                      header, key);
+    if (ret == 0) {
+        ret = write_block(out, &pos, header, suite, key, content, content_len, &data_block);
+    }
+    if (ret == 0) {
+        memcpy(index, "STGI", 4);
+        put_le(index + 4, 1, 4);
+        put_le(index + 8, data_block.offset, 8);
+        put_le(index + 16, data_block.stored, 8);
+        put_le(index + 24, data_block.raw, 8);
+        memcpy(index + 32, data_block.header, CRYPT_STREAM_HEADERBYTES);
+        ret = write_block(out, &pos, header, suite, key, index, index_len, &index_block);
+    }
+    if (ret == 0) {
+        unsigned char trailer[24];
+        put_le(trailer, index_block.offset, 8);
+        put_le(trailer + 8, index_block.stored, 8);
+        memcpy(trailer + 16, "STGA", 4);
+        put_le(trailer + 20, 1, 4);
+        ret = fwrite(trailer, 1, sizeof trailer, out) == sizeof trailer ? 0 : -1;
+    }
+    if (fclose(out) != 0 || ret != 0) {
+        fprintf(stderr, "Erro ao gravar %s\n", argv[1]);
+        return 1;
+    }
+    sodium_memzero(key, sizeof key);
+    free(content);
+    free(index);
+    return 0;
+}
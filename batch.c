@@ -0,0 +1,512 @@
+#include "batch.h"
+#include "threadpool.h"
+#include "compactar.h"
+#include "esteg.h"
+#include "crypt_utils.h"
+#include "pipeline.h"
+#include "bufpool.h"
+#include "rescache.h"
+#include "stdstream.h"
+#include "ioring.h"
+#include "opctx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Tamanho máximo de uma linha do manifesto
+#define BATCH_LINE_MAX 8192
+
+/**
+ * @brief Um job do manifesto. Os campos não usados pela operação ficam NULL.
+ */
+typedef struct {
+    int line;
+    char *op;
+    char *cover;
+    char *input;
+    char *output;
+    char *password;
+    char *suite;
+
+    int status;          // 0 sucesso, -1 erro
+    const char *error;   // motivo quando o erro é de validação ou de prazo
+    double elapsed_ms;
+    uint64_t timeout_ms; // prazo do job (0 = sem prazo)
+} BatchJob;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Lê uma string JSON (com escapes simples) a partir de *p.
+ * @return A string alocada, ou NULL se a sintaxe for inválida.
+ */
+static char *json_parse_string(const char **p) {
+    const char *s = *p;
+    if (*s != '"') {
+        return NULL;
+    }
+    s++;
+
+    char *out = malloc(strlen(s) + 1);
+    if (!out) {
+        return NULL;
+    }
+    size_t n = 0;
+    while (*s && *s != '"') {
+        if (*s == '\\') {
+            s++;
+            switch (*s) {
+            case 'n': out[n++] = '\n'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'r': out[n++] = '\r'; break;
+            case '"': case '\\': case '/': out[n++] = *s; break;
+            default:
+                free(out);
+                return NULL;
+            }
+            s++;
+        } else {
+            out[n++] = *s++;
+        }
+    }
+    if (*s != '"') {
+        free(out);
+        return NULL;
+    }
+    out[n] = '\0';
+    *p = s + 1;
+    return out;
+}
+
+static void skip_spaces(const char **p) {
+    while (**p == ' ' || **p == '\t' || **p == '\r' || **p == '\n') {
+        (*p)++;
+    }
+}
+
+/**
+ * @brief Associa um campo do manifesto ao job. Chaves desconhecidas são ignoradas.
+ */
+static void job_set_field(BatchJob *job, const char *key, char *value) {
+    char **slot = NULL;
+    if (strcmp(key, "op") == 0) slot = &job->op;
+    else if (strcmp(key, "cover") == 0 || strcmp(key, "image") == 0) slot = &job->cover;
+    else if (strcmp(key, "input") == 0) slot = &job->input;
+    else if (strcmp(key, "output") == 0) slot = &job->output;
+    else if (strcmp(key, "password") == 0) slot = &job->password;
+    else if (strcmp(key, "suite") == 0) slot = &job->suite;
+
+    if (slot) {
+        free(*slot);
+        *slot = value;
+    } else {
+        free(value);
+    }
+}
+
+/**
+ * @brief Interpreta uma linha JSONL: um objeto plano com valores string.
+ */
+static int parse_jsonl(const char *line, BatchJob *job) {
+    const char *p = line;
+    skip_spaces(&p);
+    if (*p++ != '{') {
+        return -1;
+    }
+    skip_spaces(&p);
+    if (*p == '}') {
+        return 0;
+    }
+    for (;;) {
+        skip_spaces(&p);
+        char *key = json_parse_string(&p);
+        if (!key) {
+            return -1;
+        }
+        skip_spaces(&p);
+        if (*p++ != ':') {
+            free(key);
+            return -1;
+        }
+        skip_spaces(&p);
+        char *value = json_parse_string(&p);
+        if (!value) {
+            free(key);
+            return -1;
+        }
+        job_set_field(job, key, value);
+        free(key);
+        skip_spaces(&p);
+        if (*p == ',') {
+            p++;
+            continue;
+        }
+        return *p == '}' ? 0 : -1;
+    }
+}
+
+/**
+ * @brief Interpreta uma linha TSV: operação seguida dos argumentos na ordem da linha de comando.
+ *        Cada tab separa um campo (dois tabs seguidos são um campo vazio), e a
+ *        quantidade de campos tem que ser a da operação.
+ */
+static int parse_tsv(char *line, BatchJob *job) {
+    char *fields[6];
+    int n = 0;
+    char *rest = line;
+    while (rest) {
+        if (n == 6) {
+            return -1;
+        }
+        fields[n++] = strsep(&rest, "\t");
+    }
+
+    const char *op = fields[0];
+    static const char *hide_fields[] = { "cover", "input", "output" };
+    static const char *extract_fields[] = { "cover", "output" };
+    static const char *full_fields[] = { "cover", "input", "output", "password", "suite" };
+    static const char *recover_fields[] = { "cover", "output", "password" };
+    static const char *file_fields[] = { "input", "output" };
+    const char **names;
+    int n_names;
+
+    if (strcmp(op, "hide") == 0) { names = hide_fields; n_names = 3; }
+    else if (strcmp(op, "extract") == 0) { names = extract_fields; n_names = 2; }
+    else if (strcmp(op, "full") == 0) { names = full_fields; n_names = 5; }
+    else if (strcmp(op, "recover") == 0) { names = recover_fields; n_names = 3; }
+    else if (strcmp(op, "compress") == 0 || strcmp(op, "decompress") == 0) {
+        names = file_fields; n_names = 2;
+    } else {
+        names = NULL; n_names = 0;
+    }
+
+    // A suíte do full é opcional; uma operação desconhecida é recusada ao rodar o job.
+    int n_args = n - 1;
+    if (names && n_args != n_names && !(names == full_fields && n_args == n_names - 1)) {
+        return -1;
+    }
+
+    job->op = strdup(op);
+    for (int i = 1; i < n && i - 1 < n_names; i++) {
+        // Suíte vazia é a padrão.
+        if (names[i - 1] == full_fields[4] && fields[i][0] == '\0') {
+            continue;
+        }
+        job_set_field(job, names[i - 1], strdup(fields[i]));
+    }
+    return 0;
+}
+
+static void job_free(BatchJob *job) {
+    free(job->op);
+    free(job->cover);
+    free(job->input);
+    free(job->output);
+    if (job->password) {
+        memset(job->password, 0, strlen(job->password));
+        free(job->password);
+    }
+    free(job->suite);
+}
+
+/**
+ * @brief Executa um job (chamado pelos workers do pool).
+ */
+static void run_job(void *arg) {
+    BatchJob *job = arg;
+    double start = now_ms();
+    const char *op = job->op ? job->op : "";
+
+    // Com prazo, as operações conferem o contexto a cada bloco e param ao esgotá-lo.
+    OpContext ctx;
+    OpContext *previous = NULL;
+    if (job->timeout_ms) {
+        op_context_init(&ctx, NULL, NULL);
+        op_context_set_timeout(&ctx, job->timeout_ms);
+        previous = op_context_enter(&ctx);
+    }
+
+    job->status = -1;
+    if (strcmp(op, "hide") == 0) {
+        if (job->cover && job->input && job->output) {
+            job->status = steg_hide_file(job->cover, job->input, job->output);
+        } else {
+            job->error = "campos obrigatórios: cover, input, output";
+        }
+    } else if (strcmp(op, "extract") == 0) {
+        if (job->cover && job->output) {
+            job->status = steg_extract_file(job->cover, job->output);
+        } else {
+            job->error = "campos obrigatórios: cover, output";
+        }
+    } else if (strcmp(op, "full") == 0) {
+        CryptSuite suite = CRYPT_SUITE_XCHACHA20;
+        if (!job->cover || !job->input || !job->output || !job->password) {
+            job->error = "campos obrigatórios: cover, input, output, password";
+        } else if (job->suite && crypt_suite_parse(job->suite, &suite) != 0) {
+            job->error = "suite inválida";
+        } else {
+            job->status = pipeline_full(job->cover, job->input, job->output,
+                                        (const unsigned char *)job->password,
+                                        strlen(job->password), suite, NULL);
+        }
+    } else if (strcmp(op, "recover") == 0) {
+        if (job->cover && job->output && job->password) {
+            job->status = pipeline_recover(job->cover, job->output,
+                                           (const unsigned char *)job->password,
+                                           strlen(job->password), NULL);
+        } else {
+            job->error = "campos obrigatórios: cover, output, password";
+        }
+    } else if (strcmp(op, "compress") == 0) {
+        if (job->input && job->output) {
+            job->status = compress_file(job->input, job->output);
+        } else {
+            job->error = "campos obrigatórios: input, output";
+        }
+    } else if (strcmp(op, "decompress") == 0) {
+        if (job->input && job->output) {
+            job->status = decompress_file(job->input, job->output);
+        } else {
+            job->error = "campos obrigatórios: input, output";
+        }
+    } else {
+        job->error = "operação desconhecida";
+    }
+
+    if (job->timeout_ms) {
+        if (job->status != 0 && op_context_cancelled(&ctx)) {
+            job->error = "prazo esgotado";
+        }
+        op_context_leave(previous);
+    }
+    job->elapsed_ms = now_ms() - start;
+}
+
+/**
+ * @brief Escreve uma string com os escapes exigidos pelo JSON.
+ */
+static void json_write_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; s && *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/**
+ * @brief Lê o manifesto inteiro para um vetor de jobs.
+ * @return 0 em sucesso, -1 em erro (mensagem já impressa).
+ */
+static int load_manifest(const char *manifest_path, BatchJob **jobs_out, size_t *n_out) {
+    FILE *f = stdstream_open_read(manifest_path);
+    if (!f) {
+        perror("Erro ao abrir manifesto");
+        return -1;
+    }
+
+    char line[BATCH_LINE_MAX];
+    BatchJob *jobs = NULL;
+    size_t n = 0, capacity = 0;
+    int line_no = 0;
+
+    while (fgets(line, sizeof line, f)) {
+        line_no++;
+        // Sem '\n' antes do fim do arquivo, a linha não coube no buffer.
+        if (!strchr(line, '\n') && !feof(f)) {
+            fprintf(stderr, "Erro: linha %d do manifesto passa de %d bytes\n", line_no,
+                    BATCH_LINE_MAX - 2);
+            goto fail;
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        const char *p = line;
+        skip_spaces(&p);
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (n == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            BatchJob *grown = realloc(jobs, capacity * sizeof(BatchJob));
+            if (!grown) {
+                perror("Erro ao alocar memória");
+                goto fail;
+            }
+            jobs = grown;
+        }
+
+        BatchJob *job = &jobs[n];
+        memset(job, 0, sizeof *job);
+        job->line = line_no;
+        int ok = (*p == '{') ? parse_jsonl(p, job) : parse_tsv(line, job);
+        n++;
+        if (ok != 0) {
+            fprintf(stderr, "Erro: linha %d do manifesto inválida\n", line_no);
+            goto fail;
+        }
+    }
+    stdstream_close_read(f);
+
+    *jobs_out = jobs;
+    *n_out = n;
+    return 0;
+
+fail:
+    stdstream_close_read(f);
+    for (size_t i = 0; i < n; i++) {
+        job_free(&jobs[i]);
+    }
+    free(jobs);
+    return -1;
+}
+
+/**
+ * @brief Carrega no cache, com as leituras em voo juntas, as capas dos jobs que as usam.
+ *        (extract lê a imagem inteira por conta própria, sem passar pelo cache.)
+ *
+ * @return Quantidade de capas carregadas.
+ */
+static size_t preload_covers(const BatchJob *jobs, size_t n_jobs, int direct) {
+    const char **paths = malloc(sizeof(char *) * (n_jobs ? n_jobs : 1));
+    if (!paths) {
+        return 0;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < n_jobs; i++) {
+        if (jobs[i].cover && jobs[i].op && strcmp(jobs[i].op, "extract") != 0) {
+            paths[n++] = jobs[i].cover;
+        }
+    }
+    size_t loaded = steg_cover_cache_preload(paths, n, direct);
+    free(paths);
+    return loaded;
+}
+
+int batch_run(const char *manifest_path, const BatchOptions *opts) {
+    BatchJob *jobs = NULL;
+    size_t n_jobs = 0;
+    size_t failures = 0;
+
+    if (load_manifest(manifest_path, &jobs, &n_jobs) != 0) {
+        return -1;
+    }
+
+    // Na saída padrão, as mensagens dos jobs passam para o stderr e não se misturam ao JSONL.
+    const char *results_path = opts->results_path ? opts->results_path : "-";
+    FILE *results = stdstream_open_write(results_path, 0);
+    if (!results) {
+        perror("Erro ao criar arquivo de resultados");
+        for (size_t i = 0; i < n_jobs; i++) {
+            job_free(&jobs[i]);
+        }
+        free(jobs);
+        return -1;
+    }
+
+    if (opts->result_cache_dir &&
+        result_cache_open(opts->result_cache_dir, opts->result_cache_bytes) != 0) {
+        stdstream_close_write(results, results_path, 1);
+        for (size_t i = 0; i < n_jobs; i++) {
+            job_free(&jobs[i]);
+        }
+        free(jobs);
+        return -1;
+    }
+    crypt_set_kdf_memory_budget(opts->kdf_memory_budget);
+    steg_cover_cache_set_budget(opts->cover_cache_bytes);
+    buf_pool_set_limit(opts->buffer_pool_bytes);
+    io_set_depth(opts->io_depth);
+
+    ThreadPool *pool = pool_create(opts->workers);
+    if (!pool) {
+        result_cache_close();
+        stdstream_close_write(results, results_path, 1);
+        for (size_t i = 0; i < n_jobs; i++) {
+            job_free(&jobs[i]);
+        }
+        free(jobs);
+        return -1;
+    }
+
+    double start = now_ms();
+    const char *io_backend = io_backend_name();
+    if (opts->io_depth > 0 && opts->cover_cache_bytes > 0) {
+        preload_covers(jobs, n_jobs, opts->direct_io);
+    }
+    for (size_t i = 0; i < n_jobs; i++) {
+        jobs[i].timeout_ms = opts->job_timeout_ms;
+        if (pool_submit(pool, run_job, &jobs[i]) != 0) {
+            // Sem memória para enfileirar: executa nesta thread.
+            run_job(&jobs[i]);
+        }
+    }
+    pool_wait(pool);
+    double elapsed = now_ms() - start;
+    int workers = pool_size(pool);
+    pool_destroy(pool);
+    io_set_depth(0);
+    crypt_set_kdf_memory_budget(0);
+    StegCoverCacheStats cache;
+    steg_cover_cache_get_stats(&cache);
+    steg_cover_cache_set_budget(0);
+    BufPoolStats pool_stats;
+    buf_pool_get_stats(&pool_stats);
+    buf_pool_set_limit(0);
+    ResultCacheStats results_cache;
+    result_cache_get_stats(&results_cache, NULL);
+    result_cache_close();
+
+    // Resultados na ordem do manifesto.
+    for (size_t i = 0; i < n_jobs; i++) {
+        BatchJob *job = &jobs[i];
+        fprintf(results, "{\"line\":%d,\"op\":", job->line);
+        json_write_string(results, job->op);
+        fprintf(results, ",\"output\":");
+        json_write_string(results, job->output);
+        fprintf(results, ",\"status\":\"%s\",\"ms\":%.3f", job->status == 0 ? "ok" : "erro",
+                job->elapsed_ms);
+        if (job->error) {
+            fprintf(results, ",\"error\":");
+            json_write_string(results, job->error);
+        }
+        fprintf(results, "}\n");
+        if (job->status != 0) {
+            failures++;
+        }
+        job_free(job);
+    }
+    free(jobs);
+    stdstream_close_write(results, results_path, 0);
+
+    fprintf(stderr, "Batch: %zu jobs, %zu ok, %zu com erro, %d workers, %.1f ms\n",
+            n_jobs, n_jobs - failures, failures, workers, elapsed);
+    if (opts->cover_cache_bytes > 0) {
+        fprintf(stderr, "Cache de capas: %lu acertos, %lu faltas, %lu descartes, %lu pré-carregadas\n",
+                cache.hits, cache.misses, cache.evictions, cache.preloaded);
+    }
+    fprintf(stderr, "E/S: %s, até %u requisições em voo por thread%s\n", io_backend,
+            opts->io_depth > 0 ? opts->io_depth : 1, opts->direct_io ? ", O_DIRECT" : "");
+    if (opts->result_cache_dir) {
+        fprintf(stderr, "Cache de resultados: %lu acertos, %lu faltas, %lu descartes "
+                "(%zu entradas, %.1f MB)\n", results_cache.hits, results_cache.misses,
+                results_cache.evictions, results_cache.entries,
+                results_cache.bytes / (1024.0 * 1024.0));
+    }
+    if (opts->buffer_pool_bytes > 0) {
+        fprintf(stderr, "Pool de buffers: %lu reaproveitados, %lu alocados, %lu devolvidos\n",
+                pool_stats.hits, pool_stats.misses, pool_stats.releases);
+    }
+    return failures == 0 ? 0 : -1;
+}
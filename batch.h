@@ -0,0 +1,45 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Opções do modo batch
+ */
+typedef struct {
+    int workers;               // threads do pool (<= 0 usa o número de CPUs)
+    size_t kdf_memory_budget;  // memória total para Argon2 simultâneos (0 = sem limite)
+    size_t cover_cache_bytes;  // memória para capas reutilizadas entre jobs (0 = sem cache)
+    size_t buffer_pool_bytes;  // buffers de trabalho ociosos retidos entre jobs (0 = sem pool)
+    const char *results_path;  // arquivo JSONL de resultados (NULL ou "-" = stdout)
+    const char *result_cache_dir;   // cache de resultados do 'full' em disco (NULL = sem cache)
+    size_t result_cache_bytes;      // tamanho máximo do cache de resultados (0 = sem limite)
+    unsigned io_depth;         // requisições de E/S em voo por thread (0 = pread/pwrite, uma por vez)
+    int direct_io;             // lê capas grandes com O_DIRECT
+    uint64_t job_timeout_ms;   // prazo de cada job; esgotado, o job é cancelado (0 = sem prazo)
+} BatchOptions;
+
+/**
+ * Executa todos os jobs de um manifesto em um pool com roubo de trabalho
+ *
+ * O manifesto tem um job por linha, em TSV (campos na mesma ordem da linha de
+ * comando) ou JSONL (objeto com "op", "cover", "input", "output", "password",
+ * "suite"). Linhas vazias e iniciadas por '#' são ignoradas. Operações aceitas:
+ * hide, extract, full, recover, compress e decompress.
+ *
+ * Com io_depth > 0 e o cache de capas ativo, as capas são carregadas antes dos
+ * jobs com todas as leituras em voo ao mesmo tempo (ver ioring.h).
+ *
+ * Com job_timeout_ms, cada job roda com um contexto de operação (opctx.h) com
+ * esse prazo: esgotado, o job para no próximo bloco, sem deixar saída parcial.
+ *
+ * Ao final é gravado um resultado JSONL por job, na ordem do manifesto.
+ *
+ * @param manifest_path: caminho do manifesto
+ * @param opts: opções de execução
+ * @return: 0 se todos os jobs tiveram sucesso, -1 caso contrário
+ */
+int batch_run(const char *manifest_path, const BatchOptions *opts);
+
+#endif /* BATCH_H */
@@ -0,0 +1,484 @@
+#include "bench.h"
+#include "compactar.h"
+#include "esteg.h"
+#include "crypt_utils.h"
+#include "pipeline.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include "criptografiaSimples.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Senha usada nos estágios que derivam a chave
+#define BENCH_PASSWORD "senha-do-benchmark"
+
+// Chave do estágio xor (tamanho que não divide 64, para testar a chave expandida)
+#define BENCH_XOR_KEY "chave-do-benchmark"
+
+// Largura da capa sintética em pixels (24 bits, linhas sem preenchimento)
+#define BENCH_COVER_WIDTH 1024
+#define BENCH_BMP_HEADER  54
+
+/**
+ * @brief Buffers compartilhados pelos estágios. Cada estágio lê a saída do anterior.
+ */
+typedef struct {
+    CryptSuite suite;
+    const unsigned char *password;
+    size_t password_len;
+
+    unsigned char *payload;
+    size_t payload_size;
+
+    unsigned char *workspace;
+    unsigned char *compressed;
+    size_t compressed_capacity;
+    size_t compressed_size;
+    unsigned char *restored;   // saída de decompress, decrypt e extract
+    size_t restored_size;
+
+    unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+    unsigned char key[CRYPT_KEYBYTES];
+    unsigned char stream_header[CRYPT_STREAM_HEADERBYTES];
+    unsigned char *encrypted;
+    size_t encrypted_size;
+
+    XorKey xor_key;
+
+    unsigned char *cover;
+    size_t cover_size;
+    unsigned char *stego;
+
+    char cover_path[PATH_MAX];
+    char payload_path[PATH_MAX];
+    char stego_path[PATH_MAX];
+    char recovered_path[PATH_MAX];
+} BenchContext;
+
+/**
+ * @brief Um estágio medido: função executada a cada iteração e bytes processados por execução.
+ */
+typedef struct {
+    const char *name;
+    int (*run)(BenchContext *ctx);
+    int (*check)(const BenchContext *ctx);  // confere a saída (NULL = nada a conferir)
+    size_t bytes;   // 0 = operação sem volume de dados (só latência)
+} BenchStage;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Percentil pelo posto mais próximo de amostras já ordenadas.
+ */
+static double percentile(const double *sorted, int n, double p) {
+    int rank = (int)(p * n + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[rank > n ? n - 1 : rank - 1];
+}
+
+static void put_le16(unsigned char *p, unsigned v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+/**
+ * @brief Monta em memória um BMP 24 bits de ruído com pelo menos pixel_bytes bytes de pixels.
+ */
+static unsigned char *make_cover(size_t pixel_bytes, size_t *cover_size) {
+    const size_t row = BENCH_COVER_WIDTH * 3;
+    size_t height = (pixel_bytes + row - 1) / row;
+    if (height == 0 || height > INT32_MAX || row * height > UINT32_MAX - BENCH_BMP_HEADER) {
+        fprintf(stderr, "Erro: carga grande demais para uma capa BMP\n");
+        return NULL;
+    }
+    size_t size = BENCH_BMP_HEADER + row * height;
+    unsigned char *bmp = malloc(size);
+    if (!bmp) {
+        fprintf(stderr, "Erro: sem memória para a capa sintética (%zu bytes)\n", size);
+        return NULL;
+    }
+
+    memset(bmp, 0, BENCH_BMP_HEADER);
+    bmp[0] = 'B';
+    bmp[1] = 'M';
+    put_le32(bmp + 2, (uint32_t)size);
+    put_le32(bmp + 10, BENCH_BMP_HEADER);
+    put_le32(bmp + 14, 40);
+    put_le32(bmp + 18, BENCH_COVER_WIDTH);
+    put_le32(bmp + 22, (uint32_t)height);
+    put_le16(bmp + 26, 1);
+    put_le16(bmp + 28, 24);
+    put_le32(bmp + 34, (uint32_t)(row * height));
+    put_le32(bmp + 38, 2835);
+    put_le32(bmp + 42, 2835);
+
+    unsigned char seed[randombytes_SEEDBYTES] = { 'c', 'a', 'p', 'a' };
+    randombytes_buf_deterministic(bmp + BENCH_BMP_HEADER, size - BENCH_BMP_HEADER, seed);
+    *cover_size = size;
+    return bmp;
+}
+
+/**
+ * @brief Gera a carga: bytes uniformes sobre 2^bits símbolos, sempre com a mesma semente.
+ */
+static void make_payload(unsigned char *buf, size_t size, int bits) {
+    unsigned char seed[randombytes_SEEDBYTES] = { 'c', 'a', 'r', 'g', 'a' };
+    randombytes_buf_deterministic(buf, size, seed);
+    unsigned char mask = (unsigned char)((1u << bits) - 1);
+    for (size_t i = 0; i < size; i++) {
+        buf[i] &= mask;
+    }
+}
+
+static int write_file(const char *path, const unsigned char *data, size_t size) {
+    FILE *fp = fopen(path, "wb");
+    if (!fp) {
+        fprintf(stderr, "Erro: não foi possível criar %s\n", path);
+        return -1;
+    }
+    int failed = fwrite(data, 1, size, fp) != size;
+    failed |= fclose(fp) != 0;
+    if (failed) {
+        fprintf(stderr, "Erro: falha ao gravar %s\n", path);
+    }
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Confere se o arquivo recuperado pelo estágio completo é igual à carga.
+ */
+static int file_matches(const char *path, const unsigned char *data, size_t size) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    unsigned char buf[65536];
+    size_t pos = 0, n;
+    int same = 1;
+    while (same && (n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        same = pos + n <= size && memcmp(buf, data + pos, n) == 0;
+        pos += n;
+    }
+    fclose(fp);
+    return same && pos == size;
+}
+
+static int stage_compress(BenchContext *ctx) {
+    return compress_into(ctx->payload, ctx->payload_size, ctx->compressed,
+                         ctx->compressed_capacity, &ctx->compressed_size,
+                         ctx->workspace, COMPRESS_WORKSPACE_SIZE);
+}
+
+static int stage_decompress(BenchContext *ctx) {
+    return decompress_into(ctx->compressed, ctx->compressed_size, ctx->restored,
+                           ctx->payload_size, &ctx->restored_size,
+                           ctx->workspace, DECOMPRESS_WORKSPACE_SIZE);
+}
+
+static int stage_kdf(BenchContext *ctx) {
+    return crypt_password_key_push(&ctx->suite, ctx->password, ctx->password_len,
+                                   ctx->file_header, ctx->key);
+}
+
+static int stage_encrypt(BenchContext *ctx) {
+    CryptStream cs;
+    if (crypt_stream_init_push(&cs, ctx->suite, ctx->key, ctx->stream_header) != 0) {
+        return -1;
+    }
+    size_t pos = 0, off = 0;
+    do {
+        size_t chunk = ctx->payload_size - off;
+        if (chunk > CRYPT_SEGMENT_SIZE) {
+            chunk = CRYPT_SEGMENT_SIZE;
+        }
+        size_t out_len;
+        if (crypt_stream_push(&cs, ctx->encrypted + pos, &out_len, ctx->payload + off, chunk,
+                              off + chunk == ctx->payload_size) != 0) {
+            return -1;
+        }
+        pos += out_len;
+        off += chunk;
+    } while (off < ctx->payload_size);
+    ctx->encrypted_size = pos;
+    return 0;
+}
+
+static int stage_decrypt(BenchContext *ctx) {
+    CryptStream cs;
+    if (crypt_stream_init_pull(&cs, ctx->suite, ctx->key, ctx->stream_header) != 0) {
+        return -1;
+    }
+    size_t pos = 0, off = 0;
+    int final = 0;
+    while (!final && pos < ctx->encrypted_size) {
+        size_t chunk = ctx->encrypted_size - pos;
+        if (chunk > CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) {
+            chunk = CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES;
+        }
+        size_t out_len;
+        if (crypt_stream_pull(&cs, ctx->restored + off, &out_len, &final,
+                              ctx->encrypted + pos, chunk) != 0) {
+            return -1;
+        }
+        pos += chunk;
+        off += out_len;
+    }
+    ctx->restored_size = off;
+    return final ? 0 : -1;
+}
+
+static int stage_embed(BenchContext *ctx) {
+    return steg_hide_into(ctx->cover, ctx->cover_size, ctx->payload, ctx->payload_size,
+                          ctx->stego, ctx->cover_size);
+}
+
+static int stage_extract(BenchContext *ctx) {
+    return steg_extract_into(ctx->stego, ctx->cover_size, ctx->restored, ctx->payload_size,
+                             &ctx->restored_size);
+}
+
+static int stage_xor(BenchContext *ctx) {
+    xor_apply(&ctx->xor_key, 0, ctx->payload, ctx->restored, ctx->payload_size);
+    ctx->restored_size = ctx->payload_size;
+    return 0;
+}
+
+static int stage_roundtrip(BenchContext *ctx) {
+    if (pipeline_full(ctx->cover_path, ctx->payload_path, ctx->stego_path, ctx->password,
+                      ctx->password_len, ctx->suite, NULL) != 0) {
+        return -1;
+    }
+    return pipeline_recover(ctx->stego_path, ctx->recovered_path, ctx->password,
+                            ctx->password_len, NULL);
+}
+
+/**
+ * @brief Confere se decompress, decrypt ou extract devolveram a carga original.
+ */
+static int check_restored(const BenchContext *ctx) {
+    return ctx->restored_size == ctx->payload_size &&
+           memcmp(ctx->restored, ctx->payload, ctx->payload_size) == 0;
+}
+
+/**
+ * @brief Confere se cada byte de saída do xor é a carga com o byte certo da chave.
+ */
+static int check_xor(const BenchContext *ctx) {
+    const size_t key_len = strlen(BENCH_XOR_KEY);
+    for (size_t i = 0; i < ctx->payload_size; i++) {
+        if ((ctx->restored[i] ^ ctx->payload[i]) != (unsigned char)BENCH_XOR_KEY[i % key_len]) {
+            return 0;
+        }
+    }
+    return ctx->restored_size == ctx->payload_size;
+}
+
+static int check_recovered(const BenchContext *ctx) {
+    return file_matches(ctx->recovered_path, ctx->payload, ctx->payload_size);
+}
+
+/**
+ * @brief Executa um estágio (aquecimento + iterações) e grava sua linha JSONL.
+ */
+static int run_stage(const BenchStage *stage, BenchContext *ctx, const BenchOptions *opts,
+                     double *samples, FILE *results) {
+    // A primeira execução só aquece caches e páginas dos buffers.
+    int failed = stage->run(ctx) != 0 || (stage->check && !stage->check(ctx));
+
+    int rss_reset = metrics_reset_peak_rss() == 0;
+    double total = 0;
+    for (int i = 0; i < opts->iterations && !failed; i++) {
+        double start = now_ns();
+        failed = stage->run(ctx) != 0;
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    long rss = metrics_peak_rss_kb();
+    failed = failed || (stage->check && !stage->check(ctx));
+    if (failed) {
+        fprintf(stderr, "Erro: estágio %s falhou\n", stage->name);
+        fprintf(results, "{\"stage\":\"%s\",\"status\":\"erro\"}\n", stage->name);
+        return -1;
+    }
+
+    int n = opts->iterations;
+    qsort(samples, n, sizeof(double), compare_double);
+    double p50 = percentile(samples, n, 0.50), p99 = percentile(samples, n, 0.99);
+    fprintf(results, "{\"stage\":\"%s\",\"status\":\"ok\",\"suite\":\"%s\",\"bytes\":%zu,"
+            "\"entropy_bits\":%d,\"iterations\":%d,", stage->name,
+            crypt_suite_name(ctx->suite), stage->bytes, opts->entropy_bits, n);
+    if (stage->bytes > 0) {
+        double bytes = (double)stage->bytes * n;
+        fprintf(results, "\"mb_s\":%.2f,\"ns_byte\":%.3f,", bytes / (total / 1e9) / 1e6,
+                total / bytes);
+    } else {
+        fprintf(results, "\"mb_s\":null,\"ns_byte\":null,");
+    }
+    fprintf(results, "\"p50_ms\":%.3f,\"p99_ms\":%.3f,\"peak_rss_kb\":%ld,\"rss_per_stage\":%s",
+            p50 / 1e6, p99 / 1e6, rss, rss_reset ? "true" : "false");
+    if (strcmp(stage->name, "compress") == 0) {
+        fprintf(results, ",\"output_bytes\":%zu", ctx->compressed_size);
+    }
+    fprintf(results, "}\n");
+
+    fprintf(stderr, "  %-10s p50 %9.3f ms  p99 %9.3f ms", stage->name, p50 / 1e6, p99 / 1e6);
+    if (stage->bytes > 0) {
+        fprintf(stderr, "  %9.2f MB/s", (double)stage->bytes * n / (total / 1e9) / 1e6);
+    }
+    fprintf(stderr, "  RSS %ld KB\n", rss);
+    return 0;
+}
+
+/**
+ * @brief Aloca os buffers e grava os arquivos temporários do estágio completo.
+ */
+static int context_init(BenchContext *ctx, const BenchOptions *opts, const char *tmp_dir) {
+    size_t n = opts->payload_bytes;
+    size_t segments = n / CRYPT_SEGMENT_SIZE + 1;
+    ctx->payload_size = n;
+    ctx->compressed_capacity = compress_bound(n);
+    ctx->payload = malloc(n);
+    ctx->restored = malloc(n);
+    ctx->compressed = malloc(ctx->compressed_capacity);
+    ctx->workspace = malloc(COMPRESS_WORKSPACE_SIZE);
+    ctx->encrypted = malloc(n + segments * CRYPT_SEGMENT_ABYTES);
+    if (!ctx->payload || !ctx->restored || !ctx->compressed || !ctx->workspace ||
+        !ctx->encrypted) {
+        fprintf(stderr, "Erro: sem memória para os buffers do benchmark\n");
+        return -1;
+    }
+    make_payload(ctx->payload, n, opts->entropy_bits);
+    if (xor_key_init(&ctx->xor_key, (const unsigned char *)BENCH_XOR_KEY,
+                     strlen(BENCH_XOR_KEY)) != 0) {
+        return -1;
+    }
+
+    // A capa comporta a carga crua (embed) e o fluxo comprimido e criptografado (roundtrip).
+    size_t pipeline_bytes = CRYPT_FILE_HEADERBYTES +
+                            crypt_encrypted_size(ctx->compressed_capacity);
+    ctx->cover = make_cover(steg_embed_span(pipeline_bytes > n ? pipeline_bytes : n),
+                            &ctx->cover_size);
+    if (!ctx->cover) {
+        return -1;
+    }
+    ctx->stego = malloc(ctx->cover_size);
+    if (!ctx->stego) {
+        fprintf(stderr, "Erro: sem memória para os buffers do benchmark\n");
+        return -1;
+    }
+
+    snprintf(ctx->cover_path, sizeof(ctx->cover_path), "%s/capa.bmp", tmp_dir);
+    snprintf(ctx->payload_path, sizeof(ctx->payload_path), "%s/carga.bin", tmp_dir);
+    snprintf(ctx->stego_path, sizeof(ctx->stego_path), "%s/stego.bmp", tmp_dir);
+    snprintf(ctx->recovered_path, sizeof(ctx->recovered_path), "%s/recuperado.bin", tmp_dir);
+    if (write_file(ctx->cover_path, ctx->cover, ctx->cover_size) != 0 ||
+        write_file(ctx->payload_path, ctx->payload, n) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void context_free(BenchContext *ctx) {
+    unlink(ctx->cover_path);
+    unlink(ctx->payload_path);
+    unlink(ctx->stego_path);
+    unlink(ctx->recovered_path);
+    sodium_memzero(ctx->key, sizeof(ctx->key));
+    xor_key_free(&ctx->xor_key);
+    free(ctx->payload);
+    free(ctx->restored);
+    free(ctx->compressed);
+    free(ctx->workspace);
+    free(ctx->encrypted);
+    free(ctx->cover);
+    free(ctx->stego);
+}
+
+int bench_run(const BenchOptions *opts) {
+    if (opts->payload_bytes == 0 || opts->entropy_bits < 0 || opts->entropy_bits > 8 ||
+        opts->iterations <= 0) {
+        fprintf(stderr, "Erro: opções do benchmark inválidas\n");
+        return -1;
+    }
+
+    const char *tmp_base = getenv("TMPDIR");
+    char tmp_dir[PATH_MAX - 32];
+    snprintf(tmp_dir, sizeof(tmp_dir), "%s/stegfs-bench-XXXXXX",
+             tmp_base && *tmp_base ? tmp_base : "/tmp");
+    if (!mkdtemp(tmp_dir)) {
+        fprintf(stderr, "Erro: não foi possível criar o diretório temporário %s\n", tmp_dir);
+        return -1;
+    }
+
+    BenchContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.password = (const unsigned char *)BENCH_PASSWORD;
+    ctx.password_len = strlen(BENCH_PASSWORD);
+
+    double *samples = malloc(sizeof(double) * opts->iterations);
+    FILE *results = NULL;
+    int status = -1;
+    if (crypt_suite_resolve(opts->suite, &ctx.suite) != 0) {
+        fprintf(stderr, "Erro: Suite de cifra indisponível neste processador.\n");
+        goto cleanup;
+    }
+    if (!samples || context_init(&ctx, opts, tmp_dir) != 0) {
+        goto cleanup;
+    }
+    results = stdstream_open_write(opts->results_path ? opts->results_path : "-", 0);
+    if (!results) {
+        goto cleanup;
+    }
+
+    // A ordem importa: decompress usa a saída de compress, encrypt a chave do kdf, etc.
+    const BenchStage stages[] = {
+        { "compress", stage_compress, NULL, ctx.payload_size },
+        { "decompress", stage_decompress, check_restored, ctx.payload_size },
+        { "kdf", stage_kdf, NULL, 0 },
+        { "encrypt", stage_encrypt, NULL, ctx.payload_size },
+        { "decrypt", stage_decrypt, check_restored, ctx.payload_size },
+        { "embed", stage_embed, NULL, ctx.payload_size },
+        { "extract", stage_extract, check_restored, ctx.payload_size },
+        { "xor", stage_xor, check_xor, ctx.payload_size },
+        { "roundtrip", stage_roundtrip, check_recovered, ctx.payload_size },
+    };
+
+    fprintf(stderr, "Benchmark: carga de %zu bytes, %d bits/byte de entropia, %d iterações\n",
+            ctx.payload_size, opts->entropy_bits, opts->iterations);
+    status = 0;
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++) {
+        if (run_stage(&stages[i], &ctx, opts, samples, results) != 0) {
+            status = -1;
+        }
+    }
+    // Os resultados ficam mesmo com um estágio em erro (a linha dele traz o status).
+    if (stdstream_close_write(results, opts->results_path ? opts->results_path : "-", 0) != 0) {
+        status = -1;
+    }
+
+cleanup:
+    context_free(&ctx);
+    rmdir(tmp_dir);
+    free(samples);
+    return status;
+}
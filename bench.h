@@ -0,0 +1,37 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include "crypt_utils.h"
+
+/**
+ * Opções do benchmark embutido
+ */
+typedef struct {
+    size_t payload_bytes;      // tamanho da carga sintética
+    int entropy_bits;          // entropia da carga em bits por byte (0 a 8)
+    int iterations;            // medições por estágio (depois de uma rodada de aquecimento)
+    CryptSuite suite;          // suite de cifra (ou CRYPT_SUITE_AUTO)
+    const char *results_path;  // arquivo JSONL de resultados (NULL ou "-" = stdout)
+} BenchOptions;
+
+/**
+ * Mede cada estágio separadamente com capa e carga sintéticas
+ *
+ * A carga é gerada de forma determinística (mesma semente em toda execução),
+ * com bytes uniformes sobre 2^entropy_bits símbolos, então o resultado de uma
+ * build pode ser comparado com o de outra. A capa é um BMP 24 bits de ruído
+ * com espaço para a carga do estágio completo.
+ *
+ * Estágios: compress, decompress, kdf (Argon2), encrypt, decrypt (segmentos
+ * com a chave já derivada), embed, extract, xor (chave repetida) e roundtrip
+ * (full + recover com arquivos temporários). Cada estágio gera uma linha JSONL com MB/s, ns/byte,
+ * latências p50/p99 e o pico de RSS do processo durante as medições.
+ * A saída de cada estágio é conferida; um resultado errado conta como erro.
+ *
+ * @param opts: opções do benchmark
+ * @return: 0 em sucesso, -1 em erro
+ */
+int bench_run(const BenchOptions *opts);
+
+#endif /* BENCH_H */
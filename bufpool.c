@@ -0,0 +1,297 @@
+#include "bufpool.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <sodium.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Classes de 4 KB (2^12) a 1 GB (2^30); pedidos maiores vão direto para malloc.
+#define BUF_MIN_SHIFT    12
+#define BUF_MAX_SHIFT    30
+#define BUF_CLASSES      (BUF_MAX_SHIFT - BUF_MIN_SHIFT + 1)
+#define BUF_CLASS_DIRECT BUF_CLASSES
+
+// Blocos de cada classe mantidos no cache da thread antes de irem ao depósito global.
+#define BUF_THREAD_SLOTS 4
+
+/**
+ * @brief Cabeçalho escondido antes de cada buffer. Com dois campos de 8 bytes,
+ *        o buffer mantém o alinhamento de 16 bytes devolvido por malloc.
+ */
+typedef struct BufBlock {
+    union {
+        struct BufBlock *next;   // enquanto o bloco está ocioso
+        size_t used;             // enquanto está em uso: bytes pedidos
+    };
+    size_t cls;
+} BufBlock;
+
+typedef struct {
+    BufBlock *head;
+    int count;
+} ThreadSlot;
+
+/**
+ * @brief Cache de uma thread. A trava só disputa com buf_pool_trim, que
+ *        percorre os caches registrados para esvaziá-los.
+ */
+typedef struct ThreadCache {
+    pthread_mutex_t lock;
+    ThreadSlot slots[BUF_CLASSES];
+    struct ThreadCache *next;
+    struct ThreadCache *prev;
+    int registered;
+} ThreadCache;
+
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static BufBlock *depot[BUF_CLASSES];
+static size_t pool_limit = 0;
+static size_t cached_bytes = 0;
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_releases = 0;
+
+// Caches de todas as threads que já guardaram blocos, protegidos por depot_lock.
+static ThreadCache *thread_caches = NULL;
+
+static __thread ThreadCache thread_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static pthread_key_t thread_key;
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+
+static size_t class_size(size_t cls) {
+    return (size_t)1 << (cls + BUF_MIN_SHIFT);
+}
+
+/**
+ * @brief Menor classe em que size cabe, ou BUF_CLASS_DIRECT se nenhuma couber.
+ */
+static size_t class_of(size_t size) {
+    size_t cls = 0;
+    while (cls < BUF_CLASSES && class_size(cls) < size) {
+        cls++;
+    }
+    return cls;
+}
+
+/**
+ * @brief Reserva espaço no limite para reter um bloco ocioso.
+ * @return 1 se coube, 0 se o bloco deve voltar ao sistema.
+ */
+static int reserve_cached(size_t size) {
+    size_t limit = __atomic_load_n(&pool_limit, __ATOMIC_RELAXED);
+    size_t cur = __atomic_load_n(&cached_bytes, __ATOMIC_RELAXED);
+    do {
+        if (size > limit || cur > limit - size) {
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&cached_bytes, &cur, cur + size, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 1;
+}
+
+static void release_block(BufBlock *b) {
+    __atomic_fetch_sub(&cached_bytes, class_size(b->cls), __ATOMIC_RELAXED);
+    free(b);
+}
+
+/**
+ * @brief Ao fim de uma thread, os blocos do cache dela passam para o depósito
+ *        e o cache sai da lista de registrados.
+ */
+static void thread_cache_flush(void *arg) {
+    ThreadCache *tc = arg;
+    pthread_mutex_lock(&depot_lock);
+    if (tc->prev) {
+        tc->prev->next = tc->next;
+    } else {
+        thread_caches = tc->next;
+    }
+    if (tc->next) {
+        tc->next->prev = tc->prev;
+    }
+    pthread_mutex_lock(&tc->lock);
+    for (size_t cls = 0; cls < BUF_CLASSES; cls++) {
+        while (tc->slots[cls].head) {
+            BufBlock *b = tc->slots[cls].head;
+            tc->slots[cls].head = b->next;
+            b->next = depot[cls];
+            depot[cls] = b;
+        }
+        tc->slots[cls].count = 0;
+    }
+    pthread_mutex_unlock(&tc->lock);
+    pthread_mutex_unlock(&depot_lock);
+}
+
+static void thread_key_create(void) {
+    pthread_key_create(&thread_key, thread_cache_flush);
+}
+
+/**
+ * @brief Na primeira vez que a thread guarda um bloco, registra o cache dela na
+ *        lista global e o destrutor que o esvazia quando ela terminar.
+ */
+static void thread_register(void) {
+    ThreadCache *tc = &thread_cache;
+    if (!tc->registered) {
+        pthread_once(&thread_key_once, thread_key_create);
+        pthread_setspecific(thread_key, tc);
+        pthread_mutex_lock(&depot_lock);
+        tc->prev = NULL;
+        tc->next = thread_caches;
+        if (thread_caches) {
+            thread_caches->prev = tc;
+        }
+        thread_caches = tc;
+        pthread_mutex_unlock(&depot_lock);
+        tc->registered = 1;
+    }
+}
+
+void *buf_alloc(size_t size) {
+    size_t cls = class_of(size);
+    BufBlock *b;
+
+    metrics_alloc(size);
+    if (cls == BUF_CLASS_DIRECT) {
+        if (size > SIZE_MAX - sizeof(BufBlock) || !(b = malloc(sizeof(BufBlock) + size))) {
+            return NULL;
+        }
+        b->cls = BUF_CLASS_DIRECT;
+        b->used = size;
+        return b + 1;
+    }
+
+    // Cache da thread primeiro; depois o depósito global.
+    ThreadCache *tc = &thread_cache;
+    pthread_mutex_lock(&tc->lock);
+    ThreadSlot *slot = &tc->slots[cls];
+    b = slot->head;
+    if (b) {
+        slot->head = b->next;
+        slot->count--;
+    }
+    pthread_mutex_unlock(&tc->lock);
+    if (!b) {
+        pthread_mutex_lock(&depot_lock);
+        b = depot[cls];
+        if (b) {
+            depot[cls] = b->next;
+        }
+        pthread_mutex_unlock(&depot_lock);
+    }
+    if (b) {
+        __atomic_fetch_sub(&cached_bytes, class_size(cls), __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stat_hits, 1, __ATOMIC_RELAXED);
+        b->used = size;
+        return b + 1;
+    }
+
+    b = malloc(sizeof(BufBlock) + class_size(cls));
+    if (!b) {
+        return NULL;
+    }
+    __atomic_fetch_add(&stat_misses, 1, __ATOMIC_RELAXED);
+    b->cls = cls;
+    b->used = size;
+    return b + 1;
+}
+
+void *buf_calloc(size_t size) {
+    void *ptr = buf_alloc(size);
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+void buf_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    BufBlock *b = (BufBlock *)ptr - 1;
+    size_t cls = b->cls;
+
+    if (cls == BUF_CLASS_DIRECT || !reserve_cached(class_size(cls))) {
+        if (cls != BUF_CLASS_DIRECT && __atomic_load_n(&pool_limit, __ATOMIC_RELAXED) > 0) {
+            __atomic_fetch_add(&stat_releases, 1, __ATOMIC_RELAXED);
+        }
+        free(b);
+        return;
+    }
+
+    // O bloco vai servir outro job (no daemon, de outro cliente): não pode
+    // levar chaves, texto claro ou mensagens escondidas deste.
+    sodium_memzero(ptr, b->used);
+
+    ThreadCache *tc = &thread_cache;
+    thread_register();
+    pthread_mutex_lock(&tc->lock);
+    ThreadSlot *slot = &tc->slots[cls];
+    if (slot->count < BUF_THREAD_SLOTS) {
+        b->next = slot->head;
+        slot->head = b;
+        slot->count++;
+        pthread_mutex_unlock(&tc->lock);
+        return;
+    }
+    pthread_mutex_unlock(&tc->lock);
+    pthread_mutex_lock(&depot_lock);
+    b->next = depot[cls];
+    depot[cls] = b;
+    pthread_mutex_unlock(&depot_lock);
+}
+
+void buf_pool_trim(void) {
+    pthread_mutex_lock(&depot_lock);
+    for (size_t cls = 0; cls < BUF_CLASSES; cls++) {
+        while (depot[cls]) {
+            BufBlock *b = depot[cls];
+            depot[cls] = b->next;
+            release_block(b);
+        }
+    }
+
+    // Também os caches de todas as threads registradas, não só o da atual.
+    for (ThreadCache *tc = thread_caches; tc; tc = tc->next) {
+        pthread_mutex_lock(&tc->lock);
+        for (size_t cls = 0; cls < BUF_CLASSES; cls++) {
+            while (tc->slots[cls].head) {
+                BufBlock *b = tc->slots[cls].head;
+                tc->slots[cls].head = b->next;
+                release_block(b);
+            }
+            tc->slots[cls].count = 0;
+        }
+        pthread_mutex_unlock(&tc->lock);
+    }
+    pthread_mutex_unlock(&depot_lock);
+}
+
+void buf_pool_set_limit(size_t max_bytes) {
+    __atomic_store_n(&pool_limit, max_bytes, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&cached_bytes, __ATOMIC_RELAXED) > max_bytes) {
+        buf_pool_trim();
+    }
+}
+
+void buf_pool_get_stats(BufPoolStats *stats) {
+    stats->hits = __atomic_load_n(&stat_hits, __ATOMIC_RELAXED);
+    stats->misses = __atomic_load_n(&stat_misses, __ATOMIC_RELAXED);
+    stats->releases = __atomic_load_n(&stat_releases, __ATOMIC_RELAXED);
+    stats->cached_bytes = __atomic_load_n(&cached_bytes, __ATOMIC_RELAXED);
+}
+
+void *buf_zalloc(void *opaque, unsigned int items, unsigned int size) {
+    (void)opaque;
+    if (size && items > SIZE_MAX / size) {
+        return NULL;
+    }
+    return buf_alloc((size_t)items * size);
+}
+
+void buf_zfree(void *opaque, void *ptr) {
+    (void)opaque;
+    buf_free(ptr);
+}
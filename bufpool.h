@@ -0,0 +1,73 @@
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+
+/**
+ * Pool de buffers de trabalho por classe de tamanho
+ *
+ * Os blocos são agrupados em classes de potência de dois (de 4 KB a 1 GB). Ao
+ * serem liberados, voltam primeiro a um cache da própria thread e depois a um
+ * depósito global, e são reaproveitados por alocações da mesma classe, então
+ * jobs repetidos (batch, daemon) não voltam a pedir memória ao sistema.
+ * A memória ociosa retida nunca passa do limite: acima dele, os blocos
+ * liberados voltam ao sistema. Com limite 0 (padrão) o pool só repassa para
+ * malloc/free. Os blocos são zerados ao voltar para o pool, então um job
+ * nunca recebe dados deixados por outro.
+ */
+
+/**
+ * Contadores do pool
+ */
+typedef struct {
+    unsigned long hits;       // alocações atendidas com um bloco reaproveitado
+    unsigned long misses;     // alocações que pediram memória ao sistema
+    unsigned long releases;   // blocos devolvidos ao sistema por falta de espaço no limite
+    size_t cached_bytes;      // memória ociosa retida agora
+} BufPoolStats;
+
+/**
+ * Aloca um buffer de pelo menos size bytes (alinhado como malloc)
+ *
+ * @param size: tamanho desejado
+ * @return: o buffer, ou NULL em erro; deve ser liberado com buf_free
+ */
+void *buf_alloc(size_t size);
+
+/**
+ * Como buf_alloc, mas com os size primeiros bytes zerados
+ */
+void *buf_calloc(size_t size);
+
+/**
+ * Devolve um buffer de buf_alloc ao pool (NULL é ignorado). Pode ser chamado
+ * de uma thread diferente da que alocou.
+ */
+void buf_free(void *ptr);
+
+/**
+ * Define a memória ociosa máxima retida pelo pool; 0 desativa o reaproveitamento
+ *
+ * @param max_bytes: limite em bytes (blocos em uso não contam)
+ */
+void buf_pool_set_limit(size_t max_bytes);
+
+/**
+ * Devolve ao sistema todos os blocos ociosos: os do depósito e os do cache de
+ * cada thread
+ */
+void buf_pool_trim(void);
+
+/**
+ * Lê os contadores do pool
+ */
+void buf_pool_get_stats(BufPoolStats *stats);
+
+/**
+ * Funções no formato de zalloc/zfree da zlib, para que o estado de
+ * deflate/inflate também venha do pool
+ */
+void *buf_zalloc(void *opaque, unsigned int items, unsigned int size);
+void buf_zfree(void *opaque, void *ptr);
+
+#endif /* BUFPOOL_H */
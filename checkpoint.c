@@ -0,0 +1,413 @@
+#include "checkpoint.h"
+#include "bufpool.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include "opctx.h"
+#include <sodium.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Arquivo do registro: magic(4) + versão(1) + reservado(3) + nonce + registro selado
+#define CHECKPOINT_MAGIC     "STCK"
+#define CHECKPOINT_VERSION   1
+#define CHECKPOINT_PREFIX    8
+#define CHECKPOINT_SEALED    (sizeof(CheckpointRecord) + crypto_secretbox_MACBYTES)
+#define CHECKPOINT_FILEBYTES (CHECKPOINT_PREFIX + crypto_secretbox_NONCEBYTES + CHECKPOINT_SEALED)
+
+// Tamanho de um segmento completo no fluxo criptografado
+#define CHECKPOINT_SEGMENT (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES)
+
+// Leituras da entrada ao conferir o trecho já consumido
+#define CHECKPOINT_READ_SIZE 65536
+
+char *checkpoint_path(const char *output_path) {
+    size_t len = strlen(output_path);
+    char *path = malloc(len + sizeof ".ckpt");
+    if (path) {
+        memcpy(path, output_path, len);
+        memcpy(path + len, ".ckpt", sizeof ".ckpt");
+    }
+    return path;
+}
+
+int checkpoint_bind_input(CheckpointRecord *r, FILE *input) {
+    struct stat st;
+    if (fstat(fileno(input), &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Erro: pontos de retomada precisam de um arquivo de entrada comum\n");
+        return -1;
+    }
+    r->input_size = (uint64_t)st.st_size;
+    r->input_ino = (uint64_t)st.st_ino;
+    r->input_mtime_sec = (int64_t)st.st_mtim.tv_sec;
+    r->input_mtime_nsec = (int64_t)st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/**
+ * @brief Além da identidade (tamanho, inode, mtime), relê o trecho consumido e
+ *        compara o adler32, para pegar arquivos reescritos no mesmo lugar.
+ */
+int checkpoint_check_input(const CheckpointRecord *r, FILE *input) {
+    CheckpointRecord now;
+    if (checkpoint_bind_input(&now, input) != 0) {
+        return -1;
+    }
+    if (now.input_size != r->input_size || now.input_ino != r->input_ino ||
+        now.input_mtime_sec != r->input_mtime_sec || now.input_mtime_nsec != r->input_mtime_nsec ||
+        r->input_offset > r->input_size) {
+        fprintf(stderr, "Erro: o arquivo de entrada mudou desde o último ponto de retomada\n");
+        return -1;
+    }
+
+    unsigned char *buf = buf_alloc(CHECKPOINT_READ_SIZE);
+    if (!buf) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    uLong adler = adler32(0L, Z_NULL, 0);
+    uint64_t left = r->input_offset;
+    rewind(input);
+    while (left > 0) {
+        size_t want = left < CHECKPOINT_READ_SIZE ? (size_t)left : CHECKPOINT_READ_SIZE;
+        if (metrics_fread(buf, want, input) != want) {
+            break;
+        }
+        adler = adler32(adler, buf, (uInt)want);
+        left -= want;
+    }
+    buf_free(buf);
+    if (left > 0 || (uint32_t)adler != r->adler) {
+        fprintf(stderr, "Erro: o arquivo de entrada mudou desde o último ponto de retomada\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Subchave dos registros: separada da chave do fluxo, que nunca sai da memória.
+ */
+static void record_key_derive(unsigned char record_key[CRYPT_KEYBYTES],
+                              const unsigned char key[CRYPT_KEYBYTES]) {
+    crypto_kdf_derive_from_key(record_key, CRYPT_KEYBYTES, 1, "stegckpt", key);
+}
+
+int checkpoint_stream_push(CryptStream *cs, CryptSuite suite,
+                           const unsigned char *password, size_t password_len,
+                           unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                           unsigned char record_key[CRYPT_KEYBYTES]) {
+    unsigned char key[CRYPT_KEYBYTES];
+
+    if (crypt_password_key_push(&suite, password, password_len, file_header, key) != 0) {
+        return -1;
+    }
+    int ret = crypt_stream_init_push(cs, suite, key,
+                                     file_header + CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES);
+    record_key_derive(record_key, key);
+    sodium_memzero(key, sizeof key);
+    if (ret != 0) {
+        fprintf(stderr, "Erro: Falha ao inicializar o fluxo de criptografia.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_stream_pull(CryptStream *cs,
+                           const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                           const unsigned char *password, size_t password_len,
+                           unsigned char record_key[CRYPT_KEYBYTES]) {
+    unsigned char key[CRYPT_KEYBYTES];
+    CryptSuite suite;
+
+    if (crypt_password_key_pull(file_header, password, password_len, key, &suite) != 0) {
+        return -1;
+    }
+    int ret = crypt_stream_init_pull(cs, suite, key,
+                                     file_header + CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES);
+    record_key_derive(record_key, key);
+    sodium_memzero(key, sizeof key);
+    if (ret != 0) {
+        fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief push e pull avançam o estado do fluxo da mesma forma, então autenticar
+ *        os segmentos gravados deixa cs pronto para criptografar o próximo.
+ */
+int checkpoint_replay_segment(CryptStream *cs, const unsigned char *segment,
+                              unsigned char *scratch) {
+    size_t plain_len;
+    int final;
+
+    if (crypt_stream_pull(cs, scratch, &plain_len, &final, segment, CHECKPOINT_SEGMENT) != 0) {
+        fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+        return -1;
+    }
+    if (final) {
+        fprintf(stderr, "Erro: a saída já está completa (tag final antes do ponto de retomada)\n");
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_save(const char *path, const CheckpointRecord *r,
+                    const unsigned char record_key[CRYPT_KEYBYTES]) {
+    size_t len = strlen(path);
+    char *tmp = malloc(len + sizeof ".tmp");
+    unsigned char *file = buf_alloc(CHECKPOINT_FILEBYTES);
+    int ret = -1;
+
+    if (!tmp || !file) {
+        perror("Erro ao alocar memória");
+        free(tmp);
+        buf_free(file);
+        return -1;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".tmp", sizeof ".tmp");
+
+    memset(file, 0, CHECKPOINT_PREFIX);
+    memcpy(file, CHECKPOINT_MAGIC, 4);
+    file[4] = CHECKPOINT_VERSION;
+    unsigned char *nonce = file + CHECKPOINT_PREFIX;
+    randombytes_buf(nonce, crypto_secretbox_NONCEBYTES);
+    crypto_secretbox_easy(nonce + crypto_secretbox_NONCEBYTES, (const unsigned char *)r,
+                          sizeof *r, nonce, record_key);
+
+    // O registro anterior só é trocado quando o novo já está inteiro no disco.
+    FILE *fp = fopen(tmp, "wb");
+    if (fp) {
+        int ok = fwrite(file, 1, CHECKPOINT_FILEBYTES, fp) == CHECKPOINT_FILEBYTES &&
+                 fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+        ok &= fclose(fp) == 0;
+        if (ok && rename(tmp, path) == 0) {
+            ret = 0;
+        } else {
+            remove(tmp);
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Erro ao gravar o ponto de retomada '%s'\n", path);
+    }
+    free(tmp);
+    buf_free(file);
+    return ret;
+}
+
+int checkpoint_load(const char *path, CheckpointRecord *r,
+                    const unsigned char record_key[CRYPT_KEYBYTES]) {
+    unsigned char *file = buf_alloc(CHECKPOINT_FILEBYTES + 1);
+    FILE *fp = fopen(path, "rb");
+    int ret = -1;
+
+    if (file && fp && fread(file, 1, CHECKPOINT_FILEBYTES + 1, fp) == CHECKPOINT_FILEBYTES &&
+        memcmp(file, CHECKPOINT_MAGIC, 4) == 0 && file[4] == CHECKPOINT_VERSION) {
+        const unsigned char *nonce = file + CHECKPOINT_PREFIX;
+        if (crypto_secretbox_open_easy((unsigned char *)r, nonce + crypto_secretbox_NONCEBYTES,
+                                       CHECKPOINT_SEALED, nonce, record_key) == 0 &&
+            r->pending_len <= sizeof r->pending) {
+            ret = 0;
+        }
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Erro: ponto de retomada '%s' inválido ou de outra senha\n", path);
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    buf_free(file);
+    return ret;
+}
+
+/**
+ * @brief Retomada do 'encrypt': autentica os segmentos já gravados e corta a
+ *        saída logo depois do último, onde a criptografia continua.
+ */
+static int encrypt_resume(FILE *source_fp, FILE *target_fp, const char *record_path,
+                          CheckpointRecord *r, CryptStream *cs,
+                          const unsigned char *password, size_t password_len,
+                          unsigned char record_key[CRYPT_KEYBYTES],
+                          unsigned char *segment, unsigned char *scratch) {
+    unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+
+    if (fread(file_header, 1, sizeof file_header, target_fp) != sizeof file_header) {
+        fprintf(stderr, "Erro: saída parcial sem cabeçalho; não há o que retomar\n");
+        return -1;
+    }
+    if (checkpoint_stream_pull(cs, file_header, password, password_len, record_key) != 0 ||
+        checkpoint_load(record_path, r, record_key) != 0) {
+        return -1;
+    }
+    if (r->kind != CHECKPOINT_ENCRYPT || r->output_offset < CRYPT_FILE_HEADERBYTES ||
+        (r->output_offset - CRYPT_FILE_HEADERBYTES) % CHECKPOINT_SEGMENT != 0) {
+        fprintf(stderr, "Erro: ponto de retomada de outra operação\n");
+        return -1;
+    }
+    if (checkpoint_check_input(r, source_fp) != 0) {
+        return -1;
+    }
+
+    uint64_t segments = (r->output_offset - CRYPT_FILE_HEADERBYTES) / CHECKPOINT_SEGMENT;
+    for (uint64_t i = 0; i < segments; i++) {
+        if (metrics_fread(segment, CHECKPOINT_SEGMENT, target_fp) != CHECKPOINT_SEGMENT) {
+            fprintf(stderr, "Erro: saída parcial mais curta que o ponto de retomada\n");
+            return -1;
+        }
+        if (checkpoint_replay_segment(cs, segment, scratch) != 0) {
+            return -1;
+        }
+    }
+    if (fflush(target_fp) != 0 || ftruncate(fileno(target_fp), (off_t)r->output_offset) != 0 ||
+        fseeko(target_fp, (off_t)r->output_offset, SEEK_SET) != 0) {
+        perror("Erro ao preparar a saída para a retomada");
+        return -1;
+    }
+    printf("Retomando de %llu de %llu bytes da entrada\n",
+           (unsigned long long)r->input_offset, (unsigned long long)r->input_size);
+    return 0;
+}
+
+/**
+ * @brief Mesmo laço de encrypt_body, gravando um registro a cada intervalo.
+ */
+static int encrypt_checkpointed(FILE *source_fp, FILE *target_fp, const char *record_path,
+                                CheckpointRecord *r, CryptStream *cs, size_t interval,
+                                const unsigned char record_key[CRYPT_KEYBYTES],
+                                unsigned char *buf_in, unsigned char *buf_out, int *saved) {
+    uint64_t next = r->input_offset + interval;
+    uLong adler = r->adler;
+    size_t out_len;
+    size_t in_len;
+    int eof;
+
+    op_total_file(OP_STAGE_ENCRYPT, source_fp);
+    do {
+        in_len = metrics_fread(buf_in, CRYPT_SEGMENT_SIZE, source_fp);
+        if (ferror(source_fp)) {
+            fprintf(stderr, "Erro: Falha ao ler o arquivo fonte.\n");
+            return -1;
+        }
+        eof = feof(source_fp);
+        if (op_step(OP_STAGE_ENCRYPT, in_len) != 0) {
+            return -1;
+        }
+        if (crypt_stream_push(cs, buf_out, &out_len, buf_in, in_len, eof) != 0 ||
+            metrics_fwrite(buf_out, out_len, target_fp) != out_len) {
+            fprintf(stderr, "Erro: Falha ao escrever dados criptografados.\n");
+            return -1;
+        }
+        adler = adler32(adler, buf_in, (uInt)in_len);
+        r->input_offset += in_len;
+        r->output_offset += out_len;
+
+        if (!eof && r->input_offset >= next) {
+            r->adler = (uint32_t)adler;
+            if (fflush(target_fp) != 0 || fdatasync(fileno(target_fp)) != 0 ||
+                checkpoint_save(record_path, r, record_key) != 0) {
+                fprintf(stderr, "Erro: Falha ao gravar o ponto de retomada.\n");
+                return -1;
+            }
+            *saved = 1;
+            next = r->input_offset + interval;
+        }
+    } while (!eof);
+
+    return 0;
+}
+
+int encrypt_file_checkpoint(const char *target_file, const char *source_file,
+                            const unsigned char *password, size_t password_len,
+                            CryptSuite suite, const CheckpointOptions *opt) {
+    unsigned char record_key[CRYPT_KEYBYTES];
+    CryptStream cs;
+    int saved = 0;
+    int ret = 1;
+
+    if (stdstream_is_std(target_file) || stdstream_is_std(source_file)) {
+        fprintf(stderr, "Erro: pontos de retomada não funcionam com '-' (entrada ou saída padrão)\n");
+        return 1;
+    }
+    char *record_path = checkpoint_path(target_file);
+    CheckpointRecord *r = buf_calloc(sizeof(CheckpointRecord));
+    unsigned char *buf_in = buf_alloc(CRYPT_SEGMENT_SIZE);
+    unsigned char *buf_out = buf_alloc(CHECKPOINT_SEGMENT);
+    if (!record_path || !r || !buf_in || !buf_out) {
+        perror("Erro ao alocar memória");
+        goto cleanup_buffers;
+    }
+
+    FILE *source_fp = fopen(source_file, "rb");
+    if (!source_fp) {
+        fprintf(stderr, "Erro: Nao foi possivel abrir o arquivo fonte '%s'\n", source_file);
+        goto cleanup_buffers;
+    }
+    if (checkpoint_bind_input(r, source_fp) != 0) {
+        fclose(source_fp);
+        goto cleanup_buffers;
+    }
+
+    int resuming = opt->resume && access(record_path, F_OK) == 0;
+    if (opt->resume && !resuming) {
+        printf("Nenhum ponto de retomada em '%s'; começando do início\n", record_path);
+    }
+    FILE *target_fp = fopen(target_file, resuming ? "r+b" : "wb");
+    if (!target_fp) {
+        fprintf(stderr, "Erro: Nao foi possivel criar o arquivo destino '%s'\n", target_file);
+        fclose(source_fp);
+        goto cleanup_buffers;
+    }
+
+    if (resuming) {
+        // A saída parcial e o registro continuam no disco mesmo se a retomada falhar.
+        saved = 1;
+        if (encrypt_resume(source_fp, target_fp, record_path, r, &cs, password, password_len,
+                           record_key, buf_out, buf_in) != 0) {
+            goto cleanup;
+        }
+    } else {
+        unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+        r->kind = CHECKPOINT_ENCRYPT;
+        r->adler = (uint32_t)adler32(0L, Z_NULL, 0);
+        if (checkpoint_stream_push(&cs, suite, password, password_len, file_header,
+                                   record_key) != 0) {
+            goto cleanup;
+        }
+        if (fwrite(file_header, 1, sizeof file_header, target_fp) != sizeof file_header) {
+            fprintf(stderr, "Erro: Falha ao escrever o header no arquivo de saida.\n");
+            goto cleanup;
+        }
+        r->output_offset = sizeof file_header;
+    }
+
+    if (encrypt_checkpointed(source_fp, target_fp, record_path, r, &cs, opt->interval,
+                             record_key, buf_in, buf_out, &saved) == 0) {
+        ret = 0;
+    }
+
+cleanup:
+    sodium_memzero(&cs, sizeof cs);
+    sodium_memzero(record_key, sizeof record_key);
+    fclose(source_fp);
+    if (fclose(target_fp) != 0 && ret == 0) {
+        fprintf(stderr, "Erro: Falha ao escrever dados criptografados.\n");
+        ret = 1;
+    }
+    if (ret == 0) {
+        remove(record_path);
+    } else if (!saved) {
+        // Sem nenhum registro gravado, não há o que retomar: não deixa saída parcial.
+        remove(target_file);
+    }
+
+cleanup_buffers:
+    free(record_path);
+    buf_free(r);
+    buf_free(buf_in);
+    buf_free(buf_out);
+    return ret;
+}
@@ -0,0 +1,145 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "crypt_utils.h"
+
+/**
+ * Pontos de retomada para as operações longas ('encrypt' e 'full')
+ *
+ * A cada intervalo de entrada, a operação grava em <saída>.ckpt até onde
+ * chegou: bytes consumidos da entrada, bytes do fluxo criptografado já
+ * gravados, adler32 da entrada consumida e, no 'full', os bytes comprimidos do
+ * segmento que ainda não foi fechado. A saída vai para o disco antes do
+ * registro, então ele nunca aponta além do que foi gravado.
+ *
+ * O estado da cifra não é guardado. Na retomada, a chave é derivada de novo da
+ * senha e do cabeçalho já gravado, e cada segmento gravado é autenticado outra
+ * vez: isso confere o início da saída e deixa o fluxo exatamente no estado em
+ * que estava. O registro é selado com uma subchave da chave do fluxo.
+ */
+
+/**
+ * Intervalo padrão entre registros quando só --resume é informado
+ */
+#define CHECKPOINT_DEFAULT_INTERVAL ((size_t)64 * 1024 * 1024)
+
+/**
+ * Operação que gravou o registro
+ */
+typedef enum {
+    CHECKPOINT_ENCRYPT = 1,
+    CHECKPOINT_FULL    = 2
+} CheckpointKind;
+
+/**
+ * Opções de uma execução com pontos de retomada
+ */
+typedef struct {
+    size_t interval;   // bytes de entrada entre dois registros (0 = desativado)
+    int resume;        // 1 para continuar do registro existente (sem registro, começa do zero)
+} CheckpointOptions;
+
+/**
+ * Conteúdo de um registro
+ */
+typedef struct {
+    uint32_t kind;              // CheckpointKind
+    uint32_t pending_len;       // bytes válidos em pending
+    uint64_t input_size;        // identidade da entrada: a retomada recusa outro arquivo
+    uint64_t input_ino;
+    int64_t input_mtime_sec;
+    int64_t input_mtime_nsec;
+    uint64_t input_offset;      // bytes da entrada já consumidos
+    uint64_t output_offset;     // bytes do fluxo criptografado gravados (cabeçalho + segmentos)
+    uint32_t adler;             // adler32 de entrada[0, input_offset)
+    uint32_t reserved;
+    unsigned char pending[CRYPT_SEGMENT_SIZE];  // início do segmento aberto ('full')
+} CheckpointRecord;
+
+/**
+ * Caminho do registro de uma saída ("<saída>.ckpt", liberar com free)
+ */
+char *checkpoint_path(const char *output_path);
+
+/**
+ * Preenche a identidade da entrada no registro
+ *
+ * @return: 0 em sucesso, -1 se a entrada não é um arquivo comum
+ */
+int checkpoint_bind_input(CheckpointRecord *r, FILE *input);
+
+/**
+ * Confere que a entrada é a mesma do registro e que o trecho já consumido não
+ * mudou (adler32); em sucesso, a entrada fica posicionada em input_offset
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int checkpoint_check_input(const CheckpointRecord *r, FILE *input);
+
+/**
+ * Inicia o fluxo de uma execução nova (como crypt_password_init_push)
+ *
+ * @param record_key: recebe a chave que sela os registros
+ * @return: 0 em sucesso, -1 em erro
+ */
+int checkpoint_stream_push(CryptStream *cs, CryptSuite suite,
+                           const unsigned char *password, size_t password_len,
+                           unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                           unsigned char record_key[CRYPT_KEYBYTES]);
+
+/**
+ * Inicia a retomada a partir do cabeçalho já gravado na saída
+ *
+ * Em seguida, cada segmento gravado deve passar por checkpoint_replay_segment;
+ * depois do último, cs continua criptografando do ponto em que parou.
+ *
+ * @param record_key: recebe a chave que abre os registros
+ * @return: 0 em sucesso, -1 em erro (senha incorreta aparece no primeiro segmento)
+ */
+int checkpoint_stream_pull(CryptStream *cs,
+                           const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                           const unsigned char *password, size_t password_len,
+                           unsigned char record_key[CRYPT_KEYBYTES]);
+
+/**
+ * Autentica um segmento já gravado, avançando o fluxo
+ *
+ * @param segment: CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES bytes
+ * @param scratch: CRYPT_SEGMENT_SIZE bytes para o texto claro (descartado)
+ * @return: 0 em sucesso, -1 se o segmento não confere
+ */
+int checkpoint_replay_segment(CryptStream *cs, const unsigned char *segment,
+                              unsigned char *scratch);
+
+/**
+ * Grava o registro de forma atômica (temporário + fsync + rename)
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int checkpoint_save(const char *path, const CheckpointRecord *r,
+                    const unsigned char record_key[CRYPT_KEYBYTES]);
+
+/**
+ * Lê e abre um registro
+ *
+ * @return: 0 em sucesso, -1 em erro (registro danificado ou de outra senha)
+ */
+int checkpoint_load(const char *path, CheckpointRecord *r,
+                    const unsigned char record_key[CRYPT_KEYBYTES]);
+
+/**
+ * encrypt_file_suite com pontos de retomada
+ *
+ * Entrada e saída precisam ser arquivos comuns. Em erro depois do primeiro
+ * registro, a saída parcial e o registro ficam no disco para a retomada.
+ *
+ * @return: 0 em sucesso, 1 em erro (como encrypt_file_suite)
+ */
+int encrypt_file_checkpoint(const char *target_file, const char *source_file,
+                            const unsigned char *password, size_t password_len,
+                            CryptSuite suite, const CheckpointOptions *opt);
+
+#endif /* CHECKPOINT_H */
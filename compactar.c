@@ -1,6 +1,14 @@
 #include "compactar.h"
+#include "bufpool.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include "opctx.h"
+#include "outmap.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
 #include <zlib.h>
 
 /**
@@ -14,22 +22,19 @@ int compress_data(const unsigned char *input, size_t input_size,
 
     // A função compressBound da zlib nos dá o tamanho máximo que os dados comprimidos podem ocupar no pior caso.
     // Isso garante que nosso buffer de saída seja grande o suficiente.
-    unsigned long max_size = compressBound(input_size);
+    size_t max_size = compress_bound(input_size);
     
-    // Aloca memória para o buffer que receberá os dados comprimidos.
+    // Aloca memória para o buffer que receberá os dados comprimidos (pertence ao chamador).
     *output = (unsigned char *)malloc(max_size);
     if (!*output) {
         fprintf(stderr, "Erro ao alocar memória para compressão\n");
         return -1;
     }
+    metrics_alloc(max_size);
 
-    // Comprime
-    unsigned long compressed_size = max_size;
-    int ret = compress2(*output, &compressed_size, input, input_size, 
-                        Z_DEFAULT_COMPRESSION);
-    
-    if (ret != Z_OK) {
-        fprintf(stderr, "Erro na compressão: %d\n", ret);
+    // Comprime; o estado interno da zlib vem do pool de buffers
+    size_t compressed_size;
+    if (compress_into(input, input_size, *output, max_size, &compressed_size, NULL, 0) != 0) {
         free(*output);
         *output = NULL;
         return -1;
@@ -56,8 +61,10 @@ int decompress_data(const unsigned char *input, size_t input_size,
         fprintf(stderr, "Erro ao alocar memória para descompressão\n");
         return -1;
     }
+    metrics_alloc(buffer_size);
 
     // Tenta descomprimir os dados. A função `uncompress` da zlib faz o trabalho.
+    uint64_t t = metrics_start();
     int ret = uncompress(*output, &buffer_size, input, input_size);
     
     // Se `uncompress` retornar `Z_BUF_ERROR`, significa que nosso buffer de saída não era grande o suficiente.
@@ -72,8 +79,10 @@ int decompress_data(const unsigned char *input, size_t input_size,
             return -1;
         }
         *output = new_buffer;
+        metrics_alloc(buffer_size);
         ret = uncompress(*output, &buffer_size, input, input_size);
     }
+    metrics_stop(METRICS_INFLATE, t, input_size, ret == Z_OK ? buffer_size : 0);
 
     if (ret != Z_OK) {
         fprintf(stderr, "Erro na descompressão: %d\n", ret);
@@ -86,136 +95,395 @@ int decompress_data(const unsigned char *input, size_t input_size,
     return 0;
 }
 
+// Tamanho dos blocos lidos e gravados por compress_stream/decompress_stream
+#define STREAM_CHUNK 65536
+
 /**
- * @brief Função de conveniência para comprimir um arquivo inteiro.
- *        Lê o arquivo, chama `compress_data` e salva o resultado.
+ * @brief Workspace do chamador usado como alocador da zlib.
+ *        Cada alocação avança um ponteiro; nada é devolvido antes do fim da operação.
  */
-int compress_file(const char *input_path, const char *output_path) {
-    FILE *in = fopen(input_path, "rb");
-    if (!in) {
-        perror("Erro ao abrir arquivo de entrada");
+typedef struct {
+    unsigned char *base;
+    size_t size;
+    size_t used;
+} ZWorkspace;
+
+static voidpf workspace_alloc(voidpf opaque, uInt items, uInt size) {
+    ZWorkspace *ws = (ZWorkspace *)opaque;
+    size_t n = ((size_t)items * size + 15) & ~(size_t)15;
+    if (n > ws->size - ws->used) {
+        return Z_NULL;
+    }
+    voidpf p = ws->base + ws->used;
+    ws->used += n;
+    return p;
+}
+
+static void workspace_free(voidpf opaque, voidpf ptr) {
+    (void)opaque;
+    (void)ptr;
+}
+
+/**
+ * @brief Prepara o z_stream para alocar no workspace (ou no pool de buffers, se workspace for NULL).
+ */
+static int workspace_attach(z_stream *zs, ZWorkspace *ws, void *workspace,
+                            size_t workspace_size, size_t needed) {
+    memset(zs, 0, sizeof *zs);
+    if (!workspace) {
+        zs->zalloc = buf_zalloc;
+        zs->zfree = buf_zfree;
+        return 0;
+    }
+    if (workspace_size < needed) {
+        fprintf(stderr, "Erro: workspace da zlib pequeno demais (%zu < %zu bytes)\n",
+                workspace_size, needed);
         return -1;
     }
+    // Alinha o início a 16 bytes; o alinhamento cabe na folga de COMPRESS_WORKSPACE_SIZE
+    uintptr_t addr = (uintptr_t)workspace;
+    size_t skip = (16 - (addr & 15)) & 15;
+    ws->base = (unsigned char *)workspace + skip;
+    ws->size = workspace_size - skip;
+    ws->used = 0;
+    zs->zalloc = workspace_alloc;
+    zs->zfree = workspace_free;
+    zs->opaque = ws;
+    return 0;
+}
 
-    // Lê arquivo
-    fseek(in, 0, SEEK_END);
-    long file_size = ftell(in);
-    fseek(in, 0, SEEK_SET);
+/**
+ * @brief Limite de pior caso da saída de `compress_into`.
+ */
+size_t compress_bound(size_t input_size) {
+    return (size_t)compressBound((uLong)input_size);
+}
 
-    unsigned char *input_data = (unsigned char *)malloc(file_size);
-    if (!input_data) {
-        perror("Erro ao alocar memória");
-        fclose(in);
+/**
+ * @brief Comprime para um buffer do chamador, sem alocação de memória.
+ *        Mesmo formato de `compress_data` (zlib, nível padrão).
+ */
+int compress_into(const unsigned char *input, size_t input_size,
+                  unsigned char *output, size_t output_capacity, size_t *output_size,
+                  void *workspace, size_t workspace_size) {
+    if (!input || !output || !output_size) {
         return -1;
     }
 
-    if (fread(input_data, 1, file_size, in) != (size_t)file_size) {
-        fprintf(stderr, "Erro ao ler arquivo\n");
-        free(input_data);
-        fclose(in);
+    z_stream zs;
+    ZWorkspace ws;
+    if (workspace_attach(&zs, &ws, workspace, workspace_size, COMPRESS_WORKSPACE_SIZE) != 0) {
+        return -1;
+    }
+    int ret = deflateInit(&zs, Z_DEFAULT_COMPRESSION);
+    if (ret != Z_OK) {
+        fprintf(stderr, "Erro na compressão: %d\n", ret);
         return -1;
     }
-    fclose(in);
 
-    // Comprime
-    unsigned char *output_data = NULL;
-    size_t output_size = 0;
-    
-    if (compress_data(input_data, file_size, &output_data, &output_size) != 0) {
-        free(input_data);
+    // avail_in/avail_out são uInt: buffers maiores entram em fatias
+    size_t in_left = input_size, out_left = output_capacity;
+    zs.next_in = (Bytef *)input;
+    zs.next_out = output;
+    do {
+        uInt in_chunk = in_left > UINT_MAX ? UINT_MAX : (uInt)in_left;
+        uInt out_chunk = out_left > UINT_MAX ? UINT_MAX : (uInt)out_left;
+        zs.avail_in = in_chunk;
+        zs.avail_out = out_chunk;
+        uint64_t t = metrics_start();
+        ret = deflate(&zs, in_left == in_chunk ? Z_FINISH : Z_NO_FLUSH);
+        metrics_stop(METRICS_DEFLATE, t, in_chunk - zs.avail_in, out_chunk - zs.avail_out);
+        in_left -= in_chunk - zs.avail_in;
+        out_left -= out_chunk - zs.avail_out;
+    } while (ret == Z_OK && out_left > 0);
+    deflateEnd(&zs);
+
+    if (ret != Z_STREAM_END) {
+        fprintf(stderr, "Erro na compressão: buffer de saída pequeno demais\n");
         return -1;
     }
 
-    // Salva os dados comprimidos (que estão no `output_data`) em um novo arquivo.
-    FILE *out = fopen(output_path, "wb");
-    if (!out) {
-        perror("Erro ao criar arquivo de saída");
-        free(input_data);
-        free(output_data);
+    *output_size = output_capacity - out_left;
+    return 0;
+}
+
+/**
+ * @brief Descomprime para um buffer do chamador, sem alocação de memória.
+ */
+int decompress_into(const unsigned char *input, size_t input_size,
+                    unsigned char *output, size_t output_capacity, size_t *output_size,
+                    void *workspace, size_t workspace_size) {
+    if (!input || !output || !output_size) {
         return -1;
     }
 
-    if (fwrite(output_data, 1, output_size, out) != output_size) {
-        fprintf(stderr, "Erro ao escrever arquivo\n");
-        free(input_data);
-        free(output_data);
-        fclose(out);
+    z_stream zs;
+    ZWorkspace ws;
+    if (workspace_attach(&zs, &ws, workspace, workspace_size, DECOMPRESS_WORKSPACE_SIZE) != 0) {
+        return -1;
+    }
+    int ret = inflateInit(&zs);
+    if (ret != Z_OK) {
+        fprintf(stderr, "Erro na descompressão: %d\n", ret);
         return -1;
     }
 
-    fclose(out);
-    free(input_data);
-    free(output_data);
+    size_t in_left = input_size, out_left = output_capacity;
+    zs.next_in = (Bytef *)input;
+    zs.next_out = output;
+    do {
+        uInt in_chunk = in_left > UINT_MAX ? UINT_MAX : (uInt)in_left;
+        uInt out_chunk = out_left > UINT_MAX ? UINT_MAX : (uInt)out_left;
+        zs.avail_in = in_chunk;
+        zs.avail_out = out_chunk;
+        uint64_t t = metrics_start();
+        ret = inflate(&zs, Z_NO_FLUSH);
+        metrics_stop(METRICS_INFLATE, t, in_chunk - zs.avail_in, out_chunk - zs.avail_out);
+        in_left -= in_chunk - zs.avail_in;
+        out_left -= out_chunk - zs.avail_out;
+    } while (ret == Z_OK && in_left > 0 && out_left > 0);
+    inflateEnd(&zs);
 
-    printf("Arquivo comprimido: %ld -> %zu bytes (%.1f%%)\n", 
-           file_size, output_size, 
-           100.0 - (output_size * 100.0 / file_size));
+    if (ret != Z_STREAM_END) {
+        if (out_left == 0 && (ret == Z_OK || ret == Z_BUF_ERROR)) {
+            fprintf(stderr, "Erro na descompressão: buffer de saída pequeno demais\n");
+        } else {
+            fprintf(stderr, "Erro na descompressão: %d\n", ret == Z_OK ? Z_DATA_ERROR : ret);
+        }
+        return -1;
+    }
 
+    *output_size = output_capacity - out_left;
     return 0;
 }
 
 /**
- * @brief Função de conveniência para descomprimir um arquivo inteiro.
- *        Lê o arquivo comprimido, chama `decompress_data` e salva o resultado.
+ * @brief Comprime de um arquivo aberto para outro, em blocos, sem conhecer o tamanho da entrada.
+ *        A saída é a mesma de `compress_data` (formato zlib, nível padrão).
  */
-int decompress_file(const char *input_path, const char *output_path) {
-    FILE *in = fopen(input_path, "rb");
-    if (!in) {
-        perror("Erro ao abrir arquivo comprimido");
+int compress_stream(FILE *in, FILE *out, size_t *in_bytes, size_t *out_bytes) {
+    unsigned char *in_buf = (unsigned char *)buf_alloc(STREAM_CHUNK);
+    unsigned char *out_buf = (unsigned char *)buf_alloc(STREAM_CHUNK);
+    size_t read_total = 0, written_total = 0;
+    int ret = -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    if (!in_buf || !out_buf || deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a compressão\n");
+        buf_free(in_buf);
+        buf_free(out_buf);
         return -1;
     }
 
-    // Lê arquivo
-    fseek(in, 0, SEEK_END);
-    long file_size = ftell(in);
-    fseek(in, 0, SEEK_SET);
+    op_total_file(OP_STAGE_COMPRESS, in);
+    int flush;
+    do {
+        size_t n = metrics_fread(in_buf, STREAM_CHUNK, in);
+        if (ferror(in)) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            goto cleanup;
+        }
+        if (op_step(OP_STAGE_COMPRESS, n) != 0) {
+            goto cleanup;
+        }
+        read_total += n;
+        flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = in_buf;
+        zs.avail_in = (uInt)n;
+        do {
+            zs.next_out = out_buf;
+            zs.avail_out = STREAM_CHUNK;
+            uint64_t t = metrics_start();
+            uInt avail_in = zs.avail_in;
+            deflate(&zs, flush);
+            metrics_stop(METRICS_DEFLATE, t, avail_in - zs.avail_in, STREAM_CHUNK - zs.avail_out);
+            size_t have = STREAM_CHUNK - zs.avail_out;
+            if (metrics_fwrite(out_buf, have, out) != have) {
+                fprintf(stderr, "Erro ao escrever arquivo\n");
+                goto cleanup;
+            }
+            written_total += have;
+        } while (zs.avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    *in_bytes = read_total;
+    *out_bytes = written_total;
+    ret = 0;
 
-    unsigned char *input_data = (unsigned char *)malloc(file_size);
-    if (!input_data) {
-        perror("Erro ao alocar memória");
-        fclose(in);
+cleanup:
+    deflateEnd(&zs);
+    buf_free(in_buf);
+    buf_free(out_buf);
+    return ret;
+}
+
+/**
+ * @brief Descomprime de um arquivo aberto, em blocos, para outro arquivo ou
+ *        direto em uma saída mapeada (map != NULL, que cresce conforme o
+ *        zlib produz). Falha se o fluxo comprimido estiver truncado ou tiver
+ *        dados extras no fim.
+ */
+static int inflate_stream(FILE *in, FILE *out, OutMap *map,
+                          size_t *in_bytes, size_t *out_bytes) {
+    unsigned char *in_buf = (unsigned char *)buf_alloc(STREAM_CHUNK);
+    unsigned char *out_buf = map ? NULL : (unsigned char *)buf_alloc(STREAM_CHUNK);
+    size_t read_total = 0, written_total = 0;
+    int zret = Z_OK;
+    int ret = -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    if (!in_buf || (!map && !out_buf) || inflateInit(&zs) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a descompressão\n");
+        buf_free(in_buf);
+        buf_free(out_buf);
         return -1;
     }
 
-    if (fread(input_data, 1, file_size, in) != (size_t)file_size) {
-        fprintf(stderr, "Erro ao ler arquivo\n");
-        free(input_data);
-        fclose(in);
-        return -1;
+    op_total_file(OP_STAGE_DECOMPRESS, in);
+    while (zret != Z_STREAM_END) {
+        size_t n = metrics_fread(in_buf, STREAM_CHUNK, in);
+        if (ferror(in)) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            goto cleanup;
+        }
+        if (op_step(OP_STAGE_DECOMPRESS, n) != 0) {
+            goto cleanup;
+        }
+        if (n == 0) {
+            // Entrada acabou antes do fim do fluxo comprimido.
+            fprintf(stderr, "Erro na descompressão: %d\n", Z_BUF_ERROR);
+            goto cleanup;
+        }
+        read_total += n;
+        zs.next_in = in_buf;
+        zs.avail_in = (uInt)n;
+        do {
+            zs.next_out = out_buf;
+            if (map) {
+                unsigned char *base = outmap_reserve(map, written_total + STREAM_CHUNK);
+                if (!base) {
+                    goto cleanup;
+                }
+                zs.next_out = base + written_total;
+            }
+            zs.avail_out = STREAM_CHUNK;
+            uint64_t t = metrics_start();
+            uInt avail_in = zs.avail_in;
+            zret = inflate(&zs, Z_NO_FLUSH);
+            metrics_stop(METRICS_INFLATE, t, avail_in - zs.avail_in, STREAM_CHUNK - zs.avail_out);
+            if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) {
+                fprintf(stderr, "Erro na descompressão: %d\n", zret);
+                goto cleanup;
+            }
+            size_t have = STREAM_CHUNK - zs.avail_out;
+            if (!map && metrics_fwrite(out_buf, have, out) != have) {
+                fprintf(stderr, "Erro ao escrever arquivo\n");
+                goto cleanup;
+            }
+            written_total += have;
+        } while (zs.avail_out == 0 && zret != Z_STREAM_END);
     }
-    fclose(in);
 
-    // Chama a função `decompress_data` para descomprimir o conteúdo do arquivo.
-    unsigned char *output_data = NULL;
-    size_t output_size = 0;
-    
-    if (decompress_data(input_data, file_size, &output_data, &output_size) != 0) {
-        free(input_data);
+    // Nada pode sobrar depois do fim do fluxo.
+    if (zs.avail_in > 0 || fgetc(in) != EOF) {
+        fprintf(stderr, "Erro na descompressão: %d\n", Z_DATA_ERROR);
+        goto cleanup;
+    }
+
+    *in_bytes = read_total;
+    *out_bytes = written_total;
+    ret = 0;
+
+cleanup:
+    inflateEnd(&zs);
+    buf_free(in_buf);
+    buf_free(out_buf);
+    return ret;
+}
+
+int decompress_stream(FILE *in, FILE *out, size_t *in_bytes, size_t *out_bytes) {
+    return inflate_stream(in, out, NULL, in_bytes, out_bytes);
+}
+
+/**
+ * @brief Função de conveniência para comprimir um arquivo inteiro.
+ *        Abre os arquivos ("-" = entrada/saída padrão) e chama `compress_stream`.
+ */
+int compress_file(const char *input_path, const char *output_path) {
+    FILE *in = stdstream_open_read(input_path);
+    if (!in) {
+        perror("Erro ao abrir arquivo de entrada");
         return -1;
     }
 
-    // Salva os dados descomprimidos em um novo arquivo.
-    FILE *out = fopen(output_path, "wb");
+    FILE *out = stdstream_open_write(output_path, 0);
     if (!out) {
         perror("Erro ao criar arquivo de saída");
-        free(input_data);
-        free(output_data);
+        stdstream_close_read(in);
         return -1;
     }
 
-    if (fwrite(output_data, 1, output_size, out) != output_size) {
-        fprintf(stderr, "Erro ao escrever arquivo\n");
-        free(input_data);
-        free(output_data);
-        fclose(out);
+    size_t input_size = 0, output_size = 0;
+    int failed = compress_stream(in, out, &input_size, &output_size) != 0;
+    stdstream_close_read(in);
+    if (stdstream_close_write(out, output_path, failed) != 0) {
         return -1;
     }
 
-    fclose(out);
-    free(input_data);
-    free(output_data);
+    printf("Arquivo comprimido: %zu -> %zu bytes (%.1f%%)\n", 
+           input_size, output_size, 
+           input_size ? 100.0 - (output_size * 100.0 / input_size) : 0.0);
 
-    printf("Arquivo descomprimido: %ld -> %zu bytes\n", file_size, output_size);
+    return 0;
+}
+
+/**
+ * @brief Função de conveniência para descomprimir um arquivo inteiro.
+ *        Abre os arquivos ("-" = entrada/saída padrão) e chama `inflate_stream`.
+ *        Um arquivo de saída comum é descomprimido direto em um mapa (outmap.h)
+ *        e só aparece no lugar depois do fim do fluxo.
+ */
+int decompress_file(const char *input_path, const char *output_path) {
+    FILE *in = stdstream_open_read(input_path);
+    if (!in) {
+        perror("Erro ao abrir arquivo comprimido");
+        return -1;
+    }
+
+    size_t input_size = 0, output_size = 0;
+    if (outmap_supported(output_path)) {
+        // O zlib não guarda o tamanho original: o mapa cresce pelo caminho.
+        OutMap *map = outmap_open(output_path, 0);
+        int failed = !map || inflate_stream(in, NULL, map, &input_size, &output_size) != 0;
+        stdstream_close_read(in);
+        if (failed) {
+            outmap_abort(map);
+            return -1;
+        }
+        if (outmap_commit(map, output_size) != 0) {
+            return -1;
+        }
+    } else {
+        FILE *out = stdstream_open_write(output_path, 0);
+        if (!out) {
+            perror("Erro ao criar arquivo de saída");
+            stdstream_close_read(in);
+            return -1;
+        }
+        int failed = inflate_stream(in, out, NULL, &input_size, &output_size) != 0;
+        stdstream_close_read(in);
+        if (stdstream_close_write(out, output_path, failed) != 0) {
+            return -1;
+        }
+    }
+
+    printf("Arquivo descomprimido: %zu -> %zu bytes\n", input_size, output_size);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,48 +1,118 @@
-#ifndef COMPACTAR_H
-#define COMPACTAR_H
-
-#include <stddef.h>
-
-/**
- * Comprime dados usando zlib
- * 
- * @param input: buffer de entrada
- * @param input_size: tamanho dos dados de entrada
- * @param output: ponteiro para o buffer de saída (será alocado)
- * @param output_size: ponteiro para receber o tamanho dos dados comprimidos
- * @return: 0 em sucesso, -1 em erro
- */
-int compress_data(const unsigned char *input, size_t input_size, 
-                  unsigned char **output, size_t *output_size);
-
-/**
- * Descomprime dados usando zlib
- * 
- * @param input: buffer com dados comprimidos
- * @param input_size: tamanho dos dados comprimidos
- * @param output: ponteiro para o buffer de saída (será alocado)
- * @param output_size: ponteiro para receber o tamanho dos dados descomprimidos
- * @return: 0 em sucesso, -1 em erro
- */
-int decompress_data(const unsigned char *input, size_t input_size,
-                    unsigned char **output, size_t *output_size);
-
-/**
- * Comprime um arquivo
- * 
- * @param input_path: caminho do arquivo original
- * @param output_path: caminho do arquivo comprimido
- * @return: 0 em sucesso, -1 em erro
- */
-int compress_file(const char *input_path, const char *output_path);
-
-/**
- * Descomprime um arquivo
- * 
- * @param input_path: caminho do arquivo comprimido
- * @param output_path: caminho do arquivo descomprimido
- * @return: 0 em sucesso, -1 em erro
- */
-int decompress_file(const char *input_path, const char *output_path);
-
+#ifndef COMPACTAR_H
+#define COMPACTAR_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Comprime dados usando zlib
+ * 
+ * @param input: buffer de entrada
+ * @param input_size: tamanho dos dados de entrada
+ * @param output: ponteiro para o buffer de saída (será alocado)
+ * @param output_size: ponteiro para receber o tamanho dos dados comprimidos
+ * @return: 0 em sucesso, -1 em erro
+ */
+int compress_data(const unsigned char *input, size_t input_size, 
+                  unsigned char **output, size_t *output_size);
+
+/**
+ * Descomprime dados usando zlib
+ * 
+ * @param input: buffer com dados comprimidos
+ * @param input_size: tamanho dos dados comprimidos
+ * @param output: ponteiro para o buffer de saída (será alocado)
+ * @param output_size: ponteiro para receber o tamanho dos dados descomprimidos
+ * @return: 0 em sucesso, -1 em erro
+ */
+int decompress_data(const unsigned char *input, size_t input_size,
+                    unsigned char **output, size_t *output_size);
+
+/**
+ * Workspace mínimo de compress_into e decompress_into (estado da zlib com a
+ * janela padrão de 32 KB, mais folga para alinhamento)
+ */
+#define COMPRESS_WORKSPACE_SIZE   (272 * 1024)
+#define DECOMPRESS_WORKSPACE_SIZE (48 * 1024)
+
+/**
+ * Tamanho máximo da saída de compress_into para input_size bytes
+ *
+ * @param input_size: tamanho dos dados de entrada
+ * @return: limite de pior caso em bytes
+ */
+size_t compress_bound(size_t input_size);
+
+/**
+ * Comprime dados para um buffer do chamador, sem alocar memória
+ *
+ * @param input: buffer de entrada
+ * @param input_size: tamanho dos dados de entrada
+ * @param output: buffer de saída (compress_bound(input_size) sempre basta)
+ * @param output_capacity: tamanho do buffer de saída
+ * @param output_size: ponteiro para receber o tamanho dos dados comprimidos
+ * @param workspace: memória de trabalho da zlib (NULL usa a heap)
+ * @param workspace_size: tamanho do workspace (>= COMPRESS_WORKSPACE_SIZE)
+ * @return: 0 em sucesso, -1 em erro (inclusive saída pequena demais)
+ */
+int compress_into(const unsigned char *input, size_t input_size,
+                  unsigned char *output, size_t output_capacity, size_t *output_size,
+                  void *workspace, size_t workspace_size);
+
+/**
+ * Descomprime dados para um buffer do chamador, sem alocar memória
+ *
+ * @param input: buffer com dados comprimidos
+ * @param input_size: tamanho dos dados comprimidos
+ * @param output: buffer de saída
+ * @param output_capacity: tamanho do buffer de saída
+ * @param output_size: ponteiro para receber o tamanho dos dados descomprimidos
+ * @param workspace: memória de trabalho da zlib (NULL usa a heap)
+ * @param workspace_size: tamanho do workspace (>= DECOMPRESS_WORKSPACE_SIZE)
+ * @return: 0 em sucesso, -1 em erro (inclusive saída pequena demais)
+ */
+int decompress_into(const unsigned char *input, size_t input_size,
+                    unsigned char *output, size_t output_capacity, size_t *output_size,
+                    void *workspace, size_t workspace_size);
+
+/**
+ * Comprime de um arquivo aberto para outro, em blocos (a entrada pode ser um pipe)
+ *
+ * @param in: arquivo de entrada
+ * @param out: arquivo de saída
+ * @param in_bytes: recebe a quantidade de bytes lidos
+ * @param out_bytes: recebe a quantidade de bytes gravados
+ * @return: 0 em sucesso, -1 em erro
+ */
+int compress_stream(FILE *in, FILE *out, size_t *in_bytes, size_t *out_bytes);
+
+/**
+ * Descomprime de um arquivo aberto para outro, em blocos
+ *
+ * @param in: arquivo comprimido
+ * @param out: arquivo de saída
+ * @param in_bytes: recebe a quantidade de bytes lidos
+ * @param out_bytes: recebe a quantidade de bytes gravados
+ * @return: 0 em sucesso, -1 em erro
+ */
+int decompress_stream(FILE *in, FILE *out, size_t *in_bytes, size_t *out_bytes);
+
+/**
+ * Comprime um arquivo ("-" = entrada/saída padrão)
+ * 
+ * @param input_path: caminho do arquivo original
+ * @param output_path: caminho do arquivo comprimido
+ * @return: 0 em sucesso, -1 em erro
+ */
+int compress_file(const char *input_path, const char *output_path);
+
+/**
+ * Descomprime um arquivo ("-" = entrada/saída padrão)
+ * 
+ * @param input_path: caminho do arquivo comprimido
+ * @param output_path: caminho do arquivo descomprimido
+ * @return: 0 em sucesso, -1 em erro
+ */
+int decompress_file(const char *input_path, const char *output_path);
+
 #endif // COMPACTAR_H
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "cover.h"
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t le16(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint32_t le32(const unsigned char *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int fail(int report, const char *message) {
+    if (report) {
+        fprintf(stderr, "%s\n", message);
+    }
+    return -1;
+}
+
+/**
+ * @brief BMP: o offset dos pixels fica no 10º byte do cabeçalho; a área vai
+ *        até o fim do arquivo (as imagens já geradas dependem disso).
+ */
+static int parse_bmp(const unsigned char *head, size_t head_len, uint64_t file_size,
+                     CoverLayout *layout, int report) {
+    if (head_len < 14) {
+        return fail(report, "Erro: arquivo não é BMP válido");
+    }
+    uint32_t pixel_offset = le32(head + 10);
+    if (pixel_offset < 14 || pixel_offset > file_size) {
+        return fail(report, "Erro: arquivo não é BMP válido");
+    }
+    layout->stride = 1;
+    layout->lsb = 0;
+    layout->offset = pixel_offset;
+    layout->length = file_size - pixel_offset;
+    return 0;
+}
+
+/**
+ * @brief WAV: percorre os chunks do RIFF até o "data", conferindo no "fmt "
+ *        que as amostras são PCM inteiras de 8, 16 ou 24 bits.
+ */
+static int parse_wav(const unsigned char *head, size_t head_len, uint64_t file_size,
+                     CoverLayout *layout, int report) {
+    uint32_t format = 0, channels = 0, block_align = 0, bits = 0;
+    int have_fmt = 0;
+    uint64_t pos = 12;
+
+    while (pos + 8 <= head_len) {
+        const unsigned char *chunk = head + pos;
+        uint32_t size = le32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || pos + 8 + 16 > head_len) {
+                break;
+            }
+            format = le16(chunk + 8);
+            channels = le16(chunk + 10);
+            block_align = le16(chunk + 20);
+            bits = le16(chunk + 22);
+            // WAVE_FORMAT_EXTENSIBLE: o formato real está no início do subformato.
+            if (format == 0xFFFE && size >= 40 && pos + 8 + 26 <= head_len) {
+                format = le16(chunk + 32);
+            }
+            have_fmt = 1;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_fmt || format != 1 || (bits != 8 && bits != 16 && bits != 24) ||
+                channels == 0 || block_align != channels * (bits / 8)) {
+                return fail(report, "Erro: só WAV PCM de 8, 16 ou 24 bits é suportado");
+            }
+            layout->stride = bits / 8;
+            layout->lsb = 0;
+            layout->offset = pos + 8;
+            if (layout->offset > file_size) {
+                break;
+            }
+            // Um "data" que diz ir além do arquivo (gravação interrompida) vale até o fim.
+            layout->length = size < file_size - layout->offset ? size : file_size - layout->offset;
+            layout->length -= layout->length % layout->stride;
+            return 0;
+        }
+        pos += 8 + (uint64_t)size + (size & 1);
+    }
+    return fail(report, "Erro: chunk \"data\" do WAV não encontrado nos primeiros 64 KB");
+}
+
+/**
+ * @brief Próximo número do cabeçalho PNM, pulando espaços e comentários.
+ */
+static int pnm_number(const unsigned char *head, size_t head_len, size_t *pos, uint64_t *value) {
+    while (*pos < head_len) {
+        unsigned char c = head[*pos];
+        if (c == '#') {
+            while (*pos < head_len && head[*pos] != '\n') {
+                (*pos)++;
+            }
+        } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f') {
+            (*pos)++;
+        } else {
+            break;
+        }
+    }
+    if (*pos >= head_len || head[*pos] < '0' || head[*pos] > '9') {
+        return -1;
+    }
+    *value = 0;
+    while (*pos < head_len && head[*pos] >= '0' && head[*pos] <= '9') {
+        *value = *value * 10 + (uint64_t)(head[*pos] - '0');
+        if (*value > UINT32_MAX) {
+            return -1;
+        }
+        (*pos)++;
+    }
+    return 0;
+}
+
+/**
+ * @brief PGM (P5) e PPM (P6) binários: largura, altura e maxval em texto, um
+ *        espaço e a matriz. Com maxval > 255 cada amostra tem 2 bytes em big-endian.
+ */
+static int parse_pnm(const unsigned char *head, size_t head_len, uint64_t file_size,
+                     CoverLayout *layout, int report) {
+    uint64_t width, height, maxval;
+    size_t pos = 2;
+    if (pnm_number(head, head_len, &pos, &width) != 0 ||
+        pnm_number(head, head_len, &pos, &height) != 0 ||
+        pnm_number(head, head_len, &pos, &maxval) != 0 ||
+        pos >= head_len || width == 0 || height == 0 || maxval == 0 || maxval > 65535) {
+        return fail(report, "Erro: cabeçalho PGM/PPM inválido");
+    }
+    pos++;   // o único espaço entre o maxval e a matriz
+
+    unsigned channels = layout->format == COVER_FORMAT_PPM ? 3 : 1;
+    layout->stride = maxval > 255 ? 2 : 1;
+    layout->lsb = layout->stride - 1;
+    layout->offset = pos;
+    uint64_t sample_bytes = (uint64_t)channels * layout->stride;
+    if (width > UINT64_MAX / height / sample_bytes) {
+        return fail(report, "Erro: cabeçalho PGM/PPM inválido");
+    }
+    layout->length = width * height * sample_bytes;
+    if (layout->offset > file_size || layout->length > file_size - layout->offset) {
+        return fail(report, "Erro: matriz do PGM/PPM truncada");
+    }
+    return 0;
+}
+
+static int layout_parse(const unsigned char *head, size_t head_len, uint64_t file_size,
+                        CoverLayout *layout, int report) {
+    memset(layout, 0, sizeof *layout);
+    if (head_len >= 2 && head[0] == 'B' && head[1] == 'M') {
+        layout->format = COVER_FORMAT_BMP;
+        return parse_bmp(head, head_len, file_size, layout, report);
+    }
+    if (head_len >= 12 && memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0) {
+        layout->format = COVER_FORMAT_WAV;
+        return parse_wav(head, head_len, file_size, layout, report);
+    }
+    if (head_len >= 2 && head[0] == 'P' && (head[1] == '5' || head[1] == '6')) {
+        layout->format = head[1] == '5' ? COVER_FORMAT_PGM : COVER_FORMAT_PPM;
+        return parse_pnm(head, head_len, file_size, layout, report);
+    }
+    return fail(report, "Erro: formato de capa não reconhecido (use BMP, WAV PCM, PGM ou PPM)");
+}
+
+int cover_layout_parse(const unsigned char *head, size_t head_len, uint64_t file_size,
+                       CoverLayout *layout) {
+    return layout_parse(head, head_len, file_size, layout, 1);
+}
+
+int cover_layout_probe(const unsigned char *head, size_t head_len, uint64_t file_size,
+                       CoverLayout *layout) {
+    return layout_parse(head, head_len, file_size, layout, 0);
+}
+
+const char *cover_format_name(CoverFormat format) {
+    static const char *names[] = { "BMP", "WAV", "PGM", "PPM" };
+    return (unsigned)format < sizeof names / sizeof names[0] ? names[format] : "?";
+}
@@ -0,0 +1,85 @@
+#ifndef COVER_H
+#define COVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Formatos de capa
+ *
+ * O motor de LSB (esteg.c) só enxerga uma área contínua de amostras: um bit
+ * escondido por amostra, no bit menos significativo. Este módulo reconhece o
+ * contêiner pelo início do arquivo e diz onde essa área começa, quantos bytes
+ * ela tem e em que byte de cada amostra fica o LSB:
+ *
+ * - BMP: os pixels, do offset do cabeçalho até o fim do arquivo (1 byte por amostra)
+ * - WAV PCM de 8, 16 ou 24 bits: o chunk "data" (amostras little-endian, o LSB
+ *   fica no primeiro byte); chunks depois dele são copiados sem alteração
+ * - PGM (P5) e PPM (P6) binários: a matriz do primeiro quadro (1 byte por
+ *   amostra, ou 2 em big-endian quando maxval > 255)
+ *
+ * O resto do arquivo (cabeçalhos e chunks de metadados) nunca é alterado, e a
+ * capa é lida e gravada em sequência: capas de vários GB não precisam caber
+ * em memória.
+ */
+
+/**
+ * Bytes do início do arquivo que bastam para reconhecer o formato
+ */
+#define COVER_HEAD_MAX 65536
+
+/**
+ * Maior quantidade de bytes por amostra (WAV de 24 bits)
+ */
+#define COVER_STRIDE_MAX 3
+
+typedef enum {
+    COVER_FORMAT_BMP = 0,
+    COVER_FORMAT_WAV,
+    COVER_FORMAT_PGM,
+    COVER_FORMAT_PPM
+} CoverFormat;
+
+/**
+ * Onde ficam as amostras de uma capa
+ */
+typedef struct {
+    CoverFormat format;
+    unsigned stride;     // bytes por amostra (1 a COVER_STRIDE_MAX)
+    unsigned lsb;        // byte da amostra que guarda o bit menos significativo
+    uint64_t offset;     // início da área de amostras no arquivo
+    uint64_t length;     // bytes da área (múltiplo de stride)
+} CoverLayout;
+
+/**
+ * Reconhece o formato e localiza as amostras
+ *
+ * @param head: início do arquivo
+ * @param head_len: bytes em head (o arquivo inteiro, ou pelo menos
+ *                  COVER_HEAD_MAX bytes quando ele é maior)
+ * @param file_size: tamanho total do arquivo
+ * @param layout: recebe a descrição da área de amostras
+ * @return: 0 em sucesso, -1 em erro (mensagem já escrita)
+ */
+int cover_layout_parse(const unsigned char *head, size_t head_len, uint64_t file_size,
+                       CoverLayout *layout);
+
+/**
+ * Como cover_layout_parse, mas sem mensagem de erro (para quem só testa o arquivo)
+ */
+int cover_layout_probe(const unsigned char *head, size_t head_len, uint64_t file_size,
+                       CoverLayout *layout);
+
+/**
+ * Quantidade de amostras (bits que cabem na capa)
+ */
+static inline uint64_t cover_layout_samples(const CoverLayout *layout) {
+    return layout->length / layout->stride;
+}
+
+/**
+ * Nome legível do formato ("BMP", "WAV", "PGM", "PPM")
+ */
+const char *cover_format_name(CoverFormat format);
+
+#endif /* COVER_H */
@@ -1,58 +1,199 @@
+#include "criptografiaSimples.h"
+#include "bufpool.h"
+#include "stdstream.h"
+#include "metrics.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-void xor_cipher(const char *inputFile, const char *outputFile, char key) {
-    FILE *fin = fopen(inputFile, "rb"); // "rb" = read binary (ler binario)
-    FILE *fout = fopen(outputFile, "wb"); // "wb" = write binary (escrever binario)
+// Bloco de leitura/escrita: grande o bastante para o custo por chamada sumir
+#define XOR_BLOCK (1024 * 1024)
 
-    if (fin == NULL) {
-        perror("Erro ao abrir arquivo de entrada");
-        exit(EXIT_FAILURE);
+// Vetor de 64 bytes: a GCC o divide em registradores do tamanho disponível
+// (um AVX-512, dois AVX2 ou quatro SSE2)
+typedef unsigned char XorLane __attribute__((vector_size(64)));
+
+// Em x86-64, o laço é compilado também para AVX2 e AVX-512 e a versão é
+// escolhida na carga do programa conforme a CPU.
+#if defined(__x86_64__) && defined(__has_attribute)
+#if __has_attribute(target_clones)
+#define XOR_CLONES __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+#ifndef XOR_CLONES
+#define XOR_CLONES
+#endif
+
+int xor_key_init(XorKey *k, const unsigned char *key, size_t key_len) {
+    k->pattern = NULL;
+    k->period = 0;
+    if (!key || key_len == 0 || key_len > XOR_KEY_MAX) {
+        fprintf(stderr, "Erro: a chave deve ter de 1 a %d bytes\n", XOR_KEY_MAX);
+        return -1;
+    }
+
+    // mmc(key_len, 64): o padrão recomeça alinhado com a chave a cada período
+    size_t a = key_len, b = sizeof(XorLane);
+    while (b) {
+        size_t r = a % b;
+        a = b;
+        b = r;
+    }
+    size_t period = key_len / a * sizeof(XorLane);
+
+    // Um vetor a mais no fim: a leitura que começa perto do fim do período não dá a volta
+    k->pattern = (unsigned char *)malloc(period + sizeof(XorLane));
+    if (!k->pattern) {
+        fprintf(stderr, "Erro ao alocar memória para a chave\n");
+        return -1;
+    }
+    for (size_t i = 0; i < period + sizeof(XorLane); i++) {
+        k->pattern[i] = key[i % key_len];
+    }
+    k->period = period;
+    return 0;
+}
+
+void xor_key_free(XorKey *k) {
+    free(k->pattern);
+    k->pattern = NULL;
+    k->period = 0;
+}
+
+/**
+ * @brief XOR de 64 em 64 bytes com a chave expandida; a cauda vai byte a byte.
+ *        As cargas são memcpy para aceitar ponteiros sem alinhamento.
+ */
+XOR_CLONES
+void xor_apply(const XorKey *k, uint64_t offset,
+               const unsigned char *src, unsigned char *dst, size_t len) {
+    const unsigned char *pattern = k->pattern;
+    size_t period = k->period;
+    size_t pos = (size_t)(offset % period);
+    size_t i = 0;
+
+    for (; i + sizeof(XorLane) <= len; i += sizeof(XorLane)) {
+        XorLane d, p;
+        memcpy(&d, src + i, sizeof(d));
+        memcpy(&p, pattern + pos, sizeof(p));
+        d ^= p;
+        memcpy(dst + i, &d, sizeof(d));
+        pos += sizeof(XorLane);
+        if (pos >= period) {
+            pos -= period;
+        }
+    }
+    for (; i < len; i++) {
+        dst[i] = src[i] ^ pattern[pos++];
+    }
+}
+
+/**
+ * @brief Entrada mapeada: o XOR lê direto do page cache e escreve no bloco de saída.
+ *
+ * @return 0 em sucesso, -1 em erro, 1 se a entrada não pode ser mapeada.
+ */
+static int xor_mapped(FILE *in, FILE *out, const XorKey *k, unsigned char *buf, size_t *bytes) {
+    struct stat st;
+    if (fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+        ftello(in) != 0) {
+        return 1;
     }
+    size_t size = (size_t)st.st_size;
+    unsigned char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(in), 0);
+    if (map == MAP_FAILED) {
+        return 1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
 
-    if (fout == NULL) {
-        perror("Erro ao criar arquivo de saida");
-        fclose(fin);
-        exit(EXIT_FAILURE);
+    int ret = 0;
+    for (size_t done = 0; done < size; ) {
+        size_t n = size - done < XOR_BLOCK ? size - done : XOR_BLOCK;
+        xor_apply(k, done, map + done, buf, n);
+        if (metrics_fwrite(buf, n, out) != n) {
+            fprintf(stderr, "Erro ao escrever arquivo\n");
+            ret = -1;
+            break;
+        }
+        done += n;
     }
+    munmap(map, size);
+    *bytes = size;
+    return ret;
+}
 
-    // Le o arquivo de entrada byte a byte
-    int byte;
-    while ((byte = fgetc(fin)) != EOF) {
-        // Aplica a operacao XOR com a chave
-        byte = byte ^ key;
-        
-        // Escreve o byte transformado no arquivo de saida
-        fputc(byte, fout);
+/**
+ * @brief Aplica o XOR de um arquivo aberto para outro.
+ *        Arquivos comuns são mapeados; o resto (pipes, terminais) é lido em blocos.
+ */
+int xor_stream(FILE *in, FILE *out, const XorKey *k, size_t *bytes) {
+    unsigned char *buf = (unsigned char *)buf_alloc(XOR_BLOCK);
+    if (!buf) {
+        fprintf(stderr, "Erro ao alocar memória para o XOR\n");
+        return -1;
     }
 
-    printf("Operacao concluida com sucesso!\n");
-    printf("Entrada: %s\n", inputFile);
-    printf("Saida: %s\n", outputFile);
+    int ret = xor_mapped(in, out, k, buf, bytes);
+    if (ret == 1) {
+        uint64_t total = 0;
+        ret = 0;
+        size_t n;
+        while ((n = metrics_fread(buf, XOR_BLOCK, in)) > 0) {
+            xor_apply(k, total, buf, buf, n);
+            if (metrics_fwrite(buf, n, out) != n) {
+                fprintf(stderr, "Erro ao escrever arquivo\n");
+                ret = -1;
+                break;
+            }
+            total += n;
+        }
+        if (ret == 0 && ferror(in)) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            ret = -1;
+        }
+        *bytes = (size_t)total;
+    }
 
-    // Fecha os arquivos
-    fclose(fin);
-    fclose(fout);
+    buf_free(buf);
+    return ret;
 }
 
-int main(int argc, char *argv[]) {
-    // Verifica se o número correto de argumentos foi passado
-    if (argc != 4) {
-        fprintf(stderr, "Uso: %s <arquivo_entrada> <arquivo_saida> <chave>\n", argv[0]);
-        fprintf(stderr, "Exemplo: %s original.txt criptografado.bin S\n", argv[0]);
-        fprintf(stderr, "Nota: A chave deve ser um único caractere.\n");
-        return EXIT_FAILURE;
+/**
+ * @brief Função de conveniência para aplicar o XOR a um arquivo inteiro.
+ *        Abre os arquivos ("-" = entrada/saída padrão) e chama `xor_stream`.
+ */
+int xor_cipher(const char *input_path, const char *output_path,
+               const unsigned char *key, size_t key_len) {
+    XorKey k;
+    if (xor_key_init(&k, key, key_len) != 0) {
+        return -1;
     }
 
-    const char *inputFile = argv[1];
-    const char *outputFile = argv[2];
-    char key = argv[3][0]; // Pega o primeiro caractere da string da chave
+    FILE *in = stdstream_open_read(input_path);
+    if (!in) {
+        perror("Erro ao abrir arquivo de entrada");
+        xor_key_free(&k);
+        return -1;
+    }
 
-    if (argv[3][1] != '\0') {
-        fprintf(stderr, "Aviso: A chave deve ser um único caractere. Usando apenas '%c'.\n", key);
+    FILE *out = stdstream_open_write(output_path, 0);
+    if (!out) {
+        perror("Erro ao criar arquivo de saída");
+        stdstream_close_read(in);
+        xor_key_free(&k);
+        return -1;
     }
 
-    xor_cipher(inputFile, outputFile, key);
+    size_t bytes = 0;
+    int failed = xor_stream(in, out, &k, &bytes) != 0;
+    stdstream_close_read(in);
+    xor_key_free(&k);
+    if (stdstream_close_write(out, output_path, failed) != 0) {
+        return -1;
+    }
 
-    return EXIT_SUCCESS;
+    printf("Arquivo processado: %zu bytes com chave de %zu bytes\n", bytes, key_len);
+    return 0;
 }
@@ -0,0 +1,84 @@
+#ifndef CRIPTOGRAFIA_SIMPLES_H
+#define CRIPTOGRAFIA_SIMPLES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Embaralhamento XOR com chave repetida
+ *
+ * Não é criptografia: serve só como pré-passo barato para esconder padrões
+ * óbvios (texto, cabeçalhos) antes de outros estágios. Aplicar duas vezes com
+ * a mesma chave devolve o original. O byte i da saída é entrada[i] ^
+ * chave[i % tamanho_da_chave], então qualquer trecho do arquivo pode ser
+ * processado sozinho a partir do seu deslocamento.
+ */
+
+/**
+ * Tamanho máximo da chave em bytes
+ */
+#define XOR_KEY_MAX 1024
+
+/**
+ * Chave expandida: a chave repetida até um múltiplo de 64 bytes, para o XOR
+ * andar em vetores inteiros sem dar a volta no meio de um deles
+ */
+typedef struct {
+    unsigned char *pattern;  // period + 64 bytes da chave repetida
+    size_t period;           // mmc(tamanho da chave, 64)
+} XorKey;
+
+/**
+ * Expande uma chave
+ *
+ * @param k: chave expandida (liberar com xor_key_free)
+ * @param key: bytes da chave
+ * @param key_len: tamanho da chave (1 a XOR_KEY_MAX)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int xor_key_init(XorKey *k, const unsigned char *key, size_t key_len);
+
+/**
+ * Libera uma chave expandida (pode ser chamada mais de uma vez)
+ */
+void xor_key_free(XorKey *k);
+
+/**
+ * Aplica o XOR a um trecho de dados
+ *
+ * @param k: chave expandida
+ * @param offset: posição do trecho no fluxo completo (define o alinhamento da chave)
+ * @param src: dados de entrada
+ * @param dst: saída (pode ser o próprio src)
+ * @param len: tamanho do trecho
+ */
+void xor_apply(const XorKey *k, uint64_t offset,
+               const unsigned char *src, unsigned char *dst, size_t len);
+
+/**
+ * Aplica o XOR de um arquivo aberto para outro, em blocos grandes
+ *
+ * Uma entrada que é arquivo comum é mapeada na memória; pipes são lidos em blocos.
+ *
+ * @param in: arquivo de entrada
+ * @param out: arquivo de saída
+ * @param k: chave expandida
+ * @param bytes: recebe o total de bytes processados
+ * @return: 0 em sucesso, -1 em erro
+ */
+int xor_stream(FILE *in, FILE *out, const XorKey *k, size_t *bytes);
+
+/**
+ * Aplica o XOR a um arquivo inteiro ("-" = entrada/saída padrão)
+ *
+ * @param input_path: arquivo de entrada
+ * @param output_path: arquivo de saída
+ * @param key: bytes da chave
+ * @param key_len: tamanho da chave (1 a XOR_KEY_MAX)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int xor_cipher(const char *input_path, const char *output_path,
+               const unsigned char *key, size_t key_len);
+
+#endif /* CRIPTOGRAFIA_SIMPLES_H */
@@ -27,7 +27,6 @@ int main(int argc, char *argv[])
     if (strcmp(mode, "encrypt") == 0) {
         if (encrypt_file(target_file, source_file, password, password_len) != 0) {
             fprintf(stderr, "Falha ao criptografar.\n");
-            remove(target_file); 
             return 1;
         }
         printf("Arquivo '%s' criptografado com sucesso para '%s'.\n", source_file, target_file);
@@ -35,7 +34,6 @@ int main(int argc, char *argv[])
     } else if (strcmp(mode, "decrypt") == 0) {
         if (decrypt_file(target_file, source_file, password, password_len) != 0) {
             fprintf(stderr, "Falha ao descriptografar (senha incorreta ou arquivo corrompido).\n");
-            remove(target_file);
             return 1;
         }
         printf("Arquivo '%s' descriptografado com sucesso para '%s'.\n", source_file, target_file);
@@ -1,131 +1,852 @@
 #include "crypt_utils.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include "opctx.h"
+#include "outmap.h"
+#include "keyring.h"
 #include <stdio.h>
 #include <sodium.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
-#define CHUNK_SIZE 4096
+// Tamanho dos segmentos no formato antigo (arquivos sem o cabecalho STGC)
+#define LEGACY_CHUNK_SIZE 4096
+
+// Orcamento de memoria compartilhado pelas derivacoes de chave simultaneas
+static pthread_mutex_t kdf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  kdf_cond = PTHREAD_COND_INITIALIZER;
+static size_t          kdf_budget = 0;   // 0 = sem limite
+static size_t          kdf_in_use = 0;
+
+// Cache de chaves derivadas (usado pelo daemon); fica em memoria protegida da libsodium
+typedef struct {
+    int           used;
+    unsigned long stamp;
+    unsigned char id[crypto_generichash_BYTES];  // BLAKE2b da senha com chave secreta do processo
+    unsigned char salt[crypto_pwhash_SALTBYTES];
+    unsigned char key[CRYPT_KEYBYTES];
+} KeyCacheEntry;
+
+static pthread_mutex_t key_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static KeyCacheEntry  *key_cache = NULL;
+static size_t          key_cache_slots = 0;
+static unsigned long   key_cache_clock = 0;
+static unsigned char   key_cache_secret[crypto_generichash_KEYBYTES];
+
+// Cache de chaves derivadas entre processos, no keyring do kernel (0 = desativado)
+#define KEYRING_SECRET_DESC "stegfs:kdf-secret"
+static unsigned keyring_ttl = 0;
+
+
+void crypt_set_kdf_memory_budget(size_t bytes)
+{
+    pthread_mutex_lock(&kdf_lock);
+    kdf_budget = bytes;
+    pthread_cond_broadcast(&kdf_cond);
+    pthread_mutex_unlock(&kdf_lock);
+}
+
+
+int crypt_key_cache_enable(size_t slots)
+{
+    pthread_mutex_lock(&key_cache_lock);
+    if (key_cache) {
+        sodium_memzero(key_cache, key_cache_slots * sizeof(KeyCacheEntry));
+        sodium_free(key_cache);
+        key_cache = NULL;
+        key_cache_slots = 0;
+    }
+    if (slots > 0) {
+        key_cache = sodium_allocarray(slots, sizeof(KeyCacheEntry));
+        if (!key_cache) {
+            pthread_mutex_unlock(&key_cache_lock);
+            fprintf(stderr, "Erro: Falha ao alocar o cache de chaves.\n");
+            return -1;
+        }
+        memset(key_cache, 0, slots * sizeof(KeyCacheEntry));
+        key_cache_slots = slots;
+        randombytes_buf(key_cache_secret, sizeof key_cache_secret);
+    }
+    pthread_mutex_unlock(&key_cache_lock);
+    return 0;
+}
+
+
+void crypt_keyring_enable(unsigned ttl_seconds)
+{
+    keyring_ttl = ttl_seconds;
+}
+
+
+// Descricao no keyring de uma senha (com salt NULL, a entrada do ultimo salt usado).
+// O BLAKE2b usa um segredo aleatorio guardado no proprio keyring: as descricoes,
+// visiveis em /proc/keys, nao servem para testar senhas sem ele
+static int keyring_desc(char desc[96], const char *kind,
+                        const unsigned char *password, size_t password_len,
+                        const unsigned char *salt, int create)
+{
+    unsigned char secret[crypto_generichash_KEYBYTES];
+    unsigned char id[crypto_generichash_BYTES];
+    crypto_generichash_state st;
+    // Parametros do Argon2 entram no hash: mudar o custo invalida as entradas antigas
+    const uint64_t params[3] = { crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                                 crypto_pwhash_MEMLIMIT_INTERACTIVE,
+                                 (uint64_t)crypto_pwhash_ALG_DEFAULT };
+
+    if (keyring_read(KEYRING_SECRET_DESC, secret, sizeof secret) != 0) {
+        if (!create) {
+            return -1;
+        }
+        randombytes_buf(secret, sizeof secret);
+    }
+    // O segredo e regravado a cada chave guardada, para nao expirar antes dela
+    if (create && keyring_store(KEYRING_SECRET_DESC, secret, sizeof secret, keyring_ttl) != 0) {
+        sodium_memzero(secret, sizeof secret);
+        return -1;
+    }
+    crypto_generichash_init(&st, secret, sizeof secret, sizeof id);
+    crypto_generichash_update(&st, password, password_len);
+    if (salt) {
+        crypto_generichash_update(&st, salt, crypto_pwhash_SALTBYTES);
+    }
+    crypto_generichash_update(&st, (const unsigned char *)params, sizeof params);
+    crypto_generichash_final(&st, id, sizeof id);
+
+    int n = snprintf(desc, 96, "stegfs:%s:", kind);
+    sodium_bin2hex(desc + n, 96 - (size_t)n, id, sizeof id);
+    sodium_memzero(secret, sizeof secret);
+    sodium_memzero(&st, sizeof st);
+    return 0;
+}
+
+
+// Procura no keyring a chave da senha; com salt NULL devolve a do ultimo salt em salt_out
+static int keyring_lookup(const unsigned char *password, size_t password_len,
+                          const unsigned char *salt, unsigned char *salt_out,
+                          unsigned char key[CRYPT_KEYBYTES])
+{
+    unsigned char value[crypto_pwhash_SALTBYTES + CRYPT_KEYBYTES];
+    char desc[96];
+    int found;
+
+    if (!keyring_ttl ||
+        keyring_desc(desc, salt ? "kdf" : "kdf-salt", password, password_len, salt, 0) != 0) {
+        return 0;
+    }
+    if (salt) {
+        found = keyring_read(desc, key, CRYPT_KEYBYTES) == 0;
+    } else {
+        found = keyring_read(desc, value, sizeof value) == 0;
+        if (found) {
+            memcpy(salt_out, value, crypto_pwhash_SALTBYTES);
+            memcpy(key, value + crypto_pwhash_SALTBYTES, CRYPT_KEYBYTES);
+        }
+        sodium_memzero(value, sizeof value);
+    }
+    return found;
+}
+
+
+// Guarda no keyring a chave derivada, por senha+salt e como ultimo salt da senha
+static void keyring_remember(const unsigned char *password, size_t password_len,
+                             const unsigned char *salt, const unsigned char key[CRYPT_KEYBYTES])
+{
+    unsigned char value[crypto_pwhash_SALTBYTES + CRYPT_KEYBYTES];
+    char desc[96];
+
+    if (!keyring_ttl) {
+        return;
+    }
+    if (keyring_desc(desc, "kdf", password, password_len, salt, 1) != 0 ||
+        keyring_store(desc, key, CRYPT_KEYBYTES, keyring_ttl) != 0) {
+        fprintf(stderr, "Aviso: keyring do kernel indisponivel; chave nao guardada\n");
+        return;
+    }
+    memcpy(value, salt, crypto_pwhash_SALTBYTES);
+    memcpy(value + crypto_pwhash_SALTBYTES, key, CRYPT_KEYBYTES);
+    if (keyring_desc(desc, "kdf-salt", password, password_len, NULL, 0) == 0) {
+        keyring_store(desc, value, sizeof value, keyring_ttl);
+    }
+    sodium_memzero(value, sizeof value);
+}
+
+
+// Identificador da senha no cache (nunca guarda a senha em si)
+static void key_cache_id(unsigned char id[crypto_generichash_BYTES],
+                         const unsigned char *password, size_t password_len)
+{
+    crypto_generichash(id, crypto_generichash_BYTES, password, password_len,
+                       key_cache_secret, sizeof key_cache_secret);
+}
+
+
+// Procura a chave da senha; com salt NULL aceita qualquer salt e o devolve em salt_out
+static int key_cache_lookup(const unsigned char *password, size_t password_len,
+                            const unsigned char *salt, unsigned char *salt_out,
+                            unsigned char key[CRYPT_KEYBYTES])
+{
+    unsigned char id[crypto_generichash_BYTES];
+    int found = 0;
+
+    pthread_mutex_lock(&key_cache_lock);
+    if (key_cache) {
+        key_cache_id(id, password, password_len);
+        for (size_t i = 0; i < key_cache_slots && !found; i++) {
+            KeyCacheEntry *e = &key_cache[i];
+            if (!e->used || sodium_memcmp(e->id, id, sizeof id) != 0 ||
+                (salt && memcmp(e->salt, salt, sizeof e->salt) != 0)) {
+                continue;
+            }
+            if (salt_out) {
+                memcpy(salt_out, e->salt, sizeof e->salt);
+            }
+            memcpy(key, e->key, CRYPT_KEYBYTES);
+            e->stamp = ++key_cache_clock;
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&key_cache_lock);
+    sodium_memzero(id, sizeof id);
+    return found;
+}
+
+
+// Guarda uma chave derivada, substituindo a entrada usada ha mais tempo
+static void key_cache_store(const unsigned char *password, size_t password_len,
+                            const unsigned char *salt, const unsigned char key[CRYPT_KEYBYTES])
+{
+    pthread_mutex_lock(&key_cache_lock);
+    if (key_cache) {
+        KeyCacheEntry *victim = &key_cache[0];
+        for (size_t i = 0; i < key_cache_slots; i++) {
+            if (!key_cache[i].used) {
+                victim = &key_cache[i];
+                break;
+            }
+            if (key_cache[i].stamp < victim->stamp) {
+                victim = &key_cache[i];
+            }
+        }
+        key_cache_id(victim->id, password, password_len);
+        memcpy(victim->salt, salt, sizeof victim->salt);
+        memcpy(victim->key, key, CRYPT_KEYBYTES);
+        victim->stamp = ++key_cache_clock;
+        victim->used = 1;
+    }
+    pthread_mutex_unlock(&key_cache_lock);
+}
+
+
+int crypt_suite_resolve(CryptSuite policy, CryptSuite *suite)
+{
+    switch (policy) {
+    case CRYPT_SUITE_AUTO:
+        // AES-GCM com AES-NI e mais rapido por nucleo; sem ele, XChaCha e o mais rapido
+        *suite = crypto_aead_aes256gcm_is_available() ? CRYPT_SUITE_AES256GCM
+                                                      : CRYPT_SUITE_XCHACHA20;
+        return 0;
+    case CRYPT_SUITE_XCHACHA20:
+        *suite = CRYPT_SUITE_XCHACHA20;
+        return 0;
+    case CRYPT_SUITE_AES256GCM:
+        if (!crypto_aead_aes256gcm_is_available()) {
+            return -1;
+        }
+        *suite = CRYPT_SUITE_AES256GCM;
+        return 0;
+    }
+    return -1;
+}
+
+
+int crypt_suite_parse(const char *name, CryptSuite *suite)
+{
+    if (strcmp(name, "auto") == 0) {
+        *suite = CRYPT_SUITE_AUTO;
+    } else if (strcmp(name, "xchacha") == 0 || strcmp(name, "xchacha20") == 0) {
+        *suite = CRYPT_SUITE_XCHACHA20;
+    } else if (strcmp(name, "aes") == 0 || strcmp(name, "aes256gcm") == 0) {
+        *suite = CRYPT_SUITE_AES256GCM;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+
+const char *crypt_suite_name(CryptSuite suite)
+{
+    switch (suite) {
+    case CRYPT_SUITE_AUTO:      return "auto";
+    case CRYPT_SUITE_XCHACHA20: return "XChaCha20-Poly1305";
+    case CRYPT_SUITE_AES256GCM: return "AES-256-GCM";
+    }
+    return "desconhecida";
+}
+
+
+// Deriva a chave do fluxo a partir da senha e do salt (Argon2id)
+static int derive_key(unsigned char key[CRYPT_KEYBYTES],
+                      const unsigned char *password, size_t password_len,
+                      const unsigned char salt[crypto_pwhash_SALTBYTES])
+{
+    const size_t need = crypto_pwhash_MEMLIMIT_INTERACTIVE;
+    int ret;
+
+    if (key_cache_lookup(password, password_len, salt, NULL, key)) {
+        return 0;
+    }
+    // Derivada por outro processo ha menos de keyring_ttl segundos
+    if (keyring_lookup(password, password_len, salt, NULL, key)) {
+        key_cache_store(password, password_len, salt, key);
+        return 0;
+    }
+
+    // Espera ate caber no orcamento; uma derivacao sozinha sempre pode rodar
+    pthread_mutex_lock(&kdf_lock);
+    while (kdf_budget && kdf_in_use > 0 && kdf_in_use + need > kdf_budget) {
+        pthread_cond_wait(&kdf_cond, &kdf_lock);
+    }
+    kdf_in_use += need;
+    pthread_mutex_unlock(&kdf_lock);
+
+    uint64_t t = metrics_start();
+    ret = crypto_pwhash(key, CRYPT_KEYBYTES, (const char *)password, password_len, salt,
+                        crypto_pwhash_OPSLIMIT_INTERACTIVE,
+                        crypto_pwhash_MEMLIMIT_INTERACTIVE,
+                        crypto_pwhash_ALG_DEFAULT);
+    metrics_stop(METRICS_KDF, t, 0, CRYPT_KEYBYTES);
+
+    pthread_mutex_lock(&kdf_lock);
+    kdf_in_use -= need;
+    pthread_cond_broadcast(&kdf_cond);
+    pthread_mutex_unlock(&kdf_lock);
+
+    if (ret == 0) {
+        key_cache_store(password, password_len, salt, key);
+        keyring_remember(password, password_len, salt, key);
+    }
+    return ret;
+}
+
+
+// Monta o nonce do segmento atual: nonce base XOR contador (little-endian)
+static void gcm_segment_nonce(const CryptStream *cs,
+                              unsigned char npub[crypto_aead_aes256gcm_NPUBBYTES])
+{
+    memcpy(npub, cs->nonce, crypto_aead_aes256gcm_NPUBBYTES);
+    for (int i = 0; i < 8; i++) {
+        npub[i] ^= (unsigned char)(cs->counter >> (8 * i));
+    }
+}
+
+
+int crypt_stream_init_push(CryptStream *cs, CryptSuite suite,
+                           const unsigned char key[CRYPT_KEYBYTES],
+                           unsigned char header[CRYPT_STREAM_HEADERBYTES])
+{
+    cs->suite = suite;
+    cs->counter = 0;
+
+    if (suite == CRYPT_SUITE_XCHACHA20) {
+        return crypto_secretstream_xchacha20poly1305_init_push(&cs->ss, header, key);
+    }
+    if (suite == CRYPT_SUITE_AES256GCM) {
+        // O header guarda o nonce base aleatorio; o restante e preenchimento
+        randombytes_buf(header, CRYPT_STREAM_HEADERBYTES);
+        memcpy(cs->nonce, header, sizeof cs->nonce);
+        return crypto_aead_aes256gcm_beforenm(&cs->gcm, key);
+    }
+    return -1;
+}
+
+
+static int stream_push(CryptStream *cs, unsigned char *out, size_t *out_len,
+                       const unsigned char *in, size_t in_len, int final)
+{
+    unsigned long long clen;
+    unsigned char tag = final ? crypto_secretstream_xchacha20poly1305_TAG_FINAL
+                              : crypto_secretstream_xchacha20poly1305_TAG_MESSAGE;
+
+    if (cs->suite == CRYPT_SUITE_XCHACHA20) {
+        if (crypto_secretstream_xchacha20poly1305_push(&cs->ss, out, &clen, in, in_len,
+                                                       NULL, 0, tag) != 0) {
+            return -1;
+        }
+        *out_len = (size_t) clen;
+        return 0;
+    }
+
+    if (cs->suite == CRYPT_SUITE_AES256GCM) {
+        // Segmento: tag(1) + texto cifrado + MAC(16); a tag entra como dado associado
+        unsigned char npub[crypto_aead_aes256gcm_NPUBBYTES];
+        gcm_segment_nonce(cs, npub);
+        out[0] = tag;
+        if (crypto_aead_aes256gcm_encrypt_afternm(out + 1, &clen, in, in_len, out, 1,
+                                                  NULL, npub, &cs->gcm) != 0) {
+            return -1;
+        }
+        cs->counter++;
+        *out_len = (size_t) clen + 1;
+        return 0;
+    }
+    return -1;
+}
+
+
+int crypt_stream_init_pull(CryptStream *cs, CryptSuite suite,
+                           const unsigned char key[CRYPT_KEYBYTES],
+                           const unsigned char header[CRYPT_STREAM_HEADERBYTES])
+{
+    cs->suite = suite;
+    cs->counter = 0;
+
+    if (suite == CRYPT_SUITE_XCHACHA20) {
+        return crypto_secretstream_xchacha20poly1305_init_pull(&cs->ss, header, key);
+    }
+    if (suite == CRYPT_SUITE_AES256GCM) {
+        if (!crypto_aead_aes256gcm_is_available()) {
+            fprintf(stderr, "Erro: AES-256-GCM indisponivel neste processador.\n");
+            return -1;
+        }
+        memcpy(cs->nonce, header, sizeof cs->nonce);
+        return crypto_aead_aes256gcm_beforenm(&cs->gcm, key);
+    }
+    return -1;
+}
+
+
+static int stream_pull(CryptStream *cs, unsigned char *out, size_t *out_len,
+                       int *final, const unsigned char *in, size_t in_len)
+{
+    unsigned long long mlen;
+    unsigned char tag;
+
+    if (in_len < CRYPT_SEGMENT_ABYTES) {
+        return -1;
+    }
+
+    if (cs->suite == CRYPT_SUITE_XCHACHA20) {
+        if (crypto_secretstream_xchacha20poly1305_pull(&cs->ss, out, &mlen, &tag,
+                                                       in, in_len, NULL, 0) != 0) {
+            return -1;
+        }
+    } else if (cs->suite == CRYPT_SUITE_AES256GCM) {
+        unsigned char npub[crypto_aead_aes256gcm_NPUBBYTES];
+        gcm_segment_nonce(cs, npub);
+        tag = in[0];
+        if (tag != crypto_secretstream_xchacha20poly1305_TAG_MESSAGE &&
+            tag != crypto_secretstream_xchacha20poly1305_TAG_FINAL) {
+            return -1;
+        }
+        if (crypto_aead_aes256gcm_decrypt_afternm(out, &mlen, NULL, in + 1, in_len - 1,
+                                                  in, 1, npub, &cs->gcm) != 0) {
+            return -1;
+        }
+        cs->counter++;
+    } else {
+        return -1;
+    }
+
+    *out_len = (size_t) mlen;
+    *final = (tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL);
+    return 0;
+}
+
+
+// Os segmentos publicos passam pelos contadores de metrics.h
+int crypt_stream_push(CryptStream *cs, unsigned char *out, size_t *out_len,
+                      const unsigned char *in, size_t in_len, int final)
+{
+    uint64_t t = metrics_start();
+    int ret = stream_push(cs, out, out_len, in, in_len, final);
+    metrics_stop(METRICS_ENCRYPT, t, in_len, ret == 0 ? *out_len : 0);
+    return ret;
+}
+
+
+int crypt_stream_pull(CryptStream *cs, unsigned char *out, size_t *out_len,
+                      int *final, const unsigned char *in, size_t in_len)
+{
+    uint64_t t = metrics_start();
+    int ret = stream_pull(cs, out, out_len, final, in, in_len);
+    metrics_stop(METRICS_DECRYPT, t, in_len, ret == 0 ? *out_len : 0);
+    return ret;
+}
+
+
+// Preenche o prefixo do cabecalho: magic + suite + modo + reservado
+static void write_prefix(unsigned char prefix[CRYPT_PREFIXBYTES], CryptSuite suite,
+                         unsigned char mode)
+{
+    memcpy(prefix, CRYPT_MAGIC, 4);
+    prefix[4] = (unsigned char) suite;
+    prefix[5] = mode;
+    prefix[6] = 0;
+    prefix[7] = 0;
+}
+
+
+int crypt_password_key_push(CryptSuite *suite,
+                            const unsigned char *password, size_t password_len,
+                            unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                            unsigned char key[CRYPT_KEYBYTES])
+{
+    unsigned char *salt = file_header + CRYPT_PREFIXBYTES;
+
+    if (crypt_suite_resolve(*suite, suite) != 0) {
+        fprintf(stderr, "Erro: Suite de cifra indisponivel neste processador.\n");
+        return -1;
+    }
+
+    // Gera um Salt aleatorio e deriva a chave da senha. Com o cache ativo, reaproveita
+    // o salt (e a chave) ja derivados para esta senha; o header do fluxo continua aleatorio
+    write_prefix(file_header, *suite, CRYPT_MODE_PASSWORD);
+    if (!key_cache_lookup(password, password_len, NULL, salt, key) &&
+        !keyring_lookup(password, password_len, NULL, salt, key)) {
+        randombytes_buf(salt, crypto_pwhash_SALTBYTES);
+    }
+    if (derive_key(key, password, password_len, salt) != 0) {
+        fprintf(stderr, "Erro: Falha ao derivar a chave (possivelmente pouca memoria)\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+int crypt_password_init_push(CryptStream *cs, CryptSuite suite,
+                             const unsigned char *password, size_t password_len,
+                             unsigned char file_header[CRYPT_FILE_HEADERBYTES])
+{
+    unsigned char  key[CRYPT_KEYBYTES];
+    int            ret;
+
+    if (crypt_password_key_push(&suite, password, password_len, file_header, key) != 0) {
+        return -1;
+    }
+
+    // Inicializa o fluxo de criptografia e gera o header logo apos o Salt
+    ret = crypt_stream_init_push(cs, suite, key,
+                                 file_header + CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES);
+    sodium_memzero(key, sizeof key);
+    if (ret != 0) {
+        fprintf(stderr, "Erro: Falha ao inicializar o fluxo de criptografia.\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+int crypt_password_key_pull(const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                            const unsigned char *password, size_t password_len,
+                            unsigned char key[CRYPT_KEYBYTES], CryptSuite *suite)
+{
+    const unsigned char *salt = file_header + CRYPT_PREFIXBYTES;
+
+    *suite = (CryptSuite) file_header[4];
+    if (memcmp(file_header, CRYPT_MAGIC, 4) != 0) {
+        fprintf(stderr, "Erro: Cabecalho de criptografia nao encontrado.\n");
+        return -1;
+    }
+    if (file_header[5] == CRYPT_MODE_RECIPIENTS) {
+        fprintf(stderr, "Erro: Dados criptografados para chave publica.\n");
+        return -1;
+    }
+    if (file_header[5] != CRYPT_MODE_PASSWORD ||
+        (*suite != CRYPT_SUITE_XCHACHA20 && *suite != CRYPT_SUITE_AES256GCM)) {
+        fprintf(stderr, "Erro: Suite ou modo de cifra desconhecido.\n");
+        return -1;
+    }
+
+    if (derive_key(key, password, password_len, salt) != 0) {
+        fprintf(stderr, "Erro: Falha ao derivar a chave.\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+int crypt_password_init_pull(CryptStream *cs,
+                             const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                             const unsigned char *password, size_t password_len)
+{
+    unsigned char  key[CRYPT_KEYBYTES];
+    CryptSuite     suite;
+    int            ret;
+
+    if (crypt_password_key_pull(file_header, password, password_len, key, &suite) != 0) {
+        return -1;
+    }
+    ret = crypt_stream_init_pull(cs, suite, key,
+                                 file_header + CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES);
+    sodium_memzero(key, sizeof key);
+    if (ret != 0) {
+        fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
+        return -1;
+    }
+    return 0;
+}
+
+
+// Criptografa o restante de source_fp em segmentos e grava em target_fp
+static int encrypt_body(FILE *source_fp, FILE *target_fp, CryptStream *cs)
+{
+    unsigned char  buf_in[CRYPT_SEGMENT_SIZE];
+    unsigned char  buf_out[CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES];
+    size_t         out_len;
+    size_t         in_len;
+    int            eof;
+
+    op_total_file(OP_STAGE_ENCRYPT, source_fp);
+    do {
+        in_len = metrics_fread(buf_in, sizeof buf_in, source_fp);
+        eof = feof(source_fp);
+        if (op_step(OP_STAGE_ENCRYPT, in_len) != 0) {
+            return -1;
+        }
+        if (crypt_stream_push(cs, buf_out, &out_len, buf_in, in_len, eof) != 0 ||
+            metrics_fwrite(buf_out, out_len, target_fp) != out_len) {
+            fprintf(stderr, "Erro: Falha ao escrever dados criptografados.\n");
+            return -1;
+        }
+    } while (!eof);
+
+    return 0;
+}
+
+
+// Saida de decrypt: arquivo comum em um mapa (outmap.h) ou FILE para "-" e afins
+typedef struct {
+    FILE    *fp;
+    OutMap  *map;
+    uint64_t len;     // bytes ja gravados no mapa
+} DecryptSink;
+
+
+static int sink_open(DecryptSink *sink, const char *target_file)
+{
+    memset(sink, 0, sizeof *sink);
+    if (outmap_supported(target_file)) {
+        sink->map = outmap_open(target_file, 0);
+        return sink->map ? 0 : -1;
+    }
+    sink->fp = stdstream_open_write(target_file, 0);
+    return sink->fp ? 0 : -1;
+}
+
+
+// Fecha a saida; o mapa so toma o lugar do destino em sucesso
+static int sink_close(DecryptSink *sink, const char *target_file, int failed)
+{
+    if (sink->fp) {
+        return stdstream_close_write(sink->fp, target_file, failed);
+    }
+    if (failed) {
+        outmap_abort(sink->map);
+        return -1;
+    }
+    return outmap_commit(sink->map, sink->len);
+}
+
+
+// Tamanho do texto claro de um arquivo comum a partir da posicao atual:
+// cada segmento de chunk_len bytes (o ultimo menor) carrega CRYPT_SEGMENT_ABYTES
+static uint64_t plaintext_size(FILE *source_fp, size_t chunk_len)
+{
+    struct stat st;
+    off_t       pos = ftello(source_fp);
+
+    if (fstat(fileno(source_fp), &st) != 0 || !S_ISREG(st.st_mode) ||
+        pos < 0 || pos >= st.st_size) {
+        return 0;
+    }
+    uint64_t body = (uint64_t)(st.st_size - pos);
+    uint64_t tags = (body + chunk_len - 1) / chunk_len * CRYPT_SEGMENT_ABYTES;
+    return body > tags ? body - tags : 0;
+}
+
+
+// Descriptografa os segmentos de source_fp ate a tag final e grava na saida.
+// Com um mapa, o tamanho final e reservado antes e cada segmento e aberto
+// direto no lugar dele na saida.
+static int decrypt_body(FILE *source_fp, DecryptSink *sink, CryptStream *cs,
+                        size_t chunk_len)
+{
+    unsigned char  buf_in[CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES];
+    unsigned char  buf_out[CRYPT_SEGMENT_SIZE];
+    unsigned char *dst = buf_out;
+    size_t         out_len;
+    size_t         in_len;
+    int            eof;
+    int            final;
+
+    uint64_t       expected = sink->map ? plaintext_size(source_fp, chunk_len) : 0;
+
+    op_total_file(OP_STAGE_DECRYPT, source_fp);
+    if (expected > 0 && !outmap_reserve(sink->map, expected)) {
+        return -1;
+    }
+    do {
+        in_len = metrics_fread(buf_in, chunk_len, source_fp);
+        eof = feof(source_fp);
+        if (op_step(OP_STAGE_DECRYPT, in_len) != 0) {
+            return -1;
+        }
+        if (sink->map && in_len > CRYPT_SEGMENT_ABYTES) {
+            unsigned char *base = outmap_reserve(sink->map,
+                                                 sink->len + in_len - CRYPT_SEGMENT_ABYTES);
+            if (!base) {
+                return -1;
+            }
+            dst = base + sink->len;
+        } else {
+            dst = buf_out;
+        }
+        if (crypt_stream_pull(cs, dst, &out_len, &final, buf_in, in_len) != 0) {
+            fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+            return -1;
+        }
+        if (final) {
+            if (!eof && fgetc(source_fp) != EOF) {
+                fprintf(stderr, "Erro: Fim do fluxo alcancado, mas nao e o fim do arquivo.\n");
+                return -1;
+            }
+        } else if (eof) {
+            fprintf(stderr, "Erro: Arquivo truncado (tag final ausente).\n");
+            return -1;
+        }
+        if (sink->map) {
+            if (dst == buf_out && out_len > 0) {
+                // Segmento curto demais para ter texto claro: nao deveria acontecer.
+                fprintf(stderr, "Erro: Falha ao escrever dados descriptografados.\n");
+                return -1;
+            }
+            sink->len += out_len;
+        } else if (metrics_fwrite(buf_out, out_len, sink->fp) != out_len) {
+            fprintf(stderr, "Erro: Falha ao escrever dados descriptografados.\n");
+            return -1;
+        }
+    } while (!final);
+
+    return 0;
+}
 
 
 int encrypt_file(const char *target_file, const char *source_file,
                  const unsigned char *password, size_t password_len)
 {
-    unsigned char  buf_in[CHUNK_SIZE];
-    unsigned char  buf_out[CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES];
-    unsigned char  key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
-    unsigned char  salt[crypto_pwhash_SALTBYTES];
-    unsigned char  header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
-    crypto_secretstream_xchacha20poly1305_state st;
+    return encrypt_file_suite(target_file, source_file, password, password_len,
+                              CRYPT_SUITE_XCHACHA20);
+}
+
+
+int encrypt_file_suite(const char *target_file, const char *source_file,
+                       const unsigned char *password, size_t password_len,
+                       CryptSuite suite)
+{
+    unsigned char  file_header[CRYPT_FILE_HEADERBYTES];
+    CryptStream    cs;
     FILE          *source_fp, *target_fp;
-    unsigned long long out_len;
-    size_t         in_len;
-    int            eof;
-    unsigned char  tag;
 
     // Abrir os arquivos
-    source_fp = fopen(source_file, "rb");
+    source_fp = stdstream_open_read(source_file);
     if (!source_fp) {
         fprintf(stderr, "Erro: Nao foi possivel abrir o arquivo fonte '%s'\n", source_file);
         return 1;
     }
-    target_fp = fopen(target_file, "wb");
+    target_fp = stdstream_open_write(target_file, 0);
     if (!target_fp) {
         fprintf(stderr, "Erro: Nao foi possivel criar o arquivo destino '%s'\n", target_file);
-        fclose(source_fp);
+        stdstream_close_read(source_fp);
         return 1;
     }
 
-    // Gera um Salt aleatorio
-    randombytes_buf(salt, sizeof salt);
-
-    // Deriva a chave da senha usando o Salt
-    if (crypto_pwhash(key, sizeof key, (const char *)password, password_len, salt,
-                  	crypto_pwhash_OPSLIMIT_INTERACTIVE, 
-                  	crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                  	crypto_pwhash_ALG_DEFAULT) != 0) {
-        fprintf(stderr, "Erro: Falha ao derivar a chave (possivelmente pouca memoria)\n");
+    // Gera o Salt, deriva a chave e inicializa o fluxo
+    if (crypt_password_init_push(&cs, suite, password, password_len, file_header) != 0) {
+        stdstream_close_read(source_fp);
+        stdstream_close_write(target_fp, target_file, 1);
         return 1;
     }
 
-    // Salva o Salt no inicio do arquivo de saida
-    if (fwrite(salt, 1, sizeof salt, target_fp) != sizeof salt) {
-        fprintf(stderr, "Erro: Falha ao escrever o salt no arquivo de saida.\n");
-        fclose(source_fp);
-        fclose(target_fp);
+    // Salva prefixo (com a suite), Salt e Header no inicio do arquivo de saida
+    if (fwrite(file_header, 1, sizeof file_header, target_fp) != sizeof file_header) {
+        fprintf(stderr, "Erro: Falha ao escrever o header no arquivo de saida.\n");
+        stdstream_close_read(source_fp);
+        stdstream_close_write(target_fp, target_file, 1);
         return 1;
     }
 
-    // Inicializa o fluxo de criptografia e gerar o header
-    crypto_secretstream_xchacha20poly1305_init_push(&st, header, key);
-
-    // Salva o Header no arquivo de saida
-    if (fwrite(header, 1, sizeof header, target_fp) != sizeof header) {
-        fprintf(stderr, "Erro: Falha ao escrever o header no arquivo de saida.\n");
-        fclose(source_fp);
-        fclose(target_fp);
+    // Loop de criptografia (segmento por segmento)
+    if (encrypt_body(source_fp, target_fp, &cs) != 0) {
+        stdstream_close_read(source_fp);
+        stdstream_close_write(target_fp, target_file, 1);
         return 1;
     }
 
-    // Loop de criptografia (chunk por chunk)
-    do {
-        in_len = fread(buf_in, 1, sizeof buf_in, source_fp);
-        eof = feof(source_fp);
-        tag = eof ? crypto_secretstream_xchacha20poly1305_TAG_FINAL : 0;
-        crypto_secretstream_xchacha20poly1305_push(&st, buf_out, &out_len, buf_in, in_len,
-                                                  NULL, 0, tag);
-        if (fwrite(buf_out, 1, (size_t) out_len, target_fp) != (size_t) out_len) {
-            fprintf(stderr, "Erro: Falha ao escrever dados criptografados.\n");
-            fclose(source_fp);
-            fclose(target_fp);
-            return 1;
-        }
-    } while (!eof);
-
-    fclose(source_fp);
-    fclose(target_fp);
-    return 0;
+    stdstream_close_read(source_fp);
+    return stdstream_close_write(target_fp, target_file, 0) == 0 ? 0 : 1;
 }
 
 
 int decrypt_file(const char *target_file, const char *source_file,
                  const unsigned char *password, size_t password_len)
 {
-    unsigned char  buf_in[CHUNK_SIZE + crypto_secretstream_xchacha20poly1305_ABYTES];
-    unsigned char  buf_out[CHUNK_SIZE];
-    unsigned char  key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    unsigned char  key[CRYPT_KEYBYTES];
+    unsigned char  prefix[CRYPT_PREFIXBYTES];
     unsigned char  salt[crypto_pwhash_SALTBYTES];
-    unsigned char  header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
-    crypto_secretstream_xchacha20poly1305_state st;
-    FILE          *source_fp, *target_fp;
-    unsigned long long out_len;
-    size_t         in_len;
-    int            eof;
-    unsigned char  tag;
-    int            ret = -1; 
+    unsigned char  header[CRYPT_STREAM_HEADERBYTES];
+    CryptStream    cs;
+    CryptSuite     suite = CRYPT_SUITE_XCHACHA20;
+    FILE          *source_fp;
+    DecryptSink    sink;
+    size_t         chunk_len = CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES;
+    int            ret = -1;
 
-    source_fp = fopen(source_file, "rb");
+    source_fp = stdstream_open_read(source_file);
     if (!source_fp) {
         fprintf(stderr, "Erro: Nao foi possivel abrir o arquivo fonte '%s'\n", source_file);
         return 1;
     }
-    target_fp = fopen(target_file, "wb");
-    if (!target_fp) {
+    if (sink_open(&sink, target_file) != 0) {
         fprintf(stderr, "Erro: Nao foi possivel criar o arquivo destino '%s'\n", target_file);
-        fclose(source_fp);
+        stdstream_close_read(source_fp);
         return 1;
     }
 
-    // Le o Salt
-    if (fread(salt, 1, sizeof salt, source_fp) != sizeof salt) {
+    // Le o prefixo; arquivos antigos comecam direto pelo Salt
+    if (fread(prefix, 1, sizeof prefix, source_fp) != sizeof prefix) {
         fprintf(stderr, "Erro: Falha ao ler o salt (arquivo corrompido ou invalido).\n");
         goto cleanup;
     }
+    if (memcmp(prefix, CRYPT_MAGIC, 4) == 0) {
+        suite = (CryptSuite) prefix[4];
+        if (prefix[5] == CRYPT_MODE_RECIPIENTS) {
+            fprintf(stderr, "Erro: Arquivo criptografado para chave publica (use decrypt-pk).\n");
+            goto cleanup;
+        }
+        if (prefix[5] != CRYPT_MODE_PASSWORD ||
+            (suite != CRYPT_SUITE_XCHACHA20 && suite != CRYPT_SUITE_AES256GCM)) {
+            fprintf(stderr, "Erro: Suite ou modo de cifra desconhecido.\n");
+            goto cleanup;
+        }
+        if (fread(salt, 1, sizeof salt, source_fp) != sizeof salt) {
+            fprintf(stderr, "Erro: Falha ao ler o salt (arquivo corrompido ou invalido).\n");
+            goto cleanup;
+        }
+    } else {
+        chunk_len = LEGACY_CHUNK_SIZE + CRYPT_SEGMENT_ABYTES;
+        memcpy(salt, prefix, sizeof prefix);
+        if (fread(salt + sizeof prefix, 1, sizeof salt - sizeof prefix, source_fp) !=
+            sizeof salt - sizeof prefix) {
+            fprintf(stderr, "Erro: Falha ao ler o salt (arquivo corrompido ou invalido).\n");
+            goto cleanup;
+        }
+    }
 
     // Deriva a chave
-    if (crypto_pwhash(key, sizeof key, (const char *)password, password_len, salt,
-                  	crypto_pwhash_OPSLIMIT_INTERACTIVE, 
-                  	crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                  	crypto_pwhash_ALG_DEFAULT) != 0) {
+    if (derive_key(key, password, password_len, salt) != 0) {
         fprintf(stderr, "Erro: Falha ao derivar a chave.\n");
         goto cleanup;
     }
@@ -137,37 +858,24 @@ int decrypt_file(const char *target_file, const char *source_file,
     }
 
     // Inicializa o fluxo de descriptografia
-    if (crypto_secretstream_xchacha20poly1305_init_pull(&st, header, key) != 0) {
+    if (crypt_stream_init_pull(&cs, suite, key, header) != 0) {
         fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
         goto cleanup;
     }
 
     // Loop de descriptografia
-    do {
-        in_len = fread(buf_in, 1, sizeof buf_in, source_fp);
-        eof = feof(source_fp);
-        if (crypto_secretstream_xchacha20poly1305_pull(&st, buf_out, &out_len, &tag,
-                                                      buf_in, in_len, NULL, 0) != 0) {
-            fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
-            goto cleanup;
-        }
-        if (tag == crypto_secretstream_xchacha20poly1305_TAG_FINAL) {
-            if (!eof) {
-                fprintf(stderr, "Erro: Fim do fluxo alcancado, mas nao e o fim do arquivo.\n");
-                goto cleanup;
-            }
-        }
-        if (fwrite(buf_out, 1, (size_t) out_len, target_fp) != (size_t) out_len) {
-            fprintf(stderr, "Erro: Falha ao escrever dados descriptografados.\n");
-            goto cleanup;
-        }
-    } while (tag != crypto_secretstream_xchacha20poly1305_TAG_FINAL);
+    if (decrypt_body(source_fp, &sink, &cs, chunk_len) != 0) {
+        goto cleanup;
+    }
 
-    ret = 0; 
+    ret = 0;
 
 cleanup:
-    fclose(target_fp);
-    fclose(source_fp);
+    sodium_memzero(key, sizeof key);
+    if (sink_close(&sink, target_file, ret != 0) != 0) {
+        ret = ret ? ret : 1;
+    }
+    stdstream_close_read(source_fp);
     return ret;
 }
 
@@ -176,69 +884,107 @@ int encrypt_data(const unsigned char *input_data, size_t input_len,
                  unsigned char **output_data, size_t *output_len,
                  const unsigned char *password, size_t password_len)
 {
-    unsigned char  key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
-    unsigned char  salt[crypto_pwhash_SALTBYTES];
-    unsigned char  header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
-    crypto_secretstream_xchacha20poly1305_state st;
-    unsigned long long encrypted_len;
-    size_t total_size;
-    unsigned char *result;
+    return encrypt_data_suite(input_data, input_len, output_data, output_len,
+                              password, password_len, CRYPT_SUITE_XCHACHA20);
+}
+
+
+size_t crypt_encrypted_size(size_t plain_len)
+{
+    size_t n_segments = plain_len ? (plain_len + CRYPT_SEGMENT_SIZE - 1) / CRYPT_SEGMENT_SIZE : 1;
+    return CRYPT_FILE_HEADERBYTES + plain_len + n_segments * CRYPT_SEGMENT_ABYTES;
+}
+
+
+size_t crypt_decrypted_max_size(size_t encrypted_len)
+{
+    if (encrypted_len < CRYPT_FILE_HEADERBYTES + CRYPT_SEGMENT_ABYTES) {
+        return 0;
+    }
+    return encrypted_len - CRYPT_FILE_HEADERBYTES - CRYPT_SEGMENT_ABYTES;
+}
+
+
+int encrypt_data_into(const unsigned char *input_data, size_t input_len,
+                      unsigned char *output, size_t output_capacity, size_t *output_len,
+                      const unsigned char *password, size_t password_len,
+                      CryptSuite suite)
+{
+    CryptStream    cs;
+    size_t         n_segments;
+    size_t         seg_len;
+    size_t         out_len;
     unsigned char *ptr;
 
-    // Gera um Salt aleatorio
-    randombytes_buf(salt, sizeof salt);
+    if (output_capacity < crypt_encrypted_size(input_len)) {
+        fprintf(stderr, "Erro: Buffer de saida pequeno demais para a criptografia\n");
+        return 1;
+    }
 
-    // Deriva a chave da senha usando o Salt
-    if (crypto_pwhash(key, sizeof key, (const char *)password, password_len, salt,
-                      crypto_pwhash_OPSLIMIT_INTERACTIVE, 
-                      crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                      crypto_pwhash_ALG_DEFAULT) != 0) {
-        fprintf(stderr, "Erro: Falha ao derivar a chave (possivelmente pouca memoria)\n");
+    // Gera o Salt, deriva a chave e grava o cabecalho no inicio da saida
+    if (crypt_password_init_push(&cs, suite, password, password_len, output) != 0) {
         return 1;
     }
+    ptr = output + CRYPT_FILE_HEADERBYTES;
+
+    // Criptografa os dados segmento por segmento
+    n_segments = input_len ? (input_len + CRYPT_SEGMENT_SIZE - 1) / CRYPT_SEGMENT_SIZE : 1;
+    op_total(OP_STAGE_ENCRYPT, input_len);
+    for (size_t i = 0; i < n_segments; i++) {
+        seg_len = input_len - i * CRYPT_SEGMENT_SIZE;
+        if (seg_len > CRYPT_SEGMENT_SIZE) {
+            seg_len = CRYPT_SEGMENT_SIZE;
+        }
+        if (op_step(OP_STAGE_ENCRYPT, seg_len) != 0) {
+            sodium_memzero(&cs, sizeof cs);
+            return 1;
+        }
+        if (crypt_stream_push(&cs, ptr, &out_len, input_data + i * CRYPT_SEGMENT_SIZE,
+                              seg_len, i + 1 == n_segments) != 0) {
+            fprintf(stderr, "Erro: Falha ao criptografar os dados\n");
+            sodium_memzero(&cs, sizeof cs);
+            return 1;
+        }
+        ptr += out_len;
+    }
+    sodium_memzero(&cs, sizeof cs);
 
-    // Inicializa o fluxo de criptografia e gerar o header
-    crypto_secretstream_xchacha20poly1305_init_push(&st, header, key);
+    *output_len = (size_t)(ptr - output);
+    return 0;
+}
 
-    // Calcula tamanho total: salt + header + dados criptografados
-    total_size = sizeof(salt) + sizeof(header) + input_len + 
-                 crypto_secretstream_xchacha20poly1305_ABYTES;
 
-    // Aloca memoria para o resultado
-    result = malloc(total_size);
+int encrypt_data_suite(const unsigned char *input_data, size_t input_len,
+                       unsigned char **output_data, size_t *output_len,
+                       const unsigned char *password, size_t password_len,
+                       CryptSuite suite)
+{
+    // Aloca o tamanho exato: cabecalho + dados + overhead de cada segmento
+    size_t         total_size = crypt_encrypted_size(input_len);
+    unsigned char *result = malloc(total_size);
     if (!result) {
         fprintf(stderr, "Erro: Falha ao alocar memoria para criptografia\n");
         return 1;
     }
+    metrics_alloc(total_size);
 
-    ptr = result;
-
-    // Copia salt
-    memcpy(ptr, salt, sizeof(salt));
-    ptr += sizeof(salt);
-
-    // Copia header
-    memcpy(ptr, header, sizeof(header));
-    ptr += sizeof(header);
-
-    // Criptografa os dados
-    crypto_secretstream_xchacha20poly1305_push(&st, ptr, &encrypted_len,
-                                              input_data, input_len,
-                                              NULL, 0, 
-                                              crypto_secretstream_xchacha20poly1305_TAG_FINAL);
+    if (encrypt_data_into(input_data, input_len, result, total_size, output_len,
+                          password, password_len, suite) != 0) {
+        free(result);
+        return 1;
+    }
 
     *output_data = result;
-    *output_len = sizeof(salt) + sizeof(header) + encrypted_len;
-
     return 0;
 }
 
 
-int decrypt_data(const unsigned char *input_data, size_t input_len,
-                 unsigned char **output_data, size_t *output_len,
-                 const unsigned char *password, size_t password_len)
+// Descriptografa o formato antigo: salt + header + um unico segmento XChaCha
+static int decrypt_data_legacy(const unsigned char *input_data, size_t input_len,
+                               unsigned char **output_data, size_t *output_len,
+                               const unsigned char *password, size_t password_len)
 {
-    unsigned char  key[crypto_secretstream_xchacha20poly1305_KEYBYTES];
+    unsigned char  key[CRYPT_KEYBYTES];
     unsigned char  salt[crypto_pwhash_SALTBYTES];
     unsigned char  header[crypto_secretstream_xchacha20poly1305_HEADERBYTES];
     crypto_secretstream_xchacha20poly1305_state st;
@@ -249,7 +995,7 @@ int decrypt_data(const unsigned char *input_data, size_t input_len,
     size_t encrypted_size;
 
     // Verifica tamanho minimo
-    if (input_len < sizeof(salt) + sizeof(header) + 
+    if (input_len < sizeof(salt) + sizeof(header) +
                     crypto_secretstream_xchacha20poly1305_ABYTES) {
         fprintf(stderr, "Erro: Dados criptografados invalidos (muito pequenos)\n");
         return 1;
@@ -262,10 +1008,7 @@ int decrypt_data(const unsigned char *input_data, size_t input_len,
     ptr += sizeof(salt);
 
     // Deriva a chave
-    if (crypto_pwhash(key, sizeof key, (const char *)password, password_len, salt,
-                      crypto_pwhash_OPSLIMIT_INTERACTIVE, 
-                      crypto_pwhash_MEMLIMIT_INTERACTIVE,
-                      crypto_pwhash_ALG_DEFAULT) != 0) {
+    if (derive_key(key, password, password_len, salt) != 0) {
         fprintf(stderr, "Erro: Falha ao derivar a chave.\n");
         return 1;
     }
@@ -279,6 +1022,7 @@ int decrypt_data(const unsigned char *input_data, size_t input_len,
         fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
         return 1;
     }
+    sodium_memzero(key, sizeof key);
 
     // Aloca memoria para o resultado (tamanho maximo possivel)
     encrypted_size = input_len - sizeof(salt) - sizeof(header);
@@ -307,3 +1051,349 @@ int decrypt_data(const unsigned char *input_data, size_t input_len,
 
     return 0;
 }
+
+
+// Descriptografa os segmentos de um container STGC. Com out == NULL, cada segmento
+// e aberto no proprio buffer de entrada e o texto claro e movido para o inicio dele
+static int decrypt_segments(unsigned char *inplace, const unsigned char *input_data,
+                            size_t input_len, unsigned char *out, size_t out_capacity,
+                            size_t *output_len,
+                            const unsigned char *password, size_t password_len)
+{
+    CryptStream    cs;
+    size_t         remaining;
+    size_t         chunk_len;
+    size_t         out_len;
+    size_t         total = 0;
+    size_t         offset = CRYPT_FILE_HEADERBYTES;
+    int            final = 0;
+    int            ret = 1;
+
+    // Verifica tamanho minimo
+    if (input_len < CRYPT_FILE_HEADERBYTES + CRYPT_SEGMENT_ABYTES) {
+        fprintf(stderr, "Erro: Dados criptografados invalidos (muito pequenos)\n");
+        return 1;
+    }
+    if (out && out_capacity < crypt_decrypted_max_size(input_len)) {
+        fprintf(stderr, "Erro: Buffer de saida pequeno demais para a descriptografia\n");
+        return 1;
+    }
+
+    // Deriva a chave e inicializa o fluxo a partir do cabecalho
+    if (crypt_password_init_pull(&cs, input_data, password, password_len) != 0) {
+        return 1;
+    }
+
+    // Descriptografa os segmentos ate a tag final
+    remaining = input_len - CRYPT_FILE_HEADERBYTES;
+    op_total(OP_STAGE_DECRYPT, remaining);
+    while (!final) {
+        chunk_len = remaining;
+        if (chunk_len > CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) {
+            chunk_len = CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES;
+        }
+        if (op_step(OP_STAGE_DECRYPT, chunk_len) != 0) {
+            goto cleanup;
+        }
+        if (inplace) {
+            // O texto claro ocupa exatamente a posicao do cifrado, logo apos o byte de tag
+            unsigned char *seg = inplace + offset;
+            if (crypt_stream_pull(&cs, seg + 1, &out_len, &final, seg, chunk_len) != 0) {
+                fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+                goto cleanup;
+            }
+            memmove(inplace + total, seg + 1, out_len);
+        } else if (crypt_stream_pull(&cs, out + total, &out_len, &final,
+                                     input_data + offset, chunk_len) != 0) {
+            fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+            goto cleanup;
+        }
+        offset += chunk_len;
+        remaining -= chunk_len;
+        total += out_len;
+        if (!final && remaining == 0) {
+            fprintf(stderr, "Erro: Tag final nao encontrada\n");
+            goto cleanup;
+        }
+    }
+
+    if (remaining != 0) {
+        fprintf(stderr, "Erro: Dados extras apos a tag final\n");
+        goto cleanup;
+    }
+
+    *output_len = total;
+    ret = 0;
+
+cleanup:
+    sodium_memzero(&cs, sizeof cs);
+    return ret;
+}
+
+
+int decrypt_data_into(const unsigned char *input_data, size_t input_len,
+                      unsigned char *output, size_t output_capacity, size_t *output_len,
+                      const unsigned char *password, size_t password_len)
+{
+    if (input_len < CRYPT_PREFIXBYTES || memcmp(input_data, CRYPT_MAGIC, 4) != 0) {
+        fprintf(stderr, "Erro: Cabecalho de criptografia nao encontrado.\n");
+        return 1;
+    }
+    return decrypt_segments(NULL, input_data, input_len, output, output_capacity,
+                            output_len, password, password_len);
+}
+
+
+int decrypt_data_inplace(unsigned char *data, size_t data_len, size_t *plain_len,
+                         const unsigned char *password, size_t password_len)
+{
+    if (data_len < CRYPT_PREFIXBYTES || memcmp(data, CRYPT_MAGIC, 4) != 0) {
+        fprintf(stderr, "Erro: Cabecalho de criptografia nao encontrado.\n");
+        return 1;
+    }
+    return decrypt_segments(data, data, data_len, NULL, 0, plain_len,
+                            password, password_len);
+}
+
+
+int decrypt_data(const unsigned char *input_data, size_t input_len,
+                 unsigned char **output_data, size_t *output_len,
+                 const unsigned char *password, size_t password_len)
+{
+    unsigned char *result;
+    size_t         capacity;
+
+    if (input_len < CRYPT_PREFIXBYTES || memcmp(input_data, CRYPT_MAGIC, 4) != 0) {
+        return decrypt_data_legacy(input_data, input_len, output_data, output_len,
+                                   password, password_len);
+    }
+
+    // Aloca memoria para o resultado (tamanho maximo possivel)
+    capacity = crypt_decrypted_max_size(input_len);
+    result = malloc(capacity ? capacity : 1);
+    if (!result) {
+        fprintf(stderr, "Erro: Falha ao alocar memoria para descriptografia\n");
+        return 1;
+    }
+    metrics_alloc(capacity);
+
+    if (decrypt_segments(NULL, input_data, input_len, result, capacity, output_len,
+                         password, password_len) != 0) {
+        free(result);
+        return 1;
+    }
+
+    *output_data = result;
+    return 0;
+}
+
+
+int crypt_keygen_files(const char *public_file, const char *secret_file)
+{
+    unsigned char  pk[crypto_box_PUBLICKEYBYTES];
+    unsigned char  keypair[CRYPT_SECRETKEY_FILEBYTES];
+    FILE          *fp;
+    int            ret = 1;
+
+    // O arquivo secreto guarda sk || pk, pois crypto_box_seal_open precisa dos dois
+    crypto_box_keypair(pk, keypair);
+    memcpy(keypair + crypto_box_SECRETKEYBYTES, pk, sizeof pk);
+
+    fp = fopen(secret_file, "wb");
+    if (!fp) {
+        fprintf(stderr, "Erro: Nao foi possivel criar o arquivo '%s'\n", secret_file);
+        goto cleanup;
+    }
+    fchmod(fileno(fp), S_IRUSR | S_IWUSR);
+    if (fwrite(keypair, 1, sizeof keypair, fp) != sizeof keypair) {
+        fprintf(stderr, "Erro: Falha ao escrever a chave secreta.\n");
+        fclose(fp);
+        goto cleanup;
+    }
+    fclose(fp);
+
+    fp = fopen(public_file, "wb");
+    if (!fp) {
+        fprintf(stderr, "Erro: Nao foi possivel criar o arquivo '%s'\n", public_file);
+        goto cleanup;
+    }
+    if (fwrite(pk, 1, sizeof pk, fp) != sizeof pk) {
+        fprintf(stderr, "Erro: Falha ao escrever a chave publica.\n");
+        fclose(fp);
+        goto cleanup;
+    }
+    fclose(fp);
+    ret = 0;
+
+cleanup:
+    sodium_memzero(keypair, sizeof keypair);
+    return ret;
+}
+
+
+int crypt_load_key(const char *key_file, unsigned char *key, size_t key_len)
+{
+    FILE *fp = fopen(key_file, "rb");
+    if (!fp) {
+        fprintf(stderr, "Erro: Nao foi possivel abrir a chave '%s'\n", key_file);
+        return 1;
+    }
+    // A chave deve ter exatamente key_len bytes
+    if (fread(key, 1, key_len, fp) != key_len || fgetc(fp) != EOF) {
+        fprintf(stderr, "Erro: Arquivo de chave invalido '%s'\n", key_file);
+        sodium_memzero(key, key_len);
+        fclose(fp);
+        return 1;
+    }
+    fclose(fp);
+    return 0;
+}
+
+
+int encrypt_file_recipients(const char *target_file, const char *source_file,
+                            const unsigned char (*public_keys)[crypto_box_PUBLICKEYBYTES],
+                            size_t n_recipients, CryptSuite suite)
+{
+    unsigned char  key[CRYPT_KEYBYTES];
+    unsigned char  prefix[CRYPT_PREFIXBYTES];
+    unsigned char  sealed[CRYPT_SEALED_KEYBYTES];
+    unsigned char  header[CRYPT_STREAM_HEADERBYTES];
+    CryptStream    cs;
+    FILE          *source_fp, *target_fp;
+    int            ret = 1;
+
+    if (n_recipients == 0 || n_recipients > CRYPT_MAX_RECIPIENTS) {
+        fprintf(stderr, "Erro: Numero de destinatarios invalido (1 a %d).\n",
+                CRYPT_MAX_RECIPIENTS);
+        return 1;
+    }
+
+    if (crypt_suite_resolve(suite, &suite) != 0) {
+        fprintf(stderr, "Erro: Suite de cifra indisponivel neste processador.\n");
+        return 1;
+    }
+
+    source_fp = stdstream_open_read(source_file);
+    if (!source_fp) {
+        fprintf(stderr, "Erro: Nao foi possivel abrir o arquivo fonte '%s'\n", source_file);
+        return 1;
+    }
+    target_fp = stdstream_open_write(target_file, 0);
+    if (!target_fp) {
+        fprintf(stderr, "Erro: Nao foi possivel criar o arquivo destino '%s'\n", target_file);
+        stdstream_close_read(source_fp);
+        return 1;
+    }
+
+    // Chave de fluxo aleatoria por arquivo: nenhuma derivacao de senha
+    randombytes_buf(key, sizeof key);
+
+    // Prefixo com o numero de destinatarios nos bytes reservados
+    write_prefix(prefix, suite, CRYPT_MODE_RECIPIENTS);
+    prefix[6] = (unsigned char)(n_recipients & 0xFF);
+    prefix[7] = (unsigned char)(n_recipients >> 8);
+    if (fwrite(prefix, 1, sizeof prefix, target_fp) != sizeof prefix) {
+        fprintf(stderr, "Erro: Falha ao escrever o cabecalho no arquivo de saida.\n");
+        goto cleanup;
+    }
+
+    // Embrulha a chave de fluxo para cada destinatario (crypto_box_seal)
+    for (size_t i = 0; i < n_recipients; i++) {
+        if (crypto_box_seal(sealed, key, sizeof key, public_keys[i]) != 0 ||
+            fwrite(sealed, 1, sizeof sealed, target_fp) != sizeof sealed) {
+            fprintf(stderr, "Erro: Falha ao selar a chave para o destinatario %zu.\n", i + 1);
+            goto cleanup;
+        }
+    }
+
+    if (crypt_stream_init_push(&cs, suite, key, header) != 0 ||
+        fwrite(header, 1, sizeof header, target_fp) != sizeof header) {
+        fprintf(stderr, "Erro: Falha ao escrever o header no arquivo de saida.\n");
+        goto cleanup;
+    }
+
+    if (encrypt_body(source_fp, target_fp, &cs) != 0) {
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    sodium_memzero(key, sizeof key);
+    stdstream_close_read(source_fp);
+    if (stdstream_close_write(target_fp, target_file, ret != 0) != 0) {
+        ret = 1;
+    }
+    return ret;
+}
+
+
+int decrypt_file_keypair(const char *target_file, const char *source_file,
+                         const unsigned char keypair[CRYPT_SECRETKEY_FILEBYTES])
+{
+    unsigned char  key[CRYPT_KEYBYTES];
+    unsigned char  prefix[CRYPT_PREFIXBYTES];
+    unsigned char  sealed[CRYPT_SEALED_KEYBYTES];
+    unsigned char  header[CRYPT_STREAM_HEADERBYTES];
+    const unsigned char *pk = keypair + crypto_box_SECRETKEYBYTES;
+    CryptStream    cs;
+    CryptSuite     suite;
+    FILE          *source_fp;
+    DecryptSink    sink;
+    size_t         n_recipients;
+    int            found = 0;
+    int            ret = 1;
+
+    source_fp = stdstream_open_read(source_file);
+    if (!source_fp) {
+        fprintf(stderr, "Erro: Nao foi possivel abrir o arquivo fonte '%s'\n", source_file);
+        return 1;
+    }
+    if (sink_open(&sink, target_file) != 0) {
+        fprintf(stderr, "Erro: Nao foi possivel criar o arquivo destino '%s'\n", target_file);
+        stdstream_close_read(source_fp);
+        return 1;
+    }
+
+    if (fread(prefix, 1, sizeof prefix, source_fp) != sizeof prefix ||
+        memcmp(prefix, CRYPT_MAGIC, 4) != 0 || prefix[5] != CRYPT_MODE_RECIPIENTS) {
+        fprintf(stderr, "Erro: Arquivo nao foi criptografado para chave publica.\n");
+        goto cleanup;
+    }
+    suite = (CryptSuite) prefix[4];
+    n_recipients = prefix[6] | ((size_t) prefix[7] << 8);
+
+    // Tenta abrir cada chave selada com o nosso par de chaves
+    for (size_t i = 0; i < n_recipients; i++) {
+        if (fread(sealed, 1, sizeof sealed, source_fp) != sizeof sealed) {
+            fprintf(stderr, "Erro: Cabecalho de destinatarios truncado.\n");
+            goto cleanup;
+        }
+        if (!found && crypto_box_seal_open(key, sealed, sizeof sealed, pk, keypair) == 0) {
+            found = 1;
+        }
+    }
+    if (!found) {
+        fprintf(stderr, "Erro: Esta chave nao e destinataria do arquivo.\n");
+        goto cleanup;
+    }
+
+    if (fread(header, 1, sizeof header, source_fp) != sizeof header ||
+        crypt_stream_init_pull(&cs, suite, key, header) != 0) {
+        fprintf(stderr, "Erro: Header invalido (arquivo corrompido?).\n");
+        goto cleanup;
+    }
+
+    if (decrypt_body(source_fp, &sink, &cs,
+                     CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) != 0) {
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    sodium_memzero(key, sizeof key);
+    if (sink_close(&sink, target_file, ret != 0) != 0) {
+        ret = ret ? ret : 1;
+    }
+    stdstream_close_read(source_fp);
+    return ret;
+}
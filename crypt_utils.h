@@ -2,23 +2,170 @@
 #define CRYPT_UTILS_H
 
 #include <stddef.h>
+#include <stdint.h>
+#include <sodium.h>
 
-// Funcao de criptografia de arquivo
+// Suites de cifra gravadas no cabecalho do arquivo criptografado
+typedef enum {
+    CRYPT_SUITE_AUTO      = 0,  // escolhe a suite mais rapida para o host
+    CRYPT_SUITE_XCHACHA20 = 1,  // XChaCha20-Poly1305 (secretstream), padrao portavel
+    CRYPT_SUITE_AES256GCM = 2   // AES-256-GCM segmentado (requer AES-NI)
+} CryptSuite;
+
+// Tamanho do texto claro de cada segmento e overhead por segmento (tag + MAC)
+#define CRYPT_SEGMENT_SIZE   65536
+#define CRYPT_SEGMENT_ABYTES 17
+
+// Cabecalho do fluxo (header do secretstream ou nonce base do AES-GCM)
+#define CRYPT_STREAM_HEADERBYTES 24
+#define CRYPT_KEYBYTES           32
+
+// Cabecalho do arquivo: magic(4) + suite(1) + modo(1) + reservado(2) + salt + header do fluxo
+#define CRYPT_MAGIC            "STGC"
+#define CRYPT_MODE_PASSWORD    0
+#define CRYPT_MODE_RECIPIENTS  1
+#define CRYPT_PREFIXBYTES      8
+#define CRYPT_FILE_HEADERBYTES (CRYPT_PREFIXBYTES + crypto_pwhash_SALTBYTES + \
+                                CRYPT_STREAM_HEADERBYTES)
+
+// Modo por chave publica: cada destinatario recebe a chave do fluxo selada
+#define CRYPT_MAX_RECIPIENTS      1024
+#define CRYPT_SEALED_KEYBYTES     (crypto_box_SEALBYTES + CRYPT_KEYBYTES)
+#define CRYPT_SECRETKEY_FILEBYTES (crypto_box_SECRETKEYBYTES + crypto_box_PUBLICKEYBYTES)
+
+// Estado de um fluxo segmentado, independente da suite
+typedef struct {
+    CryptSuite suite;
+    crypto_secretstream_xchacha20poly1305_state ss;
+    crypto_aead_aes256gcm_state gcm;
+    unsigned char nonce[crypto_aead_aes256gcm_NPUBBYTES];
+    uint64_t counter;
+} CryptStream;
+
+// Limita a memoria total das derivacoes de chave (Argon2) simultaneas; 0 = sem limite
+void crypt_set_kdf_memory_budget(size_t bytes);
+
+// Mantem ate `slots` chaves derivadas em memoria protegida (processos longos); 0 desativa
+int crypt_key_cache_enable(size_t slots);
+
+// Compartilha chaves derivadas entre processos pelo keyring do kernel, cada uma valida
+// por ttl_seconds; 0 desativa. As chaves nunca vao para o disco
+void crypt_keyring_enable(unsigned ttl_seconds);
+
+// Resolve a politica (auto) para uma suite concreta em *suite; 0 em sucesso, -1 se
+// a suite pedida nao esta disponivel neste processador
+int crypt_suite_resolve(CryptSuite policy, CryptSuite *suite);
+
+// Converte nome ("xchacha", "aes", "auto") em suite; 0 em sucesso, -1 se invalido
+int crypt_suite_parse(const char *name, CryptSuite *suite);
+
+// Nome legivel de uma suite
+const char *crypt_suite_name(CryptSuite suite);
+
+// Inicia um fluxo de criptografia e gera o header de CRYPT_STREAM_HEADERBYTES bytes
+int crypt_stream_init_push(CryptStream *cs, CryptSuite suite,
+                           const unsigned char key[CRYPT_KEYBYTES],
+                           unsigned char header[CRYPT_STREAM_HEADERBYTES]);
+
+// Criptografa um segmento; a saida tem in_len + CRYPT_SEGMENT_ABYTES bytes
+int crypt_stream_push(CryptStream *cs, unsigned char *out, size_t *out_len,
+                      const unsigned char *in, size_t in_len, int final);
+
+// Inicia um fluxo de descriptografia a partir do header
+int crypt_stream_init_pull(CryptStream *cs, CryptSuite suite,
+                           const unsigned char key[CRYPT_KEYBYTES],
+                           const unsigned char header[CRYPT_STREAM_HEADERBYTES]);
+
+// Descriptografa e autentica um segmento; *final indica o ultimo segmento
+int crypt_stream_pull(CryptStream *cs, unsigned char *out, size_t *out_len,
+                      int *final, const unsigned char *in, size_t in_len);
+
+// Gera Salt, deriva a chave da senha e inicia o fluxo; preenche o cabecalho do arquivo
+int crypt_password_init_push(CryptStream *cs, CryptSuite suite,
+                             const unsigned char *password, size_t password_len,
+                             unsigned char file_header[CRYPT_FILE_HEADERBYTES]);
+
+// Valida o cabecalho do arquivo, deriva a chave e inicia o fluxo de descriptografia
+int crypt_password_init_pull(CryptStream *cs,
+                             const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                             const unsigned char *password, size_t password_len);
+
+// Como crypt_password_init_push, mas so gera o Salt e devolve a chave derivada (sem
+// iniciar o fluxo), para varios fluxos com a mesma chave; *suite recebe a suite resolvida
+int crypt_password_key_push(CryptSuite *suite,
+                            const unsigned char *password, size_t password_len,
+                            unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                            unsigned char key[CRYPT_KEYBYTES]);
+
+// Como crypt_password_init_pull, mas so valida o cabecalho e devolve a chave e a suite
+int crypt_password_key_pull(const unsigned char file_header[CRYPT_FILE_HEADERBYTES],
+                            const unsigned char *password, size_t password_len,
+                            unsigned char key[CRYPT_KEYBYTES], CryptSuite *suite);
+
+// Funcao de criptografia de arquivo (XChaCha20-Poly1305)
 int encrypt_file(const char *target_file, const char *source_file,
                  const unsigned char *password, size_t password_len);
 
-// Funcao de descriptografia de arquivo
+// Funcao de criptografia de arquivo com suite escolhida
+int encrypt_file_suite(const char *target_file, const char *source_file,
+                       const unsigned char *password, size_t password_len,
+                       CryptSuite suite);
+
+// Funcao de descriptografia de arquivo (detecta a suite pelo cabecalho)
 int decrypt_file(const char *target_file, const char *source_file,
                  const unsigned char *password, size_t password_len);
 
-// Funcao de criptografia em memoria
+// Funcao de criptografia em memoria (XChaCha20-Poly1305)
 int encrypt_data(const unsigned char *input_data, size_t input_len,
                  unsigned char **output_data, size_t *output_len,
                  const unsigned char *password, size_t password_len);
 
-// Funcao de descriptografia em memoria
+// Funcao de criptografia em memoria com suite escolhida
+int encrypt_data_suite(const unsigned char *input_data, size_t input_len,
+                       unsigned char **output_data, size_t *output_len,
+                       const unsigned char *password, size_t password_len,
+                       CryptSuite suite);
+
+// Funcao de descriptografia em memoria (detecta a suite pelo cabecalho)
 int decrypt_data(const unsigned char *input_data, size_t input_len,
                  unsigned char **output_data, size_t *output_len,
                  const unsigned char *password, size_t password_len);
 
+// Tamanho exato da saida de encrypt_data_into para plain_len bytes de entrada
+size_t crypt_encrypted_size(size_t plain_len);
+
+// Limite superior do texto claro contido em encrypted_len bytes criptografados
+size_t crypt_decrypted_max_size(size_t encrypted_len);
+
+// Criptografa em um buffer do chamador (output_capacity >= crypt_encrypted_size)
+int encrypt_data_into(const unsigned char *input_data, size_t input_len,
+                      unsigned char *output, size_t output_capacity, size_t *output_len,
+                      const unsigned char *password, size_t password_len,
+                      CryptSuite suite);
+
+// Descriptografa em um buffer do chamador (output_capacity >= crypt_decrypted_max_size)
+int decrypt_data_into(const unsigned char *input_data, size_t input_len,
+                      unsigned char *output, size_t output_capacity, size_t *output_len,
+                      const unsigned char *password, size_t password_len);
+
+// Descriptografa no proprio buffer: o texto claro fica no inicio de data.
+// Em erro, o conteudo de data fica indefinido. Nao aceita o formato antigo
+int decrypt_data_inplace(unsigned char *data, size_t data_len, size_t *plain_len,
+                         const unsigned char *password, size_t password_len);
+
+// Gera um par X25519; o arquivo secreto guarda sk || pk
+int crypt_keygen_files(const char *public_file, const char *secret_file);
+
+// Le um arquivo de chave com exatamente key_len bytes
+int crypt_load_key(const char *key_file, unsigned char *key, size_t key_len);
+
+// Criptografa com chave de fluxo aleatoria selada para cada chave publica (sem Argon2)
+int encrypt_file_recipients(const char *target_file, const char *source_file,
+                            const unsigned char (*public_keys)[crypto_box_PUBLICKEYBYTES],
+                            size_t n_recipients, CryptSuite suite);
+
+// Descriptografa um arquivo do modo por chave publica usando sk || pk
+int decrypt_file_keypair(const char *target_file, const char *source_file,
+                         const unsigned char keypair[CRYPT_SECRETKEY_FILEBYTES]);
+
 #endif
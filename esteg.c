@@ -1,303 +1,1671 @@
-#include "esteg.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdint.h>
-
-// Define um "número mágico" (a sequência de caracteres "STEG").
-// Isso serve como uma assinatura para identificar rapidamente se uma imagem contém dados escondidos por este programa.
-#define MAGIC_NUMBER 0x53544547  // "STEG"
-
-/**
- * @brief Define o cabeçalho que será escondido na imagem antes dos dados.
- * Este cabeçalho contém o número mágico e o tamanho dos dados escondidos.
- */
-typedef struct {
-    uint32_t magic;
-    uint32_t data_size;
-} StegoHeader;
-
-/**
- * @brief Lê o cabeçalho de um arquivo BMP para descobrir onde os dados dos pixels começam.
- * O offset (deslocamento) está armazenado a partir do 10º byte do arquivo.
- * @param bmp_data Ponteiro para os dados brutos do arquivo BMP.
- * @return O deslocamento em bytes até a área de pixels.
- */
-static uint32_t get_bmp_pixel_offset(unsigned char *bmp_data) {
-    // Lê os 4 bytes que representam o offset para a área de pixels no arquivo BMP.
-    return bmp_data[10] | (bmp_data[11] << 8) | 
-           (bmp_data[12] << 16) | (bmp_data[13] << 24);
-}
-
-/**
- * @brief Esconde um buffer de dados dentro de uma imagem BMP.
- * 
- * @param image_path Caminho para a imagem BMP original (cover image).
- * @param data Ponteiro para os dados que serão escondidos.
- * @param data_size Tamanho dos dados a serem escondidos.
- * @param output_path Caminho para salvar a nova imagem com os dados escondidos (stego image).
- * @return 0 em caso de sucesso, -1 em caso de erro.
- */
-int steg_hide(const char *image_path, const unsigned char *data, 
-              size_t data_size, const char *output_path) {
-    
-    // Abre a imagem original em modo binário para leitura.
-    FILE *img = fopen(image_path, "rb");
-    if (!img) {
-        perror("Erro ao abrir imagem");
-        return -1;
-    }
-
-    // Lê a imagem inteira para um buffer na memória para facilitar a manipulação.
-    fseek(img, 0, SEEK_END);
-    size_t img_size = ftell(img);
-    fseek(img, 0, SEEK_SET);
-
-    unsigned char *image_buffer = malloc(img_size);
-    if (!image_buffer) {
-        perror("Erro ao alocar memória");
-        fclose(img);
-        return -1;
-    }
-    fread(image_buffer, 1, img_size, img);
-    fclose(img);
-
-    // Verifica se o arquivo é um BMP válido checando os dois primeiros bytes (assinatura "BM").
-    if (image_buffer[0] != 0x42 || image_buffer[1] != 0x4D) {
-        fprintf(stderr, "Erro: arquivo não é BMP válido\n");
-        free(image_buffer);
-        return -1;
-    }
-
-    // Obtém o offset para a área de pixels no arquivo BMP.
-    uint32_t pixel_offset = get_bmp_pixel_offset(image_buffer);
-    
-    // Calcula a capacidade de armazenamento da imagem. 
-    // Cada byte de dado requer 8 bytes na imagem (1 bit por byte, no bit menos significativo - LSB).
-    // Também subtrai o espaço necessário para o nosso próprio cabeçalho (StegoHeader).
-    size_t available = img_size - pixel_offset;
-    size_t capacity = (available / 8) - sizeof(StegoHeader);
-
-    if (data_size > capacity) {
-        fprintf(stderr, "Erro: dados muito grandes para a imagem\n");
-        fprintf(stderr, "Capacidade: %zu bytes, necessário: %zu bytes\n", 
-                capacity, data_size);
-        free(image_buffer);
-        return -1;
-    }
-
-    // Prepara o nosso cabeçalho com o número mágico e o tamanho dos dados.
-    StegoHeader header;
-    header.magic = MAGIC_NUMBER;
-    header.data_size = data_size;
-
-    size_t img_pos = pixel_offset;
-    
-    // Itera sobre cada byte do nosso cabeçalho (StegoHeader).
-    // Para cada byte, esconde seus 8 bits nos 8 bytes seguintes da imagem.
-    unsigned char *header_bytes = (unsigned char *)&header;
-    for (size_t i = 0; i < sizeof(StegoHeader); i++) {
-        unsigned char byte = header_bytes[i];
-        for (int bit = 0; bit < 8; bit++) {
-            unsigned char data_bit = (byte >> bit) & 1;
-            image_buffer[img_pos] = (image_buffer[img_pos] & 0xFE) | data_bit;
-            img_pos++;
-        }
-    }
-
-    // Faz o mesmo processo para os dados do arquivo, escondendo cada bit de cada byte.
-    for (size_t i = 0; i < data_size; i++) {
-        unsigned char byte = data[i];
-        for (int bit = 0; bit < 8; bit++) {
-            unsigned char data_bit = (byte >> bit) & 1;
-            image_buffer[img_pos] = (image_buffer[img_pos] & 0xFE) | data_bit;
-            img_pos++;
-        }
-    }
-
-    // Salva o buffer da imagem (agora modificado) em um novo arquivo.
-    FILE *output = fopen(output_path, "wb");
-    if (!output) {
-        perror("Erro ao criar arquivo de saída");
-        free(image_buffer);
-        return -1;
-    }
-    
-    fwrite(image_buffer, 1, img_size, output);
-    fclose(output);
-    free(image_buffer);
-
-    return 0;
-}
-
-/**
- * @brief Extrai dados escondidos de uma imagem BMP.
- * 
- * @param image_path Caminho para a imagem que contém os dados (stego image).
- * @param data Ponteiro para um buffer que será alocado para armazenar os dados extraídos.
- * @param data_size Ponteiro para uma variável que receberá o tamanho dos dados extraídos.
- * @return 0 em caso de sucesso, -1 em caso de erro.
- */
-int steg_extract(const char *image_path, unsigned char **data, 
-                 size_t *data_size) {
-    
-    // Abre a imagem que contém os dados escondidos em modo binário para leitura.
-    FILE *img = fopen(image_path, "rb");
-    if (!img) {
-        perror("Erro ao abrir imagem");
-        return -1;
-    }
-
-    fseek(img, 0, SEEK_END);
-    size_t img_size = ftell(img);
-    fseek(img, 0, SEEK_SET);
-
-    unsigned char *image_buffer = malloc(img_size);
-    if (!image_buffer) {
-        perror("Erro ao alocar memória");
-        fclose(img);
-        return -1;
-    }
-    fread(image_buffer, 1, img_size, img);
-    fclose(img);
-
-    // Obtém o offset para a área de pixels no arquivo BMP.
-    uint32_t pixel_offset = get_bmp_pixel_offset(image_buffer);
-    size_t img_pos = pixel_offset;
-
-    // Extrai o cabeçalho (StegoHeader) da imagem. 
-    // O processo é o inverso de esconder: lê 8 bytes da imagem para reconstruir 1 byte do cabeçalho.
-    StegoHeader header;
-    unsigned char *header_bytes = (unsigned char *)&header;
-    
-    for (size_t i = 0; i < sizeof(StegoHeader); i++) {
-        unsigned char byte = 0;
-        for (int bit = 0; bit < 8; bit++) {
-            unsigned char lsb = image_buffer[img_pos] & 1;
-            byte |= (lsb << bit);
-            img_pos++;
-        }
-        header_bytes[i] = byte;
-    }
-
-    // Verifica se o número mágico corresponde. Se não, a imagem não contém nossos dados.
-    if (header.magic != MAGIC_NUMBER) {
-        fprintf(stderr, "Erro: dados não encontrados na imagem\n");
-        free(image_buffer);
-        return -1;
-    }
-
-    // Uma vez que o cabeçalho é válido, aloca memória e extrai o restante dos dados.
-    *data = malloc(header.data_size);
-    if (!*data) {
-        perror("Erro ao alocar memória");
-        free(image_buffer);
-        return -1;
-    }
-
-    for (size_t i = 0; i < header.data_size; i++) {
-        unsigned char byte = 0;
-        for (int bit = 0; bit < 8; bit++) {
-            unsigned char lsb = image_buffer[img_pos] & 1;
-            byte |= (lsb << bit);
-            img_pos++;
-        }
-        (*data)[i] = byte;
-    }
-
-    *data_size = header.data_size;
-    free(image_buffer);
-
-    return 0;
-}
-
-/**
- * @brief Função de conveniência para esconder um arquivo inteiro.
- *        Lê o arquivo para um buffer e chama a função steg_hide.
- */
-int steg_hide_file(const char *image_path, const char *file_path, 
-                   const char *output_path) {
-    
-    // Abre o arquivo que será escondido em modo binário para leitura.
-    FILE *f = fopen(file_path, "rb");
-    if (!f) {
-        perror("Erro ao abrir arquivo");
-        return -1;
-    }
-
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-
-    unsigned char *file_data = malloc(file_size);
-    if (!file_data) {
-        perror("Erro ao alocar memória");
-        fclose(f);
-        return -1;
-    }
-
-    fread(file_data, 1, file_size, f);
-    fclose(f);
-
-    int result = steg_hide(image_path, file_data, file_size, output_path);
-    free(file_data);
-
-    return result;
-}
-
-/**
- * @brief Função de conveniência para extrair dados para um arquivo.
- *        Chama steg_extract e salva o buffer resultante em um arquivo.
- */
-int steg_extract_file(const char *image_path, const char *output_path) {
-    unsigned char *data = NULL;
-    size_t data_size = 0;
-
-    if (steg_extract(image_path, &data, &data_size) != 0) {
-        return -1;
-    }
-
-    FILE *out = fopen(output_path, "wb");
-    if (!out) {
-        perror("Erro ao criar arquivo de saída");
-        free(data);
-        return -1;
-    }
-
-    fwrite(data, 1, data_size, out);
-    fclose(out);
-    free(data);
-
-    return 0;
-}
-
-/**
- * @brief Calcula a capacidade de armazenamento de uma imagem BMP em bytes.
- * 
- * @param image_path Caminho para a imagem BMP.
- * @return A capacidade em bytes, ou -1 em caso de erro.
- */
-long steg_get_capacity(const char *image_path) {
-    FILE *img = fopen(image_path, "rb");
-    if (!img) {
-        return -1;
-    }
-
-    fseek(img, 0, SEEK_END);
-    size_t img_size = ftell(img);
-    fseek(img, 0, SEEK_SET);
-
-    unsigned char header[14];
-    fread(header, 1, 14, img);
-    fclose(img);
-
-    if (header[0] != 0x42 || header[1] != 0x4D) {
-        return -1;
-    }
-
-    uint32_t pixel_offset = get_bmp_pixel_offset(header);
-    size_t available = img_size - pixel_offset;
-    size_t capacity = (available / 8) - sizeof(StegoHeader);
-
-    return capacity;
-}
\ No newline at end of file
+#include "esteg.h"
+#include "bufpool.h"
+#include "metrics.h"
+#include "opctx.h"
+#include "ioring.h"
+#include "outmap.h"
+#include "cover.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// Define um "número mágico" (a sequência de caracteres "STEG").
+// Isso serve como uma assinatura para identificar rapidamente se uma imagem contém dados escondidos por este programa.
+#define MAGIC_NUMBER 0x53544547  // "STEG"
+
+// Imagens geradas a partir desta versão: os dados são seguidos do CRC32C deles
+// (StegoDigest). Imagens com MAGIC_NUMBER continuam sendo lidas, sem conferência.
+#define MAGIC_DIGEST 0x53544744  // "STGD"
+
+/**
+ * @brief Define o cabeçalho que será escondido na imagem antes dos dados.
+ * Este cabeçalho contém o número mágico e o tamanho dos dados escondidos.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t data_size;
+} StegoHeader;
+
+/**
+ * @brief Resumo escondido logo depois dos dados (só com MAGIC_DIGEST).
+ */
+typedef struct {
+    uint32_t crc32c;
+} StegoDigest;
+
+// Bytes de dados ocupados além do conteúdo: cabeçalho antes, resumo depois.
+#define STEG_OVERHEAD (sizeof(StegoHeader) + sizeof(StegoDigest))
+
+/**
+ * @brief Espalha os 8 bits de um byte nos LSBs de 8 bytes (bit i -> byte i).
+ * Cada nibble é multiplicado separadamente para que os produtos parciais não colidam.
+ */
+static inline uint64_t spread_bits(unsigned char byte) {
+    uint64_t lo = ((uint64_t)(byte & 0x0F) * 0x00204081ULL) & 0x01010101ULL;
+    uint64_t hi = ((uint64_t)(byte >> 4) * 0x00204081ULL) & 0x01010101ULL;
+    return lo | (hi << 32);
+}
+
+/**
+ * @brief Junta os LSBs de 8 bytes em um byte (byte i -> bit i).
+ */
+static inline unsigned char gather_bits(uint64_t lanes) {
+    return (unsigned char)(((lanes & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56);
+}
+
+/**
+ * @brief Tabela do CRC32C (polinômio de Castagnoli, refletido) para CPUs sem a instrução.
+ */
+static uint32_t crc32c_table[256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32c_table_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c >> 1) ^ (0x82F63B78U & (0U - (c & 1)));
+        }
+        crc32c_table[i] = c;
+    }
+}
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len) {
+    pthread_once(&crc32c_table_once, crc32c_table_init);
+    while (len--) {
+        crc = crc32c_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/**
+ * @brief Instrução crc32 do SSE4.2: 8 bytes por chamada.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = __builtin_ia32_crc32di(c, word);
+    }
+    for (; len > 0; len--) {
+        c = __builtin_ia32_crc32qi((uint32_t)c, *p++);
+    }
+    return (uint32_t)c;
+}
+#endif
+
+/**
+ * @brief CRC32C acumulado (comece com crc = 0).
+ */
+static uint32_t crc32c(uint32_t crc, const unsigned char *data, size_t len) {
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ~crc32c_hw(~crc, data, len);
+    }
+#endif
+    return ~crc32c_sw(~crc, data, len);
+}
+
+/**
+ * @brief Bytes da capa que carregam n bytes de dados (um bit por amostra).
+ */
+static inline size_t layout_span(const CoverLayout *layout, size_t n) {
+    return n * 8 * layout->stride;
+}
+
+/**
+ * @brief Maior bloco de dados cujas amostras cabem em STEG_IO_CHUNK * 8 bytes.
+ */
+static inline size_t layout_chunk(const CoverLayout *layout) {
+    return STEG_IO_CHUNK / layout->stride;
+}
+
+/**
+ * @brief Espaço para dados depois do StegoHeader e do StegoDigest, ou -1 se
+ *        nem eles cabem nas amostras da capa.
+ */
+static long long layout_capacity(const CoverLayout *layout) {
+    uint64_t bytes = cover_layout_samples(layout) / 8;
+    return bytes < STEG_OVERHEAD ? -1 : (long long)(bytes - STEG_OVERHEAD);
+}
+
+/**
+ * @brief layout_capacity limitada ao que o data_size (32 bits) do StegoHeader
+ *        registra: em capas de vários GB a capacidade passa disso. Só para
+ *        capas em que layout_capacity já foi conferida.
+ */
+static size_t payload_capacity(const CoverLayout *layout) {
+    long long capacity = layout_capacity(layout);
+    return capacity > UINT32_MAX ? UINT32_MAX : (size_t)capacity;
+}
+
+/**
+ * @brief steg_embed_bytes para qualquer capa: com mais de um byte por amostra
+ *        (WAV de 16/24 bits, PGM/PPM de 16 bits), só o byte do LSB é tocado.
+ */
+static void embed_samples(unsigned char *cover, const unsigned char *data, size_t n,
+                          const CoverLayout *layout) {
+    if (layout->stride == 1) {
+        steg_embed_bytes(cover, data, n);
+        return;
+    }
+    uint64_t t = metrics_start();
+    unsigned char *p = cover + layout->lsb;
+    for (size_t i = 0; i < n; i++) {
+        for (int bit = 0; bit < 8; bit++, p += layout->stride) {
+            *p = (unsigned char)((*p & 0xFE) | ((data[i] >> bit) & 1));
+        }
+    }
+    metrics_stop(METRICS_EMBED, t, n, layout_span(layout, n));
+}
+
+/**
+ * @brief steg_extract_bytes para qualquer capa (o inverso de embed_samples).
+ */
+static void extract_samples(unsigned char *data, const unsigned char *cover, size_t n,
+                            const CoverLayout *layout) {
+    if (layout->stride == 1) {
+        steg_extract_bytes(data, cover, n);
+        return;
+    }
+    uint64_t t = metrics_start();
+    const unsigned char *p = cover + layout->lsb;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char byte = 0;
+        for (int bit = 0; bit < 8; bit++, p += layout->stride) {
+            byte |= (unsigned char)((*p & 1) << bit);
+        }
+        data[i] = byte;
+    }
+    metrics_stop(METRICS_EXTRACT, t, layout_span(layout, n), n);
+}
+
+/**
+ * @brief Embute em blocos de STEG_IO_CHUNK, somando o CRC32C de cada bloco
+ *        enquanto ele ainda está no cache da CPU.
+ *
+ * @return 0 em sucesso, -1 se a operação foi cancelada (opctx.h).
+ */
+static int embed_with_crc(unsigned char *cover, const unsigned char *data,
+                          size_t data_size, uint32_t *crc, const CoverLayout *layout) {
+    while (data_size > 0) {
+        size_t n = data_size < STEG_IO_CHUNK ? data_size : STEG_IO_CHUNK;
+        if (op_step(OP_STAGE_EMBED, n) != 0) {
+            return -1;
+        }
+        *crc = crc32c(*crc, data, n);
+        embed_samples(cover, data, n, layout);
+        cover += layout_span(layout, n);
+        data += n;
+        data_size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Extrai em blocos de STEG_IO_CHUNK, somando o CRC32C de cada um.
+ *
+ * @return 0 em sucesso, -1 se a operação foi cancelada (opctx.h).
+ */
+static int extract_with_crc(unsigned char *data, const unsigned char *cover,
+                            size_t data_size, uint32_t *crc, const CoverLayout *layout) {
+    while (data_size > 0) {
+        size_t n = data_size < STEG_IO_CHUNK ? data_size : STEG_IO_CHUNK;
+        if (op_step(OP_STAGE_EXTRACT, n) != 0) {
+            return -1;
+        }
+        extract_samples(data, cover, n, layout);
+        *crc = crc32c(*crc, data, n);
+        cover += layout_span(layout, n);
+        data += n;
+        data_size -= n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Valida o StegoHeader extraído contra o espaço da capa depois dele.
+ * @return 1 se os dados são seguidos de um StegoDigest, 0 no formato antigo,
+ *         -1 (com mensagem) se não há dados ou o tamanho excede a imagem.
+ */
+static int header_check(const StegoHeader *header, size_t available) {
+    int digest;
+    if (header->magic == MAGIC_DIGEST) {
+        digest = 1;
+    } else if (header->magic == MAGIC_NUMBER) {
+        digest = 0;
+    } else {
+        fprintf(stderr, "Erro: dados não encontrados na imagem\n");
+        return -1;
+    }
+    if (header->data_size > available ||
+        (digest && available - header->data_size < sizeof(StegoDigest))) {
+        fprintf(stderr, "Erro: tamanho dos dados escondidos excede a imagem\n");
+        return -1;
+    }
+    return digest;
+}
+
+static void digest_mismatch(void) {
+    fprintf(stderr, "Erro: CRC32C dos dados escondidos não confere (imagem corrompida)\n");
+}
+
+void steg_embed_bytes(unsigned char *cover, const unsigned char *data, size_t data_size) {
+    uint64_t t = metrics_start();
+    // Processa 8 bytes da imagem por vez: limpa os LSBs e insere os bits do byte de dados.
+    for (size_t i = 0; i < data_size; i++) {
+        uint64_t lanes;
+        memcpy(&lanes, cover + i * 8, 8);
+        lanes = (lanes & ~0x0101010101010101ULL) | spread_bits(data[i]);
+        memcpy(cover + i * 8, &lanes, 8);
+    }
+    metrics_stop(METRICS_EMBED, t, data_size, data_size * 8);
+}
+
+void steg_extract_bytes(unsigned char *data, const unsigned char *cover, size_t data_size) {
+    uint64_t t = metrics_start();
+    for (size_t i = 0; i < data_size; i++) {
+        uint64_t lanes;
+        memcpy(&lanes, cover + i * 8, 8);
+        data[i] = gather_bits(lanes);
+    }
+    metrics_stop(METRICS_EXTRACT, t, data_size * 8, data_size);
+}
+
+/**
+ * @brief Capa mantida em memória pelo cache, já validada (cover.h).
+ *        `refs` conta os leitores/escritores usando os dados; a entrada só é
+ *        liberada com refs == 0. Os dados nunca são alterados depois de carregados.
+ */
+typedef struct CoverEntry {
+    struct CoverEntry *prev;   // vizinho mais recente na lista LRU
+    struct CoverEntry *next;   // vizinho menos recente
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    CoverLayout layout;
+    unsigned char *data;
+    int refs;
+    int stale;                 // o arquivo mudou no disco: sai do cache ao ser liberada
+} CoverEntry;
+
+// Lista LRU: cover_lru_head é a capa usada mais recentemente.
+static pthread_mutex_t cover_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static CoverEntry *cover_lru_head = NULL;
+static CoverEntry *cover_lru_tail = NULL;
+static size_t cover_cache_budget = 0;
+static StegCoverCacheStats cover_cache_stats;
+
+static void lru_unlink(CoverEntry *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        cover_lru_head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        cover_lru_tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(CoverEntry *e) {
+    e->prev = NULL;
+    e->next = cover_lru_head;
+    if (cover_lru_head) {
+        cover_lru_head->prev = e;
+    }
+    cover_lru_head = e;
+    if (!cover_lru_tail) {
+        cover_lru_tail = e;
+    }
+}
+
+static void cover_entry_free(CoverEntry *e) {
+    free(e->path);
+    free(e->data);
+    free(e);
+}
+
+/**
+ * @brief Remove uma entrada sem uso da lista (com o lock tomado).
+ */
+static void cover_drop_locked(CoverEntry *e) {
+    lru_unlink(e);
+    cover_cache_stats.bytes -= (size_t)e->size;
+    cover_cache_stats.entries--;
+    cover_entry_free(e);
+}
+
+/**
+ * @brief Descarta capas sem uso, da menos recente para a mais recente, até caber no orçamento.
+ */
+static void cover_evict_locked(void) {
+    CoverEntry *e = cover_lru_tail;
+    while (e && cover_cache_stats.bytes > cover_cache_budget) {
+        CoverEntry *prev = e->prev;
+        if (e->refs == 0) {
+            cover_drop_locked(e);
+            cover_cache_stats.evictions++;
+        }
+        e = prev;
+    }
+}
+
+int steg_cover_cache_set_budget(size_t max_bytes) {
+    pthread_mutex_lock(&cover_cache_lock);
+    cover_cache_budget = max_bytes;
+    cover_evict_locked();
+    pthread_mutex_unlock(&cover_cache_lock);
+    return 0;
+}
+
+void steg_cover_cache_get_stats(StegCoverCacheStats *stats) {
+    pthread_mutex_lock(&cover_cache_lock);
+    *stats = cover_cache_stats;
+    pthread_mutex_unlock(&cover_cache_lock);
+}
+
+static int cover_entry_matches(const CoverEntry *e, const struct stat *st) {
+    return e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+           e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+/**
+ * @brief Procura a capa na lista (com o lock tomado). Uma entrada do mesmo caminho
+ *        cujo arquivo mudou é marcada como velha e descartada assim que possível.
+ */
+static CoverEntry *cover_lookup_locked(const char *path, const struct stat *st) {
+    CoverEntry *e = cover_lru_head;
+    while (e) {
+        CoverEntry *next = e->next;
+        if (!e->stale && strcmp(e->path, path) == 0) {
+            if (cover_entry_matches(e, st)) {
+                return e;
+            }
+            e->stale = 1;
+            if (e->refs == 0) {
+                cover_drop_locked(e);
+            }
+        }
+        e = next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Valida os bytes já lidos de uma capa e preenche a identificação da entrada.
+ *        Só entram no cache capas reconhecidas com espaço para o StegoHeader e o
+ *        StegoDigest; as outras ficam para o caminho sem cache, que reporta o erro.
+ *
+ * @return 0 em sucesso, -1 se a capa não serve.
+ */
+static int cover_entry_fill(CoverEntry *e, const struct stat *st) {
+    size_t head = (size_t)st->st_size < COVER_HEAD_MAX ? (size_t)st->st_size : COVER_HEAD_MAX;
+    if (cover_layout_probe(e->data, head, (uint64_t)st->st_size, &e->layout) != 0 ||
+        layout_capacity(&e->layout) < 0) {
+        return -1;
+    }
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+    return 0;
+}
+
+/**
+ * @brief Lê e valida uma capa inteira para uma nova entrada (sem o lock).
+ */
+static CoverEntry *cover_load(const char *path, const struct stat *st) {
+    CoverEntry *e = calloc(1, sizeof(CoverEntry));
+    if (!e) {
+        return NULL;
+    }
+    e->path = strdup(path);
+    e->data = malloc((size_t)st->st_size);
+    metrics_alloc((size_t)st->st_size);
+    FILE *f = fopen(path, "rb");
+    if (!e->path || !e->data || !f ||
+        metrics_fread(e->data, (size_t)st->st_size, f) != (size_t)st->st_size) {
+        if (f) {
+            fclose(f);
+        }
+        cover_entry_free(e);
+        return NULL;
+    }
+    fclose(f);
+
+    if (cover_entry_fill(e, st) != 0) {
+        cover_entry_free(e);
+        return NULL;
+    }
+    return e;
+}
+
+/**
+ * @brief Obtém a capa do cache, carregando-a se necessário.
+ * @return A entrada com uma referência a mais, ou NULL se o cache estiver desativado,
+ *         se a capa não couber no orçamento ou não for um BMP válido (o chamador
+ *         lê o arquivo diretamente e reporta o erro).
+ */
+static CoverEntry *cover_acquire(const char *path) {
+    struct stat st;
+
+    pthread_mutex_lock(&cover_cache_lock);
+    if (cover_cache_budget == 0 || stat(path, &st) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_size < 14 || (size_t)st.st_size > cover_cache_budget) {
+        pthread_mutex_unlock(&cover_cache_lock);
+        return NULL;
+    }
+    CoverEntry *e = cover_lookup_locked(path, &st);
+    if (e) {
+        e->refs++;
+        lru_unlink(e);
+        lru_push_front(e);
+        cover_cache_stats.hits++;
+        pthread_mutex_unlock(&cover_cache_lock);
+        return e;
+    }
+    cover_cache_stats.misses++;
+    pthread_mutex_unlock(&cover_cache_lock);
+
+    // Carrega fora do lock para não bloquear os acertos de outras threads.
+    CoverEntry *loaded = cover_load(path, &st);
+    if (!loaded) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&cover_cache_lock);
+    e = cover_lookup_locked(path, &st);
+    if (e) {
+        // Outra thread carregou a mesma capa enquanto líamos.
+        cover_entry_free(loaded);
+        lru_unlink(e);
+    } else {
+        e = loaded;
+        cover_cache_stats.bytes += (size_t)e->size;
+        cover_cache_stats.entries++;
+    }
+    e->refs++;
+    lru_push_front(e);
+    cover_evict_locked();
+    pthread_mutex_unlock(&cover_cache_lock);
+    return e;
+}
+
+size_t steg_cover_cache_preload(const char *const *paths, size_t n, int direct) {
+    IoFile *files = calloc(n ? n : 1, sizeof(IoFile));
+    if (!files) {
+        return 0;
+    }
+
+    // Escolhe, na ordem dada, as capas ainda fora do cache que cabem no orçamento.
+    size_t m = 0, planned = 0;
+    pthread_mutex_lock(&cover_cache_lock);
+    for (size_t i = 0; i < n; i++) {
+        struct stat st;
+        if (stat(paths[i], &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 14 ||
+            (size_t)st.st_size > cover_cache_budget - planned ||
+            cover_lookup_locked(paths[i], &st)) {
+            continue;
+        }
+        int repeated = 0;
+        for (size_t k = 0; k < m && !repeated; k++) {
+            repeated = strcmp(files[k].path, paths[i]) == 0;
+        }
+        if (!repeated) {
+            files[m++].path = paths[i];
+            planned += (size_t)st.st_size;
+        }
+    }
+    pthread_mutex_unlock(&cover_cache_lock);
+
+    // Todas as leituras em voo de uma vez; a validação é a mesma de cover_load.
+    io_read_files(files, m, direct);
+    size_t loaded = 0;
+    for (size_t k = 0; k < m; k++) {
+        CoverEntry *e = files[k].data ? calloc(1, sizeof(CoverEntry)) : NULL;
+        if (!e) {
+            free(files[k].data);
+            continue;
+        }
+        e->data = files[k].data;
+        e->path = strdup(files[k].path);
+        if (!e->path || cover_entry_fill(e, &files[k].st) != 0) {
+            cover_entry_free(e);
+            continue;
+        }
+
+        pthread_mutex_lock(&cover_cache_lock);
+        if (cover_lookup_locked(e->path, &files[k].st)) {
+            cover_entry_free(e);
+        } else {
+            lru_push_front(e);
+            cover_cache_stats.bytes += (size_t)e->size;
+            cover_cache_stats.entries++;
+            cover_cache_stats.preloaded++;
+            loaded++;
+        }
+        cover_evict_locked();
+        pthread_mutex_unlock(&cover_cache_lock);
+    }
+    free(files);
+    return loaded;
+}
+
+static void cover_release(CoverEntry *e) {
+    if (!e) {
+        return;
+    }
+    pthread_mutex_lock(&cover_cache_lock);
+    if (--e->refs == 0) {
+        if (e->stale) {
+            cover_drop_locked(e);
+        } else {
+            cover_evict_locked();
+        }
+    }
+    pthread_mutex_unlock(&cover_cache_lock);
+}
+
+/**
+ * @brief Esconde dados a partir de uma capa do cache. Só o trecho de pixels alterado
+ *        (StegoHeader + dados) é copiado; o resto da saída vem direto do cache.
+ */
+static int hide_cached(const CoverEntry *cover, const unsigned char *data,
+                       size_t data_size, const char *output_path) {
+    const CoverLayout *layout = &cover->layout;
+    size_t img_size = (size_t)cover->size;
+    size_t pixel_offset = (size_t)layout->offset;
+    size_t capacity = payload_capacity(layout);
+
+    if (data_size > capacity) {
+        fprintf(stderr, "Erro: dados muito grandes para a imagem\n");
+        fprintf(stderr, "Capacidade: %zu bytes, necessário: %zu bytes\n",
+                capacity, data_size);
+        return -1;
+    }
+
+    StegoHeader header;
+    header.magic = MAGIC_DIGEST;
+    header.data_size = data_size;
+
+    size_t span_size = layout_span(layout, STEG_OVERHEAD + data_size);
+    unsigned char *span = buf_alloc(span_size);
+    if (!span) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    memcpy(span, cover->data + pixel_offset, span_size);
+    embed_samples(span, (unsigned char *)&header, sizeof(StegoHeader), layout);
+    StegoDigest digest = { 0 };
+    op_total(OP_STAGE_EMBED, data_size);
+    if (embed_with_crc(span + layout_span(layout, sizeof(StegoHeader)), data, data_size,
+                       &digest.crc32c, layout) != 0) {
+        buf_free(span);
+        return -1;
+    }
+    embed_samples(span + layout_span(layout, sizeof(StegoHeader) + data_size),
+                  (unsigned char *)&digest, sizeof(StegoDigest), layout);
+
+    int fd = open(output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        perror("Erro ao criar arquivo de saída");
+        buf_free(span);
+        return -1;
+    }
+    // Os três trechos vão juntos para a fila de E/S, cada um na sua posição.
+    size_t tail = pixel_offset + span_size;
+    IoRequest writes[3] = {
+        { fd, 1, cover->data, pixel_offset, 0, 0 },
+        { fd, 1, span, span_size, pixel_offset, 0 },
+        { fd, 1, cover->data + tail, img_size - tail, tail, 0 },
+    };
+    int failed = io_run(writes, 3, 0) != 0;
+    failed |= close(fd) != 0;
+    buf_free(span);
+    if (failed) {
+        fprintf(stderr, "Erro ao escrever a imagem\n");
+        remove(output_path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Esconde um buffer de dados dentro de uma imagem BMP.
+ * 
+ * @param image_path Caminho para a imagem BMP original (cover image).
+ * @param data Ponteiro para os dados que serão escondidos.
+ * @param data_size Tamanho dos dados a serem escondidos.
+ * @param output_path Caminho para salvar a nova imagem com os dados escondidos (stego image).
+ * @return 0 em caso de sucesso, -1 em caso de erro.
+ */
+int steg_hide(const char *image_path, const unsigned char *data, 
+              size_t data_size, const char *output_path) {
+
+    // Capa já validada no cache: evita reler o arquivo e copia só o trecho alterado.
+    CoverEntry *cached = cover_acquire(image_path);
+    if (cached) {
+        int ret = hide_cached(cached, data, data_size, output_path);
+        cover_release(cached);
+        return ret;
+    }
+    
+    // Fora do cache a capa passa em blocos pelo StegWriter: capas de vários GB
+    // (WAV longos, quadros PPM) não precisam caber na memória.
+    // Cada byte de dado requer 8 amostras da capa (1 bit por amostra, no bit menos significativo - LSB).
+    StegWriter *w = steg_writer_open(image_path, output_path);
+    if (!w) {
+        return -1;
+    }
+    op_total(OP_STAGE_EMBED, data_size);
+    if (steg_writer_write(w, data, data_size) != 0) {
+        steg_writer_abort(w);
+        return -1;
+    }
+    return steg_writer_close(w);
+}
+
+/**
+ * @brief Extrai dados escondidos de uma imagem BMP.
+ * 
+ * @param image_path Caminho para a imagem que contém os dados (stego image).
+ * @param data Ponteiro para um buffer que será alocado para armazenar os dados extraídos.
+ * @param data_size Ponteiro para uma variável que receberá o tamanho dos dados extraídos.
+ * @return 0 em caso de sucesso, -1 em caso de erro.
+ */
+int steg_extract(const char *image_path, unsigned char **data, 
+                 size_t *data_size) {
+    
+    // O StegReader valida a capa e o StegoHeader lendo só o início do arquivo;
+    // o resto é lido em blocos, sem carregar a capa inteira.
+    StegReader *r = steg_reader_open(image_path);
+    if (!r) {
+        return -1;
+    }
+
+    // Uma vez que o cabeçalho é válido, aloca memória e extrai os dados,
+    // conferindo o CRC32C que vem depois deles.
+    size_t size = steg_reader_size(r);
+    *data = malloc(size ? size : 1);
+    if (!*data) {
+        perror("Erro ao alocar memória");
+        steg_reader_close(r);
+        return -1;
+    }
+    metrics_alloc(size);
+    if (steg_reader_read(r, *data, size) != 0) {
+        free(*data);
+        *data = NULL;
+        steg_reader_close(r);
+        return -1;
+    }
+    steg_reader_close(r);
+
+    *data_size = size;
+    return 0;
+}
+
+/**
+ * @brief Função de conveniência para esconder um arquivo inteiro.
+ *        Lê o arquivo para um buffer e chama a função steg_hide.
+ */
+int steg_hide_file(const char *image_path, const char *file_path, 
+                   const char *output_path) {
+    
+    // Abre o arquivo que será escondido em modo binário para leitura.
+    FILE *f = fopen(file_path, "rb");
+    if (!f) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    unsigned char *file_data = buf_alloc(file_size);
+    if (!file_data) {
+        perror("Erro ao alocar memória");
+        fclose(f);
+        return -1;
+    }
+
+    metrics_fread(file_data, file_size, f);
+    fclose(f);
+
+    int result = steg_hide(image_path, file_data, file_size, output_path);
+    buf_free(file_data);
+
+    return result;
+}
+
+/**
+ * @brief Função de conveniência para extrair dados para um arquivo.
+ *        O tamanho vem do StegoHeader: a saída é reservada inteira e os bits
+ *        são extraídos direto no mapa (outmap.h), que só toma o lugar do
+ *        arquivo depois de o CRC32C conferir.
+ */
+int steg_extract_file(const char *image_path, const char *output_path) {
+    if (!outmap_supported(output_path)) {
+        FILE *out = fopen(output_path, "wb");
+        if (!out) {
+            perror("Erro ao criar arquivo de saída");
+            return -1;
+        }
+        int ret = steg_extract_stream(image_path, out);
+        return fclose(out) == 0 ? ret : -1;
+    }
+
+    StegReader *r = steg_reader_open(image_path);
+    if (!r) {
+        return -1;
+    }
+    size_t data_size = steg_reader_size(r);
+    OutMap *out = outmap_open(output_path, data_size);
+    if (!out) {
+        steg_reader_close(r);
+        return -1;
+    }
+    if (steg_reader_read(r, outmap_reserve(out, data_size), data_size) != 0) {
+        steg_reader_close(r);
+        outmap_abort(out);
+        return -1;
+    }
+    steg_reader_close(r);
+    return outmap_commit(out, data_size);
+}
+
+/**
+ * @brief Calcula a capacidade de armazenamento de uma imagem BMP em bytes.
+ * 
+ * @param image_path Caminho para a imagem BMP.
+ * @return A capacidade em bytes, ou -1 em caso de erro.
+ */
+long steg_get_capacity(const char *image_path) {
+    FILE *img = fopen(image_path, "rb");
+    if (!img) {
+        return -1;
+    }
+
+    fseek(img, 0, SEEK_END);
+    long img_size = ftell(img);
+    fseek(img, 0, SEEK_SET);
+
+    // O formato é reconhecido pelo início do arquivo (cover.h).
+    unsigned char *head = malloc(COVER_HEAD_MAX);
+    if (!head || img_size < 0) {
+        free(head);
+        fclose(img);
+        return -1;
+    }
+    size_t head_len = metrics_fread(head, COVER_HEAD_MAX, img);
+    fclose(img);
+
+    CoverLayout layout;
+    int ret = cover_layout_probe(head, head_len, (uint64_t)img_size, &layout);
+    free(head);
+    if (ret != 0) {
+        return -1;
+    }
+    long long capacity = layout_capacity(&layout);
+    return capacity > LONG_MAX ? LONG_MAX : (long)capacity;
+}
+
+/**
+ * @brief Bytes da capa alterados ao esconder data_size bytes (StegoHeader e StegoDigest inclusos).
+ *        Vale para capas de 1 byte por amostra (BMP e PGM/PPM de 8 bits).
+ */
+size_t steg_embed_span(size_t data_size) {
+    return (STEG_OVERHEAD + data_size) * 8;
+}
+
+/**
+ * @brief Reconhece uma capa em memória e confere se cabem o StegoHeader e o StegoDigest.
+ */
+static int buffer_layout(const unsigned char *image, size_t image_size, CoverLayout *layout) {
+    if (cover_layout_parse(image, image_size, image_size, layout) != 0) {
+        return -1;
+    }
+    if (layout_capacity(layout) < 0) {
+        fprintf(stderr, "Erro: imagem pequena demais\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Capacidade de uma capa já carregada em memória.
+ */
+long steg_capacity_buffer(const unsigned char *image, size_t image_size) {
+    CoverLayout layout;
+    if (buffer_layout(image, image_size, &layout) != 0) {
+        return -1;
+    }
+    long long capacity = layout_capacity(&layout);
+    return capacity > LONG_MAX ? LONG_MAX : (long)capacity;
+}
+
+/**
+ * @brief Esconde dados em um BMP em memória, gravando a imagem resultante em out.
+ *        Com out == cover a imagem é alterada no próprio buffer e só o trecho
+ *        de pixels usado é tocado.
+ */
+int steg_hide_into(const unsigned char *cover, size_t cover_size,
+                   const unsigned char *data, size_t data_size,
+                   unsigned char *out, size_t out_capacity) {
+    CoverLayout layout;
+    if (buffer_layout(cover, cover_size, &layout) != 0) {
+        return -1;
+    }
+
+    size_t capacity = payload_capacity(&layout);
+    if (data_size > capacity) {
+        fprintf(stderr, "Erro: dados muito grandes para a imagem\n");
+        fprintf(stderr, "Capacidade: %zu bytes, necessário: %zu bytes\n",
+                capacity, data_size);
+        return -1;
+    }
+    if (out_capacity < cover_size) {
+        fprintf(stderr, "Erro: buffer de saída menor que a imagem\n");
+        return -1;
+    }
+    if (out != cover) {
+        memcpy(out, cover, cover_size);
+    }
+
+    StegoHeader header;
+    header.magic = MAGIC_DIGEST;
+    header.data_size = data_size;
+
+    unsigned char *pixels = out + layout.offset;
+    embed_samples(pixels, (unsigned char *)&header, sizeof(StegoHeader), &layout);
+    pixels += layout_span(&layout, sizeof(StegoHeader));
+    StegoDigest digest = { 0 };
+    op_total(OP_STAGE_EMBED, data_size);
+    if (embed_with_crc(pixels, data, data_size, &digest.crc32c, &layout) != 0) {
+        return -1;
+    }
+    embed_samples(pixels + layout_span(&layout, data_size),
+                  (unsigned char *)&digest, sizeof(StegoDigest), &layout);
+    return 0;
+}
+
+/**
+ * @brief Extrai dados de um BMP em memória para um buffer do chamador.
+ *        Se o buffer for pequeno, *data_size recebe o tamanho necessário.
+ */
+int steg_extract_into(const unsigned char *image, size_t image_size,
+                      unsigned char *data, size_t data_capacity, size_t *data_size) {
+    CoverLayout layout;
+    if (buffer_layout(image, image_size, &layout) != 0) {
+        return -1;
+    }
+
+    StegoHeader header;
+    const unsigned char *pixels = image + layout.offset;
+    extract_samples((unsigned char *)&header, pixels, sizeof(StegoHeader), &layout);
+    size_t available = cover_layout_samples(&layout) / 8 - sizeof(StegoHeader);
+    int has_digest = header_check(&header, available);
+    if (has_digest < 0) {
+        return -1;
+    }
+
+    *data_size = header.data_size;
+    if (header.data_size > data_capacity) {
+        fprintf(stderr, "Erro: buffer de saída pequeno demais (%zu < %zu bytes)\n",
+                data_capacity, (size_t)header.data_size);
+        return -1;
+    }
+    pixels += layout_span(&layout, sizeof(StegoHeader));
+    uint32_t crc = 0;
+    op_total(OP_STAGE_EXTRACT, header.data_size);
+    if (extract_with_crc(data, pixels, header.data_size, &crc, &layout) != 0) {
+        return -1;
+    }
+    if (has_digest) {
+        StegoDigest digest;
+        extract_samples((unsigned char *)&digest, pixels + layout_span(&layout, header.data_size),
+                        sizeof digest, &layout);
+        if (digest.crc32c != crc) {
+            digest_mismatch();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Origem dos bytes da capa: o cache em memória ou o próprio arquivo.
+ */
+typedef struct {
+    FILE *file;
+    CoverEntry *cached;
+    size_t pos;
+    size_t size;
+} CoverSource;
+
+static int cover_source_open(CoverSource *src, const char *image_path) {
+    memset(src, 0, sizeof *src);
+    src->cached = cover_acquire(image_path);
+    if (src->cached) {
+        src->size = (size_t)src->cached->size;
+        return 0;
+    }
+
+    src->file = fopen(image_path, "rb");
+    if (!src->file) {
+        perror("Erro ao abrir imagem");
+        return -1;
+    }
+    fseek(src->file, 0, SEEK_END);
+    long size = ftell(src->file);
+    fseek(src->file, 0, SEEK_SET);
+    src->size = size > 0 ? (size_t)size : 0;
+    return 0;
+}
+
+static size_t cover_source_read(CoverSource *src, unsigned char *buf, size_t n) {
+    if (src->file) {
+        n = metrics_fread(buf, n, src->file);
+    } else {
+        if (n > src->size - src->pos) {
+            n = src->size - src->pos;
+        }
+        memcpy(buf, src->cached->data + src->pos, n);
+    }
+    src->pos += n;
+    return n;
+}
+
+/**
+ * @brief Avança até n bytes sem copiar (só para capas do cache).
+ */
+static size_t cover_source_skip(CoverSource *src, size_t n) {
+    if (n > src->size - src->pos) {
+        n = src->size - src->pos;
+    }
+    src->pos += n;
+    return n;
+}
+
+static int cover_source_seek(CoverSource *src, size_t pos) {
+    if (pos > src->size || (src->file && fseek(src->file, (long)pos, SEEK_SET) != 0)) {
+        return -1;
+    }
+    src->pos = pos;
+    return 0;
+}
+
+static void cover_source_close(CoverSource *src) {
+    if (src->file) {
+        fclose(src->file);
+    }
+    cover_release(src->cached);
+    memset(src, 0, sizeof *src);
+}
+
+/**
+ * @brief Reconhece o formato pelo início da capa (lido em buf, que precisa de
+ *        COVER_HEAD_MAX bytes) e volta ao começo do arquivo.
+ *        Capas do cache já foram reconhecidas ao entrar nele.
+ */
+static int cover_source_layout(CoverSource *src, unsigned char *buf, CoverLayout *layout) {
+    if (src->cached) {
+        *layout = src->cached->layout;
+        return 0;
+    }
+    size_t n = cover_source_read(src, buf, COVER_HEAD_MAX);
+    if (cover_layout_parse(buf, n, src->size, layout) != 0) {
+        return -1;
+    }
+    if (layout_capacity(layout) < 0) {
+        fprintf(stderr, "Erro: capa sem espaço para o cabeçalho\n");
+        return -1;
+    }
+    return cover_source_seek(src, 0);
+}
+
+/**
+ * @brief Estado de uma escrita incremental: a capa é lida e a imagem de saída é
+ *        gravada em blocos, sem manter nenhuma das duas inteira na memória.
+ */
+struct StegWriter {
+    CoverSource cover;
+    FILE *out;
+    char *output_path;       // NULL quando a saída pertence ao chamador
+    CoverLayout layout;
+    size_t header_span;      // bytes da capa sob o StegoHeader
+    size_t capacity;
+    size_t written;
+    uint32_t crc;            // CRC32C dos dados já embutidos
+    int keep_partial;        // saída já no disco para uma retomada: não é removida em erro
+    // Bytes originais da capa sob o StegoHeader, reescritos no fechamento.
+    unsigned char header_slot[sizeof(StegoHeader) * 8 * COVER_STRIDE_MAX];
+    unsigned char buffer[STEG_IO_CHUNK * 8];
+};
+
+/**
+ * @brief Copia `size` bytes da capa para a saída, ou até o fim da capa se until_eof.
+ */
+static int copy_cover(StegWriter *w, size_t size, int until_eof) {
+    while (until_eof || size > 0) {
+        size_t want = sizeof(w->buffer);
+        if (!until_eof && want > size) {
+            want = size;
+        }
+        // Com a capa no cache, os trechos sem alteração são gravados direto de lá.
+        const unsigned char *src = w->buffer;
+        size_t n;
+        if (w->cover.cached) {
+            src = w->cover.cached->data + w->cover.pos;
+            n = cover_source_skip(&w->cover, want);
+        } else {
+            n = cover_source_read(&w->cover, w->buffer, want);
+        }
+        if (n == 0) {
+            return (until_eof && !(w->cover.file && ferror(w->cover.file))) ? 0 : -1;
+        }
+        if (metrics_fwrite(src, n, w->out) != n) {
+            return -1;
+        }
+        if (!until_eof) {
+            size -= n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Retomada: compara o início da saída (cabeçalho da capa até o fim do espaço
+ *        do StegoHeader) com a capa, deixando as duas posicionadas logo depois dele.
+ */
+static int writer_match_prefix(StegWriter *w) {
+    size_t half = sizeof(w->buffer) / 2;
+    unsigned char *cover = w->buffer, *image = w->buffer + half;
+
+    for (size_t left = (size_t)w->layout.offset; left > 0; ) {
+        size_t n = left < half ? left : half;
+        if (cover_source_read(&w->cover, cover, n) != n ||
+            metrics_fread(image, n, w->out) != n || memcmp(cover, image, n) != 0) {
+            return -1;
+        }
+        left -= n;
+    }
+    if (cover_source_read(&w->cover, w->header_slot, w->header_span) != w->header_span ||
+        metrics_fread(image, w->header_span, w->out) != w->header_span ||
+        memcmp(image, w->header_slot, w->header_span) != 0) {
+        return -1;
+    }
+    // Leitura e escrita alternadas no mesmo FILE precisam de um seek entre elas.
+    return fseek(w->out, 0, SEEK_CUR);
+}
+
+/**
+ * @brief Parte comum de steg_writer_open, steg_writer_open_stream e steg_writer_resume.
+ */
+static StegWriter *writer_open(const char *image_path, FILE *out, const char *output_path,
+                               int resume) {
+    StegWriter *w = buf_calloc(sizeof(StegWriter));
+    if (!w) {
+        perror("Erro ao alocar memória");
+        return NULL;
+    }
+
+    if (cover_source_open(&w->cover, image_path) != 0) {
+        buf_free(w);
+        return NULL;
+    }
+
+    // Reconhece o formato da capa e localiza a área de amostras.
+    if (cover_source_layout(&w->cover, w->buffer, &w->layout) != 0) {
+        cover_source_close(&w->cover);
+        buf_free(w);
+        return NULL;
+    }
+    w->header_span = layout_span(&w->layout, sizeof(StegoHeader));
+    w->capacity = payload_capacity(&w->layout);
+
+    w->out = out;
+    if (output_path) {
+        w->output_path = strdup(output_path);
+        w->out = fopen(output_path, resume ? "r+b" : "wb");
+        if (!w->output_path || !w->out) {
+            perror(resume ? "Erro ao abrir a imagem parcial" : "Erro ao criar arquivo de saída");
+            if (w->out) {
+                fclose(w->out);
+            }
+            free(w->output_path);
+            cover_source_close(&w->cover);
+            buf_free(w);
+            return NULL;
+        }
+    }
+
+    if (resume) {
+        w->keep_partial = 1;
+        if (writer_match_prefix(w) != 0) {
+            fprintf(stderr, "Erro: a imagem parcial '%s' não foi gerada a partir desta capa\n",
+                    output_path);
+            steg_writer_abort(w);
+            return NULL;
+        }
+        return w;
+    }
+
+    // Copia o cabeçalho da capa e reserva o espaço do StegoHeader, que só é
+    // escrito no fechamento, quando o tamanho final dos dados é conhecido.
+    if (copy_cover(w, (size_t)w->layout.offset, 0) != 0 ||
+        cover_source_read(&w->cover, w->header_slot, w->header_span) != w->header_span ||
+        metrics_fwrite(w->header_slot, w->header_span, w->out) != w->header_span) {
+        fprintf(stderr, "Erro ao copiar a imagem\n");
+        steg_writer_abort(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+StegWriter *steg_writer_open(const char *image_path, const char *output_path) {
+    return writer_open(image_path, NULL, output_path, 0);
+}
+
+StegWriter *steg_writer_open_stream(const char *image_path, FILE *out) {
+    return writer_open(image_path, out, NULL, 0);
+}
+
+StegWriter *steg_writer_resume(const char *image_path, const char *output_path) {
+    return writer_open(image_path, NULL, output_path, 1);
+}
+
+int steg_writer_replay(StegWriter *w, unsigned char *data, size_t data_size) {
+    size_t half = sizeof(w->buffer) / 2;
+    unsigned char *cover = w->buffer, *image = w->buffer + half;
+
+    if (data_size > w->capacity - w->written) {
+        fprintf(stderr, "Erro: ponto de retomada além da capacidade da imagem\n");
+        return -1;
+    }
+    const CoverLayout *layout = &w->layout;
+    size_t stride = layout->stride;
+    while (data_size > 0) {
+        size_t n = half / layout_span(layout, 1);
+        n = data_size < n ? data_size : n;
+        size_t span = layout_span(layout, n);
+        if (cover_source_read(&w->cover, cover, span) != span ||
+            metrics_fread(image, span, w->out) != span) {
+            fprintf(stderr, "Erro: imagem parcial mais curta que o ponto de retomada\n");
+            return -1;
+        }
+        // Só o bit menos significativo de cada amostra pode diferir da capa.
+        unsigned char diff = 0;
+        for (size_t i = 0; i < span; i += stride) {
+            for (size_t j = 0; j < stride; j++) {
+                unsigned char keep = j == layout->lsb ? 0xFE : 0xFF;
+                diff |= (unsigned char)((cover[i + j] ^ image[i + j]) & keep);
+            }
+        }
+        if (diff) {
+            fprintf(stderr, "Erro: a imagem parcial não corresponde à capa\n");
+            return -1;
+        }
+        if (extract_with_crc(data, image, n, &w->crc, layout) != 0) {
+            return -1;
+        }
+        data += n;
+        data_size -= n;
+        w->written += n;
+    }
+    return fseek(w->out, 0, SEEK_CUR);
+}
+
+int steg_writer_sync(StegWriter *w) {
+    if (fflush(w->out) != 0 || fdatasync(fileno(w->out)) != 0) {
+        perror("Erro ao gravar a imagem no disco");
+        return -1;
+    }
+    w->keep_partial = 1;
+    return 0;
+}
+
+size_t steg_writer_capacity(const StegWriter *w) {
+    return w->capacity;
+}
+
+int steg_writer_write(StegWriter *w, const unsigned char *data, size_t data_size) {
+    if (data_size > w->capacity - w->written) {
+        fprintf(stderr, "Erro: dados muito grandes para a imagem\n");
+        fprintf(stderr, "Capacidade: %zu bytes, necessário: mais de %zu bytes\n",
+                w->capacity, w->written + data_size);
+        return -1;
+    }
+
+    // Embute os dados em blocos: lê 8 amostras da capa por byte de dado e grava o resultado.
+    size_t chunk = layout_chunk(&w->layout);
+    while (data_size > 0) {
+        size_t n = data_size < chunk ? data_size : chunk;
+        size_t span = layout_span(&w->layout, n);
+        if (cover_source_read(&w->cover, w->buffer, span) != span) {
+            fprintf(stderr, "Erro ao ler a imagem\n");
+            return -1;
+        }
+        if (embed_with_crc(w->buffer, data, n, &w->crc, &w->layout) != 0) {
+            return -1;
+        }
+        if (metrics_fwrite(w->buffer, span, w->out) != span) {
+            fprintf(stderr, "Erro ao escrever a imagem\n");
+            return -1;
+        }
+        data += n;
+        data_size -= n;
+        w->written += n;
+    }
+    return 0;
+}
+
+int steg_writer_close(StegWriter *w) {
+    // Embute o CRC32C logo depois dos dados (a capacidade já reserva o espaço)
+    // e copia o restante da capa sem alterações.
+    StegoDigest digest;
+    digest.crc32c = w->crc;
+    size_t span = layout_span(&w->layout, sizeof(StegoDigest));
+    if (cover_source_read(&w->cover, w->buffer, span) != span) {
+        fprintf(stderr, "Erro ao ler a imagem\n");
+        steg_writer_abort(w);
+        return -1;
+    }
+    embed_samples(w->buffer, (unsigned char *)&digest, sizeof(StegoDigest), &w->layout);
+    if (metrics_fwrite(w->buffer, span, w->out) != span || copy_cover(w, 0, 1) != 0) {
+        fprintf(stderr, "Erro ao copiar a imagem\n");
+        steg_writer_abort(w);
+        return -1;
+    }
+
+    // Agora o tamanho é conhecido: embute o StegoHeader no espaço reservado.
+    // A saída do chamador é posicionada de novo no fim, como se fosse só escrita.
+    StegoHeader header;
+    header.magic = MAGIC_DIGEST;
+    header.data_size = (uint32_t)w->written;
+    embed_samples(w->header_slot, (unsigned char *)&header, sizeof(StegoHeader), &w->layout);
+    long end = ftell(w->out);
+    int failed = end < 0 ||
+                 fseek(w->out, end - (long)(w->cover.size - w->layout.offset), SEEK_SET) != 0 ||
+                 metrics_fwrite(w->header_slot, w->header_span, w->out) != w->header_span;
+    if (w->output_path) {
+        failed |= fclose(w->out) != 0;
+        w->out = NULL;
+    } else {
+        failed |= fseek(w->out, end, SEEK_SET) != 0 || fflush(w->out) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "Erro ao escrever o cabeçalho na imagem\n");
+        steg_writer_abort(w);
+        return -1;
+    }
+
+    cover_source_close(&w->cover);
+    free(w->output_path);
+    buf_free(w);
+    return 0;
+}
+
+void steg_writer_abort(StegWriter *w) {
+    if (!w) {
+        return;
+    }
+    if (w->output_path) {
+        if (w->out) {
+            fclose(w->out);
+        }
+        // Não deixa uma imagem parcial para trás, a não ser que ela sirva para retomar.
+        if (!w->keep_partial) {
+            remove(w->output_path);
+        }
+    }
+    cover_source_close(&w->cover);
+    free(w->output_path);
+    buf_free(w);
+}
+
+/**
+ * @brief Estado de uma leitura incremental dos dados escondidos.
+ */
+struct StegReader {
+    CoverSource img;
+    CoverLayout layout;
+    size_t data_size;
+    size_t consumed;
+    int has_digest;          // imagem no formato com StegoDigest depois dos dados
+    uint32_t crc;            // CRC32C dos dados já lidos
+    unsigned char buffer[STEG_IO_CHUNK * 8];
+};
+
+StegReader *steg_reader_open(const char *image_path) {
+    StegReader *r = buf_calloc(sizeof(StegReader));
+    if (!r) {
+        perror("Erro ao alocar memória");
+        return NULL;
+    }
+
+    if (cover_source_open(&r->img, image_path) != 0) {
+        buf_free(r);
+        return NULL;
+    }
+
+    // Reconhece o formato e posiciona no início da área de amostras.
+    if (cover_source_layout(&r->img, r->buffer, &r->layout) != 0 ||
+        cover_source_seek(&r->img, (size_t)r->layout.offset) != 0) {
+        steg_reader_close(r);
+        return NULL;
+    }
+
+    // Extrai e valida o StegoHeader.
+    StegoHeader header;
+    size_t span = layout_span(&r->layout, sizeof(StegoHeader));
+    if (cover_source_read(&r->img, r->buffer, span) != span) {
+        fprintf(stderr, "Erro ao ler a imagem\n");
+        steg_reader_close(r);
+        return NULL;
+    }
+    extract_samples((unsigned char *)&header, r->buffer, sizeof(StegoHeader), &r->layout);
+    r->has_digest = header_check(&header, cover_layout_samples(&r->layout) / 8 - sizeof(StegoHeader));
+    if (r->has_digest < 0) {
+        steg_reader_close(r);
+        return NULL;
+    }
+    r->data_size = header.data_size;
+    op_total(OP_STAGE_EXTRACT, r->data_size);
+
+    return r;
+}
+
+size_t steg_reader_size(const StegReader *r) {
+    return r->data_size;
+}
+
+size_t steg_reader_remaining(const StegReader *r) {
+    return r->data_size - r->consumed;
+}
+
+int steg_reader_has_digest(const StegReader *r) {
+    return r->has_digest;
+}
+
+int steg_reader_read(StegReader *r, unsigned char *data, size_t data_size) {
+    if (data_size > r->data_size - r->consumed) {
+        fprintf(stderr, "Erro: leitura além do fim dos dados escondidos\n");
+        return -1;
+    }
+
+    size_t chunk = layout_chunk(&r->layout);
+    while (data_size > 0) {
+        size_t n = data_size < chunk ? data_size : chunk;
+        size_t span = layout_span(&r->layout, n);
+        if (cover_source_read(&r->img, r->buffer, span) != span) {
+            fprintf(stderr, "Erro ao ler a imagem\n");
+            return -1;
+        }
+        if (extract_with_crc(data, r->buffer, n, &r->crc, &r->layout) != 0) {
+            return -1;
+        }
+        data += n;
+        data_size -= n;
+        r->consumed += n;
+    }
+
+    // Última leitura: confere o CRC32C gravado depois dos dados.
+    if (r->has_digest && r->consumed == r->data_size) {
+        StegoDigest digest;
+        size_t span = layout_span(&r->layout, sizeof(StegoDigest));
+        if (cover_source_read(&r->img, r->buffer, span) != span) {
+            fprintf(stderr, "Erro ao ler a imagem\n");
+            return -1;
+        }
+        extract_samples((unsigned char *)&digest, r->buffer, sizeof(StegoDigest), &r->layout);
+        r->has_digest = 0;   // conferido uma vez só
+        if (digest.crc32c != r->crc) {
+            digest_mismatch();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void steg_reader_close(StegReader *r) {
+    if (!r) {
+        return;
+    }
+    cover_source_close(&r->img);
+    buf_free(r);
+}
+
+int steg_hide_stream(const char *image_path, FILE *in, FILE *out) {
+    unsigned char chunk[STEG_IO_CHUNK];
+    StegWriter *w = steg_writer_open_stream(image_path, out);
+    if (!w) {
+        return -1;
+    }
+
+    op_total_file(OP_STAGE_EMBED, in);
+    size_t n;
+    while ((n = metrics_fread(chunk, sizeof chunk, in)) > 0) {
+        if (steg_writer_write(w, chunk, n) != 0) {
+            steg_writer_abort(w);
+            return -1;
+        }
+    }
+    if (ferror(in)) {
+        perror("Erro ao ler arquivo");
+        steg_writer_abort(w);
+        return -1;
+    }
+    return steg_writer_close(w);
+}
+
+int steg_extract_stream(const char *image_path, FILE *out) {
+    unsigned char chunk[STEG_IO_CHUNK];
+    StegReader *r = steg_reader_open(image_path);
+    if (!r) {
+        return -1;
+    }
+
+    while (steg_reader_remaining(r) > 0) {
+        size_t n = steg_reader_remaining(r);
+        if (n > sizeof chunk) {
+            n = sizeof chunk;
+        }
+        if (steg_reader_read(r, chunk, n) != 0) {
+            steg_reader_close(r);
+            return -1;
+        }
+        if (metrics_fwrite(chunk, n, out) != n) {
+            fprintf(stderr, "Erro ao escrever arquivo\n");
+            steg_reader_close(r);
+            return -1;
+        }
+    }
+    steg_reader_close(r);
+    return fflush(out) == 0 ? 0 : -1;
+}
+
+// Trechos sem alteração de até STEG_UPDATE_GAP bytes entre duas alterações vão
+// na mesma escrita: regravar os mesmos valores sai mais barato que outra syscall.
+#define STEG_UPDATE_GAP 32
+
+/**
+ * @brief Estado de uma atualização no lugar (steg_update_file).
+ */
+typedef struct {
+    int fd;
+    size_t rewritten;
+    CoverLayout layout;
+    unsigned char old[STEG_IO_CHUNK * 8];       // amostras como estão no disco
+    unsigned char target[STEG_IO_CHUNK * 8];    // amostras com os bits novos
+    unsigned char bytes[STEG_IO_CHUNK];         // bytes escondidos hoje no trecho
+    IoRequest writes[STEG_IO_CHUNK * 8 / (STEG_UPDATE_GAP + 2) + 1];
+} StegUpdate;
+
+/**
+ * @brief Esconde até layout_chunk bytes a partir do byte de amostra pos,
+ *        gravando só as amostras cujo LSB muda. Um trecho em que os bytes
+ *        escondidos já são os mesmos não gera escrita nenhuma.
+ */
+static int update_span(StegUpdate *u, size_t pos, const unsigned char *data, size_t n) {
+    size_t span = layout_span(&u->layout, n);
+    IoRequest read = { u->fd, 0, u->old, span, pos, 0 };
+    if (io_run(&read, 1, 0) != 0 || (size_t)read.result != span) {
+        fprintf(stderr, "Erro ao ler a imagem\n");
+        return -1;
+    }
+    extract_samples(u->bytes, u->old, n, &u->layout);
+    if (memcmp(u->bytes, data, n) == 0) {
+        return 0;
+    }
+
+    memcpy(u->target, u->old, span);
+    embed_samples(u->target, data, n, &u->layout);
+    size_t nw = 0;
+    for (size_t i = 0; i < span;) {
+        if (u->target[i] == u->old[i]) {
+            i++;
+            continue;
+        }
+        size_t start = i, end = ++i, gap = 0;
+        for (; i < span; i++) {
+            if (u->target[i] != u->old[i]) {
+                end = i + 1;
+                gap = 0;
+            } else if (++gap > STEG_UPDATE_GAP) {
+                break;
+            }
+        }
+        u->writes[nw++] = (IoRequest){ u->fd, 1, u->target + start, end - start, pos + start, 0 };
+        u->rewritten += end - start;
+    }
+    if (io_run(u->writes, nw, 0) != 0) {
+        fprintf(stderr, "Erro ao escrever a imagem\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Troca os dados escondidos de uma imagem no próprio arquivo.
+ *        Os dados vão primeiro, depois o resumo e por último o cabeçalho: uma
+ *        atualização interrompida deixa o CRC32C sem conferir, e o extract
+ *        recusa a imagem em vez de devolver uma mistura das duas versões.
+ */
+int steg_update_file(const char *image_path, const char *file_path, size_t *rewritten) {
+    FILE *in = fopen(file_path, "rb");
+    if (!in) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+    fseek(in, 0, SEEK_END);
+    long file_size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    StegUpdate *u = buf_calloc(sizeof(StegUpdate));
+    if (!u) {
+        perror("Erro ao alocar memória");
+        fclose(in);
+        return -1;
+    }
+    u->fd = open(image_path, O_RDWR | O_CLOEXEC);
+    if (u->fd < 0) {
+        perror("Erro ao abrir imagem");
+        buf_free(u);
+        fclose(in);
+        return -1;
+    }
+
+    // Reconhece o formato pelo início do arquivo (u->old tem COVER_HEAD_MAX bytes).
+    int ret = -1;
+    struct stat st;
+    ssize_t head_len;
+    if (fstat(u->fd, &st) != 0 ||
+        (head_len = pread(u->fd, u->old, COVER_HEAD_MAX, 0)) < 0) {
+        perror("Erro ao ler a imagem");
+        goto cleanup;
+    }
+    if (cover_layout_parse(u->old, (size_t)head_len, (uint64_t)st.st_size, &u->layout) != 0) {
+        goto cleanup;
+    }
+    if (layout_capacity(&u->layout) < 0) {
+        fprintf(stderr, "Erro: dados não encontrados na imagem\n");
+        goto cleanup;
+    }
+    size_t pixel_offset = (size_t)u->layout.offset;
+
+    // Só atualiza uma imagem que já tem dados escondidos por este programa.
+    StegoHeader header;
+    size_t header_span = layout_span(&u->layout, sizeof(StegoHeader));
+    if (pread(u->fd, u->old, header_span, (off_t)pixel_offset) != (ssize_t)header_span) {
+        fprintf(stderr, "Erro ao ler a imagem\n");
+        goto cleanup;
+    }
+    extract_samples((unsigned char *)&header, u->old, sizeof(StegoHeader), &u->layout);
+    if (header_check(&header, cover_layout_samples(&u->layout) / 8 - sizeof(StegoHeader)) < 0) {
+        goto cleanup;
+    }
+
+    size_t capacity = payload_capacity(&u->layout);
+    if (file_size < 0 || (size_t)file_size > capacity) {
+        fprintf(stderr, "Erro: dados muito grandes para a imagem\n");
+        fprintf(stderr, "Capacidade: %zu bytes, necessário: %ld bytes\n",
+                capacity, file_size);
+        goto cleanup;
+    }
+
+    unsigned char chunk[STEG_IO_CHUNK];
+    size_t chunk_size = layout_chunk(&u->layout);
+    size_t pos = pixel_offset + header_span;
+    size_t remaining = (size_t)file_size;
+    StegoDigest digest = { 0 };
+    op_total(OP_STAGE_EMBED, remaining);
+    while (remaining > 0) {
+        size_t n = remaining < chunk_size ? remaining : chunk_size;
+        if (metrics_fread(chunk, n, in) != n) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            goto cleanup;
+        }
+        if (op_step(OP_STAGE_EMBED, n) != 0 || update_span(u, pos, chunk, n) != 0) {
+            goto cleanup;
+        }
+        digest.crc32c = crc32c(digest.crc32c, chunk, n);
+        pos += layout_span(&u->layout, n);
+        remaining -= n;
+    }
+
+    header.magic = MAGIC_DIGEST;
+    header.data_size = (uint32_t)file_size;
+    if (update_span(u, pos, (unsigned char *)&digest, sizeof digest) != 0 ||
+        update_span(u, pixel_offset, (unsigned char *)&header, sizeof header) != 0) {
+        goto cleanup;
+    }
+    if (rewritten) {
+        *rewritten = u->rewritten;
+    }
+    ret = 0;
+
+cleanup:
+    if (close(u->fd) != 0 && ret == 0) {
+        fprintf(stderr, "Erro ao escrever a imagem\n");
+        ret = -1;
+    }
+    buf_free(u);
+    fclose(in);
+    return ret;
+}
@@ -1,57 +1,343 @@
-#ifndef STEG_H
-#define STEG_H
-
-#include <stddef.h>
-
-/**
- * Esconde dados em uma imagem BMP
- * 
- * @param image_path: caminho da imagem BMP original
- * @param data: buffer com os dados a esconder
- * @param data_size: tamanho dos dados
- * @param output_path: caminho da imagem de saída
- * @return: 0 em sucesso, -1 em erro
- */
-int steg_hide(const char *image_path, const unsigned char *data, 
-              size_t data_size, const char *output_path);
-
-/**
- * Extrai dados escondidos de uma imagem BMP
- * 
- * @param image_path: caminho da imagem com dados escondidos
- * @param data: ponteiro para o buffer de saída (será alocado)
- * @param data_size: ponteiro para receber o tamanho dos dados
- * @return: 0 em sucesso, -1 em erro
- */
-int steg_extract(const char *image_path, unsigned char **data, 
-                 size_t *data_size);
-
-/**
- * Esconde um arquivo em uma imagem BMP
- * 
- * @param image_path: caminho da imagem BMP original
- * @param file_path: caminho do arquivo a esconder
- * @param output_path: caminho da imagem de saída
- * @return: 0 em sucesso, -1 em erro
- */
-int steg_hide_file(const char *image_path, const char *file_path, 
-                   const char *output_path);
-
-/**
- * Extrai dados escondidos de uma imagem e salva em arquivo
- * 
- * @param image_path: caminho da imagem com dados escondidos
- * @param output_path: caminho do arquivo de saída
- * @return: 0 em sucesso, -1 em erro
- */
-int steg_extract_file(const char *image_path, const char *output_path);
-
-/**
- * Calcula a capacidade de uma imagem BMP
- * 
- * @param image_path: caminho da imagem BMP
- * @return: capacidade em bytes, ou -1 em erro
- */
-long steg_get_capacity(const char *image_path);
-
+#ifndef STEG_H
+#define STEG_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * Quantidade de bytes de dados embutidos por bloco nas operações incrementais
+ * (cada byte ocupa 8 amostras da capa).
+ *
+ * As capas podem ser BMP, WAV PCM ou PGM/PPM (cover.h); onde a documentação
+ * abaixo diz "imagem", vale qualquer um desses formatos.
+ */
+#define STEG_IO_CHUNK 8192
+
+/**
+ * Escrita incremental de uma imagem com dados escondidos (opaco)
+ */
+typedef struct StegWriter StegWriter;
+
+/**
+ * Leitura incremental dos dados escondidos em uma imagem (opaco)
+ */
+typedef struct StegReader StegReader;
+
+/**
+ * Esconde dados em uma imagem BMP
+ * 
+ * @param image_path: caminho da imagem BMP original
+ * @param data: buffer com os dados a esconder
+ * @param data_size: tamanho dos dados
+ * @param output_path: caminho da imagem de saída
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_hide(const char *image_path, const unsigned char *data, 
+              size_t data_size, const char *output_path);
+
+/**
+ * Extrai dados escondidos de uma imagem BMP
+ * 
+ * @param image_path: caminho da imagem com dados escondidos
+ * @param data: ponteiro para o buffer de saída (será alocado)
+ * @param data_size: ponteiro para receber o tamanho dos dados
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_extract(const char *image_path, unsigned char **data, 
+                 size_t *data_size);
+
+/**
+ * Esconde um arquivo em uma imagem BMP
+ * 
+ * @param image_path: caminho da imagem BMP original
+ * @param file_path: caminho do arquivo a esconder
+ * @param output_path: caminho da imagem de saída
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_hide_file(const char *image_path, const char *file_path, 
+                   const char *output_path);
+
+/**
+ * Extrai dados escondidos de uma imagem e salva em arquivo
+ * 
+ * @param image_path: caminho da imagem com dados escondidos
+ * @param output_path: caminho do arquivo de saída
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_extract_file(const char *image_path, const char *output_path);
+
+/**
+ * Calcula a capacidade de uma imagem BMP
+ * 
+ * @param image_path: caminho da imagem BMP
+ * @return: capacidade em bytes, ou -1 em erro
+ */
+long steg_get_capacity(const char *image_path);
+
+/**
+ * Quantidade de bytes de pixels alterados para esconder data_size bytes
+ * (cabeçalho de esteganografia incluso)
+ *
+ * @param data_size: tamanho dos dados a esconder
+ * @return: bytes da capa tocados a partir do início dos pixels (capas de 1 byte
+ *          por amostra; com 2 ou 3 bytes por amostra o trecho é 2 ou 3 vezes maior)
+ */
+size_t steg_embed_span(size_t data_size);
+
+/**
+ * Calcula a capacidade de uma capa já carregada em memória
+ *
+ * @param image: bytes da imagem
+ * @param image_size: tamanho da imagem
+ * @return: capacidade em bytes, ou -1 em erro
+ */
+long steg_capacity_buffer(const unsigned char *image, size_t image_size);
+
+/**
+ * Esconde dados em uma capa em memória, sem alocar memória
+ *
+ * @param cover: bytes da imagem original
+ * @param cover_size: tamanho da imagem
+ * @param data: dados a esconder
+ * @param data_size: tamanho dos dados
+ * @param out: buffer da imagem resultante (pode ser o próprio cover)
+ * @param out_capacity: tamanho do buffer de saída (>= cover_size)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_hide_into(const unsigned char *cover, size_t cover_size,
+                   const unsigned char *data, size_t data_size,
+                   unsigned char *out, size_t out_capacity);
+
+/**
+ * Extrai dados de uma capa em memória para um buffer do chamador
+ *
+ * @param image: bytes da imagem com dados escondidos
+ * @param image_size: tamanho da imagem
+ * @param data: buffer de saída
+ * @param data_capacity: tamanho do buffer de saída
+ * @param data_size: recebe o tamanho dos dados escondidos, mesmo quando o
+ *                   buffer é pequeno demais (para o chamador realocar)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_extract_into(const unsigned char *image, size_t image_size,
+                      unsigned char *data, size_t data_capacity, size_t *data_size);
+
+/**
+ * Esconde os bits de cada byte de dados nos LSBs de 8 bytes consecutivos
+ * 
+ * @param cover: bytes da imagem (pelo menos data_size * 8)
+ * @param data: dados a esconder
+ * @param data_size: quantidade de bytes de dados
+ */
+void steg_embed_bytes(unsigned char *cover, const unsigned char *data, size_t data_size);
+
+/**
+ * Reconstrói bytes de dados a partir dos LSBs de 8 bytes consecutivos
+ * 
+ * @param data: buffer de saída (data_size bytes)
+ * @param cover: bytes da imagem (pelo menos data_size * 8)
+ * @param data_size: quantidade de bytes a extrair
+ */
+void steg_extract_bytes(unsigned char *data, const unsigned char *cover, size_t data_size);
+
+/**
+ * Inicia a escrita incremental: valida a capa e reserva o espaço do cabeçalho,
+ * que é preenchido em steg_writer_close quando o tamanho final é conhecido
+ * 
+ * @param image_path: caminho da imagem BMP original
+ * @param output_path: caminho da imagem de saída (precisa permitir fseek)
+ * @return: o escritor, ou NULL em erro
+ */
+StegWriter *steg_writer_open(const char *image_path, const char *output_path);
+
+/**
+ * Como steg_writer_open, mas grava em um arquivo já aberto pelo chamador
+ *
+ * A saída precisa permitir fseek (o cabeçalho é reescrito no fechamento) e não é
+ * fechada nem removida pelo escritor; em erro, o conteúdo parcial fica a cargo do chamador.
+ *
+ * @param image_path: caminho da imagem BMP original
+ * @param out: arquivo de saída aberto para escrita
+ * @return: o escritor, ou NULL em erro
+ */
+StegWriter *steg_writer_open_stream(const char *image_path, FILE *out);
+
+/**
+ * Reabre uma saída parcial de steg_writer_open para continuar a escrita
+ *
+ * Confere que o início da saída (cabeçalho do BMP e espaço do StegoHeader)
+ * veio desta capa. Os dados já embutidos são relidos com steg_writer_replay;
+ * depois, steg_writer_write continua do ponto seguinte. Em erro, a saída
+ * parcial não é removida.
+ *
+ * @param image_path: caminho da imagem BMP original
+ * @param output_path: imagem parcial gravada por uma execução anterior
+ * @return: o escritor, ou NULL em erro
+ */
+StegWriter *steg_writer_resume(const char *image_path, const char *output_path);
+
+/**
+ * Relê os próximos bytes já embutidos em uma saída reaberta por steg_writer_resume
+ *
+ * Cada byte da saída precisa ser igual ao da capa fora do bit menos significativo.
+ *
+ * @param data: recebe os bytes extraídos
+ * @return: 0 em sucesso, -1 se a saída é mais curta ou não corresponde à capa
+ */
+int steg_writer_replay(StegWriter *w, unsigned char *data, size_t data_size);
+
+/**
+ * Leva ao disco (fdatasync) tudo o que já foi gravado na saída
+ *
+ * A partir daí, a saída parcial é mantida em erro ou em steg_writer_abort,
+ * para uma retomada com steg_writer_resume.
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_writer_sync(StegWriter *w);
+
+/**
+ * Capacidade da capa em bytes de dados
+ */
+size_t steg_writer_capacity(const StegWriter *w);
+
+/**
+ * Embute mais dados, lendo e gravando apenas a parte da capa necessária
+ * 
+ * @return: 0 em sucesso, -1 em erro (incluindo capacidade excedida)
+ */
+int steg_writer_write(StegWriter *w, const unsigned char *data, size_t data_size);
+
+/**
+ * Copia o restante da capa, grava o cabeçalho e libera o escritor
+ * 
+ * @return: 0 em sucesso, -1 em erro (a saída parcial é removida)
+ */
+int steg_writer_close(StegWriter *w);
+
+/**
+ * Descarta a escrita: fecha os arquivos, remove a saída parcial (exceto depois de
+ * steg_writer_sync ou steg_writer_resume) e libera o escritor
+ */
+void steg_writer_abort(StegWriter *w);
+
+/**
+ * Abre uma imagem com dados escondidos e valida o cabeçalho, sem carregá-la inteira
+ * 
+ * @param image_path: caminho da imagem com dados escondidos
+ * @return: o leitor, ou NULL em erro
+ */
+StegReader *steg_reader_open(const char *image_path);
+
+/**
+ * Tamanho total dos dados escondidos
+ */
+size_t steg_reader_size(const StegReader *r);
+
+/**
+ * Bytes de dados escondidos ainda não lidos
+ */
+size_t steg_reader_remaining(const StegReader *r);
+
+/**
+ * Indica se a imagem traz o CRC32C dos dados (gerada por esta versão)
+ *
+ * Nesse caso, a leitura que chega ao fim dos dados confere o CRC32C e falha
+ * se ele não bate. Imagens antigas são lidas sem conferência.
+ *
+ * @return: 1 se há CRC32C ainda não conferido, 0 caso contrário
+ */
+int steg_reader_has_digest(const StegReader *r);
+
+/**
+ * Extrai exatamente data_size bytes, lendo apenas a parte correspondente da imagem
+ * 
+ * @return: 0 em sucesso, -1 em erro (incluindo leitura além do fim dos dados)
+ */
+int steg_reader_read(StegReader *r, unsigned char *data, size_t data_size);
+
+/**
+ * Fecha a imagem e libera o leitor
+ */
+void steg_reader_close(StegReader *r);
+
+/**
+ * Esconde todo o conteúdo de `in` em uma cópia da imagem gravada em `out`
+ *
+ * @param image_path: caminho da imagem BMP original
+ * @param in: arquivo com os dados a esconder
+ * @param out: arquivo de saída (precisa permitir fseek; não é fechado)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_hide_stream(const char *image_path, FILE *in, FILE *out);
+
+/**
+ * Extrai os dados escondidos de uma imagem para `out` (que não é fechado)
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int steg_extract_stream(const char *image_path, FILE *out);
+
+/**
+ * Troca os dados escondidos de uma imagem pelo conteúdo de um arquivo, no próprio arquivo
+ *
+ * Compara o fluxo de bits novo (cabeçalho, dados e CRC32C) com o que já está
+ * na imagem e grava, com pwrite, só os bytes de pixel cujo LSB muda. Uma
+ * pequena alteração nos dados custa escrita proporcional à diferença; a
+ * leitura ainda percorre o trecho de pixels dos dados novos.
+ *
+ * @param image_path: imagem com dados escondidos (alterada no lugar)
+ * @param file_path: arquivo com os dados novos
+ * @param rewritten: recebe os bytes de pixel gravados (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro (uma falha no meio deixa a imagem sem
+ *          passar na conferência do CRC32C)
+ */
+int steg_update_file(const char *image_path, const char *file_path, size_t *rewritten);
+
+/**
+ * Contadores do cache de capas
+ */
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    unsigned long preloaded;  // capas carregadas por steg_cover_cache_preload
+    size_t entries;       // capas em memória
+    size_t bytes;         // bytes ocupados pelas capas
+} StegCoverCacheStats;
+
+/**
+ * Define o orçamento do cache de capas (0, o padrão, desativa o cache)
+ *
+ * Com o cache ativo, steg_hide, os escritores e os leitores reutilizam capas já
+ * lidas e validadas, em vez de reabrir o arquivo. Cada capa é identificada por
+ * caminho, inode, tamanho e mtime, então uma imagem alterada no disco é recarregada.
+ * As capas são somente leitura: cada operação copia apenas o trecho de pixels que
+ * altera. Quando o total passa do orçamento, as capas sem uso menos recentes saem
+ * primeiro; capas maiores que o orçamento não entram no cache.
+ *
+ * @param max_bytes: memória máxima ocupada pelas capas
+ * @return: 0 em sucesso
+ */
+int steg_cover_cache_set_budget(size_t max_bytes);
+
+/**
+ * Carrega de uma vez várias capas no cache, com as leituras em voo ao mesmo tempo
+ *
+ * As capas entram na ordem dada enquanto couberem no orçamento; as que já
+ * estão no cache, as repetidas e as que não são BMP válidos são ignoradas.
+ * As leituras usam a camada de E/S em lote (io_uring ou pread, ver ioring.h).
+ *
+ * @param paths: caminhos das capas
+ * @param n: quantidade de caminhos
+ * @param direct: 1 para ler capas grandes com O_DIRECT
+ * @return: quantidade de capas carregadas
+ */
+size_t steg_cover_cache_preload(const char *const *paths, size_t n, int direct);
+
+/**
+ * Lê os contadores do cache de capas
+ */
+void steg_cover_cache_get_stats(StegCoverCacheStats *stats);
+
 #endif /* STEG_H */
\ No newline at end of file
@@ -0,0 +1,490 @@
+#define _GNU_SOURCE  // O_DIRECT
+#include "ioring.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+// Alinhamento de buffers, tamanhos e deslocamentos exigido por O_DIRECT
+#define IO_ALIGN 4096
+
+// Arquivos menores que isto não compensam O_DIRECT
+#define IO_DIRECT_MIN (1024 * 1024)
+
+// Maior transferência por entrada (o campo len da SQE tem 32 bits)
+#define IO_MAX_CHUNK (1u << 30)
+
+// Máximo de buffers registrados em uma chamada
+#define IO_MAX_FIXED 1024
+
+/**
+ * @brief Anel de uma thread: as duas filas mapeadas do kernel e seus ponteiros.
+ */
+typedef struct {
+    int fd;
+    unsigned depth;        // profundidade pedida em io_set_depth
+    unsigned entries;      // entradas da fila de submissão (potência de 2)
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;         // igual a sq_ring com IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size;
+    size_t sqes_size;
+} IoRing;
+
+static unsigned io_depth = 0;
+static int io_uring_unavailable = 0;   // o kernel recusou o anel uma vez: não tenta de novo
+static pthread_key_t io_ring_key;
+static pthread_once_t io_ring_once = PTHREAD_ONCE_INIT;
+static __thread IoRing *io_ring_self;
+
+static void ring_destroy(void *arg) {
+    IoRing *r = arg;
+    if (!r) {
+        return;
+    }
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_ring && r->cq_ring != r->sq_ring) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sq_ring) {
+        munmap(r->sq_ring, r->sq_ring_size);
+    }
+    close(r->fd);
+    free(r);
+}
+
+static void io_ring_key_init(void) {
+    // O anel de cada thread é fechado quando ela termina.
+    pthread_key_create(&io_ring_key, ring_destroy);
+}
+
+static void *ring_map(int fd, size_t size, off_t offset) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static IoRing *ring_create(unsigned depth) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+    if (fd < 0) {
+        return NULL;
+    }
+    // IORING_OP_READ/WRITE chegaram no 5.6, junto com IORING_FEAT_CUR_PERSONALITY.
+    IoRing *r = calloc(1, sizeof(IoRing));
+    if (!r || !(p.features & IORING_FEAT_CUR_PERSONALITY)) {
+        free(r);
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->depth = depth;
+    r->entries = p.sq_entries;
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size) {
+            r->sq_ring_size = r->cq_ring_size;
+        }
+        r->cq_ring_size = r->sq_ring_size;
+    }
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = ring_map(fd, r->sq_ring_size, IORING_OFF_SQ_RING);
+    if (r->sq_ring) {
+        r->cq_ring = (p.features & IORING_FEAT_SINGLE_MMAP) ? r->sq_ring :
+                     ring_map(fd, r->cq_ring_size, IORING_OFF_CQ_RING);
+    }
+    r->sqes = ring_map(fd, r->sqes_size, IORING_OFF_SQES);
+    if (!r->sq_ring || !r->cq_ring || !r->sqes) {
+        ring_destroy(r);
+        return NULL;
+    }
+
+    char *sq = r->sq_ring, *cq = r->cq_ring;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return r;
+}
+
+/**
+ * @brief Anel da thread atual, criado (ou recriado, se a profundidade mudou) sob demanda.
+ *
+ * @return O anel, ou NULL para usar pread/pwrite.
+ */
+static IoRing *ring_get(void) {
+    unsigned depth = __atomic_load_n(&io_depth, __ATOMIC_RELAXED);
+    if (depth == 0 || __atomic_load_n(&io_uring_unavailable, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    if (io_ring_self && io_ring_self->depth == depth) {
+        return io_ring_self;
+    }
+    pthread_once(&io_ring_once, io_ring_key_init);
+    ring_destroy(io_ring_self);
+    io_ring_self = ring_create(depth);
+    if (!io_ring_self) {
+        __atomic_store_n(&io_uring_unavailable, 1, __ATOMIC_RELAXED);
+    }
+    pthread_setspecific(io_ring_key, io_ring_self);
+    return io_ring_self;
+}
+
+void io_set_depth(unsigned depth) {
+    __atomic_store_n(&io_depth, depth, __ATOMIC_RELAXED);
+}
+
+const char *io_backend_name(void) {
+    return ring_get() ? "io_uring" : "pread/pwrite";
+}
+
+/**
+ * @brief Coloca na fila de submissão o restante (a partir de done) de uma requisição.
+ */
+static void ring_queue(IoRing *r, const IoRequest *q, size_t index, size_t done, int fixed) {
+    unsigned tail = *r->sq_tail;
+    unsigned slot = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[slot];
+    size_t len = q->len - done;
+
+    memset(sqe, 0, sizeof(*sqe));
+    if (fixed) {
+        sqe->opcode = q->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = (uint16_t)index;
+    } else {
+        sqe->opcode = q->write ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    sqe->fd = q->fd;
+    sqe->off = q->offset + done;
+    sqe->addr = (uint64_t)(uintptr_t)((unsigned char *)q->buf + done);
+    sqe->len = (uint32_t)(len > IO_MAX_CHUNK ? IO_MAX_CHUNK : len);
+    sqe->user_data = index;
+    r->sq_array[slot] = slot;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Submete as entradas pendentes e espera pelo menos uma conclusão.
+ *
+ * @param submit: entradas a submeter; em erro, fica com as que não chegaram ao kernel
+ */
+static int ring_enter(IoRing *r, unsigned *submit) {
+    for (;;) {
+        long ret = syscall(__NR_io_uring_enter, r->fd, *submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret >= 0) {
+            if ((unsigned)ret >= *submit) {
+                *submit = 0;
+                return 0;
+            }
+            *submit -= (unsigned)ret;
+        } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+            perror("Erro no io_uring_enter");
+            return -1;
+        }
+    }
+}
+
+/**
+ * @brief Depois de um erro no io_uring_enter: tira da fila as entradas que o
+ *        kernel não recebeu e espera as já submetidas terminarem, para que
+ *        nenhuma escreva em um buffer que quem chamou vai liberar.
+ *
+ * As conclusões aparecem no anel mapeado mesmo sem io_uring_enter (a fila de
+ * conclusão tem o dobro das entradas, então não transborda); se a espera pelo
+ * kernel também falhar, o anel é consultado periodicamente.
+ */
+static void ring_drain(IoRing *r, unsigned inflight, unsigned unsubmitted) {
+    __atomic_store_n(r->sq_tail, *r->sq_tail - unsubmitted, __ATOMIC_RELEASE);
+    inflight -= unsubmitted;
+
+    while (inflight > 0) {
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        inflight -= tail - head < inflight ? tail - head : inflight;
+        __atomic_store_n(r->cq_head, tail, __ATOMIC_RELEASE);
+        if (inflight == 0) {
+            break;
+        }
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) {
+            struct timespec pause = { 0, 1000000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+/**
+ * @brief Registra os buffers das requisições no anel (buf_index = posição em reqs).
+ *
+ * @return 1 se registrou, 0 se as requisições vão sem buffers fixos.
+ */
+static int ring_register(IoRing *r, const IoRequest *reqs, size_t n) {
+    if (n == 0 || n > IO_MAX_FIXED) {
+        return 0;
+    }
+    struct iovec iov[IO_MAX_FIXED];
+    for (size_t i = 0; i < n; i++) {
+        if (reqs[i].len == 0 || reqs[i].len > IO_MAX_CHUNK) {
+            return 0;
+        }
+        iov[i].iov_base = reqs[i].buf;
+        iov[i].iov_len = reqs[i].len;
+    }
+    // Falha comum: RLIMIT_MEMLOCK baixo em kernels anteriores ao 5.12.
+    return syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, (unsigned)n) == 0;
+}
+
+static int ring_run(IoRing *r, IoRequest *reqs, size_t n, int flags) {
+    int fixed = (flags & IO_FIXED_BUFFERS) && ring_register(r, reqs, n);
+    size_t next = 0;
+    unsigned inflight = 0, to_submit = 0;
+    int failed = 0;
+
+    while (next < n || inflight > 0) {
+        while (next < n && inflight < r->entries) {
+            if (reqs[next].len > 0) {
+                ring_queue(r, &reqs[next], next, 0, fixed);
+                inflight++;
+                to_submit++;
+            }
+            next++;
+        }
+        if (inflight == 0) {
+            break;
+        }
+        if (ring_enter(r, &to_submit) != 0) {
+            ring_drain(r, inflight, to_submit);
+            failed = 1;
+            break;
+        }
+
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            size_t i = (size_t)cqe->user_data;
+            IoRequest *q = &reqs[i];
+            int res = cqe->res;
+
+            if (res == -EINTR || res == -EAGAIN) {
+                res = 0;
+            } else if (res < 0 || (res == 0 && q->write)) {
+                q->result = res < 0 ? res : -EIO;
+                failed = 1;
+                inflight--;
+                continue;
+            } else if (res == 0) {
+                inflight--;   // fim do arquivo
+                continue;
+            }
+            q->result += res;
+            if ((size_t)q->result < q->len) {
+                // Transferência parcial: a entrada liberada já serve para o restante.
+                ring_queue(r, q, i, (size_t)q->result, fixed);
+                to_submit++;
+            } else {
+                inflight--;
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    if (fixed) {
+        syscall(__NR_io_uring_register, r->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+    }
+    return failed ? -1 : 0;
+}
+
+/**
+ * @brief Mecanismo reserva: uma requisição por vez com pread/pwrite.
+ */
+static int sync_run(IoRequest *reqs, size_t n) {
+    int failed = 0;
+    for (size_t i = 0; i < n; i++) {
+        IoRequest *q = &reqs[i];
+        while ((size_t)q->result < q->len) {
+            unsigned char *p = (unsigned char *)q->buf + q->result;
+            size_t len = q->len - (size_t)q->result;
+            off_t off = (off_t)(q->offset + (size_t)q->result);
+            ssize_t got = q->write ? pwrite(q->fd, p, len, off) : pread(q->fd, p, len, off);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0 || (got == 0 && q->write)) {
+                q->result = got < 0 ? -errno : -EIO;
+                failed = 1;
+                break;
+            }
+            if (got == 0) {
+                break;
+            }
+            q->result += got;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+int io_run(IoRequest *reqs, size_t n, int flags) {
+    uint64_t t = metrics_start();
+    for (size_t i = 0; i < n; i++) {
+        reqs[i].result = 0;
+    }
+
+    IoRing *r = ring_get();
+    int ret = r ? ring_run(r, reqs, n, flags) : sync_run(reqs, n);
+
+    if (t) {
+        size_t read = 0, written = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (reqs[i].result > 0) {
+                *(reqs[i].write ? &written : &read) += (size_t)reqs[i].result;
+            }
+        }
+        if (read > 0) {
+            metrics_stop(METRICS_READ, t, read, read);
+        }
+        if (written > 0) {
+            metrics_stop(METRICS_WRITE, t, written, written);
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Abre um arquivo para io_read_files, com O_DIRECT quando pedido e grande o bastante.
+ *
+ * @return O descritor, ou -1 com f->error preenchido.
+ */
+static int open_for_read(IoFile *f, int direct, int *is_direct) {
+    *is_direct = 0;
+    int fd = open(f->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        f->error = errno;
+        return -1;
+    }
+    if (fstat(fd, &f->st) != 0 || !S_ISREG(f->st.st_mode)) {
+        f->error = EINVAL;
+        close(fd);
+        return -1;
+    }
+    if (direct && f->st.st_size >= IO_DIRECT_MIN) {
+        // tmpfs e alguns sistemas de arquivos recusam O_DIRECT: segue com o descritor normal.
+        int dfd = open(f->path, O_RDONLY | O_CLOEXEC | O_DIRECT);
+        if (dfd >= 0) {
+            close(fd);
+            fd = dfd;
+            *is_direct = 1;
+        }
+    }
+    return fd;
+}
+
+size_t io_read_files(IoFile *files, size_t n, int direct) {
+    IoRequest *reqs = calloc(n ? n : 1, sizeof(IoRequest));
+    size_t *owner = calloc(n ? n : 1, sizeof(size_t));
+    unsigned char *is_direct = calloc(n ? n : 1, 1);
+    size_t m = 0, ok = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        files[i].data = NULL;
+        files[i].error = reqs && owner && is_direct ? 0 : ENOMEM;
+    }
+    if (!reqs || !owner || !is_direct) {
+        free(reqs);
+        free(owner);
+        free(is_direct);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        IoFile *f = &files[i];
+        int d;
+        int fd = open_for_read(f, direct, &d);
+        if (fd < 0) {
+            continue;
+        }
+        // Com O_DIRECT, o tamanho lido é arredondado para o bloco; a leitura para no fim do arquivo.
+        size_t size = (size_t)f->st.st_size;
+        size_t len = d ? (size + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN : size;
+        void *buf = NULL;
+        if (posix_memalign(&buf, IO_ALIGN, len ? len : 1) != 0) {
+            f->error = ENOMEM;
+            close(fd);
+            continue;
+        }
+        metrics_alloc(len);
+        f->data = buf;
+        reqs[m] = (IoRequest){ fd, 0, buf, len, 0, 0 };
+        owner[m] = i;
+        is_direct[m] = (unsigned char)d;
+        m++;
+    }
+
+    io_run(reqs, m, IO_FIXED_BUFFERS);
+
+    // Leituras recusadas com O_DIRECT (EINVAL) são refeitas pelo page cache.
+    size_t retry = 0;
+    for (size_t k = 0; k < m; k++) {
+        if (reqs[k].result == -EINVAL && is_direct[k]) {
+            int fd = open(files[owner[k]].path, O_RDONLY | O_CLOEXEC);
+            if (fd >= 0) {
+                close(reqs[k].fd);
+                reqs[k].fd = fd;
+                is_direct[k] = is_direct[retry];
+                is_direct[retry] = 0;
+                // As refeitas vão para o começo do vetor; a que estava lá já foi conferida.
+                IoRequest tmp = reqs[retry];
+                reqs[retry] = reqs[k];
+                reqs[k] = tmp;
+                size_t o = owner[retry];
+                owner[retry] = owner[k];
+                owner[k] = o;
+                retry++;
+            }
+        }
+    }
+    if (retry > 0) {
+        io_run(reqs, retry, 0);
+    }
+
+    for (size_t k = 0; k < m; k++) {
+        IoFile *f = &files[owner[k]];
+        close(reqs[k].fd);
+        if (reqs[k].result != (ssize_t)f->st.st_size) {
+            f->error = reqs[k].result < 0 ? (int)-reqs[k].result : EIO;
+            free(f->data);
+            f->data = NULL;
+        } else {
+            ok++;
+        }
+    }
+
+    free(reqs);
+    free(owner);
+    free(is_direct);
+    return ok;
+}
@@ -0,0 +1,85 @@
+#ifndef IORING_H
+#define IORING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/**
+ * E/S em lote com várias leituras e escritas em voo
+ *
+ * Com profundidade > 0, cada thread abre (na primeira chamada) um io_uring
+ * próprio com essa quantidade de entradas, usando as syscalls diretamente
+ * (sem liburing). Sem suporte no kernel (anterior ao 5.6, desativado por
+ * sysctl ou bloqueado por seccomp) ou com profundidade 0, as mesmas chamadas
+ * caem para pread/pwrite, uma requisição depois da outra.
+ */
+
+/**
+ * Uma leitura ou escrita posicional
+ */
+typedef struct {
+    int fd;
+    int write;          // 0 = leitura, 1 = escrita
+    void *buf;
+    size_t len;
+    uint64_t offset;
+    ssize_t result;     // bytes transferidos (leitura curta = fim do arquivo) ou -errno
+} IoRequest;
+
+/**
+ * Opções de io_run
+ */
+#define IO_FIXED_BUFFERS 1   // registra os buffers no anel (páginas fixadas uma vez por chamada)
+
+/**
+ * Define a quantidade máxima de requisições em voo por thread
+ *
+ * @param depth: entradas do anel (0 = só pread/pwrite)
+ */
+void io_set_depth(unsigned depth);
+
+/**
+ * Nome do mecanismo que a thread atual usaria agora ("io_uring" ou "pread/pwrite")
+ */
+const char *io_backend_name(void);
+
+/**
+ * Executa todas as requisições, mantendo até a profundidade configurada em voo
+ *
+ * Transferências parciais são continuadas até completar len (ou até o fim do
+ * arquivo, nas leituras). Os buffers precisam continuar válidos até o retorno.
+ *
+ * @param reqs: requisições (result é preenchido em cada uma)
+ * @param n: quantidade de requisições
+ * @param flags: 0 ou IO_FIXED_BUFFERS
+ * @return: 0 se nenhuma requisição falhou, -1 caso contrário
+ */
+int io_run(IoRequest *reqs, size_t n, int flags);
+
+/**
+ * Um arquivo lido inteiro por io_read_files
+ */
+typedef struct {
+    const char *path;
+    struct stat st;         // metadados do arquivo aberto
+    unsigned char *data;    // conteúdo (liberar com free), NULL em erro
+    int error;              // errno da falha, 0 em sucesso
+} IoFile;
+
+/**
+ * Lê vários arquivos inteiros com as leituras em voo ao mesmo tempo
+ *
+ * Com direct, arquivos de pelo menos 1 MB são abertos com O_DIRECT (sem passar
+ * pelo page cache), em buffers alinhados; onde o sistema de arquivos não
+ * aceita, a leitura volta a ser normal.
+ *
+ * @param files: arquivos (path preenchido pelo chamador)
+ * @param n: quantidade de arquivos
+ * @param direct: 1 para usar O_DIRECT nos arquivos grandes
+ * @return: quantidade de arquivos lidos com sucesso
+ */
+size_t io_read_files(IoFile *files, size_t n, int direct);
+
+#endif /* IORING_H */
@@ -0,0 +1,42 @@
+#include "keyring.h"
+#include <unistd.h>
+#include <linux/keyctl.h>
+#include <sys/syscall.h>
+
+// Permissões (as constantes ficam no keyutils.h, que não usamos): o possuidor
+// pode tudo; o próprio uid pode ver, ler e procurar; mais ninguém.
+#define KEYRING_PERM_POSSESSOR 0x3f000000
+#define KEYRING_PERM_USER      0x000b0000
+
+/**
+ * @brief Procura a chave "user" com a descrição dada no keyring do usuário.
+ * @return o número da chave, ou -1 se não existe (ou expirou).
+ */
+static long keyring_find(const char *desc) {
+    return syscall(SYS_keyctl, KEYCTL_SEARCH, KEY_SPEC_USER_KEYRING, "user", desc, 0);
+}
+
+int keyring_read(const char *desc, void *buf, size_t len) {
+    long id = keyring_find(desc);
+    if (id < 0) {
+        return -1;
+    }
+    // KEYCTL_READ devolve o tamanho do valor mesmo quando ele não cabe em buf.
+    long n = syscall(SYS_keyctl, KEYCTL_READ, id, buf, len);
+    return n == (long)len ? 0 : -1;
+}
+
+int keyring_store(const char *desc, const void *data, size_t len, unsigned ttl) {
+    long id = syscall(SYS_add_key, "user", desc, data, len, KEY_SPEC_USER_KEYRING);
+    if (id < 0) {
+        return -1;
+    }
+    if (syscall(SYS_keyctl, KEYCTL_SETPERM, id, KEYRING_PERM_POSSESSOR | KEYRING_PERM_USER) != 0 ||
+        syscall(SYS_keyctl, KEYCTL_SET_TIMEOUT, id, ttl) != 0) {
+        // Sem prazo a chave ficaria até o fim da sessão: melhor não guardar.
+        syscall(SYS_keyctl, KEYCTL_INVALIDATE, id);
+        return -1;
+    }
+    return 0;
+}
+
@@ -0,0 +1,42 @@
+#ifndef KEYRING_H
+#define KEYRING_H
+
+#include <stddef.h>
+
+/**
+ * Segredos pequenos no keyring do kernel
+ *
+ * Guarda valores curtos (chaves derivadas) como chaves do tipo "user" no
+ * keyring do usuário (KEY_SPEC_USER_KEYRING), que vale para todos os processos
+ * do mesmo uid enquanto ele tiver alguma sessão aberta. Os valores ficam só na
+ * memória do kernel, nunca em disco, e cada um expira depois do prazo dado em
+ * keyring_store. Usa as syscalls add_key/keyctl diretamente (sem libkeyutils);
+ * sem suporte no kernel (ou bloqueadas por seccomp), as funções só falham e o
+ * chamador segue sem o cache.
+ */
+
+/**
+ * Lê o valor guardado com a descrição dada
+ *
+ * @param desc: descrição da chave (ex.: "stegfs:kdf:<hex>")
+ * @param buf: recebe o valor
+ * @param len: tamanho exato esperado do valor
+ * @return: 0 se a chave existe e tem len bytes, -1 caso contrário
+ */
+int keyring_read(const char *desc, void *buf, size_t len);
+
+/**
+ * Guarda (ou substitui) um valor com validade
+ *
+ * A chave fica legível só pelo próprio usuário e expira em ttl segundos,
+ * contados a partir desta chamada.
+ *
+ * @param desc: descrição da chave
+ * @param data: valor
+ * @param len: tamanho do valor
+ * @param ttl: validade em segundos (> 0)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int keyring_store(const char *desc, const void *data, size_t len, unsigned ttl);
+
+#endif /* KEYRING_H */
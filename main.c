@@ -1,11 +1,223 @@
+#include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
+#include <sys/stat.h>
 #include "compactar.h"
 #include "esteg.h"
 #include "crypt_utils.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "serve.h"
+#include "stdstream.h"
+#include "archive.h"
+#include "rescache.h"
+#include "bench.h"
+#include "metrics.h"
+#include "criptografiaSimples.h"
+#include "checkpoint.h"
+#include "opctx.h"
+#include "zindex.h"
 #include "sodium.h"
 
+// Contexto do comando em execução: recebe o progresso e o cancelamento por sinal.
+static OpContext command_op;
+static int progress_shown = 0;
+
+// Maior valor aceito nas opções em MB (1 TB)
+#define OPTION_MAX_MB (1024ULL * 1024)
+
+/**
+ * @brief Procura uma opção "--nome valor" em argv e a remove, ajustando argc.
+ *
+ * @return O valor da opção, ou NULL se ela não foi informada.
+ */
+static const char *take_option(int *argc, char *argv[], const char *name) {
+    for (int i = 2; i < *argc - 1; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            const char *value = argv[i + 1];
+            for (int j = i; j + 2 <= *argc; j++) {
+                argv[j] = argv[j + 2];
+            }
+            *argc -= 2;
+            return value;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Procura uma opção sem valor ("--nome") em argv e a remove, ajustando argc.
+ *
+ * @return 1 se a opção foi informada, 0 caso contrário.
+ */
+static int take_flag(int *argc, char *argv[], const char *name) {
+    for (int i = 2; i < *argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            for (int j = i; j + 1 <= *argc; j++) {
+                argv[j] = argv[j + 1];
+            }
+            *argc -= 1;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Converte o valor de uma opção numérica: um inteiro entre min e max,
+ *        sem sinal, espaços ou sobras (atoi aceitaria "abc" como 0 e "-1").
+ *
+ * @return 0 em sucesso, -1 (mensagem já escrita) se o valor for inválido.
+ */
+static int parse_count(const char *name, const char *text, unsigned long long min,
+                       unsigned long long max, unsigned long long *value) {
+    char *end;
+    errno = 0;
+    unsigned long long v = strtoull(text, &end, 10);
+    if (text[0] < '0' || text[0] > '9' || *end != '\0' || errno == ERANGE || v < min || v > max) {
+        fprintf(stderr, "Erro: %s deve ser um número inteiro entre %llu e %llu\n", name, min, max);
+        return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+/**
+ * @brief parse_count para opções em MB (até OPTION_MAX_MB), convertido para bytes.
+ */
+static int parse_megabytes(const char *name, const char *text, unsigned long long min,
+                           size_t *bytes) {
+    unsigned long long mb;
+    if (parse_count(name, text, min, OPTION_MAX_MB, &mb) != 0) {
+        return -1;
+    }
+    *bytes = (size_t)mb * 1024 * 1024;
+    return 0;
+}
+
+/**
+ * @brief Converte um prazo em segundos (aceita frações) para milissegundos.
+ *
+ * @return 0 em sucesso, -1 (mensagem já escrita) se o valor for inválido.
+ */
+static int parse_timeout(const char *name, const char *text, uint64_t *ms) {
+    char *end;
+    double seconds = strtod(text, &end);
+    if (*end != '\0' || !(seconds > 0) || seconds > 1e6) {
+        fprintf(stderr, "Erro: %s deve ser um número positivo de segundos\n", name);
+        return -1;
+    }
+    *ms = (uint64_t)(seconds * 1000);
+    if (*ms == 0) {
+        *ms = 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Suite concreta usada por um comando que já terminou com a política `suite`.
+ */
+static CryptSuite suite_used(CryptSuite suite) {
+    CryptSuite used = suite;
+    crypt_suite_resolve(suite, &used);
+    return used;
+}
+
+/**
+ * @brief Lê a opção "--suite" (xchacha, aes ou auto). O padrão é XChaCha20.
+ *
+ * @return 0 em sucesso, -1 se a suite for inválida.
+ */
+static int take_suite_option(int *argc, char *argv[], CryptSuite *suite) {
+    const char *name = take_option(argc, argv, "--suite");
+    *suite = CRYPT_SUITE_XCHACHA20;
+    if (name && crypt_suite_parse(name, suite) != 0) {
+        fprintf(stderr, "Suite inválida: %s (use xchacha, aes ou auto)\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Lê as opções "--cache DIR" e "--cache-max MB" e ativa o cache de resultados.
+ *
+ * @return 0 em sucesso (ou sem cache), -1 em erro.
+ */
+static int take_result_cache_option(int *argc, char *argv[]) {
+    const char *dir = take_option(argc, argv, "--cache");
+    const char *max = take_option(argc, argv, "--cache-max");
+    size_t max_bytes = (size_t)1024 * 1024 * 1024;
+    if (max && parse_megabytes("--cache-max", max, 0, &max_bytes) != 0) {
+        return -1;
+    }
+    if (!dir) {
+        return 0;
+    }
+    if (result_cache_open(dir, max_bytes) != 0) {
+        return -1;
+    }
+    // Os contadores vão para o diretório do cache em qualquer saída do comando.
+    atexit(result_cache_close);
+    return 0;
+}
+
+/**
+ * @brief Lê as opções "--checkpoint MB" (intervalo entre pontos de retomada, aceita
+ *        frações) e "--resume". Só --resume usa o intervalo padrão.
+ *
+ * @return 0 em sucesso (opt->interval == 0 sem pontos de retomada), -1 se o intervalo for inválido.
+ */
+static int take_checkpoint_option(int *argc, char *argv[], CheckpointOptions *opt) {
+    const char *every = take_option(argc, argv, "--checkpoint");
+    opt->resume = take_flag(argc, argv, "--resume");
+    opt->interval = opt->resume ? CHECKPOINT_DEFAULT_INTERVAL : 0;
+    if (every) {
+        char *end;
+        double mb = strtod(every, &end);
+        if (*end != '\0' || !(mb > 0) || mb > 1024 * 1024) {
+            fprintf(stderr, "Intervalo inválido: %s (use MB, ex.: 64 ou 0.5)\n", every);
+            return -1;
+        }
+        opt->interval = (size_t)(mb * 1024 * 1024);
+        if (opt->interval == 0) {
+            opt->interval = 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Progresso no stderr ("--progress"): a linha é reescrita a cada ponto
+ *        percentual do estágio, ou a cada MB quando o total é desconhecido.
+ */
+static void print_progress(void *user, OpStage stage, uint64_t done, uint64_t total) {
+    static uint64_t last[OP_STAGES];
+    uint64_t mark = (total ? done * 100 / total : done >> 20) + 1;
+    (void)user;
+    if (__atomic_exchange_n(&last[stage], mark, __ATOMIC_RELAXED) == mark) {
+        return;
+    }
+    if (total) {
+        fprintf(stderr, "\r%-10s %3u%% (%.1f de %.1f MB)   ", op_stage_name(stage),
+                (unsigned)(mark - 1), done / (1024.0 * 1024.0), total / (1024.0 * 1024.0));
+    } else {
+        fprintf(stderr, "\r%-10s %.1f MB   ", op_stage_name(stage), done / (1024.0 * 1024.0));
+    }
+    progress_shown = 1;
+}
+
+/**
+ * @brief SIGINT/SIGTERM: pede o cancelamento do comando, que para no próximo bloco
+ *        e remove a saída parcial. Um segundo sinal encerra o processo na hora.
+ */
+static void on_cancel_signal(int sig) {
+    (void)sig;
+    op_cancel(&command_op);
+}
+
 /**
  * @brief Imprime as instruções de uso do programa, mostrando todos os comandos disponíveis.
  * 
@@ -15,20 +227,61 @@ void print_usage(const char *prog_name) {
     printf("Sistema de Esteganografia com Compressão e Criptografia\n\n");
     printf("Uso:\n");
     printf("  %s compress <arquivo> <saida.z>\n", prog_name);
-    printf("  %s decompress <arquivo.z> <saida>\n", prog_name);
-    printf("  %s encrypt <senha> <arquivo> <saida.enc>\n", prog_name);
+    printf("  %s decompress <arquivo.z> <saida> [--range INÍCIO:TAMANHO]\n", prog_name);
+    printf("  %s index <arquivo.z> [--span MB]\n", prog_name);
+    printf("  %s encrypt <senha> <arquivo> <saida.enc> [--suite xchacha|aes|auto] [--checkpoint MB] [--resume]\n", prog_name);
     printf("  %s decrypt <senha> <arquivo.enc> <saida>\n", prog_name);
+    printf("  %s xor <chave> <arquivo> <saida>\n", prog_name);
+    printf("  %s keygen <chave.pub> <chave.sec>\n", prog_name);
+    printf("  %s encrypt-pk <arquivo> <saida.enc> <chave.pub> [chave2.pub ...] [--suite xchacha|aes|auto]\n", prog_name);
+    printf("  %s decrypt-pk <chave.sec> <arquivo.enc> <saida>\n", prog_name);
     printf("  %s hide <imagem.bmp> <arquivo> <saida.bmp>\n", prog_name);
     printf("  %s extract <imagem.bmp> <saida>\n", prog_name);
+    printf("  %s update <imagem.bmp> <arquivo>\n", prog_name);
     printf("  %s capacity <imagem.bmp>\n", prog_name);
-    printf("  %s full <imagem.bmp> <arquivo> <saida.bmp>\n", prog_name);
+    printf("  %s full <imagem.bmp> <arquivo> <saida.bmp> <senha> [--suite xchacha|aes|auto] [--cache DIR] [--cache-max MB] [--checkpoint MB] [--resume]\n", prog_name);
+    printf("  %s recover <imagem.bmp> <saida> <senha>\n", prog_name);
+    printf("  %s verify <imagem.bmp> [senha]\n", prog_name);
+    printf("  %s archive <pasta> <saida.sta> <senha> [--suite xchacha|aes|auto] [--block MB]\n", prog_name);
+    printf("  %s unarchive <arquivo.sta> <destino> <senha> [caminho ...]\n", prog_name);
+    printf("  %s list <arquivo.sta> <senha>\n", prog_name);
+    printf("  %s batch <manifesto> [--workers N] [--kdf-mem MB] [--cache-covers MB] [--pool-mem MB] [--cache DIR] [--cache-max MB] [--io-depth N] [--direct] [--timeout S] [--results saida.jsonl]\n", prog_name);
+    printf("  %s cache-stats <diretório>\n", prog_name);
+    printf("  %s bench [--size MB] [--entropy BITS] [--iterations N] [--suite xchacha|aes|auto] [--results saida.jsonl]\n", prog_name);
+    printf("  %s serve <socket> [--workers N] [--cache-covers MB] [--cache-keys N] [--pool-mem MB] [--timeout S]\n", prog_name);
+    printf("  %s call <socket> <hide|extract|full|recover|ping> [argumentos...] [--timeout S]\n", prog_name);
     printf("\nComandos:\n");
     printf("  compress   - Comprime um arquivo\n");
-    printf("  decompress - Descomprime um arquivo\n");
+    printf("  decompress - Descomprime um arquivo (ou só um trecho, com --range)\n");
+    printf("  index      - Grava <arquivo.z>.zidx com pontos de acesso para leituras de trecho\n");
+    printf("  xor        - Embaralha com XOR e chave repetida (a mesma chave desfaz; não é criptografia)\n");
+    printf("  keygen     - Gera um par de chaves X25519 para o modo por chave pública\n");
+    printf("  encrypt-pk - Criptografa para um ou mais destinatários (sem senha)\n");
+    printf("  decrypt-pk - Descriptografa com a chave secreta do destinatário\n");
     printf("  hide       - Esconde arquivo em imagem\n");
     printf("  extract    - Extrai arquivo de imagem\n");
+    printf("  update     - Troca o arquivo escondido regravando só os pixels que mudam\n");
     printf("  capacity   - Mostra capacidade da imagem\n");
     printf("  full       - Comprime + criptografa + esconde (completo)\n");
+    printf("  recover    - Extrai + descriptografa + descomprime (inverso do full)\n");
+    printf("  verify     - Confere o CRC32C (e, com senha, autentica os segmentos) sem gravar os dados\n");
+    printf("  archive    - Empacota um diretório em um arquivo sólido comprimido e criptografado\n");
+    printf("  unarchive  - Extrai um arquivo sólido (inteiro ou só os caminhos indicados)\n");
+    printf("  list       - Lista o conteúdo de um arquivo sólido (lê só o índice)\n");
+    printf("  batch      - Executa os jobs de um manifesto (TSV ou JSONL) em paralelo\n");
+    printf("  cache-stats - Mostra os contadores do cache de resultados do 'full'\n");
+    printf("  bench      - Mede cada estágio com capa e carga sintéticas (resultados em JSONL)\n");
+    printf("  serve      - Daemon em socket Unix com capas e chaves em cache\n");
+    printf("  call       - Envia uma operação ao daemon (arquivos passados por descritor)\n");
+    printf("\nOpções gerais:\n");
+    printf("  --stats    - Ao final, grava no stderr um registro JSON com tempo, bytes e\n");
+    printf("               alocações de cada estágio e o pico de RSS\n");
+    printf("  --trace F  - Grava em F um rastro por thread (trace-event do Chrome/Perfetto)\n");
+    printf("  --progress - Mostra no stderr o progresso de cada estágio\n");
+    printf("  --keyring S - Guarda as chaves derivadas das senhas no keyring do kernel por S\n");
+    printf("               segundos: as próximas execuções com a mesma senha pulam o Argon2\n");
+    printf("  Ctrl-C (SIGINT) ou SIGTERM cancela a operação no próximo bloco, sem deixar saída\n");
+    printf("  parcial; um segundo sinal encerra na hora\n");
     printf("\nExemplos:\n");
     printf("  %s compress documento.txt documento.txt.z\n", prog_name);
     printf("  %s hide foto.bmp secreto.txt foto_stego.bmp\n", prog_name);
@@ -58,10 +311,40 @@ int cmd_compress(int argc, char *argv[]) {
  *        Descomprime um arquivo usando a função decompress_file.
  */
 int cmd_decompress(int argc, char *argv[]) {
+    const char *range = take_option(&argc, argv, "--range");
     if (argc != 4) {
-        fprintf(stderr, "Uso: %s decompress <arquivo.z> <saida>\n", argv[0]);
+        fprintf(stderr, "Uso: %s decompress <arquivo.z> <saida> [--range INÍCIO:TAMANHO]\n", argv[0]);
         return 1;
     }
+
+    // Só um trecho: começa no ponto de acesso do índice (se houver) mais próximo.
+    if (range) {
+        char *end;
+        unsigned long long offset = strtoull(range, &end, 10), length = 0;
+        int valid = range[0] >= '0' && range[0] <= '9' &&
+                    end[0] == ':' && end[1] >= '0' && end[1] <= '9';
+        if (valid) {
+            length = strtoull(end + 1, &end, 10);
+            valid = *end == '\0';
+        }
+        if (!valid) {
+            fprintf(stderr, "Trecho inválido: %s (use INÍCIO:TAMANHO em bytes)\n", range);
+            return 1;
+        }
+        FILE *out = stdstream_open_write(argv[3], 0);
+        if (!out) {
+            perror("Erro ao criar arquivo de saída");
+            return 1;
+        }
+        uint64_t written = 0, skipped = 0;
+        int failed = zindex_read_range(argv[2], offset, length, out, &written, &skipped) != 0;
+        if (stdstream_close_write(out, argv[3], failed) != 0 || failed) {
+            return 1;
+        }
+        printf("✓ Trecho descomprimido: %llu bytes (%llu descomprimidos e descartados antes dele)\n",
+               (unsigned long long)written, (unsigned long long)skipped);
+        return 0;
+    }
     
     printf("Descomprimindo arquivo...\n");
     if (decompress_file(argv[2], argv[3]) == 0) {
@@ -71,13 +354,51 @@ int cmd_decompress(int argc, char *argv[]) {
     return 1;
 }
 
+/**
+ * @brief Função para lidar com o comando 'index'.
+ *        Indexa um .z já existente para leituras de trecho (decompress --range).
+ */
+int cmd_index(int argc, char *argv[]) {
+    const char *span_mb = take_option(&argc, argv, "--span");
+    if (argc != 3) {
+        fprintf(stderr, "Uso: %s index <arquivo.z> [--span MB]\n", argv[0]);
+        return 1;
+    }
+    size_t span = ZINDEX_DEFAULT_SPAN;
+    if (span_mb) {
+        char *end;
+        double mb = strtod(span_mb, &end);
+        if (*end != '\0' || !(mb > 0) || mb > 1024 * 1024) {
+            fprintf(stderr, "Intervalo inválido: %s (use MB, ex.: 1 ou 0.25)\n", span_mb);
+            return 1;
+        }
+        span = (size_t)(mb * 1024 * 1024);
+        span = span ? span : 1;
+    }
+
+    printf("Indexando arquivo...\n");
+    size_t points = 0;
+    if (zindex_build(argv[2], span, &points) != 0) {
+        return 1;
+    }
+    printf("✓ Índice gravado: %s%s (%zu pontos de acesso, um a cada %.2f MB)\n",
+           argv[2], ZINDEX_SUFFIX, points, span / (1024.0 * 1024.0));
+    return 0;
+}
+
 /**
  * @brief Função para lidar com o comando 'encrypt'.
  *        Criptografa um arquivo com uma senha.
  */
 int cmd_encrypt(int argc, char *argv[]) {
+    CryptSuite suite;
+    CheckpointOptions checkpoint;
+    if (take_suite_option(&argc, argv, &suite) != 0 ||
+        take_checkpoint_option(&argc, argv, &checkpoint) != 0) {
+        return 1;
+    }
     if (argc != 5) {
-        fprintf(stderr, "Uso: %s encrypt <senha> <arquivo> <saida.enc>\n", argv[0]);
+        fprintf(stderr, "Uso: %s encrypt <senha> <arquivo> <saida.enc> [--suite xchacha|aes|auto] [--checkpoint MB] [--resume]\n", argv[0]);
         return 1;
     }
     
@@ -87,7 +408,11 @@ int cmd_encrypt(int argc, char *argv[]) {
     const char *output_file = argv[4];
     
     printf("Criptografando arquivo...\n");
-    if (encrypt_file(output_file, input_file, password, password_len) == 0) {
+    int ret = checkpoint.interval
+            ? encrypt_file_checkpoint(output_file, input_file, password, password_len, suite,
+                                      &checkpoint)
+            : encrypt_file_suite(output_file, input_file, password, password_len, suite);
+    if (ret == 0) {
         printf("✓ Arquivo criptografado com sucesso!\n");
         return 0;
     }
@@ -118,6 +443,104 @@ int cmd_decrypt(int argc, char *argv[]) {
     return 1;
 }
 
+/**
+ * @brief Função para lidar com o comando 'xor'.
+ *        Embaralha (ou desembaralha) um arquivo com uma chave repetida.
+ */
+int cmd_xor(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Uso: %s xor <chave> <arquivo> <saida>\n", argv[0]);
+        return 1;
+    }
+
+    printf("Aplicando XOR...\n");
+    if (xor_cipher(argv[3], argv[4], (const unsigned char *)argv[2], strlen(argv[2])) == 0) {
+        printf("✓ XOR aplicado com sucesso!\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'keygen'.
+ *        Gera um par de chaves X25519 para o modo por chave pública.
+ */
+int cmd_keygen(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Uso: %s keygen <chave.pub> <chave.sec>\n", argv[0]);
+        return 1;
+    }
+
+    if (crypt_keygen_files(argv[2], argv[3]) == 0) {
+        printf("✓ Par de chaves gerado: %s (pública), %s (secreta)\n", argv[2], argv[3]);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'encrypt-pk'.
+ *        Criptografa um arquivo para uma ou mais chaves públicas, sem derivação de senha.
+ */
+int cmd_encrypt_pk(int argc, char *argv[]) {
+    CryptSuite suite;
+    if (take_suite_option(&argc, argv, &suite) != 0) {
+        return 1;
+    }
+    if (argc < 5) {
+        fprintf(stderr, "Uso: %s encrypt-pk <arquivo> <saida.enc> <chave.pub> [chave2.pub ...] [--suite xchacha|aes|auto]\n", argv[0]);
+        return 1;
+    }
+
+    size_t n_recipients = argc - 4;
+    unsigned char (*public_keys)[crypto_box_PUBLICKEYBYTES] =
+        malloc(n_recipients * sizeof *public_keys);
+    if (!public_keys) {
+        perror("Erro ao alocar memória");
+        return 1;
+    }
+    for (size_t i = 0; i < n_recipients; i++) {
+        if (crypt_load_key(argv[4 + i], public_keys[i], crypto_box_PUBLICKEYBYTES) != 0) {
+            free(public_keys);
+            return 1;
+        }
+    }
+
+    printf("Criptografando arquivo para %zu destinatário(s)...\n", n_recipients);
+    int ret = encrypt_file_recipients(argv[3], argv[2], public_keys, n_recipients, suite);
+    free(public_keys);
+    if (ret == 0) {
+        printf("✓ Arquivo criptografado com sucesso!\n");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'decrypt-pk'.
+ *        Descriptografa um arquivo do modo por chave pública.
+ */
+int cmd_decrypt_pk(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Uso: %s decrypt-pk <chave.sec> <arquivo.enc> <saida>\n", argv[0]);
+        return 1;
+    }
+
+    unsigned char keypair[CRYPT_SECRETKEY_FILEBYTES];
+    if (crypt_load_key(argv[2], keypair, sizeof keypair) != 0) {
+        return 1;
+    }
+
+    printf("Descriptografando arquivo...\n");
+    int ret = decrypt_file_keypair(argv[4], argv[3], keypair);
+    sodium_memzero(keypair, sizeof keypair);
+    if (ret == 0) {
+        printf("✓ Arquivo descriptografado com sucesso!\n");
+        return 0;
+    }
+    return 1;
+}
+
 /**
  * @brief Função para lidar com o comando 'hide'.
  *        Esconde um arquivo dentro de uma imagem BMP.
@@ -128,8 +551,33 @@ int cmd_hide(int argc, char *argv[]) {
         return 1;
     }
     
+    const char *image_path = stdstream_input_path(argv[2]);
+    if (!image_path) {
+        return 1;
+    }
+
     printf("Escondendo arquivo em imagem...\n");
-    if (steg_hide_file(argv[2], argv[3], argv[4]) == 0) {
+    int ret;
+    if (!stdstream_is_std(argv[3]) && !stdstream_is_std(argv[4])) {
+        ret = steg_hide_file(image_path, argv[3], argv[4]);
+    } else {
+        // Entrada de tamanho desconhecido: o cabeçalho é reservado e corrigido no fim.
+        FILE *in = stdstream_open_read(argv[3]);
+        if (!in) {
+            perror("Erro ao abrir arquivo");
+            return 1;
+        }
+        FILE *out = stdstream_open_write(argv[4], 1);
+        if (!out) {
+            perror("Erro ao criar arquivo de saída");
+            stdstream_close_read(in);
+            return 1;
+        }
+        ret = steg_hide_stream(image_path, in, out);
+        stdstream_close_read(in);
+        ret = stdstream_close_write(out, argv[4], ret != 0);
+    }
+    if (ret == 0) {
         printf("✓ Arquivo escondido com sucesso!\n");
         return 0;
     }
@@ -146,14 +594,59 @@ int cmd_extract(int argc, char *argv[]) {
         return 1;
     }
     
+    const char *image_path = stdstream_input_path(argv[2]);
+    if (!image_path) {
+        return 1;
+    }
+
     printf("Extraindo arquivo da imagem...\n");
-    if (steg_extract_file(argv[2], argv[3]) == 0) {
+    int ret;
+    if (!stdstream_is_std(argv[3])) {
+        ret = steg_extract_file(image_path, argv[3]);
+    } else {
+        FILE *out = stdstream_open_write(argv[3], 0);
+        if (!out) {
+            return 1;
+        }
+        ret = steg_extract_stream(image_path, out);
+        ret = stdstream_close_write(out, argv[3], ret != 0);
+    }
+    if (ret == 0) {
         printf("✓ Arquivo extraído com sucesso!\n");
         return 0;
     }
     return 1;
 }
 
+/**
+ * @brief Função para lidar com o comando 'update'.
+ *        Troca, no próprio arquivo, os dados escondidos em uma imagem.
+ */
+int cmd_update(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Uso: %s update <imagem.bmp> <arquivo>\n", argv[0]);
+        return 1;
+    }
+    if (stdstream_is_std(argv[2])) {
+        fprintf(stderr, "Erro: a imagem do update é alterada no lugar e precisa ser um arquivo\n");
+        return 1;
+    }
+
+    // Os dados precisam do tamanho antes da primeira escrita: "-" vai para um temporário.
+    const char *file_path = stdstream_input_path(argv[3]);
+    if (!file_path) {
+        return 1;
+    }
+
+    printf("Atualizando arquivo escondido...\n");
+    size_t rewritten = 0;
+    if (steg_update_file(argv[2], file_path, &rewritten) != 0) {
+        return 1;
+    }
+    printf("✓ Imagem atualizada (%zu bytes de pixels regravados)\n", rewritten);
+    return 0;
+}
+
 /**
  * @brief Função para lidar com o comando 'capacity'.
  *        Verifica quantos bytes podem ser escondidos em uma imagem BMP.
@@ -164,7 +657,12 @@ int cmd_capacity(int argc, char *argv[]) {
         return 1;
     }
     
-    long capacity = steg_get_capacity(argv[2]);
+    const char *image_path = stdstream_input_path(argv[2]);
+    if (!image_path) {
+        return 1;
+    }
+
+    long capacity = steg_get_capacity(image_path);
     if (capacity >= 0) {
         printf("Capacidade da imagem: %ld bytes (%.2f KB)\n", 
                capacity, capacity / 1024.0);
@@ -178,148 +676,587 @@ int cmd_capacity(int argc, char *argv[]) {
  *        Executa o processo completo: comprime, criptografa e esconde um arquivo em uma imagem.
  */
 int cmd_full(int argc, char *argv[]) {
+    CryptSuite suite;
+    CheckpointOptions checkpoint;
+    if (take_suite_option(&argc, argv, &suite) != 0 ||
+        take_checkpoint_option(&argc, argv, &checkpoint) != 0 ||
+        take_result_cache_option(&argc, argv) != 0) {
+        return 1;
+    }
     if (argc != 6) {
-        fprintf(stderr, "Uso: %s full <imagem.bmp> <arquivo> <saida.bmp> <senha>\n", argv[0]);
+        fprintf(stderr, "Uso: %s full <imagem.bmp> <arquivo> <saida.bmp> <senha> [--suite xchacha|aes|auto] [--cache DIR] [--cache-max MB] [--checkpoint MB] [--resume]\n", argv[0]);
         return 1;
     }
     
-    const char *image_path = argv[2];
+    const char *image_path = stdstream_input_path(argv[2]);
     const char *file_path = argv[3];
     const char *output_path = argv[4];
     const unsigned char *password = (const unsigned char *)argv[5];
     size_t password_len = strlen(argv[5]);
     
-    printf("=== Processo Completo (Compressão + Criptografia + Esteganografia) ===\n");
-    
-    // 1. Lê arquivo original
-    printf("\n1. Lendo arquivo...\n");
-    FILE *f = fopen(file_path, "rb");
-    if (!f) {
-        perror("Erro ao abrir arquivo");
+    if (!image_path) {
         return 1;
     }
+
+    printf("=== Processo Completo (Compressão + Criptografia + Esteganografia) ===\n");
     
-    fseek(f, 0, SEEK_END);
-    long file_size = ftell(f);
-    fseek(f, 0, SEEK_SET);
-    
-    unsigned char *original_data = malloc(file_size);
-    if (!original_data) {
-        perror("Erro ao alocar memória");
-        fclose(f);
-        return 1;
+    // Os três estágios rodam em paralelo, em fluxo: leitura + compressão,
+    // derivação da chave + criptografia por segmento, e LSB + escrita da imagem.
+    printf("\nComprimindo, criptografando e escondendo em fluxo...\n");
+    PipelineStats stats;
+    int ret;
+    if (checkpoint.interval) {
+        ret = pipeline_full_checkpoint(image_path, file_path, output_path, password, password_len,
+                                       suite, &checkpoint, &stats);
+    } else if (!stdstream_is_std(file_path) && !stdstream_is_std(output_path)) {
+        ret = pipeline_full(image_path, file_path, output_path, password, password_len,
+                            suite, &stats);
+    } else {
+        FILE *in = stdstream_open_read(file_path);
+        if (!in) {
+            perror("Erro ao abrir arquivo");
+            return 1;
+        }
+        FILE *out = stdstream_open_write(output_path, 1);
+        if (!out) {
+            perror("Erro ao criar arquivo de saída");
+            stdstream_close_read(in);
+            return 1;
+        }
+        ret = pipeline_full_stream(image_path, in, out, password, password_len, suite, &stats);
+        stdstream_close_read(in);
+        ret = stdstream_close_write(out, output_path, ret != 0);
     }
-    fread(original_data, 1, file_size, f);
-    fclose(f);
-    
-    printf("   Tamanho original: %ld bytes\n", file_size);
-    
-    // 2. Comprime
-    printf("\n2. Comprimindo dados...\n");
-    unsigned char *compressed_data = NULL;
-    size_t compressed_size = 0;
-    
-    if (compress_data(original_data, file_size, 
-                      &compressed_data, &compressed_size) != 0) {
-        free(original_data);
+    if (ret != 0) {
         return 1;
     }
     
+    printf("   Tamanho original: %zu bytes\n", stats.input_bytes);
     printf("   Tamanho comprimido: %zu bytes (%.1f%% de redução)\n", 
-           compressed_size, 
-           100.0 - (compressed_size * 100.0 / file_size));
-    
-    // 3. Criptografa
-    printf("\n3. Criptografando dados...\n");
-    unsigned char *encrypted_data = NULL;
-    size_t encrypted_size = 0;
-    
-    if (encrypt_data(compressed_data, compressed_size,
-                     &encrypted_data, &encrypted_size,
-                     password, password_len) != 0) {
-        free(original_data);
-        free(compressed_data);
-        return 1;
-    }
-    
-    printf("   Tamanho criptografado: %zu bytes\n", encrypted_size);
-    
-    // 4. Esconde na imagem
-    printf("\n4. Escondendo na imagem...\n");
-    if (steg_hide(image_path, encrypted_data, encrypted_size, output_path) != 0) {
-        free(original_data);
-        free(compressed_data);
-        free(encrypted_data);
-        return 1;
+           stats.compressed_bytes, 
+           stats.input_bytes ? 100.0 - (stats.compressed_bytes * 100.0 / stats.input_bytes) : 0.0);
+    printf("   Tamanho criptografado: %zu bytes (%s)\n", stats.encrypted_bytes,
+           crypt_suite_name(suite_used(suite)));
+    if (result_cache_enabled() && !checkpoint.interval) {
+        printf("   Cache de resultados: %s\n", stats.cached
+               ? "acerto (compressão e criptografia reaproveitadas)" : "falta (resultado guardado)");
     }
-    
     printf("   Dados escondidos com sucesso!\n");
     
-    free(original_data);
-    free(compressed_data);
-    free(encrypted_data);
-    
     printf("\n✓ Processo completo finalizado!\n");
     printf("Imagem salva em: %s\n", output_path);
-    printf("\nPara extrair: use 'extract' e depois 'decrypt' com a mesma senha\n");
+    printf("\nPara recuperar: use 'recover' com a mesma senha\n");
     
     return 0;
 }
 
 /**
- * @brief Função principal do programa.
- * 
- * @param argc Número de argumentos da linha de comando.
- * @param argv Vetor de strings com os argumentos.
- * @return int 0 se sucesso, 1 se erro.
+ * @brief Função para lidar com o comando 'recover'.
+ *        Inverso do 'full': extrai, descriptografa e descomprime em um único fluxo.
  */
-int main(int argc, char *argv[]) {
-    // Inicializa a biblioteca de criptografia libsodium. É essencial para garantir que a biblioteca está pronta para uso.
+int cmd_recover(int argc, char *argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Uso: %s recover <imagem.bmp> <saida> <senha>\n", argv[0]);
+        return 1;
+    }
 
-    if (sodium_init() < 0) {
-        fprintf(stderr, "Erro critico: Nao foi possivel inicializar a libsodium!\n");
+    const unsigned char *password = (const unsigned char *)argv[4];
+    size_t password_len = strlen(argv[4]);
+
+    const char *image_path = stdstream_input_path(argv[2]);
+    if (!image_path) {
         return 1;
     }
-    
-    // Verifica se pelo menos um comando foi fornecido.
-    if (argc < 2) {
-        print_usage(argv[0]);
+
+    printf("Recuperando arquivo (extração + descriptografia + descompressão)...\n");
+    PipelineStats stats;
+    int ret;
+    if (!stdstream_is_std(argv[3])) {
+        ret = pipeline_recover(image_path, argv[3], password, password_len, &stats);
+    } else {
+        // Na saída padrão os dados já entregues não podem ser desfeitos: quem lê
+        // deve descartá-los se o código de saída indicar erro.
+        FILE *out = stdstream_open_write(argv[3], 0);
+        if (!out) {
+            return 1;
+        }
+        ret = pipeline_recover_stream(image_path, out, password, password_len, &stats);
+        ret = stdstream_close_write(out, argv[3], ret != 0);
+    }
+    if (ret != 0) {
+        fprintf(stderr, "Erro: Senha incorreta ou imagem corrompida\n");
         return 1;
     }
-    
-    // Pega o comando principal (ex: "compress", "hide") a partir do primeiro argumento.
-    const char *command = argv[1];
-    
-    // Compara o comando fornecido e chama a função correspondente.
+
+    printf("   Dados escondidos: %zu bytes\n", stats.encrypted_bytes);
+    printf("   Tamanho comprimido: %zu bytes\n", stats.compressed_bytes);
+    printf("   Tamanho recuperado: %zu bytes\n", stats.input_bytes);
+    printf("✓ Arquivo recuperado com sucesso: %s\n", argv[3]);
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'verify'.
+ *        Confere uma imagem de 'hide' ou 'full' em uma passada, sem gravar os dados.
+ */
+int cmd_verify(int argc, char *argv[]) {
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Uso: %s verify <imagem.bmp> [senha]\n", argv[0]);
+        return 1;
+    }
+
+    const unsigned char *password = argc == 4 ? (const unsigned char *)argv[3] : NULL;
+    size_t password_len = argc == 4 ? strlen(argv[3]) : 0;
+
+    const char *image_path = stdstream_input_path(argv[2]);
+    if (!image_path) {
+        return 1;
+    }
+
+    printf(password ? "Verificando imagem (CRC32C + autenticação dos segmentos)...\n"
+                    : "Verificando imagem (CRC32C)...\n");
+    PipelineStats stats;
+    if (pipeline_verify(image_path, password, password_len, &stats) != 0) {
+        fprintf(stderr, "Erro: a imagem não passou na verificação\n");
+        return 1;
+    }
+
+    printf("   Dados escondidos: %zu bytes\n", stats.encrypted_bytes);
+    if (password) {
+        printf("   Texto claro autenticado: %zu bytes\n", stats.compressed_bytes);
+    }
+    printf("✓ Imagem íntegra: %s\n", argv[2]);
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'archive'.
+ *        Empacota uma árvore de diretórios em blocos sólidos com índice no fim.
+ */
+int cmd_archive(int argc, char *argv[]) {
+    CryptSuite suite;
+    if (take_suite_option(&argc, argv, &suite) != 0) {
+        return 1;
+    }
+    const char *block = take_option(&argc, argv, "--block");
+    if (argc != 5) {
+        fprintf(stderr, "Uso: %s archive <pasta> <saida.sta> <senha> [--suite xchacha|aes|auto] [--block MB]\n", argv[0]);
+        return 1;
+    }
+    size_t block_size = ARCHIVE_DEFAULT_BLOCK_SIZE;
+    if (block && parse_megabytes("--block", block, 1, &block_size) != 0) {
+        return 1;
+    }
+
+    printf("Empacotando %s...\n", argv[2]);
+    ArchiveStats stats;
+    if (archive_create(argv[2], argv[3], (const unsigned char *)argv[4], strlen(argv[4]),
+                       suite, block_size, &stats) != 0) {
+        return 1;
+    }
+    printf("   Entradas: %zu\n", stats.entries);
+    printf("   Conteúdo: %llu bytes em %zu bloco(s) sólido(s)\n",
+           (unsigned long long)stats.content_bytes, stats.blocks);
+    printf("   Arquivo: %llu bytes (%s)\n", (unsigned long long)stats.archive_bytes,
+           crypt_suite_name(suite_used(suite)));
+    printf("✓ Arquivo sólido criado: %s\n", argv[3]);
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'unarchive'.
+ *        Extrai tudo, ou só os caminhos pedidos, lendo apenas os blocos necessários.
+ */
+int cmd_unarchive(int argc, char *argv[]) {
+    if (argc < 5) {
+        fprintf(stderr, "Uso: %s unarchive <arquivo.sta> <destino> <senha> [caminho ...]\n", argv[0]);
+        return 1;
+    }
+    const char *archive_path = stdstream_input_path(argv[2]);
+    if (!archive_path) {
+        return 1;
+    }
+
+    printf("Extraindo %s...\n", argv[2]);
+    ArchiveStats stats;
+    if (archive_extract(archive_path, argv[3], (const unsigned char *)argv[4], strlen(argv[4]),
+                        argv + 5, (size_t)(argc - 5), &stats) != 0) {
+        return 1;
+    }
+    printf("   Entradas extraídas: %zu (%llu bytes)\n", stats.entries,
+           (unsigned long long)stats.content_bytes);
+    printf("✓ Arquivo sólido extraído em: %s\n", argv[3]);
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'list'.
+ *        Mostra as entradas de um arquivo sólido a partir do índice.
+ */
+int cmd_list(int argc, char *argv[]) {
+    if (argc != 4) {
+        fprintf(stderr, "Uso: %s list <arquivo.sta> <senha>\n", argv[0]);
+        return 1;
+    }
+    const char *archive_path = stdstream_input_path(argv[2]);
+    if (!archive_path) {
+        return 1;
+    }
+
+    ArchiveStats stats;
+    if (archive_list(archive_path, (const unsigned char *)argv[3], strlen(argv[3]),
+                     stdout, &stats) != 0) {
+        return 1;
+    }
+    printf("%zu entrada(s), %llu bytes em %zu bloco(s); arquivo com %llu bytes\n",
+           stats.entries, (unsigned long long)stats.content_bytes, stats.blocks,
+           (unsigned long long)stats.archive_bytes);
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'batch'.
+ *        Executa os jobs de um manifesto em um pool de threads com roubo de trabalho.
+ */
+int cmd_batch(int argc, char *argv[]) {
+    BatchOptions opts = { 0, 0, (size_t)64 * 1024 * 1024, (size_t)64 * 1024 * 1024, NULL,
+                          NULL, (size_t)1024 * 1024 * 1024, 32, 0, 0 };
+    const char *workers = take_option(&argc, argv, "--workers");
+    const char *kdf_mem = take_option(&argc, argv, "--kdf-mem");
+    const char *covers = take_option(&argc, argv, "--cache-covers");
+    const char *pool_mem = take_option(&argc, argv, "--pool-mem");
+    opts.results_path = take_option(&argc, argv, "--results");
+    opts.result_cache_dir = take_option(&argc, argv, "--cache");
+    const char *cache_max = take_option(&argc, argv, "--cache-max");
+    const char *io_depth = take_option(&argc, argv, "--io-depth");
+    const char *timeout = take_option(&argc, argv, "--timeout");
+    opts.direct_io = take_flag(&argc, argv, "--direct");
+
+    if (argc != 3) {
+        fprintf(stderr, "Uso: %s batch <manifesto> [--workers N] [--kdf-mem MB] [--cache-covers MB] [--pool-mem MB] [--cache DIR] [--cache-max MB] [--io-depth N] [--direct] [--timeout S] [--results saida.jsonl]\n", argv[0]);
+        return 1;
+    }
+    if (timeout && parse_timeout("--timeout", timeout, &opts.job_timeout_ms) != 0) {
+        return 1;
+    }
+    unsigned long long n;
+    if (workers) {
+        if (parse_count("--workers", workers, 0, 1024, &n) != 0) {
+            return 1;
+        }
+        opts.workers = (int)n;
+    }
+    if ((kdf_mem && parse_megabytes("--kdf-mem", kdf_mem, 1, &opts.kdf_memory_budget) != 0) ||
+        (covers && parse_megabytes("--cache-covers", covers, 0, &opts.cover_cache_bytes) != 0) ||
+        (pool_mem && parse_megabytes("--pool-mem", pool_mem, 0, &opts.buffer_pool_bytes) != 0) ||
+        (cache_max && parse_megabytes("--cache-max", cache_max, 0, &opts.result_cache_bytes) != 0)) {
+        return 1;
+    }
+    if (io_depth) {
+        if (parse_count("--io-depth", io_depth, 0, 4096, &n) != 0) {
+            return 1;
+        }
+        opts.io_depth = (unsigned)n;
+    }
+
+    return batch_run(argv[2], &opts) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'cache-stats'.
+ *        Mostra os contadores acumulados e o tamanho do cache de resultados.
+ */
+int cmd_cache_stats(int argc, char *argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "Uso: %s cache-stats <diretório>\n", argv[0]);
+        return 1;
+    }
+    struct stat st;
+    if (stat(argv[2], &st) != 0 || !S_ISDIR(st.st_mode)) {
+        fprintf(stderr, "Erro: %s não é um diretório de cache\n", argv[2]);
+        return 1;
+    }
+    if (result_cache_open(argv[2], 0) != 0) {
+        return 1;
+    }
+
+    ResultCacheStats total;
+    result_cache_get_stats(NULL, &total);
+    result_cache_close();
+    unsigned long lookups = total.hits + total.misses;
+    printf("Cache de resultados: %s\n", argv[2]);
+    printf("   Acertos: %lu (%.1f%%)\n", total.hits, lookups ? total.hits * 100.0 / lookups : 0.0);
+    printf("   Faltas: %lu\n", total.misses);
+    printf("   Entradas gravadas: %lu, removidas pelo limite: %lu\n", total.stores, total.evictions);
+    printf("   Ocupação: %zu entradas, %.1f MB\n", total.entries, total.bytes / (1024.0 * 1024.0));
+    return 0;
+}
+
+/**
+ * @brief Função para lidar com o comando 'bench'.
+ *        Mede compressão, KDF, criptografia, esteganografia e o fluxo completo.
+ */
+int cmd_bench(int argc, char *argv[]) {
+    BenchOptions opts = { (size_t)8 * 1024 * 1024, 4, 10, CRYPT_SUITE_XCHACHA20, NULL };
+    const char *size = take_option(&argc, argv, "--size");
+    const char *entropy = take_option(&argc, argv, "--entropy");
+    const char *iterations = take_option(&argc, argv, "--iterations");
+    opts.results_path = take_option(&argc, argv, "--results");
+    if (take_suite_option(&argc, argv, &opts.suite) != 0) {
+        return 1;
+    }
+
+    if (argc != 2) {
+        fprintf(stderr, "Uso: %s bench [--size MB] [--entropy BITS] [--iterations N] [--suite xchacha|aes|auto] [--results saida.jsonl]\n", argv[0]);
+        return 1;
+    }
+    if (size) {
+        char *end;
+        double mb = strtod(size, &end);
+        if (*end != '\0' || !(mb * 1024 * 1024 >= 1) || mb > OPTION_MAX_MB) {
+            fprintf(stderr, "Erro: --size deve ser um número positivo de MB\n");
+            return 1;
+        }
+        opts.payload_bytes = (size_t)(mb * 1024 * 1024);
+    }
+    unsigned long long n;
+    if (entropy) {
+        if (parse_count("--entropy", entropy, 0, 8, &n) != 0) {
+            return 1;
+        }
+        opts.entropy_bits = (int)n;
+    }
+    if (iterations) {
+        if (parse_count("--iterations", iterations, 1, INT_MAX, &n) != 0) {
+            return 1;
+        }
+        opts.iterations = (int)n;
+    }
+
+    return bench_run(&opts) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'serve'.
+ *        Mantém o processo vivo atendendo requisições em um socket Unix.
+ */
+int cmd_serve(int argc, char *argv[]) {
+    ServeOptions opts = { 0, (size_t)64 * 1024 * 1024, (size_t)64 * 1024 * 1024, 16, 0 };
+    const char *workers = take_option(&argc, argv, "--workers");
+    const char *covers = take_option(&argc, argv, "--cache-covers");
+    const char *keys = take_option(&argc, argv, "--cache-keys");
+    const char *pool_mem = take_option(&argc, argv, "--pool-mem");
+    const char *timeout = take_option(&argc, argv, "--timeout");
+
+    if (argc != 3) {
+        fprintf(stderr, "Uso: %s serve <socket> [--workers N] [--cache-covers MB] [--cache-keys N] [--pool-mem MB] [--timeout S]\n", argv[0]);
+        return 1;
+    }
+    unsigned long long n;
+    if (workers) {
+        if (parse_count("--workers", workers, 0, 1024, &n) != 0) {
+            return 1;
+        }
+        opts.workers = (int)n;
+    }
+    if (keys) {
+        if (parse_count("--cache-keys", keys, 0, 65536, &n) != 0) {
+            return 1;
+        }
+        opts.key_slots = (size_t)n;
+    }
+    if ((covers && parse_megabytes("--cache-covers", covers, 0, &opts.cover_cache_bytes) != 0) ||
+        (pool_mem && parse_megabytes("--pool-mem", pool_mem, 0, &opts.buffer_pool_bytes) != 0) ||
+        (timeout && parse_timeout("--timeout", timeout, &opts.request_timeout_ms) != 0)) {
+        return 1;
+    }
+
+    return serve_run(argv[2], &opts) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Função para lidar com o comando 'call'.
+ *        Cliente do daemon: abre os arquivos aqui e os envia por descritor.
+ */
+int cmd_call(int argc, char *argv[]) {
+    const char *timeout = take_option(&argc, argv, "--timeout");
+    if (argc < 4) {
+        fprintf(stderr, "Uso: %s call <socket> <operação> [argumentos...] [--timeout S]\n", argv[0]);
+        fprintf(stderr, "  ping [N]\n");
+        fprintf(stderr, "  hide <imagem.bmp> <arquivo> <saida.bmp>\n");
+        fprintf(stderr, "  extract <imagem.bmp> <saida>\n");
+        fprintf(stderr, "  full <imagem.bmp> <arquivo> <saida.bmp> <senha> [suite]\n");
+        fprintf(stderr, "  recover <imagem.bmp> <saida> <senha>\n");
+        return 1;
+    }
+
+    uint64_t timeout_ms = 0;
+    if (timeout && parse_timeout("--timeout", timeout, &timeout_ms) != 0) {
+        return 1;
+    }
+    return serve_call(argv[2], argc - 3, argv + 3, timeout_ms) == 0 ? 0 : 1;
+}
+
+/**
+ * @brief Compara o comando fornecido e chama a função correspondente.
+ *
+ * @return int 0 se sucesso, 1 se erro.
+ */
+static int run_command(const char *command, int argc, char *argv[]) {
     if (strcmp(command, "compress") == 0) {
         return cmd_compress(argc, argv);
     }
     else if (strcmp(command, "decompress") == 0) {
         return cmd_decompress(argc, argv);
     }
+    else if (strcmp(command, "index") == 0) {
+        return cmd_index(argc, argv);
+    }
     else if (strcmp(command, "encrypt") == 0) {
         return cmd_encrypt(argc, argv);
     }
     else if (strcmp(command, "decrypt") == 0) {
         return cmd_decrypt(argc, argv);
     }
+    else if (strcmp(command, "xor") == 0) {
+        return cmd_xor(argc, argv);
+    }
+    else if (strcmp(command, "keygen") == 0) {
+        return cmd_keygen(argc, argv);
+    }
+    else if (strcmp(command, "encrypt-pk") == 0) {
+        return cmd_encrypt_pk(argc, argv);
+    }
+    else if (strcmp(command, "decrypt-pk") == 0) {
+        return cmd_decrypt_pk(argc, argv);
+    }
     else if (strcmp(command, "hide") == 0) {
         return cmd_hide(argc, argv);
     }
     else if (strcmp(command, "extract") == 0) {
         return cmd_extract(argc, argv);
     }
+    else if (strcmp(command, "update") == 0) {
+        return cmd_update(argc, argv);
+    }
     else if (strcmp(command, "capacity") == 0) {
         return cmd_capacity(argc, argv);
     }
     else if (strcmp(command, "full") == 0) {
         return cmd_full(argc, argv);
     }
+    else if (strcmp(command, "recover") == 0) {
+        return cmd_recover(argc, argv);
+    }
+    else if (strcmp(command, "verify") == 0) {
+        return cmd_verify(argc, argv);
+    }
+    else if (strcmp(command, "archive") == 0) {
+        return cmd_archive(argc, argv);
+    }
+    else if (strcmp(command, "unarchive") == 0) {
+        return cmd_unarchive(argc, argv);
+    }
+    else if (strcmp(command, "list") == 0) {
+        return cmd_list(argc, argv);
+    }
+    else if (strcmp(command, "batch") == 0) {
+        return cmd_batch(argc, argv);
+    }
+    else if (strcmp(command, "cache-stats") == 0) {
+        return cmd_cache_stats(argc, argv);
+    }
+    else if (strcmp(command, "bench") == 0) {
+        return cmd_bench(argc, argv);
+    }
+    else if (strcmp(command, "serve") == 0) {
+        return cmd_serve(argc, argv);
+    }
+    else if (strcmp(command, "call") == 0) {
+        return cmd_call(argc, argv);
+    }
     else {
         fprintf(stderr, "Comando inválido: %s\n\n", command);
         print_usage(argv[0]);
         return 1;
     }
+}
+
+/**
+ * @brief Função principal do programa.
+ * 
+ * @param argc Número de argumentos da linha de comando.
+ * @param argv Vetor de strings com os argumentos.
+ * @return int 0 se sucesso, 1 se erro.
+ */
+int main(int argc, char *argv[]) {
+    // Inicializa a biblioteca de criptografia libsodium. É essencial para garantir que a biblioteca está pronta para uso.
+
+    if (sodium_init() < 0) {
+        fprintf(stderr, "Erro critico: Nao foi possivel inicializar a libsodium!\n");
+        return 1;
+    }
+    
+    // Verifica se pelo menos um comando foi fornecido.
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 1;
+    }
     
-    return 0;
-}
\ No newline at end of file
+    // Pega o comando principal (ex: "compress", "hide") a partir do primeiro argumento.
+    const char *command = argv[1];
+
+    // "--stats" e "--trace" valem para qualquer comando: registro JSON com os contadores
+    // no stderr e rastro de eventos por thread em um arquivo.
+    int stats = take_flag(&argc, argv, "--stats");
+    const char *trace_path = take_option(&argc, argv, "--trace");
+    int progress = take_flag(&argc, argv, "--progress");
+    const char *keyring_ttl = take_option(&argc, argv, "--keyring");
+
+    // Com "-" em algum argumento, o stdout fica só para os dados e as mensagens vão para o stderr.
+    for (int i = 2; i < argc; i++) {
+        if (stdstream_is_std(argv[i]) && stdstream_claim_stdout() != 0) {
+            return 1;
+        }
+    }
+
+    // Chaves derivadas compartilhadas entre execuções, só na memória do kernel.
+    if (keyring_ttl) {
+        unsigned long long ttl;
+        if (parse_count("--keyring", keyring_ttl, 1, UINT_MAX, &ttl) != 0) {
+            return 1;
+        }
+        crypt_keyring_enable((unsigned)ttl);
+    }
+    if (stats) {
+        metrics_enable(1);
+    }
+    if (trace_path) {
+        metrics_trace_start();
+    }
+    // O comando roda com um contexto de operação: progresso opcional e
+    // cancelamento cooperativo no primeiro SIGINT/SIGTERM (sem SA_RESTART, uma
+    // leitura bloqueada também é interrompida).
+    op_context_init(&command_op, progress ? print_progress : NULL, NULL);
+    op_context_enter(&command_op);
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_cancel_signal;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    uint64_t start = metrics_now_ns();
+    int status = run_command(command, argc, argv);
+    if (progress_shown) {
+        fputc('\n', stderr);
+    }
+    if (stats) {
+        metrics_write_json(stderr, command, status, metrics_now_ns() - start);
+    }
+    if (trace_path && metrics_trace_write(trace_path) != 0) {
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,293 @@
+#include "metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+// Eventos por bloco do buffer de rastro de uma thread
+#define TRACE_CHUNK_EVENTS 4096
+
+int metrics_active = 0;
+
+/**
+ * @brief Contadores de um estágio, somados atomicamente por todas as threads.
+ */
+typedef struct {
+    uint64_t calls;
+    uint64_t ns;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+} StageCounters;
+
+/**
+ * @brief Uma chamada marcada, guardada no buffer da thread que a executou.
+ */
+typedef struct {
+    uint64_t start_ns;
+    uint64_t dur_ns;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    int stage;
+} TraceEvent;
+
+typedef struct TraceChunk {
+    struct TraceChunk *next;   // bloco anterior da mesma thread
+    size_t count;
+    TraceEvent events[TRACE_CHUNK_EVENTS];
+} TraceChunk;
+
+/**
+ * @brief Buffer de rastro de uma thread. Só a dona escreve nele; a lista global
+ *        de buffers cresce com CAS, então registrar uma thread também não trava.
+ */
+typedef struct TraceThread {
+    struct TraceThread *next;
+    int tid;
+    char name[32];
+    TraceChunk *chunks;        // bloco atual primeiro
+} TraceThread;
+
+static const char *const stage_names[METRICS_STAGES] = {
+    "read", "deflate", "inflate", "kdf", "encrypt", "decrypt", "embed", "extract", "write",
+    "wait", "task"
+};
+
+static StageCounters counters[METRICS_STAGES];
+static uint64_t alloc_count;
+static uint64_t alloc_bytes;
+static int rss_reset_ok;
+
+static TraceThread *trace_threads;
+static unsigned trace_generation;   // muda a cada início/fim: invalida os buffers antigos
+static int trace_next_tid;
+static uint64_t trace_origin_ns;
+static __thread TraceThread *trace_self;
+static __thread unsigned trace_self_generation;
+
+uint64_t metrics_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void metrics_enable(int on) {
+    memset(counters, 0, sizeof(counters));
+    alloc_count = 0;
+    alloc_bytes = 0;
+    rss_reset_ok = on && metrics_reset_peak_rss() == 0;
+    if (on) {
+        __atomic_fetch_or(&metrics_active, METRICS_COUNTERS, __ATOMIC_RELAXED);
+    } else {
+        __atomic_fetch_and(&metrics_active, ~METRICS_COUNTERS, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief Buffer de rastro da thread atual, criado e registrado no primeiro evento.
+ *
+ * @return O buffer, ou NULL sem memória (o evento é descartado).
+ */
+static TraceThread *trace_thread(void) {
+    unsigned generation = __atomic_load_n(&trace_generation, __ATOMIC_ACQUIRE);
+    if (trace_self && trace_self_generation == generation) {
+        return trace_self;
+    }
+    TraceThread *t = calloc(1, sizeof(TraceThread));
+    if (!t) {
+        return NULL;
+    }
+    t->tid = __atomic_add_fetch(&trace_next_tid, 1, __ATOMIC_RELAXED);
+    snprintf(t->name, sizeof(t->name), "thread %d", t->tid);
+    t->next = __atomic_load_n(&trace_threads, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_threads, &t->next, t, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    trace_self = t;
+    trace_self_generation = generation;
+    return t;
+}
+
+static void trace_append(MetricsStage stage, uint64_t start_ns, uint64_t end_ns,
+                         size_t bytes_in, size_t bytes_out) {
+    TraceThread *t = trace_thread();
+    if (!t) {
+        return;
+    }
+    TraceChunk *c = t->chunks;
+    if (!c || c->count == TRACE_CHUNK_EVENTS) {
+        c = malloc(sizeof(TraceChunk));
+        if (!c) {
+            return;
+        }
+        c->count = 0;
+        c->next = t->chunks;
+        t->chunks = c;
+    }
+    TraceEvent *e = &c->events[c->count++];
+    e->start_ns = start_ns;
+    e->dur_ns = end_ns - start_ns;
+    e->bytes_in = bytes_in;
+    e->bytes_out = bytes_out;
+    e->stage = stage;
+}
+
+void metrics_record(MetricsStage stage, uint64_t start_ns, size_t bytes_in, size_t bytes_out) {
+    uint64_t end_ns = metrics_now_ns();
+    int active = __atomic_load_n(&metrics_active, __ATOMIC_RELAXED);
+    if (active & METRICS_COUNTERS) {
+        StageCounters *c = &counters[stage];
+        __atomic_fetch_add(&c->calls, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->ns, end_ns - start_ns, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->bytes_in, bytes_in, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->bytes_out, bytes_out, __ATOMIC_RELAXED);
+    }
+    if (active & METRICS_TRACE) {
+        trace_append(stage, start_ns, end_ns, bytes_in, bytes_out);
+    }
+}
+
+int metrics_trace_start(void) {
+    if (__atomic_load_n(&metrics_active, __ATOMIC_RELAXED) & METRICS_TRACE) {
+        return -1;
+    }
+    trace_origin_ns = metrics_now_ns();
+    __atomic_add_fetch(&trace_generation, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_or(&metrics_active, METRICS_TRACE, __ATOMIC_RELAXED);
+    metrics_thread_name("main");
+    return 0;
+}
+
+void metrics_thread_name(const char *name) {
+    if (!(__atomic_load_n(&metrics_active, __ATOMIC_RELAXED) & METRICS_TRACE)) {
+        return;
+    }
+    TraceThread *t = trace_thread();
+    if (t) {
+        snprintf(t->name, sizeof(t->name), "%s", name);
+    }
+}
+
+/**
+ * @brief Grava os eventos de todas as threads no formato trace-event (JSON).
+ */
+static int trace_write_events(FILE *out, TraceThread *threads) {
+    long pid = (long)getpid();
+    int first = 1;
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (TraceThread *t = threads; t; t = t->next) {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", pid, t->tid, t->name);
+        first = 0;
+        for (TraceChunk *c = t->chunks; c; c = c->next) {
+            for (size_t i = 0; i < c->count; i++) {
+                const TraceEvent *e = &c->events[i];
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"stegfs\",\"ph\":\"X\","
+                        "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%d,"
+                        "\"args\":{\"bytes_in\":%llu,\"bytes_out\":%llu}}",
+                        stage_names[e->stage], (e->start_ns - trace_origin_ns) / 1e3,
+                        e->dur_ns / 1e3, pid, t->tid, (unsigned long long)e->bytes_in,
+                        (unsigned long long)e->bytes_out);
+            }
+        }
+    }
+    fprintf(out, "\n]}\n");
+    return ferror(out) ? -1 : 0;
+}
+
+int metrics_trace_write(const char *path) {
+    __atomic_fetch_and(&metrics_active, ~METRICS_TRACE, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&trace_generation, 1, __ATOMIC_RELEASE);
+    TraceThread *threads = __atomic_exchange_n(&trace_threads, NULL, __ATOMIC_ACQUIRE);
+
+    int ret = -1;
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("Erro ao criar o arquivo de rastro");
+    } else {
+        ret = trace_write_events(out, threads);
+        ret |= fclose(out) != 0 ? -1 : 0;
+        if (ret != 0) {
+            fprintf(stderr, "Erro ao escrever o arquivo de rastro %s\n", path);
+        }
+    }
+
+    while (threads) {
+        TraceThread *next = threads->next;
+        while (threads->chunks) {
+            TraceChunk *c = threads->chunks;
+            threads->chunks = c->next;
+            free(c);
+        }
+        free(threads);
+        threads = next;
+    }
+    return ret;
+}
+
+void metrics_record_alloc(size_t bytes) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+int metrics_reset_peak_rss(void) {
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp) {
+        return -1;
+    }
+    int failed = fputs("5", fp) == EOF;
+    failed |= fclose(fp) != 0;
+    return failed ? -1 : 0;
+}
+
+long metrics_peak_rss_kb(void) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(fp);
+        if (kb >= 0) {
+            return kb;
+        }
+    }
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss : -1;
+}
+
+void metrics_write_json(FILE *out, const char *op, int status, uint64_t wall_ns) {
+    fprintf(out, "{\"op\":\"%s\",\"status\":\"%s\",\"wall_ms\":%.3f,\"peak_rss_kb\":%ld,"
+            "\"rss_since_start\":%s,\"allocs\":%llu,\"alloc_bytes\":%llu,\"stages\":{",
+            op, status == 0 ? "ok" : "erro", wall_ns / 1e6, metrics_peak_rss_kb(),
+            rss_reset_ok ? "true" : "false",
+            (unsigned long long)__atomic_load_n(&alloc_count, __ATOMIC_RELAXED),
+            (unsigned long long)__atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED));
+
+    int first = 1;
+    for (int i = 0; i < METRICS_STAGES; i++) {
+        StageCounters c;
+        c.calls = __atomic_load_n(&counters[i].calls, __ATOMIC_RELAXED);
+        c.ns = __atomic_load_n(&counters[i].ns, __ATOMIC_RELAXED);
+        c.bytes_in = __atomic_load_n(&counters[i].bytes_in, __ATOMIC_RELAXED);
+        c.bytes_out = __atomic_load_n(&counters[i].bytes_out, __ATOMIC_RELAXED);
+        if (c.calls == 0) {
+            continue;
+        }
+        fprintf(out, "%s\"%s\":{\"calls\":%llu,\"ms\":%.3f,\"bytes_in\":%llu,\"bytes_out\":%llu",
+                first ? "" : ",", stage_names[i], (unsigned long long)c.calls, c.ns / 1e6,
+                (unsigned long long)c.bytes_in, (unsigned long long)c.bytes_out);
+        // Vazão sobre o tempo gasto no estágio (a entrada consumida por segundo).
+        if (c.bytes_in > 0 && c.ns > 0) {
+            fprintf(out, ",\"mb_s\":%.2f", c.bytes_in / (c.ns / 1e9) / 1e6);
+        }
+        fprintf(out, "}");
+        first = 0;
+    }
+    fprintf(out, "}}\n");
+    fflush(out);
+}
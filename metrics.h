@@ -0,0 +1,169 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Contadores por estágio (tempo, bytes e alocações) e rastro de eventos
+ *
+ * Os módulos marcam cada chamada de leitura, deflate/inflate, Argon2, segmento
+ * AEAD, embed/extract e escrita com metrics_start/metrics_stop. Desativado (o
+ * padrão), o custo é um teste de uma variável global por chamada; ativado, são
+ * duas leituras do relógio monotônico e somas atômicas. Os tempos são somados
+ * entre threads, então em um pipeline a soma dos estágios pode passar do tempo total.
+ *
+ * Com o rastro ativo, cada chamada marcada também vira um evento (início,
+ * duração, bytes) no buffer da própria thread, sem trava; no fim, os buffers
+ * de todas as threads são gravados no formato trace-event do Chrome/Perfetto.
+ */
+
+/**
+ * Estágios medidos
+ */
+typedef enum {
+    METRICS_READ = 0,   // leitura de arquivos (entrada e imagens)
+    METRICS_DEFLATE,    // compressão zlib
+    METRICS_INFLATE,    // descompressão zlib
+    METRICS_KDF,        // derivação de chave (Argon2)
+    METRICS_ENCRYPT,    // segmentos criptografados
+    METRICS_DECRYPT,    // segmentos autenticados e descriptografados
+    METRICS_EMBED,      // bits escondidos nos LSBs
+    METRICS_EXTRACT,    // bits lidos dos LSBs
+    METRICS_WRITE,      // escrita de arquivos
+    METRICS_WAIT,       // espera em uma fila do pipeline (vazia ou cheia)
+    METRICS_TASK,       // job executado por uma thread do pool
+    METRICS_STAGES
+} MetricsStage;
+
+/**
+ * Coletas ativas em metrics_active
+ */
+#define METRICS_COUNTERS 1
+#define METRICS_TRACE    2
+
+/**
+ * Coletas ativas agora (só leitura fora de metrics.c)
+ */
+extern int metrics_active;
+
+/**
+ * Zera os contadores e o pico de RSS e ativa (on != 0) ou desativa a coleta
+ */
+void metrics_enable(int on);
+
+/**
+ * Começa a gravar o rastro; a thread que chama recebe o nome "main"
+ *
+ * @return: 0 em sucesso, -1 se o rastro já está ativo
+ */
+int metrics_trace_start(void);
+
+/**
+ * Encerra o rastro e o grava em JSON (trace-event do Chrome/Perfetto)
+ *
+ * Deve ser chamada com as threads instrumentadas já paradas (fim do comando).
+ * Os buffers são liberados mesmo se a gravação falhar.
+ *
+ * @param path: arquivo de saída
+ * @return: 0 em sucesso, -1 em erro
+ */
+int metrics_trace_write(const char *path);
+
+/**
+ * Dá nome à thread atual no rastro (ignorado sem rastro ativo)
+ */
+void metrics_thread_name(const char *name);
+
+/**
+ * Relógio monotônico em nanossegundos
+ */
+uint64_t metrics_now_ns(void);
+
+/**
+ * Soma uma chamada ao estágio (use metrics_stop)
+ */
+void metrics_record(MetricsStage stage, uint64_t start_ns, size_t bytes_in, size_t bytes_out);
+
+/**
+ * Soma uma alocação de bytes (use metrics_alloc)
+ */
+void metrics_record_alloc(size_t bytes);
+
+/**
+ * Início de uma chamada medida: 0 quando a coleta está desativada
+ */
+static inline uint64_t metrics_start(void) {
+    return metrics_active ? metrics_now_ns() : 0;
+}
+
+/**
+ * Fim de uma chamada iniciada com metrics_start
+ *
+ * @param stage: estágio medido
+ * @param start: valor devolvido por metrics_start
+ * @param bytes_in: bytes consumidos pela chamada
+ * @param bytes_out: bytes produzidos pela chamada
+ */
+static inline void metrics_stop(MetricsStage stage, uint64_t start,
+                                size_t bytes_in, size_t bytes_out) {
+    if (start) {
+        metrics_record(stage, start, bytes_in, bytes_out);
+    }
+}
+
+/**
+ * Conta uma alocação de memória de trabalho
+ */
+static inline void metrics_alloc(size_t bytes) {
+    if (metrics_active & METRICS_COUNTERS) {
+        metrics_record_alloc(bytes);
+    }
+}
+
+/**
+ * fread de bytes soltos contado no estágio de leitura
+ */
+static inline size_t metrics_fread(void *buf, size_t n, FILE *fp) {
+    uint64_t t = metrics_start();
+    size_t got = fread(buf, 1, n, fp);
+    metrics_stop(METRICS_READ, t, got, got);
+    return got;
+}
+
+/**
+ * fwrite de bytes soltos contado no estágio de escrita
+ */
+static inline size_t metrics_fwrite(const void *buf, size_t n, FILE *fp) {
+    uint64_t t = metrics_start();
+    size_t put = fwrite(buf, 1, n, fp);
+    metrics_stop(METRICS_WRITE, t, put, put);
+    return put;
+}
+
+/**
+ * Zera o pico de RSS do processo (Linux >= 4.0)
+ *
+ * @return: 0 em sucesso, -1 se o sistema não permite (o pico fica acumulado)
+ */
+int metrics_reset_peak_rss(void);
+
+/**
+ * Pico de RSS do processo em KB (VmHWM, ou ru_maxrss sem /proc), -1 em erro
+ */
+long metrics_peak_rss_kb(void);
+
+/**
+ * Grava um registro JSON (uma linha) com os contadores desde metrics_enable
+ *
+ * Só aparecem os estágios com pelo menos uma chamada.
+ *
+ * @param out: destino
+ * @param op: nome da operação
+ * @param status: 0 se a operação teve sucesso
+ * @param wall_ns: duração total da operação
+ */
+void metrics_write_json(FILE *out, const char *op, int status, uint64_t wall_ns);
+
+#endif /* METRICS_H */
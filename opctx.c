@@ -0,0 +1,87 @@
+#include "opctx.h"
+#include "metrics.h"
+#include <string.h>
+#include <sys/stat.h>
+
+__thread OpContext *op_current = NULL;
+
+void op_context_init(OpContext *ctx, OpProgressFn progress, void *user) {
+    memset(ctx, 0, sizeof *ctx);
+    ctx->progress = progress;
+    ctx->user = user;
+}
+
+void op_context_set_timeout(OpContext *ctx, uint64_t ms) {
+    ctx->deadline_ns = ms ? metrics_now_ns() + ms * 1000000ULL : 0;
+}
+
+OpContext *op_context_enter(OpContext *ctx) {
+    OpContext *previous = op_current;
+    op_current = ctx;
+    return previous;
+}
+
+void op_context_leave(OpContext *previous) {
+    op_current = previous;
+}
+
+/**
+ * @brief Só um armazenamento atômico: seguro em um tratador de sinal.
+ */
+void op_cancel(OpContext *ctx) {
+    int expected = 0;
+    __atomic_compare_exchange_n(&ctx->cancelled, &expected, 1, 0,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+int op_context_cancelled(const OpContext *ctx) {
+    return __atomic_load_n(&ctx->cancelled, __ATOMIC_RELAXED);
+}
+
+const char *op_stage_name(OpStage stage) {
+    static const char *names[OP_STAGES] = {
+        "compress", "decompress", "encrypt", "decrypt", "embed", "extract"
+    };
+    return (unsigned)stage < OP_STAGES ? names[stage] : "?";
+}
+
+int op_step_slow(OpContext *ctx, OpStage stage, size_t bytes) {
+    if (bytes > 0) {
+        uint64_t done = __atomic_add_fetch(&ctx->done[stage], bytes, __ATOMIC_RELAXED);
+        if (ctx->progress) {
+            ctx->progress(ctx->user, stage, done,
+                          __atomic_load_n(&ctx->total[stage], __ATOMIC_RELAXED));
+        }
+    }
+
+    if (ctx->deadline_ns && metrics_now_ns() >= ctx->deadline_ns) {
+        int expected = 0;
+        __atomic_compare_exchange_n(&ctx->cancelled, &expected, 2, 0,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+    int cancelled = __atomic_load_n(&ctx->cancelled, __ATOMIC_RELAXED);
+    if (!cancelled) {
+        return 0;
+    }
+    // Várias threads do pipeline podem ver o cancelamento; a mensagem sai uma vez.
+    if (!__atomic_exchange_n(&ctx->reported, 1, __ATOMIC_RELAXED)) {
+        fprintf(stderr, cancelled == 2 ? "Erro: prazo da operação esgotado\n"
+                                       : "Erro: operação cancelada\n");
+    }
+    return -1;
+}
+
+void op_total_slow(OpContext *ctx, OpStage stage, uint64_t bytes) {
+    __atomic_add_fetch(&ctx->total[stage], bytes, __ATOMIC_RELAXED);
+}
+
+void op_total_file(OpStage stage, FILE *fp) {
+    struct stat st;
+    if (!op_current || fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+    off_t pos = ftello(fp);
+    if (pos >= 0 && pos < st.st_size) {
+        op_total_slow(op_current, stage, (uint64_t)(st.st_size - pos));
+    }
+}
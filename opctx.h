@@ -0,0 +1,147 @@
+#ifndef OPCTX_H
+#define OPCTX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Contexto de operação: progresso e cancelamento cooperativo
+ *
+ * As operações longas da biblioteca (compress/decompress em fluxo, encrypt e
+ * decrypt por segmento, embed/extract em blocos e os pipelines do 'full',
+ * 'recover' e 'verify') chamam op_step a cada bloco com os bytes consumidos.
+ * Com um contexto instalado na thread, op_step soma o progresso do estágio,
+ * chama o callback e confere o pedido de cancelamento e o prazo. Cancelada, a
+ * operação sai pelo mesmo caminho de qualquer outro erro: os buffers são
+ * liberados e a saída parcial é removida (a não ser a de uma execução com
+ * --checkpoint, que fica para a retomada).
+ *
+ * O contexto é da thread: op_context_enter o instala antes da chamada e
+ * op_context_leave o retira. As threads internas do pipeline herdam o
+ * contexto de quem o chamou. Sem contexto (o padrão), op_step custa a leitura
+ * de uma variável da thread.
+ */
+
+/**
+ * Estágios com progresso próprio
+ */
+typedef enum {
+    OP_STAGE_COMPRESS = 0,  // bytes originais comprimidos
+    OP_STAGE_DECOMPRESS,    // bytes comprimidos lidos
+    OP_STAGE_ENCRYPT,       // bytes claros criptografados
+    OP_STAGE_DECRYPT,       // bytes criptografados autenticados
+    OP_STAGE_EMBED,         // bytes escondidos na imagem
+    OP_STAGE_EXTRACT,       // bytes extraídos da imagem
+    OP_STAGES
+} OpStage;
+
+/**
+ * Callback de progresso
+ *
+ * Pode ser chamado de qualquer thread da operação (no pipeline, de várias ao
+ * mesmo tempo), uma vez por bloco; deve ser rápido.
+ *
+ * @param user: ponteiro do contexto
+ * @param stage: estágio que avançou
+ * @param done: bytes do estágio já processados
+ * @param total: bytes esperados no estágio (0 = desconhecido)
+ */
+typedef void (*OpProgressFn)(void *user, OpStage stage, uint64_t done, uint64_t total);
+
+/**
+ * Estado de uma operação (inicialize com op_context_init)
+ */
+typedef struct {
+    OpProgressFn progress;      // NULL = sem callback
+    void *user;
+    uint64_t deadline_ns;       // prazo em metrics_now_ns() (0 = sem prazo)
+    int cancelled;              // 1 cancelada pelo chamador, 2 prazo esgotado
+    int reported;               // mensagem de cancelamento já escrita
+    uint64_t done[OP_STAGES];
+    uint64_t total[OP_STAGES];
+} OpContext;
+
+/**
+ * Contexto da thread atual (só leitura fora de opctx.c)
+ */
+extern __thread OpContext *op_current;
+
+/**
+ * Zera o contexto e define o callback
+ *
+ * @param progress: callback de progresso (pode ser NULL)
+ * @param user: repassado ao callback
+ */
+void op_context_init(OpContext *ctx, OpProgressFn progress, void *user);
+
+/**
+ * Define um prazo a partir de agora
+ *
+ * @param ms: milissegundos (0 remove o prazo)
+ */
+void op_context_set_timeout(OpContext *ctx, uint64_t ms);
+
+/**
+ * Instala o contexto na thread atual
+ *
+ * @return: o contexto anterior, para op_context_leave
+ */
+OpContext *op_context_enter(OpContext *ctx);
+
+/**
+ * Restaura o contexto anterior da thread
+ */
+void op_context_leave(OpContext *previous);
+
+/**
+ * Pede o cancelamento; pode ser chamada de outra thread ou de um tratador de sinal
+ */
+void op_cancel(OpContext *ctx);
+
+/**
+ * Indica se a operação foi cancelada (pelo chamador ou pelo prazo)
+ *
+ * @return: 0 se não, 1 cancelada, 2 prazo esgotado
+ */
+int op_context_cancelled(const OpContext *ctx);
+
+/**
+ * Nome legível do estágio
+ */
+const char *op_stage_name(OpStage stage);
+
+/**
+ * Parte lenta de op_step e op_total (use as versões inline)
+ */
+int op_step_slow(OpContext *ctx, OpStage stage, size_t bytes);
+void op_total_slow(OpContext *ctx, OpStage stage, uint64_t bytes);
+
+/**
+ * Soma bytes ao estágio e confere o cancelamento (chamada a cada bloco)
+ *
+ * Na primeira vez que encontra a operação cancelada, escreve a mensagem de erro.
+ *
+ * @return: 0 para continuar, -1 se a operação foi cancelada
+ */
+static inline int op_step(OpStage stage, size_t bytes) {
+    OpContext *ctx = op_current;
+    return ctx ? op_step_slow(ctx, stage, bytes) : 0;
+}
+
+/**
+ * Soma bytes ao total esperado do estágio
+ */
+static inline void op_total(OpStage stage, uint64_t bytes) {
+    OpContext *ctx = op_current;
+    if (ctx) {
+        op_total_slow(ctx, stage, bytes);
+    }
+}
+
+/**
+ * Soma ao total do estágio o que falta ler de um arquivo comum (pipes ficam desconhecidos)
+ */
+void op_total_file(OpStage stage, FILE *fp);
+
+#endif /* OPCTX_H */
@@ -0,0 +1,212 @@
+#define _GNU_SOURCE  // fallocate, mremap
+#include "outmap.h"
+#include "stdstream.h"
+#include "metrics.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct OutMap {
+    int fd;
+    unsigned char *base;     // NULL enquanto nada foi reservado
+    size_t mapped;           // bytes reservados e mapeados
+    mode_t mode;             // permissões que a saída terá
+    char *path;
+    char *tmp;
+};
+
+static mode_t process_umask;
+static pthread_once_t umask_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief A umask só pode ser lida trocando-a; isso é feito uma vez só.
+ */
+static void umask_read(void) {
+    process_umask = umask(0);
+    umask(process_umask);
+}
+
+int outmap_supported(const char *path) {
+    struct stat st;
+    if (stdstream_is_std(path)) {
+        return 0;
+    }
+    // Um rename trocaria o dispositivo ou o link simbólico por um arquivo comum.
+    if (lstat(path, &st) == 0) {
+        return S_ISREG(st.st_mode);
+    }
+    return errno == ENOENT;
+}
+
+/**
+ * @brief Reserva blocos para [from, to) e estende o arquivo. Sem suporte a
+ *        fallocate no sistema de arquivos, só estende (esparso).
+ */
+static int reserve_blocks(int fd, uint64_t from, uint64_t to) {
+    if (fallocate(fd, 0, (off_t)from, (off_t)(to - from)) == 0) {
+        return 0;
+    }
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+        return -1;
+    }
+    return ftruncate(fd, (off_t)to);
+}
+
+OutMap *outmap_open(const char *path, uint64_t size) {
+    OutMap *m = calloc(1, sizeof *m);
+    size_t len = strlen(path);
+    char *tmp = malloc(len + sizeof ".XXXXXX");
+    char *copy = strdup(path);
+    if (!m || !tmp || !copy) {
+        perror("Erro ao alocar memória");
+        free(m);
+        free(tmp);
+        free(copy);
+        return NULL;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, ".XXXXXX", sizeof ".XXXXXX");
+    m->path = copy;
+    m->tmp = tmp;
+
+    // A saída fica com as permissões de um fopen: as do arquivo substituído,
+    // ou 0666 menos a umask.
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        m->mode = st.st_mode & 07777;
+    } else {
+        pthread_once(&umask_once, umask_read);
+        m->mode = 0666 & ~process_umask;
+    }
+
+    m->fd = mkostemp(tmp, O_CLOEXEC);
+    if (m->fd < 0) {
+        perror("Erro ao criar arquivo de saída");
+        free(m->path);
+        free(m->tmp);
+        free(m);
+        return NULL;
+    }
+    if (size > 0 && !outmap_reserve(m, size)) {
+        outmap_abort(m);
+        return NULL;
+    }
+    return m;
+}
+
+unsigned char *outmap_reserve(OutMap *m, uint64_t size) {
+    if (size <= m->mapped) {
+        return m->base;
+    }
+    // A primeira reserva é exata; as seguintes pelo menos dobram o mapa.
+    uint64_t want = (uint64_t)m->mapped * 2;
+    want = want > size ? want : size;
+    if ((size_t)want != want) {
+        fprintf(stderr, "Erro: saída grande demais para mapear\n");
+        return NULL;
+    }
+
+    // Os blocos vêm antes do mapa: sem espaço, o erro aparece aqui e não
+    // como SIGBUS na primeira escrita.
+    if (reserve_blocks(m->fd, m->mapped, want) != 0) {
+        perror("Erro ao reservar espaço para a saída");
+        return NULL;
+    }
+    void *p = m->base ? mremap(m->base, m->mapped, (size_t)want, MREMAP_MAYMOVE)
+                      : mmap(NULL, (size_t)want, PROT_READ | PROT_WRITE, MAP_SHARED, m->fd, 0);
+    if (p == MAP_FAILED) {
+        perror("Erro ao mapear arquivo de saída");
+        return NULL;
+    }
+    m->base = p;
+    m->mapped = (size_t)want;
+    return m->base;
+}
+
+static void outmap_free(OutMap *m) {
+    if (m->base) {
+        munmap(m->base, m->mapped);
+    }
+    if (m->fd >= 0) {
+        close(m->fd);
+    }
+    free(m->path);
+    free(m->tmp);
+    free(m);
+}
+
+/**
+ * @brief Grava no disco o diretório que contém path, para que a entrada
+ *        criada pelo rename sobreviva a uma queda.
+ * @return 0 em sucesso, -1 em erro (sistemas de arquivos que não sincronizam
+ *         diretórios contam como sucesso).
+ */
+static int sync_parent_dir(const char *path) {
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    if (!slash) {
+        dir = strdup(".");
+    } else if (slash == path) {
+        dir = strdup("/");
+    } else {
+        dir = strndup(path, (size_t)(slash - path));
+    }
+    if (!dir) {
+        return -1;
+    }
+    int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    free(dir);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd) != 0 && errno != EINVAL ? -1 : 0;
+    close(fd);
+    return rc;
+}
+
+int outmap_commit(OutMap *m, uint64_t length) {
+    uint64_t t = metrics_start();
+    if (m->base) {
+        munmap(m->base, m->mapped);
+        m->base = NULL;
+    }
+    // O corte devolve a reserva que sobrou além dos dados. Os dados vão ao disco
+    // antes do rename: depois de uma queda, o nome final tem o arquivo inteiro
+    // ou continua com o que havia antes.
+    int failed = ftruncate(m->fd, (off_t)length) != 0 || fchmod(m->fd, m->mode) != 0 ||
+                 fdatasync(m->fd) != 0;
+    failed |= close(m->fd) != 0;
+    m->fd = -1;
+    if (failed) {
+        fprintf(stderr, "Erro ao escrever arquivo\n");
+        outmap_abort(m);
+        return -1;
+    }
+    if (rename(m->tmp, m->path) != 0) {
+        perror("Erro ao criar arquivo de saída");
+        outmap_abort(m);
+        return -1;
+    }
+    if (sync_parent_dir(m->path) != 0) {
+        perror("Erro ao gravar o diretório de saída");
+        outmap_free(m);
+        return -1;
+    }
+    metrics_stop(METRICS_WRITE, t, (size_t)length, (size_t)length);
+    outmap_free(m);
+    return 0;
+}
+
+void outmap_abort(OutMap *m) {
+    if (!m) {
+        return;
+    }
+    unlink(m->tmp);
+    outmap_free(m);
+}
@@ -0,0 +1,66 @@
+#ifndef OUTMAP_H
+#define OUTMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Saída mapeada com troca atômica
+ *
+ * Usada por extract, decompress e decrypt para gravar arquivos comuns. A saída
+ * é montada em um temporário no mesmo diretório ("<saída>.XXXXXX"), reservado
+ * com fallocate e mapeado com mmap: os dados são decodificados direto no mapa,
+ * sem buffer intermediário nem fwrite. Em sucesso, outmap_commit corta o
+ * temporário no tamanho final e o renomeia sobre a saída; em falha (ou
+ * cancelamento), outmap_abort o apaga. A saída nunca fica parcial: ou ela
+ * aparece inteira, ou um arquivo que já existia continua como estava.
+ *
+ * A saída padrão ("-") e caminhos que já existem sem ser arquivos comuns
+ * (dispositivos, FIFOs, links simbólicos) continuam pelo stdio
+ * (stdstream_open_write): outmap_supported diz qual caminho usar.
+ */
+
+typedef struct OutMap OutMap;
+
+/**
+ * Indica se o caminho pode ser gravado por um OutMap
+ *
+ * @param path: caminho da saída (pode ser "-")
+ * @return: 1 se sim, 0 se a saída deve usar o stdio
+ */
+int outmap_supported(const char *path);
+
+/**
+ * Cria o temporário da saída e reserva o tamanho esperado
+ *
+ * @param path: caminho final da saída
+ * @param size: tamanho esperado em bytes (0 = desconhecido; outmap_reserve cresce o mapa)
+ * @return: o OutMap, ou NULL em erro (mensagem já escrita)
+ */
+OutMap *outmap_open(const char *path, uint64_t size);
+
+/**
+ * Garante que o mapa cubra os primeiros size bytes
+ *
+ * Quando precisa crescer, reserva pelo menos o dobro do tamanho atual. O mapa
+ * pode mudar de endereço: use sempre o ponteiro devolvido.
+ *
+ * @return: início do mapa, ou NULL em erro (por exemplo, disco cheio)
+ */
+unsigned char *outmap_reserve(OutMap *m, uint64_t size);
+
+/**
+ * Fecha a saída com length bytes e a coloca no lugar do caminho final
+ *
+ * Libera m em qualquer caso; em erro, o temporário é apagado.
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int outmap_commit(OutMap *m, uint64_t length);
+
+/**
+ * Descarta o temporário e libera m (NULL é ignorado)
+ */
+void outmap_abort(OutMap *m);
+
+#endif /* OUTMAP_H */
@@ -0,0 +1,1215 @@
+#include "pipeline.h"
+#include "esteg.h"
+#include "compactar.h"
+#include "bufpool.h"
+#include "rescache.h"
+#include "metrics.h"
+#include "opctx.h"
+#include "stdstream.h"
+#include "threadpool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+// Tamanho das leituras do arquivo original
+#define PIPE_READ_SIZE 65536
+
+// Segmentos por lote no 'verify': um lote é extraído enquanto o anterior é autenticado
+#define VERIFY_BATCH 32
+#define VERIFY_SEGMENT (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES)
+
+/**
+ * @brief Bloco trocado entre estágios. Cabe um segmento criptografado inteiro.
+ */
+typedef struct {
+    unsigned char data[CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES];
+    size_t len;
+    int final;
+} PipeBlock;
+
+/**
+ * @brief Fila limitada de blocos protegida por mutex.
+ *        `aborted` acorda todos os estágios quando algum deles falha.
+ */
+typedef struct {
+    PipeBlock *items[PIPE_QUEUE_DEPTH];
+    size_t head;
+    size_t count;
+    int aborted;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} PipeQueue;
+
+/**
+ * @brief Estado compartilhado do pipeline 'full'.
+ *        Cada ligação entre estágios tem uma fila de blocos livres e uma de blocos cheios.
+ */
+typedef struct {
+    FILE *input;
+    const unsigned char *password;
+    size_t password_len;
+    CryptSuite suite;
+
+    PipeQueue free_ab, full_ab;   // compressão -> criptografia
+    PipeQueue free_bc, full_bc;   // criptografia -> esteganografia
+    PipeBlock blocks[2 * PIPE_QUEUE_DEPTH];
+
+    int status_compress;
+    int status_encrypt;
+    PipelineStats stats;
+
+    // Pontos de retomada (NULL sem --checkpoint). A compressão publica o ponto
+    // em record e a thread principal o grava; os dois lados usam ckpt_lock.
+    const CheckpointOptions *ckpt;
+    pthread_mutex_t ckpt_lock;
+    int record_ready;
+    int resumed;                   // continua de um registro: cabeçalho e segmentos já na imagem
+    CryptStream resume_cs;         // fluxo reconstruído na retomada
+    unsigned char record_key[CRYPT_KEYBYTES];
+    CheckpointRecord record;
+
+    OpContext *op;                 // contexto de quem chamou, herdado pelos estágios
+} Pipeline;
+
+static void queue_init(PipeQueue *q) {
+    q->head = 0;
+    q->count = 0;
+    q->aborted = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+}
+
+static void queue_destroy(PipeQueue *q) {
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+/**
+ * @brief Insere um bloco, esperando enquanto a fila está cheia.
+ * @return 0 em sucesso, -1 se o pipeline foi abortado.
+ */
+static int queue_push(PipeQueue *q, PipeBlock *b) {
+    pthread_mutex_lock(&q->lock);
+    uint64_t t = q->count == PIPE_QUEUE_DEPTH ? metrics_start() : 0;
+    while (q->count == PIPE_QUEUE_DEPTH && !q->aborted) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    metrics_stop(METRICS_WAIT, t, 0, 0);
+    if (q->aborted) {
+        pthread_mutex_unlock(&q->lock);
+        return -1;
+    }
+    q->items[(q->head + q->count) % PIPE_QUEUE_DEPTH] = b;
+    q->count++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+/**
+ * @brief Retira um bloco, esperando enquanto a fila está vazia.
+ * @return O bloco, ou NULL se o pipeline foi abortado.
+ */
+static PipeBlock *queue_pop(PipeQueue *q) {
+    pthread_mutex_lock(&q->lock);
+    uint64_t t = q->count == 0 ? metrics_start() : 0;
+    while (q->count == 0 && !q->aborted) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    metrics_stop(METRICS_WAIT, t, 0, 0);
+    if (q->aborted) {
+        pthread_mutex_unlock(&q->lock);
+        return NULL;
+    }
+    PipeBlock *b = q->items[q->head];
+    q->head = (q->head + 1) % PIPE_QUEUE_DEPTH;
+    q->count--;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return b;
+}
+
+static void queue_abort(PipeQueue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->aborted = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief Interrompe todos os estágios (usado quando qualquer um deles falha).
+ */
+static void pipeline_abort(Pipeline *p) {
+    queue_abort(&p->free_ab);
+    queue_abort(&p->full_ab);
+    queue_abort(&p->free_bc);
+    queue_abort(&p->full_bc);
+}
+
+/**
+ * @brief Envia um bloco cheio para a criptografia e pega um bloco livre.
+ * @return 0 em sucesso, -1 se o pipeline foi abortado.
+ */
+static int push_segment(Pipeline *p, PipeBlock **blk) {
+    (*blk)->final = 0;
+    p->stats.compressed_bytes += (*blk)->len;
+    if (queue_push(&p->full_ab, *blk) != 0 || !(*blk = queue_pop(&p->free_ab))) {
+        return -1;
+    }
+    (*blk)->len = 0;
+    return 0;
+}
+
+/**
+ * @brief Passa a entrada pendente em zs pelo deflate. Cada vez que o bloco enche,
+ *        ele segue para a criptografia.
+ * @return 0 em sucesso, -1 em erro de compressão, 1 se o pipeline foi abortado.
+ */
+static int deflate_blocks(Pipeline *p, z_stream *zs, PipeBlock **blk, int flush) {
+    for (;;) {
+        PipeBlock *b = *blk;
+        zs->next_out = b->data + b->len;
+        zs->avail_out = (uInt)(CRYPT_SEGMENT_SIZE - b->len);
+        uint64_t t = metrics_start();
+        uInt avail_in = zs->avail_in, avail_out = zs->avail_out;
+        int zret = deflate(zs, flush);
+        metrics_stop(METRICS_DEFLATE, t, avail_in - zs->avail_in, avail_out - zs->avail_out);
+        if (zret == Z_STREAM_ERROR) {
+            fprintf(stderr, "Erro na compressão\n");
+            return -1;
+        }
+        b->len = CRYPT_SEGMENT_SIZE - zs->avail_out;
+        if (b->len < CRYPT_SEGMENT_SIZE) {
+            return 0;
+        }
+        if (push_segment(p, blk) != 0) {
+            return 1;
+        }
+    }
+}
+
+/**
+ * @brief Acrescenta bytes prontos ao fluxo comprimido (cabeçalho e adler32 do zlib).
+ * @return 0 em sucesso, 1 se o pipeline foi abortado.
+ */
+static int append_bytes(Pipeline *p, PipeBlock **blk, const unsigned char *data, size_t len) {
+    while (len > 0) {
+        size_t n = CRYPT_SEGMENT_SIZE - (*blk)->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy((*blk)->data + (*blk)->len, data, n);
+        (*blk)->len += n;
+        data += n;
+        len -= n;
+        if ((*blk)->len == CRYPT_SEGMENT_SIZE && push_segment(p, blk) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Ponto de retomada: Z_FULL_FLUSH alinha o fluxo em byte e esquece o
+ *        dicionário, então um deflate novo consegue continuar dali. O segmento ainda
+ *        aberto vai junto no registro, gravado pela thread principal quando os
+ *        segmentos anteriores já estiverem na imagem.
+ * @return Como deflate_blocks.
+ */
+static int compress_checkpoint(Pipeline *p, z_stream *zs, PipeBlock **blk, uLong adler) {
+    int ret = deflate_blocks(p, zs, blk, Z_FULL_FLUSH);
+    if (ret != 0) {
+        return ret;
+    }
+
+    // Se o ponto anterior ainda não foi gravado, este é pulado.
+    pthread_mutex_lock(&p->ckpt_lock);
+    if (!p->record_ready) {
+        CheckpointRecord *r = &p->record;
+        r->input_offset = p->stats.input_bytes;
+        r->output_offset = CRYPT_FILE_HEADERBYTES + p->stats.compressed_bytes / CRYPT_SEGMENT_SIZE *
+                                                    (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES);
+        r->adler = (uint32_t)adler;
+        r->pending_len = (uint32_t)(*blk)->len;
+        memcpy(r->pending, (*blk)->data, (*blk)->len);
+        p->record_ready = 1;
+    }
+    pthread_mutex_unlock(&p->ckpt_lock);
+    return 0;
+}
+
+/**
+ * @brief Estágio 1: lê o arquivo e comprime com deflate (formato zlib, igual ao compress2),
+ *        cortando a saída em segmentos de CRYPT_SEGMENT_SIZE bytes.
+ *
+ *        Com pontos de retomada, o deflate é bruto e o cabeçalho e o adler32 do zlib
+ *        são escritos aqui, para que a retomada continue o mesmo fluxo zlib com um
+ *        deflate novo.
+ */
+static void *stage_compress(void *arg) {
+    Pipeline *p = arg;
+    unsigned char in[PIPE_READ_SIZE];
+    z_stream zs;
+    int flush;
+    int raw = p->ckpt != NULL;
+    uLong adler = p->resumed ? p->record.adler : adler32(0L, Z_NULL, 0);
+    uint64_t next_checkpoint = raw ? p->stats.input_bytes + p->ckpt->interval : 0;
+
+    metrics_thread_name("pipeline: leitura + deflate");
+    op_context_enter(p->op);
+    op_total_file(OP_STAGE_COMPRESS, p->input);
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, raw ? -MAX_WBITS : MAX_WBITS,
+                     8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a compressão\n");
+        pipeline_abort(p);
+        return NULL;
+    }
+
+    PipeBlock *blk = queue_pop(&p->free_ab);
+    if (!blk) {
+        deflateEnd(&zs);
+        return NULL;
+    }
+    blk->len = 0;
+    if (p->resumed) {
+        memcpy(blk->data, p->record.pending, p->record.pending_len);
+        blk->len = p->record.pending_len;
+    } else if (raw) {
+        // Cabeçalho zlib: deflate com janela de 32 KB, nível padrão
+        blk->data[0] = 0x78;
+        blk->data[1] = 0x9C;
+        blk->len = 2;
+    }
+
+    do {
+        size_t n = metrics_fread(in, sizeof in, p->input);
+        if (ferror(p->input)) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            goto fail;
+        }
+        if (op_step(OP_STAGE_COMPRESS, n) != 0) {
+            goto fail;
+        }
+        p->stats.input_bytes += n;
+        if (raw) {
+            adler = adler32(adler, in, (uInt)n);
+        }
+        flush = feof(p->input) ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = in;
+        zs.avail_in = (uInt)n;
+
+        int ret = deflate_blocks(p, &zs, &blk, flush);
+        if (ret == 0 && raw && flush != Z_FINISH && p->stats.input_bytes >= next_checkpoint) {
+            ret = compress_checkpoint(p, &zs, &blk, adler);
+            next_checkpoint = p->stats.input_bytes + p->ckpt->interval;
+        }
+        if (ret < 0) {
+            goto fail;
+        }
+        if (ret > 0) {
+            deflateEnd(&zs);
+            return NULL;
+        }
+    } while (flush != Z_FINISH);
+
+    if (raw) {
+        unsigned char trailer[4] = { (unsigned char)(adler >> 24), (unsigned char)(adler >> 16),
+                                     (unsigned char)(adler >> 8), (unsigned char)adler };
+        if (append_bytes(p, &blk, trailer, sizeof trailer) != 0) {
+            deflateEnd(&zs);
+            return NULL;
+        }
+    }
+
+    // O último segmento (possivelmente vazio) leva a marca final.
+    blk->final = 1;
+    p->stats.compressed_bytes += blk->len;
+    deflateEnd(&zs);
+    if (queue_push(&p->full_ab, blk) != 0) {
+        return NULL;
+    }
+    p->status_compress = 0;
+    return NULL;
+
+fail:
+    deflateEnd(&zs);
+    pipeline_abort(p);
+    return NULL;
+}
+
+/**
+ * @brief Estágio 2: deriva a chave (em paralelo com a compressão) e criptografa
+ *        cada segmento. O cabeçalho do arquivo criptografado segue como primeiro bloco.
+ */
+static void *stage_encrypt(void *arg) {
+    Pipeline *p = arg;
+    CryptStream cs;
+    PipeBlock *in, *out;
+    int final;
+
+    // Toda saída passa por `done`, que apaga o estado do fluxo (chave) da pilha.
+    metrics_thread_name("pipeline: kdf + aead");
+    op_context_enter(p->op);
+    if (p->resumed) {
+        // Retomada: o fluxo já foi reconstruído e o cabeçalho já está na imagem.
+        cs = p->resume_cs;
+    } else {
+        out = queue_pop(&p->free_bc);
+        if (!out) {
+            goto done;
+        }
+        int ret = p->ckpt ? checkpoint_stream_push(&cs, p->suite, p->password, p->password_len,
+                                                   out->data, p->record_key)
+                          : crypt_password_init_push(&cs, p->suite, p->password, p->password_len,
+                                                     out->data);
+        if (ret != 0) {
+            pipeline_abort(p);
+            goto done;
+        }
+        out->len = CRYPT_FILE_HEADERBYTES;
+        out->final = 0;
+        if (queue_push(&p->full_bc, out) != 0) {
+            goto done;
+        }
+    }
+
+    do {
+        if (!(in = queue_pop(&p->full_ab)) || !(out = queue_pop(&p->free_bc))) {
+            goto done;
+        }
+        if (op_step(OP_STAGE_ENCRYPT, in->len) != 0) {
+            pipeline_abort(p);
+            goto done;
+        }
+        if (crypt_stream_push(&cs, out->data, &out->len, in->data, in->len,
+                              in->final) != 0) {
+            fprintf(stderr, "Erro: Falha ao criptografar os dados\n");
+            pipeline_abort(p);
+            goto done;
+        }
+        final = in->final;
+        out->final = final;
+        if (queue_push(&p->free_ab, in) != 0 || queue_push(&p->full_bc, out) != 0) {
+            goto done;
+        }
+    } while (!final);
+
+    p->status_encrypt = 0;
+
+done:
+    sodium_memzero(&cs, sizeof cs);
+    return NULL;
+}
+
+/**
+ * @brief Grava o ponto publicado pela compressão quando a imagem chega exatamente
+ *        ao fim dos segmentos anteriores a ele. Chamada antes de embutir cada bloco.
+ */
+static int checkpoint_persist(Pipeline *p, StegWriter *writer, const char *record_path) {
+    int ret = 0;
+
+    pthread_mutex_lock(&p->ckpt_lock);
+    if (p->record_ready && p->record.output_offset <= p->stats.encrypted_bytes) {
+        if (p->record.output_offset == p->stats.encrypted_bytes &&
+            (steg_writer_sync(writer) != 0 ||
+             checkpoint_save(record_path, &p->record, p->record_key) != 0)) {
+            ret = -1;
+        }
+        p->record_ready = 0;
+    }
+    pthread_mutex_unlock(&p->ckpt_lock);
+    return ret;
+}
+
+/**
+ * @brief Retomada do 'full': relê da imagem parcial o cabeçalho e os segmentos já
+ *        embutidos, autenticando cada um (o que reconstrói o fluxo), e confere a
+ *        entrada. Em sucesso, os estágios continuam do ponto gravado.
+ */
+static StegWriter *full_resume(Pipeline *p, const char *image_path, const char *output_path,
+                               const char *record_path) {
+    unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+    CheckpointRecord *r = &p->record;
+    StegWriter *writer = steg_writer_resume(image_path, output_path);
+    unsigned char *segment = buf_alloc(CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES);
+    unsigned char *scratch = buf_alloc(CRYPT_SEGMENT_SIZE);
+    const size_t seg_len = CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES;
+
+    if (!writer || !segment || !scratch) {
+        goto fail;
+    }
+    if (steg_writer_replay(writer, file_header, sizeof file_header) != 0 ||
+        checkpoint_stream_pull(&p->resume_cs, file_header, p->password, p->password_len,
+                               p->record_key) != 0 ||
+        checkpoint_load(record_path, r, p->record_key) != 0) {
+        goto fail;
+    }
+    if (r->kind != CHECKPOINT_FULL || r->output_offset < CRYPT_FILE_HEADERBYTES ||
+        (r->output_offset - CRYPT_FILE_HEADERBYTES) % seg_len != 0) {
+        fprintf(stderr, "Erro: ponto de retomada de outra operação\n");
+        goto fail;
+    }
+    if (checkpoint_check_input(r, p->input) != 0) {
+        goto fail;
+    }
+
+    uint64_t segments = (r->output_offset - CRYPT_FILE_HEADERBYTES) / seg_len;
+    for (uint64_t i = 0; i < segments; i++) {
+        if (steg_writer_replay(writer, segment, seg_len) != 0 ||
+            checkpoint_replay_segment(&p->resume_cs, segment, scratch) != 0) {
+            goto fail;
+        }
+    }
+
+    p->resumed = 1;
+    p->stats.input_bytes = (size_t)r->input_offset;
+    p->stats.compressed_bytes = (size_t)(segments * CRYPT_SEGMENT_SIZE);
+    p->stats.encrypted_bytes = (size_t)r->output_offset;
+    printf("Retomando de %llu de %llu bytes da entrada\n",
+           (unsigned long long)r->input_offset, (unsigned long long)r->input_size);
+    buf_free(segment);
+    buf_free(scratch);
+    return writer;
+
+fail:
+    // A imagem parcial e o registro continuam no disco para outra tentativa.
+    steg_writer_abort(writer);
+    buf_free(segment);
+    buf_free(scratch);
+    return NULL;
+}
+
+/**
+ * @brief Corpo comum de pipeline_full e pipeline_full_stream.
+ *        A saída é um caminho (output_path) ou um arquivo do chamador (output).
+ *        Com tee, os dados embutidos também são copiados para ele (cache de
+ *        resultados); uma falha nessa cópia fica em ferror(tee) e não interrompe o job.
+ *        Com ckpt (só com output_path), grava pontos de retomada em <saída>.ckpt.
+ */
+static int full_run(const char *image_path, FILE *input,
+                    const char *output_path, FILE *output, FILE *tee,
+                    const unsigned char *password, size_t password_len,
+                    CryptSuite suite, const CheckpointOptions *ckpt,
+                    PipelineStats *stats) {
+    pthread_t compress_thread, encrypt_thread;
+    PipeBlock *blk;
+    char *record_path = NULL;
+    int final = 0;
+    int ret = -1;
+
+    // Os blocos entre estágios ocupam centenas de KB: vêm do pool para não
+    // repetir a alocação a cada execução em batch/daemon.
+    Pipeline *p = buf_calloc(sizeof(Pipeline));
+    if (!p) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    p->input = input;
+    p->password = password;
+    p->password_len = password_len;
+    p->suite = suite;
+    p->ckpt = ckpt;
+    p->op = op_current;
+    pthread_mutex_init(&p->ckpt_lock, NULL);
+
+    // Valida a capa e prepara a saída antes de iniciar os estágios.
+    StegWriter *writer = NULL;
+    if (ckpt) {
+        record_path = checkpoint_path(output_path);
+        int resuming = record_path && ckpt->resume && access(record_path, F_OK) == 0;
+        if (record_path && ckpt->resume && !resuming) {
+            printf("Nenhum ponto de retomada em '%s'; começando do início\n", record_path);
+        }
+        if (!record_path) {
+            perror("Erro ao alocar memória");
+        } else if (resuming) {
+            writer = full_resume(p, image_path, output_path, record_path);
+        } else if (checkpoint_bind_input(&p->record, input) == 0) {
+            p->record.kind = CHECKPOINT_FULL;
+            writer = steg_writer_open(image_path, output_path);
+        }
+    } else {
+        writer = output_path ? steg_writer_open(image_path, output_path)
+                             : steg_writer_open_stream(image_path, output);
+    }
+    if (!writer) {
+        goto cleanup_checkpoint;
+    }
+
+    p->status_compress = -1;
+    p->status_encrypt = -1;
+    queue_init(&p->free_ab);
+    queue_init(&p->full_ab);
+    queue_init(&p->free_bc);
+    queue_init(&p->full_bc);
+    for (int i = 0; i < PIPE_QUEUE_DEPTH; i++) {
+        queue_push(&p->free_ab, &p->blocks[i]);
+        queue_push(&p->free_bc, &p->blocks[PIPE_QUEUE_DEPTH + i]);
+    }
+
+    if (pthread_create(&compress_thread, NULL, stage_compress, p) != 0) {
+        fprintf(stderr, "Erro ao criar thread de compressão\n");
+        goto cleanup_queues;
+    }
+    if (pthread_create(&encrypt_thread, NULL, stage_encrypt, p) != 0) {
+        fprintf(stderr, "Erro ao criar thread de criptografia\n");
+        pipeline_abort(p);
+        pthread_join(compress_thread, NULL);
+        goto cleanup_queues;
+    }
+
+    // Estágio 3 (nesta thread): embute cada bloco na imagem assim que ele chega.
+    while (!final) {
+        if (!(blk = queue_pop(&p->full_bc))) {
+            break;
+        }
+        if (ckpt && checkpoint_persist(p, writer, record_path) != 0) {
+            pipeline_abort(p);
+            break;
+        }
+        if (steg_writer_write(writer, blk->data, blk->len) != 0) {
+            pipeline_abort(p);
+            break;
+        }
+        if (tee) {
+            metrics_fwrite(blk->data, blk->len, tee);
+        }
+        p->stats.encrypted_bytes += blk->len;
+        final = blk->final;
+        if (queue_push(&p->free_bc, blk) != 0) {
+            break;
+        }
+    }
+
+    pthread_join(compress_thread, NULL);
+    pthread_join(encrypt_thread, NULL);
+
+    if (final && p->status_compress == 0 && p->status_encrypt == 0) {
+        ret = steg_writer_close(writer);
+        writer = NULL;
+    }
+
+cleanup_queues:
+    if (writer) {
+        steg_writer_abort(writer);
+    }
+    if (ret == 0 && stats) {
+        *stats = p->stats;
+    }
+    queue_destroy(&p->free_ab);
+    queue_destroy(&p->full_ab);
+    queue_destroy(&p->free_bc);
+    queue_destroy(&p->full_bc);
+
+cleanup_checkpoint:
+    if (ret == 0 && record_path) {
+        remove(record_path);
+    }
+    free(record_path);
+    pthread_mutex_destroy(&p->ckpt_lock);
+    sodium_memzero(&p->resume_cs, sizeof p->resume_cs);
+    sodium_memzero(p->record_key, sizeof p->record_key);
+    sodium_memzero(&p->record, sizeof p->record);
+    buf_free(p);
+    return ret;
+}
+
+/**
+ * @brief Confere se os dados guardados no cache foram criptografados com esta
+ *        senha, autenticando o primeiro segmento.
+ */
+static int cached_password_ok(FILE *entry, const unsigned char *password, size_t password_len) {
+    unsigned char header[CRYPT_FILE_HEADERBYTES];
+    unsigned char *seg = buf_alloc(2 * (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES));
+    CryptStream cs;
+    size_t len, out_len;
+    int final, ok = 0;
+
+    if (seg && fread(header, 1, sizeof header, entry) == sizeof header &&
+        (len = fread(seg, 1, CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES, entry)) > 0 &&
+        crypt_password_init_pull(&cs, header, password, password_len) == 0) {
+        ok = crypt_stream_pull(&cs, seg + CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES, &out_len,
+                               &final, seg, len) == 0;
+        sodium_memzero(&cs, sizeof cs);
+    }
+    buf_free(seg);
+    return ok;
+}
+
+/**
+ * @brief Acerto no cache de resultados: embute os dados já criptografados.
+ */
+static int full_from_cache(const char *image_path, const char *output_path, FILE *entry,
+                           PipelineStats *stats) {
+    unsigned char *buffer = buf_alloc(PIPE_READ_SIZE);
+    StegWriter *writer = buffer ? steg_writer_open(image_path, output_path) : NULL;
+    size_t n, total = 0;
+
+    if (!writer) {
+        buf_free(buffer);
+        return -1;
+    }
+    rewind(entry);
+    while ((n = metrics_fread(buffer, PIPE_READ_SIZE, entry)) > 0) {
+        if (steg_writer_write(writer, buffer, n) != 0) {
+            steg_writer_abort(writer);
+            buf_free(buffer);
+            return -1;
+        }
+        total += n;
+    }
+    buf_free(buffer);
+    if (ferror(entry) || total < CRYPT_FILE_HEADERBYTES) {
+        fprintf(stderr, "Erro ao ler o cache de resultados\n");
+        steg_writer_abort(writer);
+        return -1;
+    }
+    if (steg_writer_close(writer) != 0) {
+        return -1;
+    }
+
+    // O tamanho comprimido sai do formato: cada segmento acrescenta CRYPT_SEGMENT_ABYTES.
+    size_t body = total - CRYPT_FILE_HEADERBYTES;
+    size_t segments = body / (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) +
+                      (body % (CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) != 0);
+    stats->encrypted_bytes = total;
+    stats->compressed_bytes = body - segments * CRYPT_SEGMENT_ABYTES;
+    stats->cached = 1;
+    return 0;
+}
+
+/**
+ * @brief pipeline_full com o cache de resultados: identifica o arquivo pelo hash
+ *        do conteúdo e dos parâmetros, reaproveita ou guarda o resultado.
+ */
+static int full_cached(const char *image_path, FILE *input, const char *output_path,
+                       const unsigned char *password, size_t password_len,
+                       CryptSuite suite, PipelineStats *stats) {
+    CryptSuite resolved = suite;
+    int unavailable = crypt_suite_resolve(suite, &resolved) != 0;
+    unsigned char params[] = { 'f', 'u', 'l', 'l', 1, (unsigned char)resolved };
+    unsigned char id[RESULT_CACHE_IDBYTES];
+    PipelineStats local = { 0, 0, 0, 0 };
+    uint64_t input_bytes;
+
+    if (unavailable || result_cache_hash(input, params, sizeof params, id, &input_bytes) != 0 ||
+        fseek(input, 0, SEEK_SET) != 0) {
+        return full_run(image_path, input, output_path, NULL, NULL,
+                        password, password_len, suite, NULL, stats);
+    }
+
+    FILE *entry = result_cache_lookup(id);
+    if (entry) {
+        int usable = cached_password_ok(entry, password, password_len);
+        int ret = usable ? full_from_cache(image_path, output_path, entry, &local) : -1;
+        fclose(entry);
+        if (usable) {
+            result_cache_record(1);
+            local.input_bytes = (size_t)input_bytes;
+            if (ret == 0 && stats) {
+                *stats = local;
+            }
+            return ret;
+        }
+        // Outra senha: recalcula e a entrada passa a ser a desta execução.
+    }
+
+    result_cache_record(0);
+    ResultCacheEntry store;
+    int storing = result_cache_store_begin(&store) == 0;
+    int ret = full_run(image_path, input, output_path, NULL, storing ? store.fp : NULL,
+                       password, password_len, suite, NULL, stats);
+    if (storing) {
+        result_cache_store_commit(&store, id, ret == 0);
+    }
+    return ret;
+}
+
+int pipeline_full(const char *image_path, const char *file_path,
+                  const char *output_path,
+                  const unsigned char *password, size_t password_len,
+                  CryptSuite suite, PipelineStats *stats) {
+    FILE *input = fopen(file_path, "rb");
+    if (!input) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+    int ret = result_cache_enabled()
+            ? full_cached(image_path, input, output_path, password, password_len, suite, stats)
+            : full_run(image_path, input, output_path, NULL, NULL,
+                       password, password_len, suite, NULL, stats);
+    fclose(input);
+    return ret;
+}
+
+int pipeline_full_checkpoint(const char *image_path, const char *file_path,
+                             const char *output_path,
+                             const unsigned char *password, size_t password_len,
+                             CryptSuite suite, const CheckpointOptions *opt,
+                             PipelineStats *stats) {
+    if (stdstream_is_std(file_path) || stdstream_is_std(output_path)) {
+        fprintf(stderr, "Erro: pontos de retomada não funcionam com '-' (entrada ou saída padrão)\n");
+        return -1;
+    }
+    FILE *input = fopen(file_path, "rb");
+    if (!input) {
+        perror("Erro ao abrir arquivo");
+        return -1;
+    }
+    int ret = full_run(image_path, input, output_path, NULL, NULL,
+                       password, password_len, suite, opt, stats);
+    fclose(input);
+    return ret;
+}
+
+int pipeline_full_stream(const char *image_path, FILE *input, FILE *output,
+                         const unsigned char *password, size_t password_len,
+                         CryptSuite suite, PipelineStats *stats) {
+    return full_run(image_path, input, NULL, output, NULL, password, password_len, suite,
+                    NULL, stats);
+}
+
+/**
+ * @brief Descomprime um bloco e grava a saída.
+ * @return Z_OK ou Z_STREAM_END em sucesso, outro código zlib (ou -1 de escrita) em erro.
+ */
+static int inflate_to_file(z_stream *zs, const unsigned char *in, size_t in_len,
+                           FILE *out, unsigned char *buffer, size_t *written) {
+    int ret = Z_OK;
+
+    zs->next_in = (unsigned char *)in;
+    zs->avail_in = (uInt)in_len;
+    do {
+        zs->next_out = buffer;
+        zs->avail_out = PIPE_READ_SIZE;
+        uint64_t t = metrics_start();
+        uInt avail_in = zs->avail_in;
+        ret = inflate(zs, Z_NO_FLUSH);
+        metrics_stop(METRICS_INFLATE, t, avail_in - zs->avail_in, PIPE_READ_SIZE - zs->avail_out);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            return ret;
+        }
+        size_t n = PIPE_READ_SIZE - zs->avail_out;
+        if (metrics_fwrite(buffer, n, out) != n) {
+            return -1;
+        }
+        *written += n;
+    } while (zs->avail_out == 0 && ret != Z_STREAM_END);
+
+    if (ret == Z_STREAM_END && zs->avail_in > 0) {
+        return Z_DATA_ERROR;
+    }
+    return ret == Z_BUF_ERROR ? Z_OK : ret;
+}
+
+/**
+ * @brief Formato antigo do 'full' (um único segmento sem cabeçalho STGC):
+ *        só pode ser autenticado inteiro, então os dados são carregados na memória.
+ */
+static int recover_legacy(StegReader *reader, const unsigned char *head, size_t head_len,
+                          FILE *out, const unsigned char *password, size_t password_len,
+                          PipelineStats *stats) {
+    size_t total = steg_reader_size(reader);
+    unsigned char *encrypted = buf_alloc(total ? total : 1);
+    unsigned char *compressed = NULL, *original = NULL;
+    size_t compressed_size, original_size;
+    int ret = -1;
+
+    if (!encrypted) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    memcpy(encrypted, head, head_len);
+    if (steg_reader_read(reader, encrypted + head_len, total - head_len) != 0 ||
+        decrypt_data(encrypted, total, &compressed, &compressed_size,
+                     password, password_len) != 0 ||
+        decompress_data(compressed, compressed_size, &original, &original_size) != 0) {
+        goto cleanup;
+    }
+    if (metrics_fwrite(original, original_size, out) != original_size) {
+        fprintf(stderr, "Erro ao escrever arquivo\n");
+        goto cleanup;
+    }
+    stats->encrypted_bytes = total;
+    stats->compressed_bytes = compressed_size;
+    stats->input_bytes = original_size;
+    ret = 0;
+
+cleanup:
+    buf_free(encrypted);
+    free(compressed);
+    free(original);
+    return ret;
+}
+
+int pipeline_recover_stream(const char *image_path, FILE *out,
+                            const unsigned char *password, size_t password_len,
+                            PipelineStats *stats) {
+    unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+    PipelineStats local = {0, 0, 0, 0};
+    CryptStream cs;
+    z_stream zs;
+    int zret = Z_OK;
+    int final = 0;
+    int ret = -1;
+
+    StegReader *reader = steg_reader_open(image_path);
+    if (!reader) {
+        return -1;
+    }
+
+    unsigned char *segment = buf_alloc(CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES);
+    unsigned char *plain = buf_alloc(CRYPT_SEGMENT_SIZE);
+    unsigned char *buffer = buf_alloc(PIPE_READ_SIZE);
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    if (!segment || !plain || !buffer || inflateInit(&zs) != Z_OK) {
+        fprintf(stderr, "Erro ao alocar memória\n");
+        goto cleanup;
+    }
+
+    // Lê o cabeçalho do arquivo criptografado; sem o magic, é o formato antigo.
+    size_t total = steg_reader_size(reader);
+    size_t head_len = total < sizeof file_header ? total : sizeof file_header;
+    if (steg_reader_read(reader, file_header, head_len) != 0) {
+        goto cleanup;
+    }
+    if (head_len < CRYPT_PREFIXBYTES || memcmp(file_header, CRYPT_MAGIC, 4) != 0) {
+        ret = recover_legacy(reader, file_header, head_len, out,
+                             password, password_len, &local);
+        goto cleanup;
+    }
+    if (head_len < sizeof file_header ||
+        crypt_password_init_pull(&cs, file_header, password, password_len) != 0) {
+        if (head_len < sizeof file_header) {
+            fprintf(stderr, "Erro: Dados criptografados invalidos (muito pequenos)\n");
+        }
+        goto cleanup;
+    }
+
+    // Um segmento por vez: extrai da imagem, autentica/descriptografa e descomprime.
+    while (!final) {
+        size_t chunk = steg_reader_remaining(reader);
+        if (chunk > CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES) {
+            chunk = CRYPT_SEGMENT_SIZE + CRYPT_SEGMENT_ABYTES;
+        }
+        size_t plain_len;
+        if (chunk == 0) {
+            fprintf(stderr, "Erro: Tag final nao encontrada\n");
+            goto cleanup;
+        }
+        if (steg_reader_read(reader, segment, chunk) != 0 ||
+            op_step(OP_STAGE_DECRYPT, chunk) != 0) {
+            goto cleanup;
+        }
+        if (crypt_stream_pull(&cs, plain, &plain_len, &final, segment, chunk) != 0) {
+            fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+            goto cleanup;
+        }
+        local.compressed_bytes += plain_len;
+        zret = inflate_to_file(&zs, plain, plain_len, out, buffer, &local.input_bytes);
+        if (zret != Z_OK && zret != Z_STREAM_END) {
+            fprintf(stderr, "Erro na descompressão: %d\n", zret);
+            goto cleanup;
+        }
+    }
+
+    if (steg_reader_remaining(reader) != 0) {
+        fprintf(stderr, "Erro: Dados extras apos a tag final\n");
+        goto cleanup;
+    }
+    if (zret != Z_STREAM_END) {
+        fprintf(stderr, "Erro na descompressão: dados comprimidos incompletos\n");
+        goto cleanup;
+    }
+    local.encrypted_bytes = total;
+    ret = 0;
+
+cleanup:
+    sodium_memzero(&cs, sizeof cs);
+    inflateEnd(&zs);
+    buf_free(segment);
+    buf_free(plain);
+    buf_free(buffer);
+    steg_reader_close(reader);
+    if (fflush(out) != 0 && ret == 0) {
+        fprintf(stderr, "Erro ao escrever arquivo\n");
+        ret = -1;
+    }
+    if (ret == 0 && stats) {
+        *stats = local;
+    }
+    return ret;
+}
+
+int pipeline_recover(const char *image_path, const char *output_path,
+                     const unsigned char *password, size_t password_len,
+                     PipelineStats *stats) {
+    FILE *out = fopen(output_path, "wb");
+    if (!out) {
+        perror("Erro ao criar arquivo de saída");
+        return -1;
+    }
+
+    int ret = pipeline_recover_stream(image_path, out, password, password_len, stats);
+    if (fclose(out) != 0 && ret == 0) {
+        fprintf(stderr, "Erro ao escrever arquivo\n");
+        ret = -1;
+    }
+    if (ret != 0) {
+        // Não deixa uma saída parcial para trás.
+        remove(output_path);
+    }
+    return ret;
+}
+
+typedef struct VerifyBatch VerifyBatch;
+
+/**
+ * @brief Argumento de uma tarefa AES-GCM: o segmento index do lote.
+ */
+typedef struct {
+    VerifyBatch *batch;
+    size_t index;
+} VerifyArg;
+
+/**
+ * @brief Lote de segmentos do 'verify'. Cada segmento tem seu espaço para o
+ *        texto claro (descartado) e seu resultado, preenchido pelas tarefas.
+ */
+struct VerifyBatch {
+    unsigned char *data;                  // VERIFY_BATCH segmentos de VERIFY_SEGMENT bytes
+    unsigned char *scratch;               // VERIFY_BATCH * CRYPT_SEGMENT_SIZE bytes
+    size_t count;
+    size_t len[VERIFY_BATCH];
+    int status[VERIFY_BATCH];             // 0 = autenticado
+    int final[VERIFY_BATCH];
+    size_t plain[VERIFY_BATCH];
+    CryptStream cs[VERIFY_BATCH];         // AES-GCM: contador de cada segmento
+    CryptStream *chain;                   // XChaCha20: o fluxo contínuo (uma tarefa por lote)
+    VerifyArg args[VERIFY_BATCH];
+};
+
+static int verify_segment(VerifyBatch *b, CryptStream *cs, size_t i) {
+    b->status[i] = crypt_stream_pull(cs, b->scratch + i * CRYPT_SEGMENT_SIZE, &b->plain[i],
+                                     &b->final[i], b->data + i * VERIFY_SEGMENT, b->len[i]);
+    return b->status[i];
+}
+
+/**
+ * @brief Tarefa AES-GCM: um segmento, com a cópia do fluxo no contador dele.
+ */
+static void verify_gcm_task(void *arg) {
+    VerifyArg *a = arg;
+    VerifyBatch *b = a->batch;
+    verify_segment(b, &b->cs[a->index], a->index);
+    sodium_memzero(&b->cs[a->index], sizeof b->cs[a->index]);
+}
+
+/**
+ * @brief Tarefa XChaCha20: o lote inteiro em ordem, parando no primeiro erro.
+ */
+static void verify_chain_task(void *arg) {
+    VerifyBatch *b = arg;
+    for (size_t i = 0; i < b->count; i++) {
+        if (verify_segment(b, b->chain, i) != 0) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Extrai o próximo lote; no fim dos dados, count fica menor que VERIFY_BATCH.
+ */
+static int verify_fill(VerifyBatch *b, StegReader *reader) {
+    b->count = 0;
+    while (b->count < VERIFY_BATCH && steg_reader_remaining(reader) > 0) {
+        size_t chunk = steg_reader_remaining(reader);
+        if (chunk > VERIFY_SEGMENT) {
+            chunk = VERIFY_SEGMENT;
+        }
+        if (steg_reader_read(reader, b->data + b->count * VERIFY_SEGMENT, chunk) != 0) {
+            return -1;
+        }
+        b->len[b->count] = chunk;
+        b->status[b->count] = -1;
+        b->final[b->count] = 0;
+        b->plain[b->count] = 0;
+        b->count++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Submete o lote; se o pool recusar uma tarefa, ela roda aqui mesmo.
+ */
+static void verify_submit(ThreadPool *pool, VerifyBatch *b, const CryptStream *cs,
+                          uint64_t first_segment) {
+    if (cs->suite != CRYPT_SUITE_AES256GCM) {
+        if (pool_submit(pool, verify_chain_task, b) != 0) {
+            verify_chain_task(b);
+        }
+        return;
+    }
+    for (size_t i = 0; i < b->count; i++) {
+        b->cs[i] = *cs;
+        b->cs[i].counter = first_segment + i;
+        b->args[i].batch = b;
+        b->args[i].index = i;
+        if (pool_submit(pool, verify_gcm_task, &b->args[i]) != 0) {
+            verify_gcm_task(&b->args[i]);
+        }
+    }
+}
+
+/**
+ * @brief Confere os resultados de um lote já autenticado, na ordem dos segmentos.
+ */
+static int verify_check(const VerifyBatch *b, int *final_seen, size_t *plain_bytes) {
+    for (size_t i = 0; i < b->count; i++) {
+        if (*final_seen) {
+            fprintf(stderr, "Erro: Dados extras apos a tag final\n");
+            return -1;
+        }
+        if (b->status[i] != 0) {
+            fprintf(stderr, "ERRO: MENSAGEM CORROMPIDA OU SENHA INCORRETA.\n");
+            return -1;
+        }
+        *final_seen = b->final[i];
+        *plain_bytes += b->plain[i];
+    }
+    return 0;
+}
+
+/**
+ * @brief Autentica o fluxo STGC escondido, com dois lotes alternando entre a
+ *        extração (thread atual) e a autenticação (pool).
+ */
+static int verify_stream(StegReader *reader, const unsigned char *password,
+                         size_t password_len, size_t *plain_bytes) {
+    unsigned char file_header[CRYPT_FILE_HEADERBYTES];
+    VerifyBatch *batches = buf_calloc(2 * sizeof(VerifyBatch));
+    ThreadPool *pool = NULL;
+    CryptStream cs;
+    int final_seen = 0;
+    int ret = -1;
+
+    memset(&cs, 0, sizeof cs);
+    if (!batches) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    for (int k = 0; k < 2; k++) {
+        batches[k].data = buf_alloc(VERIFY_BATCH * VERIFY_SEGMENT);
+        batches[k].scratch = buf_alloc(VERIFY_BATCH * CRYPT_SEGMENT_SIZE);
+        batches[k].chain = &cs;
+        if (!batches[k].data || !batches[k].scratch) {
+            perror("Erro ao alocar memória");
+            goto cleanup;
+        }
+    }
+
+    if (steg_reader_size(reader) < sizeof file_header ||
+        steg_reader_read(reader, file_header, sizeof file_header) != 0 ||
+        memcmp(file_header, CRYPT_MAGIC, 4) != 0) {
+        fprintf(stderr, "Erro: os dados escondidos não são um fluxo criptografado (STGC)\n");
+        goto cleanup;
+    }
+    if (crypt_password_init_pull(&cs, file_header, password, password_len) != 0) {
+        goto cleanup;
+    }
+    pool = pool_create(0);
+    if (!pool) {
+        fprintf(stderr, "Erro ao criar o pool de threads\n");
+        goto cleanup;
+    }
+
+    VerifyBatch *pending = NULL;
+    uint64_t next_segment = 0;
+    for (int cur = 0; ; cur ^= 1) {
+        VerifyBatch *b = &batches[cur];
+        int filled = verify_fill(b, reader);
+        if (pending) {
+            pool_wait(pool);
+            if (verify_check(pending, &final_seen, plain_bytes) != 0) {
+                goto cleanup;
+            }
+        }
+        if (filled != 0) {
+            goto cleanup;
+        }
+        if (b->count == 0) {
+            break;
+        }
+        verify_submit(pool, b, &cs, next_segment);
+        next_segment += b->count;
+        pending = b;
+    }
+    if (!final_seen) {
+        fprintf(stderr, "Erro: Tag final nao encontrada\n");
+        goto cleanup;
+    }
+    ret = 0;
+
+cleanup:
+    pool_destroy(pool);
+    sodium_memzero(&cs, sizeof cs);
+    for (int k = 0; k < 2; k++) {
+        if (batches[k].scratch) {
+            sodium_memzero(batches[k].scratch, VERIFY_BATCH * CRYPT_SEGMENT_SIZE);
+        }
+        buf_free(batches[k].data);
+        buf_free(batches[k].scratch);
+    }
+    sodium_memzero(batches, 2 * sizeof(VerifyBatch));
+    buf_free(batches);
+    return ret;
+}
+
+int pipeline_verify(const char *image_path, const unsigned char *password,
+                    size_t password_len, PipelineStats *stats) {
+    PipelineStats local = {0, 0, 0, 0};
+    int ret = -1;
+
+    StegReader *reader = steg_reader_open(image_path);
+    if (!reader) {
+        return -1;
+    }
+    int has_digest = steg_reader_has_digest(reader);
+    local.encrypted_bytes = steg_reader_size(reader);
+
+    if (password) {
+        if (!has_digest) {
+            fprintf(stderr, "Aviso: imagem sem CRC32C (versão anterior); só a autenticação é feita\n");
+        }
+        ret = verify_stream(reader, password, password_len, &local.compressed_bytes);
+    } else if (!has_digest) {
+        fprintf(stderr, "Erro: imagem sem CRC32C (versão anterior); informe a senha para autenticar os dados\n");
+    } else {
+        // Sem senha: só a extração, que confere o CRC32C na última leitura.
+        unsigned char *scratch = buf_alloc(PIPE_READ_SIZE);
+        if (!scratch) {
+            perror("Erro ao alocar memória");
+        } else {
+            ret = 0;
+            while (ret == 0 && steg_reader_remaining(reader) > 0) {
+                size_t chunk = steg_reader_remaining(reader);
+                ret = steg_reader_read(reader, scratch, chunk < PIPE_READ_SIZE ? chunk : PIPE_READ_SIZE);
+            }
+            buf_free(scratch);
+        }
+    }
+
+    steg_reader_close(reader);
+    if (ret == 0 && stats) {
+        *stats = local;
+    }
+    return ret;
+}
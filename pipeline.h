@@ -0,0 +1,123 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "crypt_utils.h"
+#include "checkpoint.h"
+
+/**
+ * Quantidade de blocos em trânsito entre dois estágios do pipeline
+ */
+#define PIPE_QUEUE_DEPTH 4
+
+/**
+ * Tamanhos observados em cada estágio do pipeline
+ */
+typedef struct {
+    size_t input_bytes;       // bytes do arquivo original (lidos ou recuperados)
+    size_t compressed_bytes;  // bytes do fluxo deflate
+    size_t encrypted_bytes;   // bytes embutidos na imagem (cabeçalho + segmentos)
+    int cached;               // 1 se os dados vieram do cache de resultados
+} PipelineStats;
+
+/**
+ * Comprime, criptografa e esconde um arquivo em fluxo contínuo
+ *
+ * Os estágios rodam em threads próprias ligadas por filas limitadas:
+ * leitura + deflate -> Argon2 + criptografia por segmento -> LSB + escrita.
+ * A memória usada não depende do tamanho do arquivo.
+ *
+ * Com o cache de resultados ativo (rescache.h), o arquivo é identificado pelo
+ * hash do conteúdo e da suite. Em um acerto, os dados criptografados guardados
+ * são embutidos direto, sem compressão nem criptografia; a senha é conferida
+ * antes contra o primeiro segmento. Em uma falta, o resultado é guardado.
+ *
+ * @param image_path: caminho da imagem BMP original
+ * @param file_path: caminho do arquivo a esconder
+ * @param output_path: caminho da imagem de saída
+ * @param password: senha usada na derivação da chave
+ * @param password_len: tamanho da senha
+ * @param suite: suite de cifra (ou CRYPT_SUITE_AUTO)
+ * @param stats: recebe os tamanhos de cada estágio (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro (a imagem parcial é removida)
+ */
+int pipeline_full(const char *image_path, const char *file_path,
+                  const char *output_path,
+                  const unsigned char *password, size_t password_len,
+                  CryptSuite suite, PipelineStats *stats);
+
+/**
+ * pipeline_full com pontos de retomada (checkpoint.h)
+ *
+ * A cada opt->interval bytes da entrada, o deflate é esvaziado (Z_FULL_FLUSH)
+ * e um registro é gravado em <saída>.ckpt assim que os segmentos anteriores
+ * estão no disco. Com opt->resume e um registro presente, a imagem parcial é
+ * conferida contra a capa, os segmentos já embutidos são autenticados de novo
+ * e a compressão continua do deslocamento gravado. O cache de resultados não é
+ * usado. Em erro depois do primeiro registro, a imagem parcial é mantida.
+ *
+ * @param opt: intervalo e retomada
+ * @return: 0 em sucesso (o registro é removido), -1 em erro
+ */
+int pipeline_full_checkpoint(const char *image_path, const char *file_path,
+                             const char *output_path,
+                             const unsigned char *password, size_t password_len,
+                             CryptSuite suite, const CheckpointOptions *opt,
+                             PipelineStats *stats);
+
+/**
+ * Como pipeline_full, mas com entrada e saída já abertas pelo chamador
+ *
+ * Nenhum dos dois arquivos é fechado. A saída precisa permitir fseek e, em erro,
+ * o conteúdo parcial fica a cargo do chamador.
+ */
+int pipeline_full_stream(const char *image_path, FILE *input, FILE *output,
+                         const unsigned char *password, size_t password_len,
+                         CryptSuite suite, PipelineStats *stats);
+
+/**
+ * Operação inversa de pipeline_full, em fluxo e sem arquivos intermediários
+ *
+ * Extrai os bits da imagem, autentica/descriptografa cada segmento e descomprime
+ * direto para a saída. Imagens geradas pela versão antiga do 'full' (um único
+ * segmento sem cabeçalho de suite) também são aceitas, mas são carregadas inteiras.
+ *
+ * @param image_path: caminho da imagem com dados escondidos
+ * @param output_path: caminho do arquivo recuperado
+ * @param password: senha usada no 'full'
+ * @param password_len: tamanho da senha
+ * @param stats: recebe os tamanhos de cada estágio (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro (a saída parcial é removida)
+ */
+int pipeline_recover(const char *image_path, const char *output_path,
+                     const unsigned char *password, size_t password_len,
+                     PipelineStats *stats);
+
+/**
+ * Como pipeline_recover, mas grava em um arquivo já aberto pelo chamador (que não é fechado)
+ */
+int pipeline_recover_stream(const char *image_path, FILE *out,
+                            const unsigned char *password, size_t password_len,
+                            PipelineStats *stats);
+
+/**
+ * Confere uma imagem gerada por 'hide' ou 'full' sem gravar os dados em lugar nenhum
+ *
+ * Os dados escondidos são extraídos em uma única passada e o CRC32C gravado
+ * depois deles é conferido. Com senha, os dados precisam ser um fluxo STGC:
+ * cada segmento é autenticado e o texto claro é descartado. Os segmentos
+ * AES-GCM são independentes e são conferidos em paralelo; os de XChaCha20 são
+ * encadeados e são conferidos em ordem, em paralelo com a extração.
+ *
+ * @param image_path: caminho da imagem com dados escondidos
+ * @param password: senha do fluxo criptografado (NULL confere só o CRC32C)
+ * @param password_len: tamanho da senha
+ * @param stats: recebe os bytes escondidos (encrypted_bytes) e, com senha, os
+ *               bytes de texto claro autenticados (compressed_bytes); pode ser NULL
+ * @return: 0 se tudo confere, -1 em erro
+ */
+int pipeline_verify(const char *image_path, const unsigned char *password,
+                    size_t password_len, PipelineStats *stats);
+
+#endif /* PIPELINE_H */
@@ -0,0 +1,410 @@
+#include "rescache.h"
+#include "bufpool.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sodium.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Leituras do arquivo de entrada durante o hash
+#define RESCACHE_READ_SIZE 65536
+
+// Sufixo das entradas; o nome é o identificador em hexadecimal
+#define RESCACHE_SUFFIX ".res"
+#define RESCACHE_NAME_LEN (2 * RESULT_CACHE_IDBYTES + sizeof RESCACHE_SUFFIX - 1)
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int cache_enabled = 0;
+static char cache_dir[PATH_MAX - RESCACHE_NAME_LEN - 1];   // cabe com o nome de qualquer entrada
+static uint64_t cache_max_bytes = 0;
+static uint64_t cache_bytes = 0;          // estimativa, refeita a cada remoção
+static unsigned char cache_secret[crypto_generichash_KEYBYTES];
+static ResultCacheStats saved;            // contadores gravados até a abertura
+static ResultCacheStats session;          // contadores desta execução
+
+/**
+ * @brief Uma entrada encontrada na varredura do diretório.
+ */
+typedef struct {
+    char name[RESCACHE_NAME_LEN + 1];
+    time_t mtime;
+    uint64_t size;
+} CacheFile;
+
+static int join_path(char *out, size_t size, const char *name) {
+    return (size_t)snprintf(out, size, "%s/%s", cache_dir, name) < size ? 0 : -1;
+}
+
+/**
+ * @brief Caminho da entrada id (o tamanho do diretório já foi conferido na abertura).
+ */
+static void entry_path(char *out, size_t size, const unsigned char id[RESULT_CACHE_IDBYTES]) {
+    char name[RESCACHE_NAME_LEN + 1];
+    sodium_bin2hex(name, 2 * RESULT_CACHE_IDBYTES + 1, id, RESULT_CACHE_IDBYTES);
+    strcat(name, RESCACHE_SUFFIX);
+    join_path(out, size, name);
+}
+
+static int is_entry_name(const char *name) {
+    size_t len = strlen(name);
+    return len == RESCACHE_NAME_LEN &&
+           strcmp(name + len - (sizeof RESCACHE_SUFFIX - 1), RESCACHE_SUFFIX) == 0;
+}
+
+/**
+ * @brief Lê a chave do cache, criando-a na primeira vez. A criação passa por um
+ *        temporário e link(), então dois processos nunca veem uma chave parcial.
+ */
+static int load_secret(void) {
+    char path[PATH_MAX], tmp[PATH_MAX];
+    if (join_path(path, sizeof path, "key") != 0 || join_path(tmp, sizeof tmp, "key.XXXXXX") != 0) {
+        fprintf(stderr, "Erro: caminho do cache longo demais\n");
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 && errno == ENOENT) {
+        unsigned char fresh[sizeof cache_secret];
+        randombytes_buf(fresh, sizeof fresh);
+        int tmp_fd = mkstemp(tmp);
+        if (tmp_fd < 0) {
+            perror("Erro ao criar a chave do cache");
+            return -1;
+        }
+        int ok = write(tmp_fd, fresh, sizeof fresh) == (ssize_t)sizeof fresh && fsync(tmp_fd) == 0;
+        close(tmp_fd);
+        sodium_memzero(fresh, sizeof fresh);
+        if (ok && link(tmp, path) != 0 && errno != EEXIST) {
+            ok = 0;
+        }
+        unlink(tmp);
+        if (!ok) {
+            perror("Erro ao criar a chave do cache");
+            return -1;
+        }
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    if (fd < 0) {
+        perror("Erro ao abrir a chave do cache");
+        return -1;
+    }
+    ssize_t n = read(fd, cache_secret, sizeof cache_secret);
+    close(fd);
+    if (n != (ssize_t)sizeof cache_secret) {
+        fprintf(stderr, "Erro: chave do cache inválida em %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Abre o arquivo de contadores com trava exclusiva.
+ * @return O descritor, ou -1 em erro.
+ */
+static int stats_lock(void) {
+    char path[PATH_MAX];
+    if (join_path(path, sizeof path, "stats") != 0) {
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void stats_read(int fd, ResultCacheStats *s) {
+    char text[256];
+    ssize_t n = pread(fd, text, sizeof text - 1, 0);
+    memset(s, 0, sizeof *s);
+    if (n > 0) {
+        text[n] = '\0';
+        sscanf(text, "hits %lu misses %lu stores %lu evictions %lu",
+               &s->hits, &s->misses, &s->stores, &s->evictions);
+    }
+}
+
+static void stats_write(int fd, const ResultCacheStats *s) {
+    char text[256];
+    int n = snprintf(text, sizeof text, "hits %lu\nmisses %lu\nstores %lu\nevictions %lu\n",
+                     s->hits, s->misses, s->stores, s->evictions);
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, text, (size_t)n, 0) != n) {
+        fprintf(stderr, "Aviso: não foi possível gravar os contadores do cache\n");
+    }
+}
+
+/**
+ * @brief Lista as entradas do diretório.
+ * @return Quantidade de entradas (files alocado com malloc), ou -1 em erro.
+ */
+static long scan_entries(CacheFile **files, uint64_t *total) {
+    DIR *d = opendir(cache_dir);
+    if (!d) {
+        return -1;
+    }
+    CacheFile *list = NULL;
+    size_t n = 0, cap = 0;
+    struct dirent *de;
+    *total = 0;
+    while ((de = readdir(d))) {
+        struct stat st;
+        char path[PATH_MAX];
+        if (!is_entry_name(de->d_name) || join_path(path, sizeof path, de->d_name) != 0 ||
+            stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 64;
+            CacheFile *grown = realloc(list, cap * sizeof *grown);
+            if (!grown) {
+                break;
+            }
+            list = grown;
+        }
+        memcpy(list[n].name, de->d_name, RESCACHE_NAME_LEN + 1);
+        list[n].mtime = st.st_mtime;
+        list[n].size = (uint64_t)st.st_size;
+        *total += list[n].size;
+        n++;
+    }
+    closedir(d);
+    *files = list;
+    return (long)n;
+}
+
+static int by_mtime(const void *a, const void *b) {
+    const CacheFile *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/**
+ * @brief Remove as entradas usadas há mais tempo até o cache caber no limite.
+ *        Chamada com cache_lock.
+ */
+static void evict_locked(void) {
+    CacheFile *files = NULL;
+    uint64_t total;
+    long n = scan_entries(&files, &total);
+    if (n < 0) {
+        return;
+    }
+    qsort(files, (size_t)n, sizeof *files, by_mtime);
+    for (long i = 0; i < n && total > cache_max_bytes; i++) {
+        char path[PATH_MAX];
+        if (join_path(path, sizeof path, files[i].name) == 0 && unlink(path) == 0) {
+            total -= files[i].size;
+            session.evictions++;
+        }
+    }
+    cache_bytes = total;
+    free(files);
+}
+
+int result_cache_open(const char *dir, uint64_t max_bytes) {
+    result_cache_close();
+
+    if (strlen(dir) >= sizeof cache_dir) {
+        fprintf(stderr, "Erro: caminho do cache longo demais\n");
+        return -1;
+    }
+    if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+        perror("Erro ao criar o diretório do cache");
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    strcpy(cache_dir, dir);
+    cache_max_bytes = max_bytes;
+    memset(&session, 0, sizeof session);
+    int ret = load_secret();
+    if (ret == 0) {
+        int fd = stats_lock();
+        if (fd >= 0) {
+            stats_read(fd, &saved);
+            close(fd);
+        } else {
+            memset(&saved, 0, sizeof saved);
+        }
+        CacheFile *files = NULL;
+        if (scan_entries(&files, &cache_bytes) < 0) {
+            perror("Erro ao ler o diretório do cache");
+            ret = -1;
+        }
+        free(files);
+    }
+    cache_enabled = ret == 0;
+    pthread_mutex_unlock(&cache_lock);
+    return ret;
+}
+
+void result_cache_close(void) {
+    pthread_mutex_lock(&cache_lock);
+    if (cache_enabled) {
+        int fd = stats_lock();
+        if (fd >= 0) {
+            ResultCacheStats s;
+            stats_read(fd, &s);
+            s.hits += session.hits;
+            s.misses += session.misses;
+            s.stores += session.stores;
+            s.evictions += session.evictions;
+            stats_write(fd, &s);
+            close(fd);
+        }
+        sodium_memzero(cache_secret, sizeof cache_secret);
+        cache_enabled = 0;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int result_cache_enabled(void) {
+    pthread_mutex_lock(&cache_lock);
+    int enabled = cache_enabled;
+    pthread_mutex_unlock(&cache_lock);
+    return enabled;
+}
+
+int result_cache_hash(FILE *fp, const void *params, size_t params_len,
+                      unsigned char id[RESULT_CACHE_IDBYTES], uint64_t *input_bytes) {
+    crypto_generichash_state state;
+    unsigned char *buffer = buf_alloc(RESCACHE_READ_SIZE);
+    uint64_t total = 0;
+    size_t n;
+
+    if (!buffer) {
+        perror("Erro ao alocar memória");
+        return -1;
+    }
+    pthread_mutex_lock(&cache_lock);
+    crypto_generichash_init(&state, cache_secret, sizeof cache_secret, RESULT_CACHE_IDBYTES);
+    pthread_mutex_unlock(&cache_lock);
+
+    // O tamanho dos parâmetros (uint64 little-endian, inteiro) entra no hash
+    // para separá-los do conteúdo.
+    unsigned char len_bytes[8];
+    for (int i = 0; i < 8; i++) {
+        len_bytes[i] = (unsigned char)((uint64_t)params_len >> (8 * i));
+    }
+    crypto_generichash_update(&state, len_bytes, sizeof len_bytes);
+    crypto_generichash_update(&state, params, params_len);
+    while ((n = fread(buffer, 1, RESCACHE_READ_SIZE, fp)) > 0) {
+        crypto_generichash_update(&state, buffer, n);
+        total += n;
+    }
+    buf_free(buffer);
+    if (ferror(fp)) {
+        fprintf(stderr, "Erro ao ler arquivo\n");
+        return -1;
+    }
+    crypto_generichash_final(&state, id, RESULT_CACHE_IDBYTES);
+    if (input_bytes) {
+        *input_bytes = total;
+    }
+    return 0;
+}
+
+FILE *result_cache_lookup(const unsigned char id[RESULT_CACHE_IDBYTES]) {
+    char path[PATH_MAX];
+    entry_path(path, sizeof path, id);
+    FILE *fp = fopen(path, "rb");
+    if (fp) {
+        // O mtime marca o último uso: é a ordem das remoções.
+        futimens(fileno(fp), NULL);
+    }
+    return fp;
+}
+
+void result_cache_record(int hit) {
+    pthread_mutex_lock(&cache_lock);
+    if (hit) {
+        session.hits++;
+    } else {
+        session.misses++;
+    }
+    pthread_mutex_unlock(&cache_lock);
+}
+
+int result_cache_store_begin(ResultCacheEntry *entry) {
+    entry->fp = NULL;
+    if (join_path(entry->tmp_path, sizeof entry->tmp_path, "tmp.XXXXXX") != 0) {
+        return -1;
+    }
+    int fd = mkstemp(entry->tmp_path);
+    if (fd < 0) {
+        perror("Aviso: não foi possível gravar no cache");
+        return -1;
+    }
+    entry->fp = fdopen(fd, "wb");
+    if (!entry->fp) {
+        close(fd);
+        unlink(entry->tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int result_cache_store_commit(ResultCacheEntry *entry,
+                              const unsigned char id[RESULT_CACHE_IDBYTES], int ok) {
+    if (!entry->fp) {
+        return -1;
+    }
+    ok = !ferror(entry->fp) && fflush(entry->fp) == 0 && ok;
+    off_t size = ok ? ftello(entry->fp) : 0;
+    if (fclose(entry->fp) != 0) {
+        ok = 0;
+    }
+    entry->fp = NULL;
+
+    char path[PATH_MAX];
+    entry_path(path, sizeof path, id);
+    if (!ok || rename(entry->tmp_path, path) != 0) {
+        unlink(entry->tmp_path);
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    session.stores++;
+    cache_bytes += (uint64_t)size;
+    if (cache_max_bytes > 0 && cache_bytes > cache_max_bytes) {
+        evict_locked();
+    }
+    pthread_mutex_unlock(&cache_lock);
+    return 0;
+}
+
+void result_cache_get_stats(ResultCacheStats *run, ResultCacheStats *total) {
+    CacheFile *files = NULL;
+    uint64_t bytes = 0;
+    long n = -1;
+
+    pthread_mutex_lock(&cache_lock);
+    if (cache_enabled) {
+        n = scan_entries(&files, &bytes);
+        free(files);
+    }
+    if (run) {
+        *run = session;
+    }
+    if (total) {
+        total->hits = saved.hits + session.hits;
+        total->misses = saved.misses + session.misses;
+        total->stores = saved.stores + session.stores;
+        total->evictions = saved.evictions + session.evictions;
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    for (int i = 0; i < 2; i++) {
+        ResultCacheStats *s = i == 0 ? run : total;
+        if (s) {
+            s->entries = n > 0 ? (size_t)n : 0;
+            s->bytes = bytes;
+        }
+    }
+}
@@ -0,0 +1,118 @@
+#ifndef RESCACHE_H
+#define RESCACHE_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Cache de resultados em disco, endereçado pelo conteúdo
+ *
+ * Cada entrada é identificada por um BLAKE2b com chave do conteúdo da entrada e
+ * dos parâmetros da operação. A chave é um segredo aleatório do próprio cache
+ * (arquivo "key" no diretório), então os nomes das entradas não revelam nada
+ * sobre os arquivos. As entradas são gravadas em um temporário e renomeadas,
+ * então processos e threads podem usar o mesmo diretório ao mesmo tempo.
+ * Acima do limite de tamanho, as entradas usadas há mais tempo são removidas.
+ * Os contadores ficam no arquivo "stats" do diretório e acumulam entre execuções.
+ */
+
+/**
+ * Tamanho do identificador de uma entrada
+ */
+#define RESULT_CACHE_IDBYTES 32
+
+/**
+ * Contadores do cache
+ */
+typedef struct {
+    unsigned long hits;       // resultados reaproveitados
+    unsigned long misses;     // resultados recalculados
+    unsigned long stores;     // entradas gravadas
+    unsigned long evictions;  // entradas removidas pelo limite de tamanho
+    size_t entries;           // entradas no diretório agora
+    uint64_t bytes;           // bytes ocupados pelas entradas
+} ResultCacheStats;
+
+/**
+ * Entrada sendo gravada (temporário no diretório do cache)
+ */
+typedef struct {
+    FILE *fp;
+    char tmp_path[PATH_MAX];
+} ResultCacheEntry;
+
+/**
+ * Ativa o cache em um diretório (criado com permissão só para o dono se não existir)
+ *
+ * @param dir: diretório do cache
+ * @param max_bytes: tamanho máximo das entradas (0 = sem limite)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int result_cache_open(const char *dir, uint64_t max_bytes);
+
+/**
+ * Grava os contadores desta execução e desativa o cache
+ */
+void result_cache_close(void);
+
+/**
+ * Indica se o cache está ativo
+ */
+int result_cache_enabled(void);
+
+/**
+ * Calcula o identificador de uma entrada: BLAKE2b com a chave do cache sobre os
+ * parâmetros e todo o conteúdo de fp (lido até o fim)
+ *
+ * @param fp: conteúdo de entrada
+ * @param params: parâmetros da operação que mudam o resultado
+ * @param params_len: tamanho de params
+ * @param id: recebe o identificador
+ * @param input_bytes: recebe a quantidade de bytes lidos de fp (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int result_cache_hash(FILE *fp, const void *params, size_t params_len,
+                      unsigned char id[RESULT_CACHE_IDBYTES], uint64_t *input_bytes);
+
+/**
+ * Abre uma entrada para leitura e a marca como usada agora
+ *
+ * Não altera os contadores: quem chama decide se a entrada serve e chama
+ * result_cache_record.
+ *
+ * @return: a entrada, ou NULL se ela não existe
+ */
+FILE *result_cache_lookup(const unsigned char id[RESULT_CACHE_IDBYTES]);
+
+/**
+ * Conta um acerto (hit != 0) ou uma falta
+ */
+void result_cache_record(int hit);
+
+/**
+ * Cria o temporário de uma nova entrada
+ *
+ * @return: 0 em sucesso, -1 em erro (o resultado só não é guardado)
+ */
+int result_cache_store_begin(ResultCacheEntry *entry);
+
+/**
+ * Fecha o temporário e, se ok, o publica como a entrada id (substituindo uma
+ * anterior); depois aplica o limite de tamanho. Com !ok, o temporário é removido.
+ *
+ * @return: 0 se a entrada foi publicada, -1 caso contrário
+ */
+int result_cache_store_commit(ResultCacheEntry *entry,
+                              const unsigned char id[RESULT_CACHE_IDBYTES], int ok);
+
+/**
+ * Lê os contadores e o tamanho atual do cache
+ *
+ * @param run: contadores desta execução (pode ser NULL)
+ * @param total: contadores acumulados com as execuções anteriores (pode ser NULL)
+ */
+void result_cache_get_stats(ResultCacheStats *run, ResultCacheStats *total);
+
+#endif /* RESCACHE_H */
@@ -0,0 +1,718 @@
+#define _GNU_SOURCE  // accept4, pipe2 e MSG_CMSG_CLOEXEC
+#include "serve.h"
+#include "threadpool.h"
+#include "esteg.h"
+#include "crypt_utils.h"
+#include "pipeline.h"
+#include "bufpool.h"
+#include "stdstream.h"
+#include "opctx.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Descritores aceitos por requisição (entrada e saída)
+#define SERVE_MAX_FDS 2
+#define SERVE_MAX_REPLY 256
+
+/**
+ * @brief Conexão de um cliente. Enquanto `busy`, a requisição dela está no pool
+ *        e o laço principal não lê a próxima; só observa se o cliente desconecta,
+ *        para cancelar a requisição pelo `op`.
+ */
+typedef struct {
+    int fd;
+    int busy;
+    int hangup;              // o cliente desconectou com a requisição em andamento
+    OpContext *op;           // contexto da requisição em andamento (NULL antes de começar)
+} ServeConn;
+
+typedef struct {
+    ThreadPool *pool;
+    int listen_fd;
+    int wake[2];             // pipe usado pelos workers para acordar o poll
+
+    uint64_t timeout_ms;     // prazo máximo de uma requisição (0 = sem prazo)
+
+    pthread_mutex_t lock;
+    ServeConn *conns;
+    size_t n_conns;
+    size_t cap_conns;
+} Server;
+
+/**
+ * @brief Uma requisição recebida, executada por um worker do pool.
+ */
+typedef struct {
+    Server *srv;
+    int conn_fd;
+    char msg[SERVE_MAX_REQUEST];
+    size_t len;
+    int fds[SERVE_MAX_FDS];
+    int n_fds;
+} ServeRequest;
+
+static volatile sig_atomic_t serve_stop = 0;
+
+static void on_stop_signal(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+/**
+ * @brief Envia uma mensagem "status\0detalhe".
+ */
+static int send_reply(int fd, const char *status, const char *detail) {
+    char reply[SERVE_MAX_REPLY];
+    size_t len = strlen(status) + 1;
+    memcpy(reply, status, len);
+    size_t detail_len = strlen(detail);
+    if (detail_len > sizeof(reply) - len) {
+        detail_len = sizeof(reply) - len;
+    }
+    memcpy(reply + len, detail, detail_len);
+    return send(fd, reply, len + detail_len, MSG_NOSIGNAL) < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Executa uma requisição já separada em campos.
+ * @return 0 em sucesso, -1 em erro; `detail` recebe a mensagem da resposta.
+ */
+static int execute_request(ServeRequest *req, char *fields[4], char *detail, size_t detail_size) {
+    const char *op = fields[0];
+    const char *cover = fields[1];
+    const char *password = fields[2];
+    int need_fds;
+
+    if (strcmp(op, "ping") == 0) {
+        snprintf(detail, detail_size, "pong");
+        return 0;
+    } else if (strcmp(op, "hide") == 0 || strcmp(op, "full") == 0) {
+        need_fds = 2;
+    } else if (strcmp(op, "extract") == 0 || strcmp(op, "recover") == 0) {
+        need_fds = 1;
+    } else {
+        snprintf(detail, detail_size, "operação desconhecida: %s", op);
+        return -1;
+    }
+    if (req->n_fds != need_fds || cover[0] == '\0') {
+        snprintf(detail, detail_size, "'%s' precisa da capa e de %d descritor(es)", op, need_fds);
+        return -1;
+    }
+
+    // Os FILE assumem os descritores: fclose também os fecha.
+    FILE *in = need_fds == 2 ? fdopen(req->fds[0], "rb") : NULL;
+    FILE *out = fdopen(req->fds[need_fds - 1], "wb");
+    if ((need_fds == 2 && !in) || !out) {
+        snprintf(detail, detail_size, "descritor inválido");
+        if (in) {
+            fclose(in);
+        } else if (need_fds == 2) {
+            close(req->fds[0]);
+        }
+        if (out) {
+            fclose(out);
+        } else {
+            close(req->fds[need_fds - 1]);
+        }
+        req->n_fds = 0;
+        return -1;
+    }
+    req->n_fds = 0;
+
+    PipelineStats stats = {0, 0, 0, 0};
+    int ret = -1;
+    if (strcmp(op, "hide") == 0) {
+        ret = steg_hide_stream(cover, in, out);
+    } else if (strcmp(op, "extract") == 0) {
+        ret = steg_extract_stream(cover, out);
+    } else if (strcmp(op, "full") == 0) {
+        CryptSuite suite = CRYPT_SUITE_XCHACHA20;
+        if (fields[3][0] && crypt_suite_parse(fields[3], &suite) != 0) {
+            snprintf(detail, detail_size, "suite inválida: %s", fields[3]);
+        } else {
+            ret = pipeline_full_stream(cover, in, out, (const unsigned char *)password,
+                                       strlen(password), suite, &stats);
+        }
+    } else {
+        ret = pipeline_recover_stream(cover, out, (const unsigned char *)password,
+                                      strlen(password), &stats);
+    }
+
+    if (in) {
+        fclose(in);
+    }
+    if (fclose(out) != 0) {
+        ret = -1;
+    }
+    if (ret == 0) {
+        snprintf(detail, detail_size, "%zu %zu %zu",
+                 stats.input_bytes, stats.compressed_bytes, stats.encrypted_bytes);
+    } else if (detail[0] == '\0') {
+        snprintf(detail, detail_size, "falha em '%s' (veja o log do daemon)", op);
+    }
+    return ret;
+}
+
+/**
+ * @brief Conexão com o descritor `fd` (chame com srv->lock).
+ */
+static ServeConn *find_conn(Server *srv, int fd) {
+    for (size_t i = 0; i < srv->n_conns; i++) {
+        if (srv->conns[i].fd == fd) {
+            return &srv->conns[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Prazo da requisição: o pedido pelo cliente (campo "prazo", em ms),
+ *        limitado ao do daemon.
+ */
+static uint64_t request_timeout(const Server *srv, const char *field) {
+    char *end;
+    unsigned long long asked = strtoull(field, &end, 10);
+    if (field[0] < '0' || field[0] > '9' || *end != '\0' || asked == 0) {
+        return srv->timeout_ms;
+    }
+    return srv->timeout_ms && srv->timeout_ms < asked ? srv->timeout_ms : asked;
+}
+
+/**
+ * @brief Tarefa do pool: executa a requisição, responde e libera a conexão.
+ */
+static void run_request(void *arg) {
+    ServeRequest *req = arg;
+    Server *srv = req->srv;
+    int conn_fd = req->conn_fd;
+    char detail[200] = "";
+    char *fields[5];
+
+    // Campos separados por '\0'; os que faltam ficam vazios.
+    size_t pos = 0;
+    for (int i = 0; i < 5; i++) {
+        fields[i] = pos < req->len ? req->msg + pos : req->msg + req->len;
+        pos += strlen(fields[i]) + 1;
+    }
+
+    // Cada requisição tem seu contexto: as operações param no próximo bloco quando
+    // o prazo esgota ou quando o laço principal vê o cliente desconectar.
+    OpContext ctx;
+    op_context_init(&ctx, NULL, NULL);
+    op_context_set_timeout(&ctx, request_timeout(srv, fields[4]));
+    pthread_mutex_lock(&srv->lock);
+    ServeConn *conn = find_conn(srv, conn_fd);
+    if (conn) {
+        conn->op = &ctx;
+        if (conn->hangup) {
+            op_cancel(&ctx);
+        }
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    OpContext *previous = op_context_enter(&ctx);
+    int ret = execute_request(req, fields, detail, sizeof detail);
+    op_context_leave(previous);
+    int cancelled = ret != 0 ? op_context_cancelled(&ctx) : 0;
+    if (cancelled) {
+        snprintf(detail, sizeof detail, "%s",
+                 cancelled == 2 ? "prazo esgotado" : "operação cancelada");
+    }
+    send_reply(conn_fd, ret == 0 ? "ok" : "erro", detail);
+
+    for (int i = 0; i < req->n_fds; i++) {
+        close(req->fds[i]);
+    }
+    sodium_memzero(req->msg, sizeof req->msg);
+    free(req);
+
+    pthread_mutex_lock(&srv->lock);
+    conn = find_conn(srv, conn_fd);
+    if (conn) {
+        conn->busy = 0;
+        conn->hangup = 0;
+        conn->op = NULL;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    if (write(srv->wake[1], "", 1) < 0) {
+        // O pipe cheio já garante que o poll vai acordar.
+    }
+}
+
+/**
+ * @brief Lê uma requisição da conexão e a entrega ao pool.
+ * @return 0 se a conexão continua aberta, -1 se deve ser fechada.
+ */
+static int receive_request(Server *srv, ServeConn *conn) {
+    ServeRequest *req = calloc(1, sizeof(ServeRequest));
+    if (!req) {
+        return -1;
+    }
+
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * SERVE_MAX_FDS)];
+    } control;
+    struct iovec iov = { req->msg, sizeof(req->msg) - 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof control.buf;
+
+    ssize_t n = recvmsg(conn->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) {
+        free(req);
+        return -1;
+    }
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            int count = (int)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+            int *fds = (int *)CMSG_DATA(c);
+            for (int i = 0; i < count; i++) {
+                if (req->n_fds < SERVE_MAX_FDS) {
+                    req->fds[req->n_fds++] = fds[i];
+                } else {
+                    close(fds[i]);
+                }
+            }
+        }
+    }
+    req->srv = srv;
+    req->conn_fd = conn->fd;
+    req->len = (size_t)n;
+
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        send_reply(conn->fd, "erro", "requisição grande demais");
+        for (int i = 0; i < req->n_fds; i++) {
+            close(req->fds[i]);
+        }
+        free(req);
+        return 0;
+    }
+
+    conn->busy = 1;
+    if (pool_submit(srv->pool, run_request, req) != 0) {
+        conn->busy = 0;
+        send_reply(conn->fd, "erro", "daemon sem memória");
+        for (int i = 0; i < req->n_fds; i++) {
+            close(req->fds[i]);
+        }
+        free(req);
+    }
+    return 0;
+}
+
+static int add_connection(Server *srv, int fd) {
+    if (srv->n_conns == srv->cap_conns) {
+        size_t cap = srv->cap_conns ? srv->cap_conns * 2 : 16;
+        ServeConn *conns = realloc(srv->conns, cap * sizeof(ServeConn));
+        if (!conns) {
+            return -1;
+        }
+        srv->conns = conns;
+        srv->cap_conns = cap;
+    }
+    srv->conns[srv->n_conns] = (ServeConn){ fd, 0, 0, NULL };
+    srv->n_conns++;
+    return 0;
+}
+
+/**
+ * @brief Cria o socket de escuta com permissão só para o dono.
+ */
+static int open_listener(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Erro: caminho do socket muito longo\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("Erro ao criar socket");
+        return -1;
+    }
+
+    // Remove um socket antigo, mas nunca outro tipo de arquivo.
+    struct stat st;
+    if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(socket_path);
+    }
+
+    mode_t old_mask = umask(077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof addr);
+    umask(old_mask);
+    if (ret != 0 || listen(fd, 64) != 0) {
+        perror("Erro ao abrir o socket");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int serve_run(const char *socket_path, const ServeOptions *opts) {
+    Server srv;
+    memset(&srv, 0, sizeof srv);
+    pthread_mutex_init(&srv.lock, NULL);
+    srv.timeout_ms = opts->request_timeout_ms;
+
+    if (crypt_key_cache_enable(opts->key_slots) != 0 ||
+        steg_cover_cache_set_budget(opts->cover_cache_bytes) != 0) {
+        return -1;
+    }
+    buf_pool_set_limit(opts->buffer_pool_bytes);
+
+    srv.listen_fd = open_listener(socket_path);
+    if (srv.listen_fd < 0) {
+        return -1;
+    }
+    if (pipe2(srv.wake, O_CLOEXEC | O_NONBLOCK) != 0) {
+        perror("Erro ao criar pipe");
+        close(srv.listen_fd);
+        unlink(socket_path);
+        return -1;
+    }
+    srv.pool = pool_create(opts->workers);
+    if (!srv.pool) {
+        close(srv.listen_fd);
+        close(srv.wake[0]);
+        close(srv.wake[1]);
+        unlink(socket_path);
+        return -1;
+    }
+
+    // Sem SA_RESTART: o sinal interrompe o poll e o laço termina.
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "Daemon ouvindo em %s (%d workers)\n", socket_path, pool_size(srv.pool));
+
+    struct pollfd *pfds = NULL;
+    size_t pfds_cap = 0;
+    int ret = 0;
+
+    while (!serve_stop) {
+        pthread_mutex_lock(&srv.lock);
+        size_t n = 0;
+        if (pfds_cap < srv.n_conns + 2) {
+            pfds_cap = srv.n_conns + 16;
+            struct pollfd *grown = realloc(pfds, pfds_cap * sizeof(struct pollfd));
+            if (!grown) {
+                pthread_mutex_unlock(&srv.lock);
+                perror("Erro ao alocar memória");
+                ret = -1;
+                break;
+            }
+            pfds = grown;
+        }
+        pfds[n++] = (struct pollfd){ srv.listen_fd, POLLIN, 0 };
+        pfds[n++] = (struct pollfd){ srv.wake[0], POLLIN, 0 };
+        // Conexões ocupadas só são observadas até o cliente desconectar (POLLHUP).
+        for (size_t i = 0; i < srv.n_conns; i++) {
+            if (!srv.conns[i].busy) {
+                pfds[n++] = (struct pollfd){ srv.conns[i].fd, POLLIN, 0 };
+            } else if (!srv.conns[i].hangup) {
+                pfds[n++] = (struct pollfd){ srv.conns[i].fd, 0, 0 };
+            }
+        }
+        pthread_mutex_unlock(&srv.lock);
+
+        if (poll(pfds, n, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Erro no poll");
+            ret = -1;
+            break;
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            char drain[64];
+            while (read(srv.wake[0], drain, sizeof drain) > 0) {
+            }
+        }
+
+        for (size_t k = 2; k < n; k++) {
+            if (!pfds[k].revents) {
+                continue;
+            }
+            pthread_mutex_lock(&srv.lock);
+            for (size_t i = 0; i < srv.n_conns; i++) {
+                if (srv.conns[i].fd != pfds[k].fd) {
+                    continue;
+                }
+                if (srv.conns[i].busy) {
+                    // O worker ainda responde por este descritor: só cancela a requisição.
+                    if (pfds[k].revents & (POLLHUP | POLLERR)) {
+                        srv.conns[i].hangup = 1;
+                        if (srv.conns[i].op) {
+                            op_cancel(srv.conns[i].op);
+                        }
+                    }
+                    break;
+                }
+                if (receive_request(&srv, &srv.conns[i]) != 0) {
+                    close(srv.conns[i].fd);
+                    srv.conns[i] = srv.conns[--srv.n_conns];
+                }
+                break;
+            }
+            pthread_mutex_unlock(&srv.lock);
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            int fd = accept4(srv.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                pthread_mutex_lock(&srv.lock);
+                if (add_connection(&srv, fd) != 0) {
+                    close(fd);
+                }
+                pthread_mutex_unlock(&srv.lock);
+            }
+        }
+    }
+
+    // Termina as requisições em andamento antes de fechar as conexões.
+    pool_destroy(srv.pool);
+    for (size_t i = 0; i < srv.n_conns; i++) {
+        close(srv.conns[i].fd);
+    }
+    free(srv.conns);
+    free(pfds);
+    close(srv.listen_fd);
+    close(srv.wake[0]);
+    close(srv.wake[1]);
+    unlink(socket_path);
+    pthread_mutex_destroy(&srv.lock);
+    steg_cover_cache_set_budget(0);
+    crypt_key_cache_enable(0);
+    buf_pool_set_limit(0);
+    fprintf(stderr, "Daemon encerrado\n");
+    return ret;
+}
+
+/**
+ * @brief Conecta ao socket do daemon.
+ */
+static int connect_daemon(const char *socket_path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Erro: caminho do socket muito longo\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+        perror("Erro ao conectar ao daemon");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Envia uma requisição com até SERVE_MAX_FDS descritores e lê a resposta.
+ *        `reply` recebe o status e o detalhe, cada um terminado em '\0'; se a
+ *        resposta não chegar, os dois ficam vazios.
+ * @return 0 se o daemon respondeu "ok", -1 caso contrário.
+ */
+static int call_once(int sock, const char *request, size_t len, const int *fds, int n_fds,
+                     char *reply, size_t reply_size) {
+    reply[0] = reply[1] = '\0';
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int) * SERVE_MAX_FDS)];
+    } control;
+    struct iovec iov = { (void *)request, len };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof msg);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (n_fds > 0) {
+        memset(&control, 0, sizeof control);
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * n_fds);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * n_fds);
+        memcpy(CMSG_DATA(c), fds, sizeof(int) * n_fds);
+    }
+
+    if (sendmsg(sock, &msg, MSG_NOSIGNAL) < 0) {
+        perror("Erro ao enviar requisição");
+        return -1;
+    }
+    ssize_t n = recv(sock, reply, reply_size - 2, 0);
+    if (n <= 0) {
+        fprintf(stderr, "Erro: o daemon fechou a conexão\n");
+        return -1;
+    }
+    reply[n] = reply[n + 1] = '\0';   // o detalhe chega sem terminador
+    return strcmp(reply, "ok") == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Mede o tempo de ida e volta de `count` pings na mesma conexão.
+ */
+static int call_ping(int sock, long count) {
+    char reply[SERVE_MAX_REPLY + 2];
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++) {
+        if (call_once(sock, "ping", 5, NULL, 0, reply, sizeof reply) != 0) {
+            return -1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double us = ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / 1e3;
+    printf("✓ %ld ping(s), média de %.1f µs por requisição\n", count, us / count);
+    return 0;
+}
+
+int serve_call(const char *socket_path, int argc, char *argv[], uint64_t timeout_ms) {
+    if (argc < 1) {
+        fprintf(stderr, "Erro: operação não informada\n");
+        return -1;
+    }
+
+    const char *op = argv[0];
+    const char *cover = "", *input = NULL, *output = NULL, *password = "", *suite = "";
+    long count = 1;
+    if (strcmp(op, "ping") == 0 && argc <= 2) {
+        // sem arquivos; só a quantidade opcional
+        if (argc == 2) {
+            char *end;
+            errno = 0;
+            count = strtol(argv[1], &end, 10);
+            if (argv[1][0] < '0' || argv[1][0] > '9' || *end != '\0' || errno == ERANGE ||
+                count <= 0) {
+                fprintf(stderr, "Erro: a quantidade de pings deve ser um número positivo\n");
+                return -1;
+            }
+        }
+    } else if (strcmp(op, "hide") == 0 && argc == 4) {
+        cover = argv[1]; input = argv[2]; output = argv[3];
+    } else if (strcmp(op, "extract") == 0 && argc == 3) {
+        cover = argv[1]; output = argv[2];
+    } else if (strcmp(op, "full") == 0 && (argc == 5 || argc == 6)) {
+        cover = argv[1]; input = argv[2]; output = argv[3]; password = argv[4];
+        suite = argc == 6 ? argv[5] : "";
+    } else if (strcmp(op, "recover") == 0 && argc == 4) {
+        cover = argv[1]; output = argv[2]; password = argv[3];
+    } else {
+        fprintf(stderr, "Erro: argumentos inválidos para '%s'\n", op);
+        return -1;
+    }
+
+    int sock = connect_daemon(socket_path);
+    if (sock < 0) {
+        return -1;
+    }
+    if (strcmp(op, "ping") == 0) {
+        int ret = call_ping(sock, count);
+        close(sock);
+        return ret;
+    }
+
+    // O daemon pode ter outro diretório de trabalho: a capa vai como caminho absoluto.
+    char cover_abs[PATH_MAX];
+    if (stdstream_is_std(cover)) {
+        fprintf(stderr, "Erro: a capa enviada ao daemon precisa ser um arquivo\n");
+        close(sock);
+        return -1;
+    }
+    if (!realpath(cover, cover_abs)) {
+        perror("Erro ao abrir imagem");
+        close(sock);
+        return -1;
+    }
+
+    char request[SERVE_MAX_REQUEST];
+    char timeout[24] = "";
+    if (timeout_ms) {
+        snprintf(timeout, sizeof timeout, "%llu", (unsigned long long)timeout_ms);
+    }
+    int len = snprintf(request, sizeof request, "%s%c%s%c%s%c%s%c%s", op, 0, cover_abs, 0,
+                       password, 0, suite, 0, timeout);
+    if (len < 0 || (size_t)len >= sizeof request) {
+        fprintf(stderr, "Erro: requisição grande demais\n");
+        close(sock);
+        return -1;
+    }
+
+    // "-" passa a entrada/saída padrão ao daemon. hide e full voltam ao cabeçalho
+    // da imagem, então um stdout sem seek é trocado por um temporário.
+    int fds[SERVE_MAX_FDS];
+    int n_fds = 0;
+    FILE *in_fp = NULL;
+    if (input) {
+        in_fp = stdstream_open_read(input);
+        if (!in_fp) {
+            perror("Erro ao abrir arquivo");
+            close(sock);
+            return -1;
+        }
+        fds[n_fds++] = fileno(in_fp);
+    }
+    FILE *out_fp = stdstream_open_write(output, input != NULL);
+    if (!out_fp) {
+        perror("Erro ao criar arquivo de saída");
+        stdstream_close_read(in_fp);
+        close(sock);
+        return -1;
+    }
+    fds[n_fds++] = fileno(out_fp);
+
+    char reply[SERVE_MAX_REPLY + 2] = { 0 };
+    int ret = call_once(sock, request, (size_t)len + 1, fds, n_fds, reply, sizeof reply);
+    sodium_memzero(request, sizeof request);
+    stdstream_close_read(in_fp);
+    close(sock);
+
+    const char *detail = reply + strlen(reply) + 1;
+    if (ret != 0 && *detail) {
+        fprintf(stderr, "Erro: %s\n", detail);
+    }
+    // Em erro, não deixa uma saída parcial para trás.
+    if (stdstream_close_write(out_fp, output, ret != 0) != 0) {
+        return -1;
+    }
+    if (strcmp(op, "full") == 0 || strcmp(op, "recover") == 0) {
+        size_t input_bytes, compressed_bytes, encrypted_bytes;
+        if (sscanf(detail, "%zu %zu %zu", &input_bytes, &compressed_bytes, &encrypted_bytes) == 3) {
+            printf("   Original: %zu bytes, comprimido: %zu bytes, escondido: %zu bytes\n",
+                   input_bytes, compressed_bytes, encrypted_bytes);
+        }
+    }
+    printf("✓ '%s' concluído pelo daemon: %s\n", op, output);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Tamanho máximo de uma requisição (campos de texto; os arquivos vão como descritores)
+ */
+#define SERVE_MAX_REQUEST 4096
+
+/**
+ * Opções do daemon
+ */
+typedef struct {
+    int workers;               // threads do pool (<= 0 usa o número de CPUs)
+    size_t cover_cache_bytes;  // memória para capas mantidas entre requisições
+    size_t buffer_pool_bytes;  // buffers de trabalho ociosos retidos entre requisições
+    size_t key_slots;          // chaves derivadas mantidas em memória entre requisições
+    uint64_t request_timeout_ms;  // prazo máximo de cada requisição (0 = sem prazo)
+} ServeOptions;
+
+/**
+ * Atende requisições em um socket Unix até receber SIGINT ou SIGTERM
+ *
+ * Protocolo (SOCK_SEQPACKET, uma mensagem por requisição e uma por resposta):
+ * a requisição tem os campos "op", "capa", "senha", "suite" e "prazo" (em ms,
+ * vazio = sem prazo) separados por '\0' e leva os arquivos como descritores
+ * (SCM_RIGHTS): entrada e saída para hide/full, só a saída para extract/recover.
+ * A resposta é "ok" ou "erro", seguida de '\0' e de um detalhe. As requisições
+ * rodam em um pool de threads, e capas e chaves derivadas ficam em cache entre elas.
+ *
+ * Cada requisição roda com seu próprio OpContext: ela para no próximo bloco quando
+ * o prazo (o do cliente, limitado a request_timeout_ms) esgota ou quando o cliente
+ * desconecta, e a resposta traz "prazo esgotado" ou "operação cancelada".
+ *
+ * @param socket_path: caminho do socket (um socket antigo no caminho é substituído)
+ * @param opts: opções do daemon
+ * @return: 0 ao encerrar normalmente, -1 em erro
+ */
+int serve_run(const char *socket_path, const ServeOptions *opts);
+
+/**
+ * Envia uma requisição a um daemon e espera a resposta
+ *
+ * Operações: ping [N], hide <capa> <arquivo> <saida>, extract <capa> <saida>,
+ * full <capa> <arquivo> <saida> <senha> [suite], recover <capa> <saida> <senha>.
+ * Os arquivos são abertos aqui e passados por descritor, então o daemon não
+ * precisa de acesso aos caminhos de entrada e saída.
+ *
+ * @param socket_path: caminho do socket do daemon
+ * @param argc: quantidade de argumentos (operação incluída)
+ * @param argv: operação seguida dos argumentos
+ * @param timeout_ms: prazo da requisição no daemon (0 = só o do daemon)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int serve_call(const char *socket_path, int argc, char *argv[], uint64_t timeout_ms);
+
+#endif /* SERVE_H */
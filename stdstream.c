@@ -0,0 +1,214 @@
+#define _GNU_SOURCE  // splice
+#include "stdstream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+
+// Quantidade máxima movida por chamada de splice/sendfile/read
+#define STDSTREAM_CHUNK (1 << 20)
+
+static int stdout_fd = -1;          // stdout original, depois de stdstream_claim_stdout
+static FILE *stdout_data = NULL;    // FILE sobre stdout_fd
+static FILE *stdout_spool = NULL;   // temporário quando o stdout não aceita seek
+static FILE *stdin_spool = NULL;    // cópia da entrada padrão usada como capa
+static int stdin_taken = 0;
+static int stdout_taken = 0;
+static char stdin_spool_path[32];
+
+int stdstream_is_std(const char *path) {
+    return path && strcmp(path, "-") == 0;
+}
+
+int stdstream_claim_stdout(void) {
+    if (stdout_fd >= 0) {
+        return 0;
+    }
+    fflush(stdout);
+    stdout_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (stdout_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("Erro ao reservar a saída padrão");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Copia in_fd até o fim para out_fd sem passar pelo espaço do usuário
+ *        quando possível: splice se um dos lados é pipe, sendfile se a origem
+ *        é um arquivo comum, e read/write nos demais casos.
+ */
+static int copy_fd(int in_fd, int out_fd) {
+    ssize_t n;
+
+    while ((n = splice(in_fd, NULL, out_fd, NULL, STDSTREAM_CHUNK, SPLICE_F_MOVE)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS) {
+                break;
+            }
+            return -1;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    while ((n = sendfile(out_fd, in_fd, NULL, STDSTREAM_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS) {
+                break;
+            }
+            return -1;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    char *buffer = malloc(STDSTREAM_CHUNK);
+    if (!buffer) {
+        return -1;
+    }
+    int ret = 0;
+    while ((n = read(in_fd, buffer, STDSTREAM_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ret = -1;
+            break;
+        }
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = write(out_fd, buffer + done, (size_t)(n - done));
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                ret = -1;
+                break;
+            }
+            done += w;
+        }
+        if (ret != 0) {
+            break;
+        }
+    }
+    free(buffer);
+    return ret;
+}
+
+FILE *stdstream_open_read(const char *path) {
+    if (!stdstream_is_std(path)) {
+        return fopen(path, "rb");
+    }
+    if (stdin_taken) {
+        fprintf(stderr, "Erro: a entrada padrão só pode ser usada por um argumento\n");
+        errno = EBUSY;
+        return NULL;
+    }
+    stdin_taken = 1;
+    return stdin;
+}
+
+void stdstream_close_read(FILE *fp) {
+    if (fp && fp != stdin) {
+        fclose(fp);
+    }
+}
+
+FILE *stdstream_open_write(const char *path, int seekable) {
+    if (!stdstream_is_std(path)) {
+        return fopen(path, "wb");
+    }
+    if (stdout_taken) {
+        fprintf(stderr, "Erro: a saída padrão só pode ser usada por um argumento\n");
+        errno = EBUSY;
+        return NULL;
+    }
+    if (stdstream_claim_stdout() != 0) {
+        return NULL;
+    }
+    stdout_taken = 1;
+
+    // Em O_APPEND a correção do cabeçalho iria para o fim: também usa o temporário.
+    if (seekable && (lseek(stdout_fd, 0, SEEK_CUR) < 0 ||
+                     (fcntl(stdout_fd, F_GETFL) & O_APPEND))) {
+        stdout_spool = tmpfile();
+        if (!stdout_spool) {
+            perror("Erro ao criar arquivo temporário");
+        }
+        return stdout_spool;
+    }
+    stdout_data = fdopen(stdout_fd, "wb");
+    if (!stdout_data) {
+        perror("Erro ao abrir a saída padrão");
+    }
+    return stdout_data;
+}
+
+int stdstream_close_write(FILE *fp, const char *path, int failed) {
+    if (!fp) {
+        return -1;
+    }
+    if (!stdstream_is_std(path)) {
+        if (fclose(fp) != 0 && !failed) {
+            fprintf(stderr, "Erro ao escrever arquivo\n");
+            failed = 1;
+        }
+        if (failed) {
+            remove(path);
+        }
+        return failed ? -1 : 0;
+    }
+
+    if (fflush(fp) != 0 && !failed) {
+        fprintf(stderr, "Erro ao escrever na saída padrão\n");
+        failed = 1;
+    }
+    if (fp == stdout_spool) {
+        if (!failed && (lseek(fileno(fp), 0, SEEK_SET) < 0 ||
+                        copy_fd(fileno(fp), stdout_fd) != 0)) {
+            fprintf(stderr, "Erro ao escrever na saída padrão\n");
+            failed = 1;
+        }
+        fclose(fp);
+        stdout_spool = NULL;
+    }
+    return failed ? -1 : 0;
+}
+
+const char *stdstream_input_path(const char *path) {
+    if (!stdstream_is_std(path)) {
+        return path;
+    }
+    if (stdin_taken) {
+        fprintf(stderr, "Erro: a entrada padrão só pode ser usada por um argumento\n");
+        errno = EBUSY;
+        return NULL;
+    }
+    stdin_taken = 1;
+
+    // A capa precisa de tamanho e acesso aleatório: a entrada vai para um temporário.
+    stdin_spool = tmpfile();
+    if (!stdin_spool) {
+        perror("Erro ao criar arquivo temporário");
+        return NULL;
+    }
+    if (copy_fd(STDIN_FILENO, fileno(stdin_spool)) != 0) {
+        perror("Erro ao ler a entrada padrão");
+        fclose(stdin_spool);
+        stdin_spool = NULL;
+        return NULL;
+    }
+    snprintf(stdin_spool_path, sizeof stdin_spool_path, "/proc/self/fd/%d",
+             fileno(stdin_spool));
+    return stdin_spool_path;
+}
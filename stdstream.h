@@ -0,0 +1,86 @@
+#ifndef STDSTREAM_H
+#define STDSTREAM_H
+
+#include <stdio.h>
+
+/**
+ * Caminho "-" como entrada ou saída padrão
+ *
+ * Quando algum argumento é "-", o stdout é reservado para os dados
+ * (stdstream_claim_stdout) e as mensagens do programa passam a sair no stderr.
+ * A entrada padrão só pode ser consumida por um argumento, e a saída padrão
+ * só pode receber um.
+ */
+
+/**
+ * Indica se o caminho representa a entrada/saída padrão
+ *
+ * @param path: caminho informado pelo usuário (pode ser NULL)
+ * @return: 1 se for "-", 0 caso contrário
+ */
+int stdstream_is_std(const char *path);
+
+/**
+ * Reserva o stdout para dados: guarda o descritor original e aponta o
+ * descritor 1 para o stderr, então printf passa a sair no stderr
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int stdstream_claim_stdout(void);
+
+/**
+ * Abre um caminho para leitura sequencial ("-" = entrada padrão)
+ *
+ * @param path: caminho do arquivo ou "-"
+ * @return: o arquivo, ou NULL em erro (para caminhos comuns, errno indica a
+ *          causa e a mensagem fica com quem chamou)
+ */
+FILE *stdstream_open_read(const char *path);
+
+/**
+ * Fecha uma entrada aberta por stdstream_open_read (NULL é ignorado)
+ */
+void stdstream_close_read(FILE *fp);
+
+/**
+ * Abre um caminho para escrita ("-" = saída padrão)
+ *
+ * Com seekable, uma saída padrão que não aceita seek (pipe, socket, terminal)
+ * é trocada por um arquivo temporário anônimo, enviado ao stdout em
+ * stdstream_close_write. Assim o cabeçalho ainda pode ser corrigido no fim
+ * da escrita.
+ *
+ * @param path: caminho do arquivo ou "-"
+ * @param seekable: 1 se quem escreve precisa voltar no arquivo
+ * @return: o arquivo, ou NULL em erro (para caminhos comuns, errno indica a
+ *          causa e a mensagem fica com quem chamou)
+ */
+FILE *stdstream_open_write(const char *path, int seekable);
+
+/**
+ * Fecha uma saída aberta por stdstream_open_write
+ *
+ * Em sucesso, o temporário da saída padrão é copiado para o stdout com
+ * splice/sendfile. Em falha, um arquivo de saída comum é removido e o
+ * temporário é descartado sem chegar ao stdout.
+ *
+ * @param fp: arquivo devolvido por stdstream_open_write
+ * @param path: o mesmo caminho passado na abertura
+ * @param failed: diferente de 0 se a operação falhou
+ * @return: 0 em sucesso, -1 em erro (ou se failed)
+ */
+int stdstream_close_write(FILE *fp, const char *path, int failed);
+
+/**
+ * Caminho para uma entrada que precisa de acesso aleatório (capas)
+ *
+ * Para "-", a entrada padrão é copiada para um arquivo temporário anônimo
+ * (com splice quando ela é um pipe) e o caminho devolvido é /proc/self/fd/N.
+ * Outros caminhos são devolvidos sem alteração.
+ *
+ * @param path: caminho do arquivo ou "-"
+ * @return: caminho utilizável, ou NULL em erro
+ */
+const char *stdstream_input_path(const char *path);
+
+#endif /* STDSTREAM_H */
@@ -0,0 +1,291 @@
+#include "threadpool.h"
+#include "metrics.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Capacidade inicial de cada fila dupla (cresce quando necessário)
+#define POOL_DEQUE_INITIAL 64
+
+typedef struct {
+    PoolTaskFn fn;
+    void *arg;
+} PoolTask;
+
+/**
+ * @brief Fila dupla circular de um worker. O dono usa o fim, os ladrões usam o início.
+ */
+typedef struct {
+    PoolTask *items;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;
+} PoolDeque;
+
+struct ThreadPool {
+    int n_workers;
+    int n_deques;
+    pthread_t *threads;
+    PoolDeque *deques;
+    size_t next_deque;       // distribuição round-robin das submissões externas
+
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;
+    pthread_cond_t done_cond;
+    size_t queued;           // tarefas nas filas
+    size_t pending;          // tarefas submetidas e ainda não concluídas
+    int shutdown;
+};
+
+typedef struct {
+    ThreadPool *pool;
+    int id;
+} PoolWorkerArg;
+
+// Índice do worker da thread atual (-1 fora do pool)
+static __thread int current_worker = -1;
+static __thread ThreadPool *current_pool = NULL;
+
+static int deque_push_bottom(PoolDeque *d, PoolTask task) {
+    pthread_mutex_lock(&d->lock);
+    if (d->count == d->capacity) {
+        size_t new_capacity = d->capacity * 2;
+        PoolTask *items = malloc(new_capacity * sizeof(PoolTask));
+        if (!items) {
+            pthread_mutex_unlock(&d->lock);
+            return -1;
+        }
+        for (size_t i = 0; i < d->count; i++) {
+            items[i] = d->items[(d->head + i) % d->capacity];
+        }
+        free(d->items);
+        d->items = items;
+        d->head = 0;
+        d->capacity = new_capacity;
+    }
+    d->items[(d->head + d->count) % d->capacity] = task;
+    d->count++;
+    pthread_mutex_unlock(&d->lock);
+    return 0;
+}
+
+static int deque_pop_bottom(PoolDeque *d, PoolTask *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        d->count--;
+        *task = d->items[(d->head + d->count) % d->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+static int deque_steal_top(PoolDeque *d, PoolTask *task) {
+    int found = 0;
+    pthread_mutex_lock(&d->lock);
+    if (d->count > 0) {
+        *task = d->items[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&d->lock);
+    return found;
+}
+
+/**
+ * @brief Pega uma tarefa da própria fila ou rouba de outro worker.
+ */
+static int take_task(ThreadPool *pool, int id, PoolTask *task) {
+    if (deque_pop_bottom(&pool->deques[id], task)) {
+        return 1;
+    }
+    for (int i = 1; i < pool->n_workers; i++) {
+        if (deque_steal_top(&pool->deques[(id + i) % pool->n_workers], task)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    PoolWorkerArg *wa = arg;
+    ThreadPool *pool = wa->pool;
+    int id = wa->id;
+    PoolTask task;
+
+    free(wa);
+    current_worker = id;
+    current_pool = pool;
+
+    char name[32];
+    snprintf(name, sizeof(name), "worker %d", id);
+    metrics_thread_name(name);
+
+    for (;;) {
+        if (take_task(pool, id, &task)) {
+            pthread_mutex_lock(&pool->lock);
+            pool->queued--;
+            pthread_mutex_unlock(&pool->lock);
+
+            uint64_t t = metrics_start();
+            task.fn(task.arg);
+            metrics_stop(METRICS_TASK, t, 0, 0);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->pending == 0) {
+                pthread_cond_broadcast(&pool->done_cond);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        // Nada para fazer: dorme até chegar trabalho novo ou o pool encerrar.
+        pthread_mutex_lock(&pool->lock);
+        while (pool->queued == 0 && !pool->shutdown) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+        int stop = pool->shutdown && pool->queued == 0;
+        pthread_mutex_unlock(&pool->lock);
+        if (stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+ThreadPool *pool_create(int n_workers) {
+    if (n_workers <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n_workers = cpus > 0 ? (int)cpus : 1;
+    }
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (!pool) {
+        perror("Erro ao alocar memória");
+        return NULL;
+    }
+    pool->threads = calloc(n_workers, sizeof(pthread_t));
+    pool->deques = calloc(n_workers, sizeof(PoolDeque));
+    if (!pool->threads || !pool->deques) {
+        perror("Erro ao alocar memória");
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    pool->n_deques = n_workers;
+    for (int i = 0; i < n_workers; i++) {
+        pool->deques[i].capacity = POOL_DEQUE_INITIAL;
+        pool->deques[i].items = malloc(POOL_DEQUE_INITIAL * sizeof(PoolTask));
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+    }
+
+    for (int i = 0; i < n_workers; i++) {
+        PoolWorkerArg *wa = malloc(sizeof(PoolWorkerArg));
+        if (!pool->deques[i].items || !wa) {
+            free(wa);
+            fprintf(stderr, "Erro ao alocar memória para o pool\n");
+            break;
+        }
+        wa->pool = pool;
+        wa->id = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, wa) != 0) {
+            free(wa);
+            fprintf(stderr, "Erro ao criar thread do pool\n");
+            break;
+        }
+        pool->n_workers = i + 1;
+    }
+
+    if (pool->n_workers == 0) {
+        pool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+int pool_size(const ThreadPool *pool) {
+    return pool->n_workers;
+}
+
+int pool_submit(ThreadPool *pool, PoolTaskFn fn, void *arg) {
+    PoolTask task = { fn, arg };
+    size_t target;
+
+    // De dentro de um worker, a tarefa vai para a fila dele; de fora, round-robin.
+    if (current_pool == pool) {
+        target = (size_t)current_worker;
+    } else {
+        pthread_mutex_lock(&pool->lock);
+        target = pool->next_deque++ % pool->n_workers;
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    // Conta a tarefa antes de publicá-la: um worker pode tirá-la da fila
+    // assim que o push terminar, e não pode decrementar contadores que
+    // ainda não a incluem.
+    pthread_mutex_lock(&pool->lock);
+    pool->queued++;
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (deque_push_bottom(&pool->deques[target], task) != 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->queued--;
+        if (--pool->pending == 0) {
+            pthread_cond_broadcast(&pool->done_cond);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        fprintf(stderr, "Erro ao alocar memória para o pool\n");
+        return -1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void pool_wait(ThreadPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(ThreadPool *pool) {
+    if (!pool) {
+        return;
+    }
+    pool_wait(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->work_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_workers; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // Todas as filas foram inicializadas, mesmo as de workers que não chegaram a iniciar.
+    for (int i = 0; i < pool->n_deques; i++) {
+        free(pool->deques[i].items);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+}
@@ -0,0 +1,50 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+/**
+ * Pool de threads com roubo de trabalho (work stealing)
+ *
+ * Cada worker tem sua própria fila dupla: ele consome as tarefas mais novas do
+ * fim da sua fila e, quando ela esvazia, rouba as mais antigas do início da fila
+ * de outro worker. Tarefas submetidas de dentro de um worker vão para a fila dele.
+ */
+typedef struct ThreadPool ThreadPool;
+
+/**
+ * Função executada por uma tarefa
+ */
+typedef void (*PoolTaskFn)(void *arg);
+
+/**
+ * Cria o pool e inicia os workers
+ *
+ * @param n_workers: quantidade de threads (<= 0 usa o número de CPUs online)
+ * @return: o pool, ou NULL em erro
+ */
+ThreadPool *pool_create(int n_workers);
+
+/**
+ * Quantidade de workers do pool
+ */
+int pool_size(const ThreadPool *pool);
+
+/**
+ * Submete uma tarefa
+ *
+ * @return: 0 em sucesso, -1 em erro
+ */
+int pool_submit(ThreadPool *pool, PoolTaskFn fn, void *arg);
+
+/**
+ * Espera até que todas as tarefas submetidas tenham terminado
+ */
+void pool_wait(ThreadPool *pool);
+
+/**
+ * Espera as tarefas pendentes, encerra os workers e libera o pool
+ */
+void pool_destroy(ThreadPool *pool);
+
+#endif /* THREADPOOL_H */
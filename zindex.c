@@ -0,0 +1,409 @@
+#include "zindex.h"
+#include "compactar.h"
+#include "bufpool.h"
+#include "metrics.h"
+#include "opctx.h"
+#include "outmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+// Tamanho dos blocos lidos do .z e descomprimidos de uma vez
+#define ZINDEX_CHUNK 65536
+
+// Janela do deflate: o máximo de saída anterior que um bloco pode referenciar
+#define ZINDEX_WINDOW 32768
+
+#define ZINDEX_MAGIC   "STZI"
+#define ZINDEX_VERSION 1
+
+/**
+ * @brief Início do arquivo de índice.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t span;
+    uint64_t compressed_size;     // tamanho do .z indexado
+    uint64_t uncompressed_size;
+    uint32_t trailer;             // últimos 4 bytes do .z (adler32 dos dados)
+    uint32_t points;
+} ZIndexHeader;
+
+/**
+ * @brief Um ponto de acesso, seguido no arquivo pelos `packed` bytes da janela
+ *        comprimida. O bloco começa `bits` bits antes do fim do byte in - 1
+ *        (ou exatamente no byte in, com bits == 0).
+ */
+typedef struct {
+    uint64_t out;
+    uint64_t in;
+    uint32_t bits;
+    uint32_t window;
+    uint32_t packed;
+    uint32_t reserved;
+} ZIndexPoint;
+
+/**
+ * @brief Caminho do índice de um .z (liberar com free).
+ */
+static char *index_path(const char *path) {
+    size_t len = strlen(path);
+    char *idx = malloc(len + sizeof ZINDEX_SUFFIX);
+    if (!idx) {
+        perror("Erro ao alocar memória");
+        return NULL;
+    }
+    memcpy(idx, path, len);
+    memcpy(idx + len, ZINDEX_SUFFIX, sizeof ZINDEX_SUFFIX);
+    return idx;
+}
+
+/**
+ * @brief Tamanho do .z e seus últimos 4 bytes, que identificam a versão indexada.
+ *        Deixa o arquivo posicionado no início.
+ */
+static int stream_identity(FILE *in, uint64_t *size, uint32_t *trailer) {
+    struct stat st;
+    unsigned char tail[4];
+    if (fstat(fileno(in), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size < 6) {
+        fprintf(stderr, "Erro: o índice precisa de um arquivo .z comum\n");
+        return -1;
+    }
+    if (fseek(in, -4, SEEK_END) != 0 || fread(tail, 1, 4, in) != 4 || fseek(in, 0, SEEK_SET) != 0) {
+        fprintf(stderr, "Erro ao ler arquivo\n");
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+    memcpy(trailer, tail, 4);
+    return 0;
+}
+
+/**
+ * @brief Acrescenta um ponto de acesso no fim do índice em construção.
+ */
+static int add_point(OutMap *map, size_t *len, z_stream *zs, uint64_t in, uint64_t out,
+                     unsigned char *window, unsigned char *packed) {
+    uInt window_len = 0;
+    size_t packed_len = 0;
+    if (inflateGetDictionary(zs, window, &window_len) != Z_OK ||
+        (window_len > 0 && compress_into(window, window_len, packed, compress_bound(ZINDEX_WINDOW),
+                                         &packed_len, NULL, 0) != 0)) {
+        fprintf(stderr, "Erro ao guardar a janela do ponto de acesso\n");
+        return -1;
+    }
+
+    ZIndexPoint p = { out, in, (uint32_t)(zs->data_type & 7), window_len, (uint32_t)packed_len, 0 };
+    unsigned char *base = outmap_reserve(map, *len + sizeof p + packed_len);
+    if (!base) {
+        return -1;
+    }
+    memcpy(base + *len, &p, sizeof p);
+    memcpy(base + *len + sizeof p, packed, packed_len);
+    *len += sizeof p + packed_len;
+    return 0;
+}
+
+int zindex_build(const char *path, size_t span, size_t *points) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror("Erro ao abrir arquivo comprimido");
+        return -1;
+    }
+    ZIndexHeader header;
+    memset(&header, 0, sizeof header);
+    if (stream_identity(in, &header.compressed_size, &header.trailer) != 0) {
+        fclose(in);
+        return -1;
+    }
+
+    char *idx = index_path(path);
+    OutMap *map = idx ? outmap_open(idx, sizeof header) : NULL;
+    unsigned char *in_buf = buf_alloc(ZINDEX_CHUNK);
+    unsigned char *out_buf = buf_alloc(ZINDEX_CHUNK);
+    unsigned char *window = buf_alloc(ZINDEX_WINDOW);
+    unsigned char *packed = buf_alloc(compress_bound(ZINDEX_WINDOW));
+    int ret = -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    if (!map || !in_buf || !out_buf || !window || !packed || inflateInit(&zs) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a descompressão\n");
+        outmap_abort(map);
+        map = NULL;
+        goto cleanup_buffers;
+    }
+
+    // Descomprime com Z_BLOCK, que para no fim de cada bloco deflate: ali o
+    // estado do zlib é só a posição do bit e a janela, e dá para recomeçar.
+    uint64_t total_in = 0, total_out = 0, last = 0;
+    size_t len = sizeof header, count = 0;
+    int zret = Z_OK;
+    op_total_file(OP_STAGE_DECOMPRESS, in);
+    do {
+        if (zs.avail_in == 0) {
+            size_t n = metrics_fread(in_buf, ZINDEX_CHUNK, in);
+            if (ferror(in)) {
+                fprintf(stderr, "Erro ao ler arquivo\n");
+                goto cleanup;
+            }
+            if (op_step(OP_STAGE_DECOMPRESS, n) != 0) {
+                goto cleanup;
+            }
+            if (n == 0) {
+                fprintf(stderr, "Erro na descompressão: %d\n", Z_BUF_ERROR);
+                goto cleanup;
+            }
+            zs.next_in = in_buf;
+            zs.avail_in = (uInt)n;
+        }
+        if (zs.avail_out == 0) {
+            zs.next_out = out_buf;
+            zs.avail_out = ZINDEX_CHUNK;
+        }
+        uInt avail_in = zs.avail_in, avail_out = zs.avail_out;
+        uint64_t t = metrics_start();
+        zret = inflate(&zs, Z_BLOCK);
+        metrics_stop(METRICS_INFLATE, t, avail_in - zs.avail_in, avail_out - zs.avail_out);
+        total_in += avail_in - zs.avail_in;
+        total_out += avail_out - zs.avail_out;
+        if (zret != Z_OK && zret != Z_STREAM_END) {
+            fprintf(stderr, "Erro na descompressão: %d\n", zret == Z_NEED_DICT ? Z_DATA_ERROR : zret);
+            goto cleanup;
+        }
+
+        // Início de um bloco que não é o último (bit 64): vira ponto de acesso
+        // se estiver a pelo menos `span` bytes do anterior.
+        if (zret == Z_OK && (zs.data_type & 128) && !(zs.data_type & 64) &&
+            (count == 0 || total_out - last >= span)) {
+            if (add_point(map, &len, &zs, total_in, total_out, window, packed) != 0) {
+                goto cleanup;
+            }
+            last = total_out;
+            count++;
+        }
+    } while (zret != Z_STREAM_END);
+
+    // Nada pode sobrar depois do fim do fluxo.
+    if (zs.avail_in > 0 || fgetc(in) != EOF) {
+        fprintf(stderr, "Erro na descompressão: %d\n", Z_DATA_ERROR);
+        goto cleanup;
+    }
+
+    memcpy(header.magic, ZINDEX_MAGIC, 4);
+    header.version = ZINDEX_VERSION;
+    header.span = span;
+    header.uncompressed_size = total_out;
+    header.points = (uint32_t)count;
+    unsigned char *base = outmap_reserve(map, len);
+    if (!base) {
+        goto cleanup;
+    }
+    memcpy(base, &header, sizeof header);
+    ret = outmap_commit(map, len);
+    map = NULL;
+    if (ret == 0 && points) {
+        *points = count;
+    }
+
+cleanup:
+    inflateEnd(&zs);
+    outmap_abort(map);
+cleanup_buffers:
+    buf_free(in_buf);
+    buf_free(out_buf);
+    buf_free(window);
+    buf_free(packed);
+    free(idx);
+    fclose(in);
+    return ret;
+}
+
+/**
+ * @brief Procura no índice o último ponto de acesso até offset e descomprime a
+ *        janela dele.
+ * @return 1 com o ponto em *point, 0 se não há índice utilizável (o trecho é lido
+ *         do início), -1 se offset está depois do fim dos dados.
+ */
+static int find_point(const char *path, uint64_t size, uint32_t trailer, uint64_t offset,
+                      ZIndexPoint *point, unsigned char *window) {
+    char *idx = index_path(path);
+    FILE *f = idx ? fopen(idx, "rb") : NULL;
+    if (!f) {
+        free(idx);
+        return 0;
+    }
+
+    ZIndexHeader header;
+    int found = 0;
+    long packed_at = 0;
+    if (fread(&header, sizeof header, 1, f) != 1 || memcmp(header.magic, ZINDEX_MAGIC, 4) != 0 ||
+        header.version != ZINDEX_VERSION) {
+        fprintf(stderr, "Aviso: '%s' não é um índice válido; lendo do início\n", idx);
+        goto done;
+    }
+    if (header.compressed_size != size || header.trailer != trailer) {
+        fprintf(stderr, "Aviso: o índice '%s' é de outra versão do arquivo; lendo do início\n", idx);
+        goto done;
+    }
+    if (offset >= header.uncompressed_size) {
+        found = -1;
+        goto done;
+    }
+
+    // Os pontos estão em ordem crescente de saída; as janelas dos que ficam
+    // antes do escolhido só são puladas.
+    ZIndexPoint p;
+    for (uint32_t i = 0; i < header.points && fread(&p, sizeof p, 1, f) == 1 && p.out <= offset; i++) {
+        *point = p;
+        packed_at = ftell(f);
+        found = 1;
+        if (fseek(f, p.packed, SEEK_CUR) != 0) {
+            break;
+        }
+    }
+    if (found && point->window > 0) {
+        size_t cap = compress_bound(ZINDEX_WINDOW), window_len = 0;
+        unsigned char *packed = buf_alloc(cap);
+        if (!packed || point->packed > cap || point->window > ZINDEX_WINDOW ||
+            fseek(f, packed_at, SEEK_SET) != 0 ||
+            fread(packed, 1, point->packed, f) != point->packed ||
+            decompress_into(packed, point->packed, window, ZINDEX_WINDOW, &window_len, NULL, 0) != 0 ||
+            window_len != point->window) {
+            fprintf(stderr, "Aviso: índice '%s' corrompido; lendo do início\n", idx);
+            found = 0;
+        }
+        buf_free(packed);
+    }
+
+done:
+    fclose(f);
+    free(idx);
+    return found;
+}
+
+int zindex_read_range(const char *path, uint64_t offset, uint64_t length, FILE *out,
+                      uint64_t *written, uint64_t *skipped) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror("Erro ao abrir arquivo comprimido");
+        return -1;
+    }
+    uint64_t size;
+    uint32_t trailer;
+    if (stream_identity(in, &size, &trailer) != 0) {
+        fclose(in);
+        return -1;
+    }
+    if (written) {
+        *written = 0;
+    }
+    if (skipped) {
+        *skipped = 0;
+    }
+
+    unsigned char *in_buf = buf_alloc(ZINDEX_CHUNK);
+    unsigned char *out_buf = buf_alloc(ZINDEX_CHUNK);
+    unsigned char *window = buf_alloc(ZINDEX_WINDOW);
+    uint64_t pos = 0, done = 0;
+    int ret = -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof zs);
+    zs.zalloc = buf_zalloc;
+    zs.zfree = buf_zfree;
+    ZIndexPoint point = { 0 };
+    int found = in_buf && out_buf && window ? find_point(path, size, trailer, offset, &point, window) : 0;
+    if (found < 0 || length == 0) {
+        // Trecho depois do fim dos dados: não há nada a descomprimir.
+        ret = 0;
+        goto cleanup_buffers;
+    }
+    if (!in_buf || !out_buf || !window ||
+        (found ? inflateInit2(&zs, -MAX_WBITS) : inflateInit(&zs)) != Z_OK) {
+        fprintf(stderr, "Erro ao inicializar a descompressão\n");
+        goto cleanup_buffers;
+    }
+
+    // A partir de um ponto de acesso o fluxo é deflate cru: o bloco pode começar
+    // no meio de um byte, e a janela anterior vem do índice.
+    if (found) {
+        int c = 0;
+        if (fseek(in, (long)(point.in - (point.bits ? 1 : 0)), SEEK_SET) != 0 ||
+            (point.bits && (c = fgetc(in)) == EOF)) {
+            fprintf(stderr, "Erro ao ler arquivo\n");
+            goto cleanup;
+        }
+        if ((point.bits && inflatePrime(&zs, (int)point.bits, c >> (8 - point.bits)) != Z_OK) ||
+            (point.window && inflateSetDictionary(&zs, window, point.window) != Z_OK)) {
+            fprintf(stderr, "Erro ao posicionar no ponto de acesso\n");
+            goto cleanup;
+        }
+        pos = point.out;
+    }
+
+    int zret = Z_OK;
+    op_total(OP_STAGE_DECOMPRESS, offset - pos + length);
+    while (done < length && zret != Z_STREAM_END) {
+        if (zs.avail_in == 0) {
+            size_t n = metrics_fread(in_buf, ZINDEX_CHUNK, in);
+            if (ferror(in)) {
+                fprintf(stderr, "Erro ao ler arquivo\n");
+                goto cleanup;
+            }
+            if (n == 0) {
+                fprintf(stderr, "Erro na descompressão: %d\n", Z_BUF_ERROR);
+                goto cleanup;
+            }
+            zs.next_in = in_buf;
+            zs.avail_in = (uInt)n;
+        }
+        zs.next_out = out_buf;
+        zs.avail_out = ZINDEX_CHUNK;
+        uInt avail_in = zs.avail_in;
+        uint64_t t = metrics_start();
+        zret = inflate(&zs, Z_NO_FLUSH);
+        size_t have = ZINDEX_CHUNK - zs.avail_out;
+        metrics_stop(METRICS_INFLATE, t, avail_in - zs.avail_in, have);
+        if (zret != Z_OK && zret != Z_STREAM_END && zret != Z_BUF_ERROR) {
+            fprintf(stderr, "Erro na descompressão: %d\n", zret == Z_NEED_DICT ? Z_DATA_ERROR : zret);
+            goto cleanup;
+        }
+        if (op_step(OP_STAGE_DECOMPRESS, have) != 0) {
+            goto cleanup;
+        }
+
+        // Descarta o que vem antes do trecho e grava só a parte dentro dele.
+        size_t from = pos < offset ? (size_t)(offset - pos < have ? offset - pos : have) : 0;
+        size_t take = have - from;
+        if (take > length - done) {
+            take = (size_t)(length - done);
+        }
+        if (take > 0 && metrics_fwrite(out_buf + from, take, out) != take) {
+            fprintf(stderr, "Erro ao escrever arquivo\n");
+            goto cleanup;
+        }
+        pos += have;
+        done += take;
+    }
+
+    if (written) {
+        *written = done;
+    }
+    if (skipped) {
+        *skipped = (pos < offset ? pos : offset) - point.out;
+    }
+    ret = 0;
+
+cleanup:
+    inflateEnd(&zs);
+cleanup_buffers:
+    buf_free(in_buf);
+    buf_free(out_buf);
+    buf_free(window);
+    fclose(in);
+    return ret;
+}
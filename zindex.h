@@ -0,0 +1,63 @@
+#ifndef ZINDEX_H
+#define ZINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Índice de acesso aleatório para arquivos .z
+ *
+ * Os .z gravados por compress_data/compress_stream são um único fluxo zlib:
+ * para ler um trecho do meio seria preciso descomprimir tudo antes dele. O
+ * índice (no estilo do zran.c da zlib) é montado descomprimindo o arquivo uma
+ * vez e anotando, a cada `span` bytes descomprimidos, um ponto de acesso no
+ * início de um bloco deflate: posição do bit no arquivo comprimido, posição na
+ * saída e os 32 KB de saída anteriores (a janela de que o bloco pode depender),
+ * comprimida. Ele fica ao lado do arquivo, em "<arquivo.z>.zidx", e o .z não é
+ * alterado.
+ *
+ * Uma leitura de trecho começa no último ponto antes do início pedido, então
+ * descomprime no máximo `span` bytes a mais que o trecho. Sem índice (ou com um
+ * índice de outra versão do arquivo), a leitura ainda funciona, do início.
+ */
+
+/**
+ * Sufixo do arquivo de índice
+ */
+#define ZINDEX_SUFFIX ".zidx"
+
+/**
+ * Distância padrão entre pontos de acesso (bytes descomprimidos)
+ */
+#define ZINDEX_DEFAULT_SPAN ((size_t)1024 * 1024)
+
+/**
+ * Monta o índice de um .z e o grava em "<path>.zidx"
+ *
+ * @param path: arquivo comprimido (um fluxo zlib)
+ * @param span: distância mínima entre pontos de acesso, em bytes descomprimidos
+ * @param points: recebe a quantidade de pontos gravados (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro (mensagem já escrita)
+ */
+int zindex_build(const char *path, size_t span, size_t *points);
+
+/**
+ * Descomprime só o trecho [offset, offset + length) de um .z
+ *
+ * Usa "<path>.zidx" quando ele existe e corresponde ao arquivo. Um trecho que
+ * passa do fim dos dados é cortado no fim.
+ *
+ * @param path: arquivo comprimido
+ * @param offset: início do trecho, em bytes descomprimidos
+ * @param length: tamanho do trecho
+ * @param out: destino dos bytes do trecho
+ * @param written: recebe a quantidade de bytes gravados (pode ser NULL)
+ * @param skipped: recebe quantos bytes foram descomprimidos e descartados antes
+ *                 do trecho (pode ser NULL)
+ * @return: 0 em sucesso, -1 em erro
+ */
+int zindex_read_range(const char *path, uint64_t offset, uint64_t length, FILE *out,
+                      uint64_t *written, uint64_t *skipped);
+
+#endif /* ZINDEX_H */